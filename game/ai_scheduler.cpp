@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "ai_scheduler.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AI_SLOT_COUNT (AI_THINK_INTERVAL_MAX * 2)
+
+static convar_int_t ai_think_budget_us("ai_think_budget_us", 1000, 50, 100000, "Time per tick for AI thinks, agents past the budget are deferred");
+static convar_float_t ai_think_near_distance("ai_think_near_distance", 24.0f, 1.0f, 10000.0f, "Agents closer than this to a player think every tick");
+static convar_float_t ai_think_far_distance(
+    "ai_think_far_distance", 96.0f, 1.0f, 10000.0f, "Agents farther than this from every player think at the lowest rate");
+
+static profiler_zone_t zone_tick("ai_scheduler_t::tick");
+static profiler_zone_t zone_think("ai_scheduler_t::think");
+
+ai_scheduler_t::ai_scheduler_t(think_func_t think)
+{
+    _think = think;
+    _tick = 0;
+    memset(_slot_load, 0, sizeof(_slot_load));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void ai_scheduler_t::add_agent(Uint32 agent, profiler_zone_t* zone)
+{
+    if (agent >= _agents.size())
+        _agents.resize(agent + 1, agent_t {});
+
+    agent_t& a = _agents[agent];
+    if (a.active)
+        remove_agent(agent);
+
+    a = agent_t {};
+    a.active = true;
+    a.visible = true;
+    a.zone = zone;
+    a.last_think = _tick;
+    a.interval = compute_interval(a);
+    a.due = _tick;
+    a.load_tick = _tick;
+    _slot_load[a.load_tick % AI_SLOT_COUNT]++;
+
+    /* First think anywhere in the first interval */
+    schedule(a, _tick, _tick + a.interval);
+}
+
+void ai_scheduler_t::remove_agent(Uint32 agent)
+{
+    if (agent >= _agents.size() || !_agents[agent].active)
+        return;
+    _slot_load[_agents[agent].load_tick % AI_SLOT_COUNT]--;
+    _agents[agent].active = false;
+}
+
+void ai_scheduler_t::set_agent(Uint32 agent, const float pos[3], bool visible)
+{
+    if (agent >= _agents.size() || !_agents[agent].active)
+        return;
+
+    agent_t& a = _agents[agent];
+    for (int i = 0; i < 3; i++)
+        a.pos[i] = pos[i];
+    a.visible = visible;
+
+    /* Re-place the next think whenever the interval changes, this is also what spreads out freshly added agents */
+    Uint32 interval = compute_interval(a);
+    if (interval != a.interval)
+    {
+        Uint32 latest = SDL_max(a.last_think + interval, _tick + 1);
+        schedule(a, _tick, latest);
+        a.interval = interval;
+    }
+}
+
+void ai_scheduler_t::set_players(const float* positions, int count) { _players.assign(positions, positions + count * 3); }
+
+Uint32 ai_scheduler_t::compute_interval(const agent_t& agent) const
+{
+    if (_players.empty())
+        return AI_THINK_INTERVAL_MAX;
+
+    float dist2 = INFINITY;
+    for (size_t i = 0; i < _players.size(); i += 3)
+    {
+        float dx = _players[i] - agent.pos[0], dy = _players[i + 1] - agent.pos[1], dz = _players[i + 2] - agent.pos[2];
+        dist2 = SDL_min(dist2, dx * dx + dy * dy + dz * dz);
+    }
+
+    float near = ai_think_near_distance.get(), far = SDL_max(ai_think_far_distance.get(), near);
+    Uint32 interval;
+    if (dist2 < near * near)
+        interval = 1;
+    else if (dist2 >= far * far)
+        interval = AI_THINK_INTERVAL_MAX / 2;
+    else
+    {
+        float t = (sqrtf(dist2) - near) / (far - near);
+        interval = t < 0.5f ? 2 : 4;
+    }
+
+    if (!agent.visible)
+        interval *= 2;
+    return SDL_min(interval, Uint32(AI_THINK_INTERVAL_MAX));
+}
+
+void ai_scheduler_t::schedule(agent_t& agent, Uint32 earliest, Uint32 latest)
+{
+    /* Prefer the latest tick on ties, so a lightly loaded scheduler keeps exact intervals */
+    Uint32 best = latest;
+    for (Uint32 t = latest; t > earliest; t--)
+        if (_slot_load[t % AI_SLOT_COUNT] < _slot_load[best % AI_SLOT_COUNT])
+            best = t;
+
+    _slot_load[agent.load_tick % AI_SLOT_COUNT]--;
+    agent.due = best;
+    agent.load_tick = best;
+    _slot_load[agent.load_tick % AI_SLOT_COUNT]++;
+}
+
+void ai_scheduler_t::tick(Uint32 tick)
+{
+    PROFILER_SCOPE(zone_tick);
+
+    _tick = tick;
+    memset(&_stats, 0, sizeof(_stats));
+
+    _due.clear();
+    for (Uint32 i = 0; i < _agents.size(); i++)
+    {
+        if (!_agents[i].active)
+            continue;
+        _stats.agents++;
+        if (Sint32(tick - _agents[i].due) >= 0)
+            _due.push_back(i);
+    }
+    _stats.due = _due.size();
+
+    /* Most overdue first, then the agents that want to think most often */
+    std::sort(_due.begin(), _due.end(), [this](Uint32 a, Uint32 b) {
+        const agent_t& aa = _agents[a];
+        const agent_t& ab = _agents[b];
+        if (aa.due != ab.due)
+            return Sint32(aa.due - ab.due) < 0;
+        if (aa.interval != ab.interval)
+            return aa.interval < ab.interval;
+        return a < b;
+    });
+
+    double freq = double(SDL_GetPerformanceFrequency());
+    Uint64 budget = Uint64(ai_think_budget_us.get()) * SDL_GetPerformanceFrequency() / 1000000;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (size_t i = 0; i < _due.size(); i++)
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (i && now - start > budget)
+        {
+            /* Deferred agents keep their due tick (So they sort first next tick), but count as load on the next
+             * tick. Left on the tick they were due on, they would alias a tick AI_SLOT_COUNT later. */
+            _stats.deferred = _due.size() - i;
+            for (; i < _due.size(); i++)
+            {
+                agent_t& a = _agents[_due[i]];
+                _slot_load[a.load_tick % AI_SLOT_COUNT]--;
+                a.load_tick = tick + 1;
+                _slot_load[a.load_tick % AI_SLOT_COUNT]++;
+            }
+            break;
+        }
+
+        Uint32 id = _due[i];
+        _stats.max_lateness = SDL_max(_stats.max_lateness, tick - _agents[id].due);
+
+        {
+            profiler_scope_t scope(_agents[id].zone ? *_agents[id].zone : zone_think);
+            _think(id, tick - _agents[id].last_think);
+        }
+        _stats.thinks++;
+
+        /* The callback may have added agents (Reallocating _agents) or removed this one */
+        agent_t& a = _agents[id];
+        if (!a.active)
+            continue;
+
+        float cost_us = float((SDL_GetPerformanceCounter() - now) * 1000000.0 / freq);
+        a.cost_us = a.cost_us ? a.cost_us + (cost_us - a.cost_us) * 0.125f : cost_us;
+
+        a.last_think = tick;
+        a.interval = compute_interval(a);
+        schedule(a, tick + a.interval / 2, tick + a.interval);
+    }
+
+    _stats.elapsed_us = float((SDL_GetPerformanceCounter() - start) * 1000000.0 / freq);
+}
+
+/**
+ * Agents scattered around the players with a fixed cost busy loop as the think, reports the per tick load for a few
+ * agent counts (Think time should stay flat once the budget is hit)
+ */
+static int command_ai_think_bench(const int argc, const char** argv)
+{
+    std::vector<int> counts;
+    if (argc > 1)
+        counts.push_back(SDL_clamp(atoi(argv[1]), 1, 1000000));
+    else
+        counts = { 100, 1000, 10000 };
+    float think_us = argc > 2 ? SDL_clamp(atof(argv[2]), 0.0, 10000.0) : 20.0f;
+
+    const int ticks = 120;
+    for (int count : counts)
+    {
+        Uint32 seed = 12345;
+        auto rand_float = [&seed](float range) {
+            seed = seed * 1664525u + 1013904223u;
+            return ((seed >> 8) / float(1 << 24) * 2.0f - 1.0f) * range;
+        };
+
+        Uint64 spin_ticks = Uint64(think_us * SDL_GetPerformanceFrequency() / 1000000.0);
+        ai_scheduler_t scheduler([spin_ticks](Uint32, Uint32) {
+            Uint64 end = SDL_GetPerformanceCounter() + spin_ticks;
+            while (SDL_GetPerformanceCounter() < end)
+                ;
+        });
+
+        const float players[] = { 0.0f, 0.0f, 0.0f, 40.0f, 0.0f, 40.0f };
+        scheduler.set_players(players, 2);
+
+        float extent = ai_think_far_distance.get() * 1.5f;
+        for (int i = 0; i < count; i++)
+        {
+            float pos[3] = { rand_float(extent), rand_float(8.0f), rand_float(extent) };
+            scheduler.add_agent(i);
+            scheduler.set_agent(i, pos, rand_float(1.0f) > 0.0f);
+        }
+
+        Uint32 min_thinks = UINT32_MAX, max_thinks = 0, max_lateness = 0;
+        double total_thinks = 0.0, total_us = 0.0, max_us = 0.0;
+        for (int t = 1; t <= ticks; t++)
+        {
+            scheduler.tick(t);
+            const ai_scheduler_t::stats_t& s = scheduler.get_stats();
+            /* Skip the first few ticks where everything is still spreading out */
+            if (t <= AI_THINK_INTERVAL_MAX)
+                continue;
+            min_thinks = SDL_min(min_thinks, s.thinks);
+            max_thinks = SDL_max(max_thinks, s.thinks);
+            max_lateness = SDL_max(max_lateness, s.max_lateness);
+            total_thinks += s.thinks;
+            total_us += s.elapsed_us;
+            max_us = SDL_max(max_us, double(s.elapsed_us));
+        }
+
+        int measured = ticks - AI_THINK_INTERVAL_MAX;
+        dc_log("ai_think_bench: %d agents: %.1f thinks/tick (min %u, max %u), %.0f us/tick (max %.0f, budget %d), up to %u ticks late", count,
+            total_thinks / measured, min_thinks, max_thinks, total_us / measured, max_us, ai_think_budget_us.get(), max_lateness);
+    }
+
+    return 0;
+}
+
+void ai_scheduler::init() { dev_console::add_command("ai_think_bench", command_ai_think_bench); }
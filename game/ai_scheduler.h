@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_AI_SCHEDULER_H
+#define MPH_TETRA_GAME_AI_SCHEDULER_H
+
+#include "util/profiler.h"
+
+#include <SDL_bits.h>
+#include <functional>
+#include <vector>
+
+/**
+ * Longest think interval in ticks (Power of two)
+ */
+#define AI_THINK_INTERVAL_MAX 16
+
+/**
+ * Time sliced think scheduler for enemies and bots
+ *
+ * Every agent gets a think interval from its distance to the closest player: 1 tick inside ai_think_near_distance,
+ * 2 or 4 between that and ai_think_far_distance, AI_THINK_INTERVAL_MAX / 2 beyond it, doubled when no player can see
+ * it. When an agent is rescheduled it takes the least loaded tick in the last half of its interval, so agents that
+ * spawn together spread out instead of thinking in lockstep.
+ *
+ * tick() runs the due agents (Most overdue first) until ai_think_budget_us is spent, the rest are deferred to the next
+ * tick where they sort to the front. The most overdue agent always runs so nothing starves.
+ *
+ * Think time goes to the agent's profiler zone (Per agent type) or "ai_scheduler_t::think", and a moving average per
+ * agent is kept for get_agent_cost_us().
+ *
+ * Everything, including the think callback, runs on the thread calling tick().
+ */
+class ai_scheduler_t
+{
+public:
+    /**
+     * @param agent Agent id
+     * @param elapsed Ticks since the agent last thought (Or since it was added)
+     */
+    typedef std::function<void(Uint32 agent, Uint32 elapsed)> think_func_t;
+
+    struct stats_t
+    {
+        Uint32 agents;
+        Uint32 due;
+        Uint32 thinks;
+        Uint32 deferred;
+        /** Largest number of ticks a think ran late this tick */
+        Uint32 max_lateness;
+        float elapsed_us;
+    };
+
+    ai_scheduler_t(think_func_t think);
+
+    /**
+     * @param agent Dense id (Entity index)
+     * @param zone Profiler zone for this agent's type, must outlive the scheduler (NULL for the shared zone)
+     */
+    void add_agent(Uint32 agent, profiler_zone_t* zone = NULL);
+
+    void remove_agent(Uint32 agent);
+
+    /**
+     * Updates what the interval is based on, the next think is moved if the interval changes
+     *
+     * @param pos Position
+     * @param visible True if any player can see the agent
+     */
+    void set_agent(Uint32 agent, const float pos[3], bool visible);
+
+    /**
+     * @param positions 3 floats per player
+     */
+    void set_players(const float* positions, int count);
+
+    /**
+     * Runs due agents within the budget
+     *
+     * @param tick Current tick, must increase by one per call
+     */
+    void tick(Uint32 tick);
+
+    inline const stats_t& get_stats() const { return _stats; }
+
+    /**
+     * Moving average of the agent's think time in microseconds
+     */
+    inline float get_agent_cost_us(Uint32 agent) const { return agent < _agents.size() ? _agents[agent].cost_us : 0.0f; }
+    inline Uint32 get_agent_interval(Uint32 agent) const { return agent < _agents.size() ? _agents[agent].interval : 0; }
+
+private:
+    struct agent_t
+    {
+        bool active;
+        bool visible;
+        float pos[3];
+        Uint32 interval;
+        Uint32 last_think;
+        Uint32 due;
+        /** Tick counted in _slot_load, due until the agent is deferred, then the tick it will be tried on next */
+        Uint32 load_tick;
+        float cost_us;
+        profiler_zone_t* zone;
+    };
+
+    Uint32 compute_interval(const agent_t& agent) const;
+
+    /**
+     * Picks the least loaded tick in (earliest, latest] and moves the agent there
+     */
+    void schedule(agent_t& agent, Uint32 earliest, Uint32 latest);
+
+    think_func_t _think;
+    std::vector<agent_t> _agents;
+    std::vector<float> _players;
+    Uint32 _tick;
+
+    /**
+     * Agents to run on each tick modulo AI_THINK_INTERVAL_MAX * 2
+     *
+     * Only ticks from the current one to AI_THINK_INTERVAL_MAX ahead are counted (Deferred agents move to the next
+     * tick), so no two of them share a slot
+     */
+    Uint32 _slot_load[AI_THINK_INTERVAL_MAX * 2];
+
+    std::vector<Uint32> _due;
+    stats_t _stats;
+};
+
+namespace ai_scheduler
+{
+/**
+ * Registers the ai_think_bench console command
+ */
+void init();
+};
+
+#endif
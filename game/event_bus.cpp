@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "event_bus.h"
+
+#include "gui/console.h"
+#include "util/hash.h"
+
+#include <SDL.h>
+#include <stdlib.h>
+
+struct test_damage_t
+{
+    float amount;
+};
+
+static Uint32 test_rand(Uint32& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+/**
+ * Publishes from parallel_for() with different grain sizes and checks that every split merges to the same sequence
+ */
+static int command_event_bus_selftest(const int argc, const char** argv)
+{
+    int num_entities = argc > 1 ? SDL_clamp(atoi(argv[1]), 1, 1000000) : 10000;
+    const int grains[] = { 1, 7, 64, 1000, num_entities };
+
+    int failures = 0;
+    Uint64 reference = 0;
+    size_t reference_count = 0;
+    for (size_t g = 0; g < SDL_arraysize(grains); g++)
+    {
+        event_channel_t<test_damage_t> damage;
+        event_bus_t bus;
+        bus.add_channel(&damage);
+
+        size_t batches = 0, delivered = 0;
+        damage.subscribe([&](const event_t<test_damage_t>*, size_t count) {
+            batches++;
+            delivered += count;
+        });
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (Uint32 tick = 0; tick < 2; tick++)
+        {
+            jobs::parallel_for(num_entities, grains[g], [&](int begin, int end) {
+                for (int i = begin; i < end; i++)
+                {
+                    Uint32 seed = i * 2654435761u + tick;
+                    int count = test_rand(seed) % 4;
+                    for (int k = 0; k < count; k++)
+                        damage.publish(tick, test_rand(seed) % num_entities, i, { float(test_rand(seed) % 100) });
+                }
+            });
+        }
+        Uint64 published = SDL_GetPerformanceCounter();
+        bus.flip();
+        Uint64 flipped = SDL_GetPerformanceCounter();
+        bus.dispatch();
+
+        const std::vector<event_t<test_damage_t>>& events = damage.get_events();
+        Uint64 hash = util::fnv1a64(events.data(), events.size() * sizeof(events[0]));
+        if (g == 0)
+        {
+            reference = hash;
+            reference_count = events.size();
+        }
+        else if (hash != reference || events.size() != reference_count)
+        {
+            dc_log_error("event_bus_selftest: Grain %d merged differently (%zu events, %016llx != %016llx)", grains[g], events.size(),
+                (unsigned long long)hash, (unsigned long long)reference);
+            failures++;
+        }
+
+        if (batches != 1 || delivered != events.size())
+        {
+            dc_log_error("event_bus_selftest: Subscriber got %zu events in %zu batches, expected %zu in 1", delivered, batches, events.size());
+            failures++;
+        }
+
+        double freq = double(SDL_GetPerformanceFrequency());
+        dc_log("event_bus_selftest: Grain %d: %zu events, publish %.2f ms, flip %.2f ms", grains[g], events.size(), (published - start) * 1000.0 / freq,
+            (flipped - published) * 1000.0 / freq);
+    }
+
+    if (failures)
+        dc_log_error("event_bus_selftest: %d failures", failures);
+    else
+        dc_log("event_bus_selftest: Merge order is independent of the split across %d threads", jobs::get_thread_count());
+    return failures ? 1 : 0;
+}
+
+void event_bus::init() { dev_console::add_command("event_bus_selftest", command_event_bus_selftest); }
@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_EVENT_BUS_H
+#define MPH_TETRA_GAME_EVENT_BUS_H
+
+#include "util/jobs.h"
+
+#include <SDL_bits.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#define EVENT_ENTITY_NONE 0xFFFFFFFF
+
+/**
+ * Event as seen by subscribers
+ */
+template <typename T>
+struct event_t
+{
+    Uint32 tick;
+    /** Entity the event is about (The receiver: Damage target, door, pickup, scanned object) */
+    Uint32 entity;
+    /** Entity that published the event, EVENT_ENTITY_NONE for the world */
+    Uint32 source;
+    /** Publish order among events with the same tick, entity, and source */
+    Uint32 seq;
+    T data;
+};
+
+class event_channel_base_t
+{
+public:
+    virtual ~event_channel_base_t() { }
+
+    /**
+     * Sync point: Merges everything published since the last flip() into the events seen by dispatch()
+     *
+     * Must not run concurrently with publish()
+     */
+    virtual void flip() = 0;
+
+    /**
+     * Hands the events merged by the last flip() to every subscriber
+     */
+    virtual void dispatch() = 0;
+};
+
+/**
+ * Double buffered channel for one event type
+ *
+ * publish() appends to a queue owned by the calling thread (Indexed by jobs::get_thread_index()), so entity systems
+ * running under jobs::parallel_for() publish without locks or atomics. flip() concatenates the per-thread queues and
+ * sorts by (tick, entity, source, seq), which is deterministic regardless of how work was split between threads as long
+ * as each source publishes from a single thread per update phase (True when a parallel_for() item is an entity).
+ *
+ * Subscribers get the whole batch at once, in sorted order, so events for the same entity are adjacent. Subscribers may
+ * publish, those events land in the next flip().
+ *
+ * Only the main thread and job workers may publish (Any other thread would share the main thread's queue).
+ */
+template <typename T>
+class event_channel_t : public event_channel_base_t
+{
+public:
+    typedef std::function<void(const event_t<T>* events, size_t count)> subscriber_t;
+
+    void publish(Uint32 tick, Uint32 entity, Uint32 source, const T& data)
+    {
+        thread_queue_t& queue = _queues[jobs::get_thread_index()];
+        queue.events.push_back({ tick, entity, source, queue.seq++, data });
+    }
+
+    inline void subscribe(subscriber_t subscriber) { _subscribers.push_back(std::move(subscriber)); }
+
+    void flip() override
+    {
+        _events.clear();
+        for (int i = 0; i < JOBS_MAX_THREADS; i++)
+        {
+            _events.insert(_events.end(), _queues[i].events.begin(), _queues[i].events.end());
+            _queues[i].events.clear();
+            _queues[i].seq = 0;
+        }
+
+        std::sort(_events.begin(), _events.end(), [](const event_t<T>& a, const event_t<T>& b) {
+            if (a.tick != b.tick)
+                return a.tick < b.tick;
+            if (a.entity != b.entity)
+                return a.entity < b.entity;
+            if (a.source != b.source)
+                return a.source < b.source;
+            return a.seq < b.seq;
+        });
+
+        /* Per-thread counters depend on what else the thread ran, renumber so the output does not */
+        for (size_t i = 1; i < _events.size(); i++)
+        {
+            const event_t<T>& prev = _events[i - 1];
+            event_t<T>& cur = _events[i];
+            bool same = cur.tick == prev.tick && cur.entity == prev.entity && cur.source == prev.source;
+            cur.seq = same ? prev.seq + 1 : 0;
+        }
+        if (_events.size())
+            _events[0].seq = 0;
+    }
+
+    void dispatch() override
+    {
+        if (_events.empty())
+            return;
+        for (const subscriber_t& subscriber : _subscribers)
+            subscriber(_events.data(), _events.size());
+    }
+
+    /**
+     * Events merged by the last flip()
+     */
+    inline const std::vector<event_t<T>>& get_events() const { return _events; }
+
+private:
+    struct thread_queue_t
+    {
+        std::vector<event_t<T>> events;
+        Uint32 seq = 0;
+        /* Keeps neighboring threads from writing to the same cache line */
+        Uint8 padding[64];
+    };
+
+    thread_queue_t _queues[JOBS_MAX_THREADS];
+    std::vector<event_t<T>> _events;
+    std::vector<subscriber_t> _subscribers;
+};
+
+/**
+ * Set of channels that flip and dispatch together
+ *
+ * Typical tick:
+ * - Entity systems run in parallel and publish
+ * - flip()
+ * - dispatch(), subscribers apply the results (Channels in the order they were added)
+ */
+class event_bus_t
+{
+public:
+    inline void add_channel(event_channel_base_t* channel) { _channels.push_back(channel); }
+
+    void flip()
+    {
+        for (event_channel_base_t* channel : _channels)
+            channel->flip();
+    }
+
+    void dispatch()
+    {
+        for (event_channel_base_t* channel : _channels)
+            channel->dispatch();
+    }
+
+private:
+    std::vector<event_channel_base_t*> _channels;
+};
+
+namespace event_bus
+{
+/**
+ * Registers the event_bus_selftest console command
+ */
+void init();
+};
+
+#endif
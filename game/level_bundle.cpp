@@ -0,0 +1,625 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "level_bundle.h"
+
+#include "gui/console.h"
+#include "util/archive.h"
+#include "util/asset_cache.h"
+#include "util/binary_layout.h"
+#include "util/hash.h"
+#include "util/jobs.h"
+#include "util/lzss.h"
+#include "util/physfs/physfs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LEVEL_BUNDLE_MAGIC "MPHLVLB"
+#define LEVEL_BUNDLE_VERSION 1
+#define LEVEL_BUNDLE_ALIGN 64
+
+static profiler_zone_t zone_open("level_bundle::open");
+static profiler_zone_t zone_cook("level_bundle::cook");
+
+/* ================================ Format ================================ */
+
+/**
+ * Everything is little endian, offsets are from the start of the file
+ *
+ * [header_t] [section_t * section_count] [string table] [sections...], each part starts on a 64 byte boundary
+ */
+struct header_t
+{
+    /**
+     * NULL-Terminated "MPHLVLB\0"
+     */
+    char magic[8];
+    Uint32 version;
+    Uint32 section_count;
+    Uint64 rom_hash;
+    Uint64 file_size;
+    Uint64 section_table_offset;
+    Uint64 string_table_offset;
+    Uint32 string_table_size;
+    Uint32 reserved[3];
+};
+static_assert(sizeof(header_t) == LEVEL_BUNDLE_ALIGN, "header_t size incorrect");
+typedef util::binary_layout_t<header_t, BINARY_FIELD_LE(header_t, version), BINARY_FIELD_LE(header_t, section_count), BINARY_FIELD_LE(header_t, rom_hash),
+    BINARY_FIELD_LE(header_t, file_size), BINARY_FIELD_LE(header_t, section_table_offset), BINARY_FIELD_LE(header_t, string_table_offset),
+    BINARY_FIELD_LE(header_t, string_table_size)>
+    header_layout_t;
+
+/**
+ * Sorted by name
+ */
+struct section_entry_t
+{
+    /**
+     * Offset of the NULL-Terminated name in the string table
+     */
+    Uint32 name_offset;
+    Uint32 type;
+    Uint64 offset;
+    Uint64 size;
+    Uint32 crc;
+    Uint32 reserved;
+};
+static_assert(sizeof(section_entry_t) == 32, "section_entry_t size incorrect");
+typedef util::binary_layout_t<section_entry_t, BINARY_FIELD_LE(section_entry_t, name_offset), BINARY_FIELD_LE(section_entry_t, type),
+    BINARY_FIELD_LE(section_entry_t, offset), BINARY_FIELD_LE(section_entry_t, size), BINARY_FIELD_LE(section_entry_t, crc)>
+    section_entry_layout_t;
+
+static inline Uint64 align_up(Uint64 x) { return (x + LEVEL_BUNDLE_ALIGN - 1) & ~Uint64(LEVEL_BUNDLE_ALIGN - 1); }
+
+/* ================================ Runtime ================================ */
+
+/**
+ * Maps the file read only
+ *
+ * @returns Mapping, or NULL on failure
+ */
+static void* map_file(const std::string& path, size_t& size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && Uint64(file_size.QuadPart) <= SIZE_MAX)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+
+    /* The view keeps the mapping alive */
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    size = size_t(file_size.QuadPart);
+    return view;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && Uint64(st.st_size) <= SIZE_MAX)
+        view = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return NULL;
+
+    size = size_t(st.st_size);
+    return view;
+#endif
+}
+
+static void unmap_file(void* mapping, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, size);
+#endif
+}
+
+/**
+ * Reads the file through PhysFS into a 64 byte aligned heap buffer
+ */
+static const Uint8* read_file_aligned(const char* path, std::vector<Uint8>& heap, size_t& size)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path);
+    if (!fd)
+        return NULL;
+
+    PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+    const Uint8* data = NULL;
+    if (len > 0 && Uint64(len) <= SIZE_MAX - LEVEL_BUNDLE_ALIGN)
+    {
+        heap.resize(size_t(len) + LEVEL_BUNDLE_ALIGN);
+        Uint8* aligned = heap.data() + (LEVEL_BUNDLE_ALIGN - (uintptr_t(heap.data()) % LEVEL_BUNDLE_ALIGN)) % LEVEL_BUNDLE_ALIGN;
+        if (PHYSFS_readBytes(fd, aligned, len) == len)
+        {
+            data = aligned;
+            size = size_t(len);
+        }
+    }
+    PHYSFS_close(fd);
+    return data;
+}
+
+std::unique_ptr<level_bundle::bundle_t> level_bundle::bundle_t::open(const char* path, Uint64 rom_hash)
+{
+    PROFILER_SCOPE(zone_open);
+
+    std::unique_ptr<bundle_t> bundle(new bundle_t);
+
+    const char* real_dir = PHYSFS_getRealDir(path);
+    if (!real_dir)
+        return NULL;
+
+    /* For files inside archives PHYSFS_getRealDir() returns the archive, so this fails to open and the file gets read */
+    std::string real_path = std::string(real_dir) + PHYSFS_getDirSeparator() + (path[0] == '/' ? path + 1 : path);
+    bundle->mapping = map_file(real_path, bundle->size);
+
+    if (bundle->mapping)
+        bundle->base = (const Uint8*)bundle->mapping;
+    else
+        bundle->base = read_file_aligned(path, bundle->heap, bundle->size);
+
+    if (!bundle->base)
+        return NULL;
+
+    header_t header;
+    if (!header_layout_t::read(bundle->base, bundle->size, 0, header))
+        return NULL;
+
+    if (memcmp(header.magic, LEVEL_BUNDLE_MAGIC, sizeof(header.magic)) || header.version != LEVEL_BUNDLE_VERSION || header.file_size != bundle->size)
+        return NULL;
+
+    if (rom_hash && header.rom_hash != rom_hash)
+        return NULL;
+    bundle->rom_hash = header.rom_hash;
+
+    /* The string table must be in bounds and end with a terminator, so every name offset below it is a valid string */
+    const Uint64 str_ofs = header.string_table_offset;
+    const Uint64 str_size = header.string_table_size;
+    if (str_ofs > bundle->size || str_size > bundle->size - str_ofs || !str_size || bundle->base[str_ofs + str_size - 1] != '\0')
+        return NULL;
+    const char* strings = (const char*)bundle->base + str_ofs;
+
+    util::binary_table_t<section_entry_layout_t> table(bundle->base, bundle->size, header.section_table_offset, header.section_count);
+    if (table.size() != header.section_count)
+        return NULL;
+
+    std::vector<section_entry_t> entries(header.section_count);
+    if (!table.get_range(0, entries.size(), entries.data()))
+        return NULL;
+
+    bundle->sections.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const section_entry_t& e = entries[i];
+        if (e.name_offset >= str_size || e.offset % LEVEL_BUNDLE_ALIGN || e.offset > bundle->size || e.size > bundle->size - e.offset)
+            return NULL;
+        if (e.type > SECTION_ARCHIVE_ENTRY)
+            return NULL;
+
+        entry_t& s = bundle->sections[i];
+        s.name = strings + e.name_offset;
+        s.type = section_type_t(e.type);
+        s.offset = e.offset;
+        s.size = e.size;
+        s.crc = e.crc;
+
+        if (i && strcmp(bundle->sections[i - 1].name, s.name) >= 0)
+            return NULL;
+    }
+
+    return bundle;
+}
+
+level_bundle::bundle_t::~bundle_t()
+{
+    if (mapping)
+        unmap_file(mapping, size);
+}
+
+bool level_bundle::bundle_t::get_section(size_t i, section_t& out) const
+{
+    if (i >= sections.size())
+        return false;
+
+    const entry_t& s = sections[i];
+    out.name = s.name;
+    out.type = s.type;
+    out.data = base + s.offset;
+    out.size = size_t(s.size);
+    out.crc = s.crc;
+    return true;
+}
+
+bool level_bundle::bundle_t::find(const char* name, section_t& out) const
+{
+    auto it = std::lower_bound(sections.begin(), sections.end(), name, [](const entry_t& s, const char* n) { return strcmp(s.name, n) < 0; });
+    if (it == sections.end() || strcmp(it->name, name))
+        return false;
+    return get_section(size_t(it - sections.begin()), out);
+}
+
+bool level_bundle::bundle_t::verify() const
+{
+    for (const entry_t& s : sections)
+        if (util::crc32(base + s.offset, size_t(s.size)) != s.crc)
+            return false;
+    return true;
+}
+
+/* ================================ Cooking ================================ */
+
+bool level_bundle::compute_rom_hash(const char* rom_root, Uint64& hash)
+{
+    hash = FNV1A64_OFFSET_BASIS;
+
+    const char* parts[] = { "/header", "/bin/fat.bin" };
+    for (size_t i = 0; i < SDL_arraysize(parts); i++)
+    {
+        PHYSFS_File* fd = PHYSFS_openRead((std::string(rom_root) + parts[i]).c_str());
+        if (!fd)
+            return false;
+
+        PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+        std::vector<Uint8> data(len > 0 ? size_t(len) : 0);
+        bool success = len > 0 && PHYSFS_readBytes(fd, data.data(), len) == len;
+        PHYSFS_close(fd);
+        if (!success)
+            return false;
+
+        hash = util::fnv1a64(data.data(), data.size(), hash);
+    }
+
+    return true;
+}
+
+std::string level_bundle::get_bundle_path(const char* level_name) { return std::string(LEVEL_BUNDLE_DIR "/") + level_name + ".bundle"; }
+
+/**
+ * Lists files under root, paths are relative to root and have no leading slash
+ */
+static void list_files(const std::string& root, const std::string& relative, std::vector<std::string>& out)
+{
+    std::string dir = relative.length() ? root + "/" + relative : root;
+    char** names = PHYSFS_enumerateFiles(dir.c_str());
+    for (int i = 0; names && names[i]; i++)
+    {
+        std::string path = relative.length() ? relative + "/" + names[i] : names[i];
+
+        PHYSFS_Stat stat;
+        if (!PHYSFS_stat((root + "/" + path).c_str(), &stat))
+            continue;
+
+        if (stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+            list_files(root, path, out);
+        else if (stat.filetype == PHYSFS_FILETYPE_REGULAR)
+            out.push_back(path);
+    }
+    PHYSFS_freeList(names);
+}
+
+void level_bundle::find_level_files(const char* rom_root, const char* level_name, std::vector<std::string>& out)
+{
+    std::vector<std::string> files;
+    list_files(rom_root, "", files);
+
+    std::string needle(level_name);
+    std::transform(needle.begin(), needle.end(), needle.begin(), ::tolower);
+
+    out.clear();
+    for (const std::string& path : files)
+    {
+        std::string lower(path);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (lower.find(needle) != std::string::npos)
+            out.push_back(path);
+    }
+}
+
+struct cooked_section_t
+{
+    std::string name;
+    level_bundle::section_type_t type;
+    std::vector<Uint8> data;
+};
+
+/**
+ * Reads, decompresses and unpacks one ROM file
+ */
+static bool cook_file(const std::string& rom_root, const std::string& path, std::vector<cooked_section_t>& out)
+{
+    std::string full_path = rom_root + "/" + path;
+    std::vector<Uint8> raw;
+
+    /* Files the room prefetcher already pulled in are reused, but cooking walks the whole ROM so misses are not inserted */
+    asset_cache::data_t cached = asset_cache::find(full_path.c_str());
+    if (cached)
+        raw = *cached;
+    else
+    {
+        PHYSFS_File* fd = PHYSFS_openRead(full_path.c_str());
+        if (!fd)
+            return false;
+
+        PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+        bool success = len >= 0 && len <= SDL_MAX_SINT32;
+        if (success)
+        {
+            raw.resize(size_t(len));
+            success = PHYSFS_readBytes(fd, raw.data(), len) == len;
+        }
+        PHYSFS_close(fd);
+        if (!success)
+            return false;
+    }
+
+    /* Same detection as rom_diff, NitroFS files are LZ10/LZ11 with a magic byte and overlays use the overlay format */
+    std::vector<Uint8> unpacked;
+    bool is_overlay = path.find("_overlays/") != std::string::npos;
+    bool decompressed = (is_overlay || (raw.size() && (raw[0] == 0x10 || raw[0] == 0x11))) && util::decompress_lz(raw, unpacked, is_overlay);
+    std::vector<Uint8>& data = decompressed ? unpacked : raw;
+
+    std::vector<util::archive_entry_t> entries;
+    if (data.size() >= 8 && !memcmp(data.data(), "SNDFILE", 8) && util::archive_extract_entries(data, entries))
+    {
+        for (util::archive_entry_t& entry : entries)
+        {
+            cooked_section_t section;
+            section.name = path + "/" + std::string(entry.fname.c_str());
+            section.type = level_bundle::SECTION_ARCHIVE_ENTRY;
+            section.data.swap(entry.data);
+            out.push_back(std::move(section));
+        }
+        return true;
+    }
+
+    cooked_section_t section;
+    section.name = path;
+    section.type = decompressed ? level_bundle::SECTION_FILE_DECOMPRESSED : level_bundle::SECTION_FILE;
+    section.data.swap(data);
+    out.push_back(std::move(section));
+    return true;
+}
+
+static bool write_padding(PHYSFS_File* fd, Uint64 to)
+{
+    static const Uint8 zeros[LEVEL_BUNDLE_ALIGN] = { 0 };
+    PHYSFS_sint64 pos = PHYSFS_tell(fd);
+    if (pos < 0 || Uint64(pos) > to)
+        return false;
+    Uint64 len = to - Uint64(pos);
+    return PHYSFS_writeBytes(fd, zeros, len) == PHYSFS_sint64(len);
+}
+
+bool level_bundle::cook(const char* rom_root, const std::vector<std::string>& files, const char* out_path)
+{
+    PROFILER_SCOPE(zone_cook);
+
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    if (!compute_rom_hash(rom_root, header.rom_hash))
+        return false;
+
+    /* Decompression and archive extraction are the slow part */
+    std::vector<std::vector<cooked_section_t>> per_file(files.size());
+    std::vector<Uint8> file_ok(files.size());
+    std::string root(rom_root);
+    jobs::parallel_for(files.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            file_ok[i] = cook_file(root, files[i], per_file[i]);
+    });
+
+    std::vector<cooked_section_t> cooked;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!file_ok[i])
+            return false;
+        for (cooked_section_t& s : per_file[i])
+            cooked.push_back(std::move(s));
+    }
+
+    std::sort(cooked.begin(), cooked.end(), [](const cooked_section_t& a, const cooked_section_t& b) { return a.name < b.name; });
+    for (size_t i = 1; i < cooked.size(); i++)
+        if (cooked[i - 1].name == cooked[i].name)
+            return false;
+
+    std::string strings;
+    std::vector<section_entry_t> entries(cooked.size());
+    Uint64 pos = align_up(sizeof(header_t)) + align_up(sizeof(section_entry_t) * cooked.size());
+    for (size_t i = 0; i < cooked.size(); i++)
+    {
+        section_entry_t& e = entries[i];
+        memset(&e, 0, sizeof(e));
+        e.name_offset = Uint32(strings.size());
+        e.type = cooked[i].type;
+        e.size = cooked[i].data.size();
+        e.crc = util::crc32(cooked[i].data.data(), cooked[i].data.size());
+        strings.append(cooked[i].name.c_str(), cooked[i].name.length() + 1);
+    }
+    if (strings.empty())
+        strings.push_back('\0');
+
+    memcpy(header.magic, LEVEL_BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = LEVEL_BUNDLE_VERSION;
+    header.section_count = Uint32(cooked.size());
+    header.section_table_offset = align_up(sizeof(header_t));
+    header.string_table_offset = pos;
+    header.string_table_size = Uint32(strings.size());
+
+    pos = align_up(pos + strings.size());
+    for (section_entry_t& e : entries)
+    {
+        e.offset = pos;
+        pos = align_up(pos + e.size);
+    }
+    header.file_size = pos;
+
+    std::string dir(out_path);
+    dir.resize(dir.find_last_of('/') == std::string::npos ? 0 : dir.find_last_of('/'));
+    if (dir.length() && !PHYSFS_mkdir(dir.c_str()))
+        return false;
+
+    PHYSFS_File* fd = PHYSFS_openWrite(out_path);
+    if (!fd)
+        return false;
+
+    header_t header_le = header;
+    header_layout_t::correct(header_le);
+    bool success = PHYSFS_writeBytes(fd, &header_le, sizeof(header_le)) == sizeof(header_le);
+
+    std::vector<section_entry_t> entries_le(entries);
+    section_entry_layout_t::correct_array(entries_le.data(), entries_le.size());
+    success = success && write_padding(fd, header.section_table_offset);
+    success = success && PHYSFS_writeBytes(fd, entries_le.data(), sizeof(section_entry_t) * entries_le.size()) == PHYSFS_sint64(sizeof(section_entry_t) * entries_le.size());
+
+    success = success && write_padding(fd, header.string_table_offset);
+    success = success && PHYSFS_writeBytes(fd, strings.data(), strings.size()) == PHYSFS_sint64(strings.size());
+
+    for (size_t i = 0; success && i < cooked.size(); i++)
+    {
+        success = write_padding(fd, entries[i].offset);
+        success = success && PHYSFS_writeBytes(fd, cooked[i].data.data(), cooked[i].data.size()) == PHYSFS_sint64(cooked[i].data.size());
+    }
+    success = success && write_padding(fd, header.file_size);
+
+    success = PHYSFS_close(fd) && success;
+    if (!success)
+        PHYSFS_delete(out_path);
+    return success;
+}
+
+/* ================================ Commands ================================ */
+
+static int command_level_cook(const int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        dc_log("Usage: %s <rom root> <level> [files...]", argv[0]);
+        dc_log("Without files every file with the level name in its path is cooked (Paths are relative to the rom root)");
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    for (int i = 3; i < argc; i++)
+        files.push_back(argv[i][0] == '/' ? argv[i] + 1 : argv[i]);
+    if (files.empty())
+        level_bundle::find_level_files(argv[1], argv[2], files);
+
+    if (files.empty())
+    {
+        dc_log_error("No files found for level \"%s\" in %s", argv[2], argv[1]);
+        return 1;
+    }
+
+    std::string path = level_bundle::get_bundle_path(argv[2]);
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (!level_bundle::cook(argv[1], files, path.c_str()))
+    {
+        dc_log_error("Unable to cook %s from %s", path.c_str(), argv[1]);
+        return 1;
+    }
+    double elapsed = double(SDL_GetPerformanceCounter() - start) * 1000.0 / double(SDL_GetPerformanceFrequency());
+
+    dc_log("Cooked %zu files into %s in %.1f ms", files.size(), path.c_str(), elapsed);
+    return 0;
+}
+
+static int command_level_load(const int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        dc_log("Usage: %s <rom root> <level> [verify]", argv[0]);
+        dc_log("Opens the cooked bundle of a level and lists its sections, \"verify\" also checks the CRC of every section");
+        return 1;
+    }
+
+    Uint64 rom_hash;
+    if (!level_bundle::compute_rom_hash(argv[1], rom_hash))
+    {
+        dc_log_error("%s is not a mounted ROM", argv[1]);
+        return 1;
+    }
+
+    std::string path = level_bundle::get_bundle_path(argv[2]);
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::unique_ptr<level_bundle::bundle_t> bundle = level_bundle::bundle_t::open(path.c_str(), rom_hash);
+    double elapsed = double(SDL_GetPerformanceCounter() - start) * 1000.0 / double(SDL_GetPerformanceFrequency());
+
+    if (!bundle)
+    {
+        dc_log_error("Unable to open %s (Missing, malformed, or cooked from another ROM)", path.c_str());
+        return 1;
+    }
+
+    static const char* type_names[] = { "file", "decompressed", "archive entry" };
+    for (size_t i = 0; i < bundle->get_section_count(); i++)
+    {
+        level_bundle::section_t section;
+        bundle->get_section(i, section);
+        dc_log("%-13s %8zu %s", type_names[section.type], section.size, section.name);
+    }
+
+    dc_log("Opened %s (%zu sections, %zu bytes, %s) in %.3f ms", path.c_str(), bundle->get_section_count(), bundle->get_size(),
+        bundle->is_mapped() ? "mapped" : "read", elapsed);
+
+    if (argc > 3 && !strcmp(argv[3], "verify"))
+    {
+        if (!bundle->verify())
+        {
+            dc_log_error("CRC mismatch in %s", path.c_str());
+            return 1;
+        }
+        dc_log("All sections verified");
+    }
+
+    return 0;
+}
+
+void level_bundle::init()
+{
+    dev_console::add_command("level_cook", command_level_cook);
+    dev_console::add_command("level_load", command_level_load);
+}
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_LEVEL_BUNDLE_H
+#define MPH_TETRA_GAME_LEVEL_BUNDLE_H
+
+#include <SDL_bits.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#define LEVEL_BUNDLE_DIR "/cache/levels"
+
+/**
+ * Cooked level bundles
+ *
+ * Cooking collects the ROM files of a level into a single file and does all the work that would otherwise be repeated
+ * on every load. LZ compressed files are stored decompressed and .arc archives are stored as their entries. The bundle
+ * uses offsets instead of pointers, and every section starts on a 64 byte boundary. It is stamped with a hash of the
+ * source ROM (Header and FAT), so a bundle cooked from another ROM revision is rejected.
+ *
+ * At runtime the bundle is memory mapped and sections are used in place. Opening only validates the header and the
+ * section table, so a load costs a map and a few hundred bytes of parsing, no matter how large the level is.
+ */
+namespace level_bundle
+{
+enum section_type_t : Uint32
+{
+    /** File exactly as stored in the ROM */
+    SECTION_FILE = 0,
+    /** LZ10/LZ11/overlay compressed file, stored decompressed */
+    SECTION_FILE_DECOMPRESSED = 1,
+    /** Entry of a .arc archive, named "<archive path>/<entry name>" */
+    SECTION_ARCHIVE_ENTRY = 2,
+};
+
+struct section_t
+{
+    /** Path relative to the ROM root, points into the bundle */
+    const char* name;
+    section_type_t type;
+    /** 64 byte aligned, valid for the lifetime of the bundle */
+    const Uint8* data;
+    size_t size;
+    /** CRC-32 of data */
+    Uint32 crc;
+};
+
+class bundle_t
+{
+public:
+    /**
+     * Maps a bundle (Or reads it when it can't be mapped, e.g. when it is inside an archive)
+     *
+     * @param path PhysFS path of the bundle
+     * @param rom_hash Expected hash of the source ROM (See compute_rom_hash()), 0 to accept any
+     *
+     * @returns Bundle, or NULL if it is missing, malformed, or was cooked from another ROM
+     */
+    static std::unique_ptr<bundle_t> open(const char* path, Uint64 rom_hash);
+
+    ~bundle_t();
+
+    inline Uint64 get_rom_hash() const { return rom_hash; }
+    inline size_t get_section_count() const { return sections.size(); }
+    inline size_t get_size() const { return size; }
+    inline bool is_mapped() const { return mapping != NULL; }
+
+    /**
+     * @returns false if i is out of range
+     */
+    bool get_section(size_t i, section_t& out) const;
+
+    /**
+     * Binary search by name
+     *
+     * @returns false if there is no section with that name
+     */
+    bool find(const char* name, section_t& out) const;
+
+    /**
+     * Checks the CRC of every section, this touches every page so it is not done by open()
+     */
+    bool verify() const;
+
+private:
+    bundle_t() = default;
+    bundle_t(const bundle_t&) = delete;
+    bundle_t& operator=(const bundle_t&) = delete;
+
+    /* Mapped file, or NULL when the bundle was read into heap */
+    void* mapping = NULL;
+    std::vector<Uint8> heap;
+
+    const Uint8* base = NULL;
+    size_t size = 0;
+    Uint64 rom_hash = 0;
+
+    struct entry_t
+    {
+        const char* name;
+        section_type_t type;
+        Uint64 offset;
+        Uint64 size;
+        Uint32 crc;
+    };
+    std::vector<entry_t> sections;
+};
+
+/**
+ * Hashes the parts of a ROM that identify it (Header and FAT)
+ *
+ * @param rom_root PhysFS directory of a mounted ROM (e.g. /nds/rom_release)
+ *
+ * @returns false if rom_root is not a mounted ROM
+ */
+bool compute_rom_hash(const char* rom_root, Uint64& hash);
+
+/**
+ * @returns PhysFS path of the bundle for a level
+ */
+std::string get_bundle_path(const char* level_name);
+
+/**
+ * Cooks a level bundle
+ *
+ * @param rom_root PhysFS directory of a mounted ROM
+ * @param files Paths relative to rom_root (Without leading slash)
+ * @param out_path PhysFS path to write to (In the write directory)
+ *
+ * @returns false on failure, a partially written bundle is deleted
+ */
+bool cook(const char* rom_root, const std::vector<std::string>& files, const char* out_path);
+
+/**
+ * Lists the files of a ROM whose path contains level_name (Case insensitive)
+ */
+void find_level_files(const char* rom_root, const char* level_name, std::vector<std::string>& out);
+
+/**
+ * Registers the console commands
+ */
+void init();
+}
+
+#endif
@@ -0,0 +1,569 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "navigation.h"
+
+#include "gui/console.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <math.h>
+#include <queue>
+#include <stdlib.h>
+
+static profiler_zone_t zone_build("nav_graph_t::build");
+static profiler_zone_t zone_next_hops("nav_graph_t::next_hops");
+
+static inline float distance(const float* a, const float* b)
+{
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+struct open_entry_t
+{
+    float priority;
+    /**
+     * Cost when queued, entries whose node has since been reached more cheaply are skipped
+     */
+    float cost;
+    Uint16 node;
+    bool operator<(const open_entry_t& other) const { return priority > other.priority; }
+};
+
+/**
+ * Per thread search state, generations avoid clearing the arrays for every search
+ */
+struct search_scratch_t
+{
+    std::vector<float> cost;
+    std::vector<Uint16> came_from;
+    std::vector<Uint32> generation;
+    Uint32 current_generation = 0;
+    std::vector<open_entry_t> open_storage;
+
+    void begin(size_t num_nodes)
+    {
+        if (generation.size() < num_nodes)
+        {
+            cost.resize(num_nodes);
+            came_from.resize(num_nodes);
+            generation.assign(num_nodes, 0);
+            current_generation = 0;
+        }
+        if (++current_generation == 0)
+        {
+            std::fill(generation.begin(), generation.end(), 0);
+            current_generation = 1;
+        }
+        open_storage.clear();
+    }
+
+    inline bool visited(Uint16 node) { return generation[node] == current_generation; }
+    inline void visit(Uint16 node, float c, Uint16 from)
+    {
+        generation[node] = current_generation;
+        cost[node] = c;
+        came_from[node] = from;
+    }
+};
+
+static thread_local search_scratch_t scratch;
+
+std::shared_ptr<const nav_graph_t> nav_graph_t::build(const float* positions, size_t num_nodes, const std::vector<nav_edge_desc_t>& edges)
+{
+    PROFILER_SCOPE(zone_build);
+
+    if (num_nodes >= NAV_NODE_NONE)
+    {
+        dc_log_error("Navigation graph has too many nodes (%zu)", num_nodes);
+        return NULL;
+    }
+
+    std::shared_ptr<nav_graph_t> graph(new nav_graph_t());
+    graph->_num_nodes = num_nodes;
+    graph->_positions.assign(positions, positions + num_nodes * 3);
+    graph->_heuristic_scale = 1.0f;
+
+    /* Expand into directed edges, then bucket them by source node */
+    struct directed_t
+    {
+        Uint16 from, to;
+        float cost;
+    };
+    std::vector<directed_t> directed;
+    directed.reserve(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        const nav_edge_desc_t& e = edges[i];
+        if (e.from >= num_nodes || e.to >= num_nodes)
+        {
+            dc_log_error("Navigation edge %zu references a missing node (%u -> %u)", i, e.from, e.to);
+            return NULL;
+        }
+
+        float length = distance(&positions[e.from * 3], &positions[e.to * 3]);
+        float cost = e.cost < 0.0f ? length : e.cost;
+        if (length > 0.0f)
+            graph->_heuristic_scale = SDL_min(graph->_heuristic_scale, cost / length);
+
+        directed.push_back({ e.from, e.to, cost });
+        if (e.bidirectional)
+            directed.push_back({ e.to, e.from, cost });
+    }
+
+    graph->_edge_begin.assign(num_nodes + 1, 0);
+    for (size_t i = 0; i < directed.size(); i++)
+        graph->_edge_begin[directed[i].from + 1]++;
+    for (size_t i = 0; i < num_nodes; i++)
+        graph->_edge_begin[i + 1] += graph->_edge_begin[i];
+
+    graph->_edge_to.resize(directed.size());
+    graph->_edge_cost.resize(directed.size());
+    std::vector<Uint32> fill(graph->_edge_begin.begin(), graph->_edge_begin.end() - 1);
+    for (size_t i = 0; i < directed.size(); i++)
+    {
+        Uint32 slot = fill[directed[i].from]++;
+        graph->_edge_to[slot] = directed[i].to;
+        graph->_edge_cost[slot] = directed[i].cost;
+    }
+
+    graph->compute_components();
+    if (num_nodes <= NAV_TABLE_MAX_NODES)
+        graph->compute_tables();
+
+    return graph;
+}
+
+/**
+ * Components are computed on the graph with every edge treated as bidirectional, so a one way edge can make two nodes
+ * share a component while one can't reach the other. is_reachable() is exact for the (common) all bidirectional case
+ * and a cheap early out otherwise, next_hop() still reports unreachable correctly.
+ */
+void nav_graph_t::compute_components()
+{
+    /* Union-find */
+    std::vector<int> parent(_num_nodes);
+    for (size_t i = 0; i < _num_nodes; i++)
+        parent[i] = i;
+
+    auto find = [&parent](int x) {
+        while (parent[x] != x)
+            x = parent[x] = parent[parent[x]];
+        return x;
+    };
+
+    for (size_t from = 0; from < _num_nodes; from++)
+        for (Uint32 e = _edge_begin[from]; e < _edge_begin[from + 1]; e++)
+            parent[find(from)] = find(_edge_to[e]);
+
+    _component.assign(_num_nodes, -1);
+    std::vector<int> root_to_component(_num_nodes, -1);
+    int num_components = 0;
+    for (size_t i = 0; i < _num_nodes; i++)
+    {
+        int root = find(i);
+        if (root_to_component[root] < 0)
+            root_to_component[root] = num_components++;
+        _component[i] = root_to_component[root];
+    }
+}
+
+/**
+ * One Dijkstra per source node (In parallel), the first hop of every node is inherited from its predecessor
+ */
+void nav_graph_t::compute_tables()
+{
+    size_t n = _num_nodes;
+    _next_hop.assign(n * n, NAV_NODE_NONE);
+    _distance.assign(n * n, INFINITY);
+
+    jobs::parallel_for(n, 8, [this, n](int begin, int end) {
+        std::vector<Uint16> order;
+        std::vector<open_entry_t> open;
+        for (int src = begin; src < end; src++)
+        {
+            Uint16* next_hop = &_next_hop[src * n];
+            float* dist = &_distance[src * n];
+            std::vector<Uint16> pred(n, NAV_NODE_NONE);
+            std::vector<bool> settled(n, false);
+
+            order.clear();
+            open.clear();
+            dist[src] = 0.0f;
+            open.push_back({ 0.0f, 0.0f, (Uint16)src });
+
+            while (open.size())
+            {
+                std::pop_heap(open.begin(), open.end());
+                open_entry_t cur = open.back();
+                open.pop_back();
+                if (settled[cur.node])
+                    continue;
+                settled[cur.node] = true;
+                order.push_back(cur.node);
+
+                for (Uint32 e = _edge_begin[cur.node]; e < _edge_begin[cur.node + 1]; e++)
+                {
+                    Uint16 to = _edge_to[e];
+                    float c = dist[cur.node] + _edge_cost[e];
+                    if (c < dist[to])
+                    {
+                        dist[to] = c;
+                        pred[to] = cur.node;
+                        open.push_back({ c, c, to });
+                        std::push_heap(open.begin(), open.end());
+                    }
+                }
+            }
+
+            /* Settle order guarantees a node's predecessor is resolved before the node */
+            next_hop[src] = src;
+            for (size_t i = 1; i < order.size(); i++)
+            {
+                Uint16 node = order[i];
+                next_hop[node] = pred[node] == src ? node : next_hop[pred[node]];
+            }
+        }
+    });
+}
+
+inline float nav_graph_t::heuristic(Uint16 a, Uint16 b) const { return distance(&_positions[a * 3], &_positions[b * 3]) * _heuristic_scale; }
+
+float nav_graph_t::astar(Uint16 from, Uint16 to, std::vector<Uint16>* path) const
+{
+    scratch.begin(_num_nodes);
+    std::vector<open_entry_t>& open = scratch.open_storage;
+
+    scratch.visit(from, 0.0f, NAV_NODE_NONE);
+    open.push_back({ heuristic(from, to), 0.0f, from });
+
+    while (open.size())
+    {
+        std::pop_heap(open.begin(), open.end());
+        open_entry_t cur = open.back();
+        open.pop_back();
+
+        if (cur.node == to)
+            break;
+
+        /* Stale entry, a cheaper route to this node was found after it was queued */
+        if (cur.cost > scratch.cost[cur.node])
+            continue;
+
+        for (Uint32 e = _edge_begin[cur.node]; e < _edge_begin[cur.node + 1]; e++)
+        {
+            Uint16 next = _edge_to[e];
+            float c = scratch.cost[cur.node] + _edge_cost[e];
+            if (!scratch.visited(next) || c < scratch.cost[next])
+            {
+                scratch.visit(next, c, cur.node);
+                open.push_back({ c + heuristic(next, to), c, next });
+                std::push_heap(open.begin(), open.end());
+            }
+        }
+    }
+
+    if (!scratch.visited(to))
+        return INFINITY;
+
+    if (path)
+    {
+        path->clear();
+        for (Uint16 node = to; node != NAV_NODE_NONE; node = scratch.came_from[node])
+            path->push_back(node);
+        std::reverse(path->begin(), path->end());
+    }
+
+    return scratch.cost[to];
+}
+
+Uint16 nav_graph_t::nearest_node(const float pos[3]) const
+{
+    Uint16 best = NAV_NODE_NONE;
+    float best_dist = INFINITY;
+    for (size_t i = 0; i < _num_nodes; i++)
+    {
+        float d = distance(pos, &_positions[i * 3]);
+        if (d < best_dist)
+        {
+            best_dist = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+nav_hop_t nav_graph_t::next_hop(Uint16 from, Uint16 to) const
+{
+    nav_hop_t hop = { NAV_NODE_NONE, INFINITY };
+    if (from >= _num_nodes || to >= _num_nodes || !is_reachable(from, to))
+        return hop;
+
+    if (has_tables())
+    {
+        hop.next = _next_hop[from * _num_nodes + to];
+        hop.cost = _distance[from * _num_nodes + to];
+        return hop;
+    }
+
+    if (from == to)
+        return { from, 0.0f };
+
+    static thread_local std::vector<Uint16> path;
+    hop.cost = astar(from, to, &path);
+    if (hop.cost != INFINITY)
+        hop.next = path[1];
+    return hop;
+}
+
+bool nav_graph_t::find_path(Uint16 from, Uint16 to, std::vector<Uint16>& out) const
+{
+    out.clear();
+    if (from >= _num_nodes || to >= _num_nodes || !is_reachable(from, to))
+        return false;
+
+    if (!has_tables())
+        return astar(from, to, &out) != INFINITY;
+
+    if (_next_hop[from * _num_nodes + to] == NAV_NODE_NONE)
+        return false;
+
+    out.push_back(from);
+    for (Uint16 node = from; node != to;)
+        out.push_back(node = _next_hop[node * _num_nodes + to]);
+    return true;
+}
+
+void nav_graph_t::next_hops(const nav_query_t* queries, size_t count, nav_hop_t* out) const
+{
+    PROFILER_SCOPE(zone_next_hops);
+
+    /* Table lookups are cheap, A* queries get smaller chunks so they spread better */
+    int grain = has_tables() ? 256 : 8;
+    jobs::parallel_for(count, grain, [=](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            out[i] = next_hop(queries[i].from, queries[i].to);
+    });
+}
+
+/**
+ * Builds a grid graph with random holes (Like a room with pillars) and times table building and queries
+ */
+static int command_nav_bench(const int argc, const char** argv)
+{
+    int side = argc > 1 ? SDL_clamp(atoi(argv[1]), 2, 250) : 16;
+    int num_queries = argc > 2 ? SDL_max(atoi(argv[2]), 1) : 100000;
+
+    Uint32 seed = 0xBEEF;
+    auto rand_next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    std::vector<float> positions;
+    std::vector<int> grid_to_node(side * side, -1);
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            if (rand_next() % 8 == 0)
+                continue;
+            grid_to_node[y * side + x] = positions.size() / 3;
+            positions.push_back(x * 4.0f);
+            positions.push_back(0.0f);
+            positions.push_back(y * 4.0f);
+        }
+    }
+
+    std::vector<nav_edge_desc_t> edges;
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            int a = grid_to_node[y * side + x];
+            int right = x + 1 < side ? grid_to_node[y * side + x + 1] : -1;
+            int down = y + 1 < side ? grid_to_node[(y + 1) * side + x] : -1;
+            if (a >= 0 && right >= 0)
+                edges.push_back({ (Uint16)a, (Uint16)right, -1.0f, true });
+            if (a >= 0 && down >= 0)
+                edges.push_back({ (Uint16)a, (Uint16)down, -1.0f, true });
+        }
+    }
+
+    size_t num_nodes = positions.size() / 3;
+    if (!num_nodes)
+        return 1;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::shared_ptr<const nav_graph_t> graph = nav_graph_t::build(positions.data(), num_nodes, edges);
+    double build_ms = double(SDL_GetPerformanceCounter() - start) * 1000.0 / double(SDL_GetPerformanceFrequency());
+    if (!graph)
+        return 1;
+
+    std::vector<nav_query_t> queries(num_queries);
+    for (int i = 0; i < num_queries; i++)
+        queries[i] = { (Uint16)(rand_next() % num_nodes), (Uint16)(rand_next() % num_nodes) };
+    std::vector<nav_hop_t> results(num_queries);
+
+    start = SDL_GetPerformanceCounter();
+    graph->next_hops(queries.data(), queries.size(), results.data());
+    double query_s = double(SDL_GetPerformanceCounter() - start) / double(SDL_GetPerformanceFrequency());
+
+    int reachable = 0;
+    for (int i = 0; i < num_queries; i++)
+        reachable += results[i].next != NAV_NODE_NONE;
+
+    dc_log("ai_nav_bench: %zu nodes, %zu edges, %s, built in %.2f ms", num_nodes, edges.size(), graph->has_tables() ? "tables" : "A*", build_ms);
+    dc_log("ai_nav_bench: %d queries on %d threads in %.2f ms (%.0f queries/s), %d reachable", num_queries, jobs::get_thread_count(), query_s * 1000.0,
+        num_queries / query_s, reachable);
+
+    return 0;
+}
+
+/**
+ * Compares next_hop() and find_path() against a brute force O(n^2) Dijkstra on random graphs with one way edges and
+ * custom costs (Some below the euclidean distance), small enough for the tables and large enough for A*
+ */
+static int command_nav_selftest()
+{
+    Uint32 seed = 0x5EED;
+    auto rand_next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    int failures = 0;
+    const int node_counts[] = { 48, NAV_TABLE_MAX_NODES, NAV_TABLE_MAX_NODES + 200 };
+    for (int num_nodes : node_counts)
+    {
+        std::vector<float> positions(num_nodes * 3);
+        for (float& p : positions)
+            p = (rand_next() % 1000) * 0.1f;
+
+        std::vector<nav_edge_desc_t> edges;
+        for (int i = 0; i < num_nodes; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                nav_edge_desc_t e;
+                e.from = i;
+                e.to = rand_next() % num_nodes;
+                e.bidirectional = rand_next() % 3 == 0;
+                float d = distance(&positions[e.from * 3], &positions[e.to * 3]);
+                e.cost = rand_next() % 2 ? -1.0f : d * (0.5f + (rand_next() % 1000) * 0.0015f);
+                edges.push_back(e);
+            }
+        }
+
+        std::shared_ptr<const nav_graph_t> graph = nav_graph_t::build(positions.data(), num_nodes, edges);
+        if (!graph)
+        {
+            dc_log_error("ai_nav_selftest: Unable to build a graph with %d nodes", num_nodes);
+            failures++;
+            continue;
+        }
+
+        /* Cheapest direct edge between every pair */
+        std::vector<float> edge_cost(size_t(num_nodes) * num_nodes, INFINITY);
+        for (const nav_edge_desc_t& e : edges)
+        {
+            float cost = e.cost < 0.0f ? distance(&positions[e.from * 3], &positions[e.to * 3]) : e.cost;
+            float& forward = edge_cost[size_t(e.from) * num_nodes + e.to];
+            forward = SDL_min(forward, cost);
+            if (e.bidirectional)
+            {
+                float& backward = edge_cost[size_t(e.to) * num_nodes + e.from];
+                backward = SDL_min(backward, cost);
+            }
+        }
+
+        int mismatches = 0;
+        std::vector<float> dist(num_nodes);
+        std::vector<bool> done(num_nodes);
+        std::vector<Uint16> path;
+        for (int q = 0; q < 16; q++)
+        {
+            Uint16 from = rand_next() % num_nodes;
+
+            std::fill(dist.begin(), dist.end(), INFINITY);
+            std::fill(done.begin(), done.end(), false);
+            dist[from] = 0.0f;
+            for (int round = 0; round < num_nodes; round++)
+            {
+                int best = -1;
+                for (int i = 0; i < num_nodes; i++)
+                    if (!done[i] && dist[i] != INFINITY && (best < 0 || dist[i] < dist[best]))
+                        best = i;
+                if (best < 0)
+                    break;
+                done[best] = true;
+                for (int i = 0; i < num_nodes; i++)
+                    dist[i] = SDL_min(dist[i], dist[best] + edge_cost[size_t(best) * num_nodes + i]);
+            }
+
+            for (int to = 0; to < num_nodes; to++)
+            {
+                nav_hop_t hop = graph->next_hop(from, to);
+                bool found = graph->find_path(from, to, path);
+                if (dist[to] == INFINITY)
+                {
+                    mismatches += hop.next != NAV_NODE_NONE || found;
+                    continue;
+                }
+
+                float tolerance = 1e-4f * SDL_max(1.0f, dist[to]);
+                if (hop.next == NAV_NODE_NONE || fabsf(hop.cost - dist[to]) > tolerance || !found || path.front() != from || path.back() != to)
+                {
+                    mismatches++;
+                    continue;
+                }
+
+                /* The path must follow real edges, add up to the cheapest cost, and start with the next hop */
+                float path_cost = 0.0f;
+                for (size_t i = 1; i < path.size(); i++)
+                    path_cost += edge_cost[size_t(path[i - 1]) * num_nodes + path[i]];
+                Uint16 expected_next = path.size() > 1 ? path[1] : from;
+                mismatches += fabsf(path_cost - dist[to]) > tolerance || hop.next != expected_next;
+            }
+        }
+
+        if (mismatches)
+        {
+            dc_log_error("ai_nav_selftest: %d nodes (%s): %d queries disagree with Dijkstra", num_nodes, graph->has_tables() ? "tables" : "A*", mismatches);
+            failures++;
+        }
+    }
+
+    if (failures)
+        return 1;
+    dc_log("ai_nav_selftest: Tables and A* match Dijkstra");
+    return 0;
+}
+
+void navigation::init()
+{
+    dev_console::add_command("ai_nav_bench", command_nav_bench);
+    dev_console::add_command("ai_nav_selftest", command_nav_selftest);
+}
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_NAVIGATION_H
+#define MPH_TETRA_GAME_NAVIGATION_H
+
+#include <SDL_bits.h>
+#include <memory>
+#include <vector>
+
+/**
+ * Graphs with at most this many nodes get all pairs next hop and distance tables (6 bytes per pair, 1.5 MiB at the limit)
+ */
+#define NAV_TABLE_MAX_NODES 512
+
+#define NAV_NODE_NONE 0xFFFF
+
+struct nav_edge_desc_t
+{
+    Uint16 from;
+    Uint16 to;
+    /**
+     * Traversal cost, negative to use the distance between the nodes
+     */
+    float cost;
+    bool bidirectional;
+};
+
+/**
+ * Input for nav_graph_t::next_hops()
+ */
+struct nav_query_t
+{
+    Uint16 from;
+    Uint16 to;
+};
+
+struct nav_hop_t
+{
+    /**
+     * Node to move towards next, NAV_NODE_NONE if `to` can't be reached (`from` if already there)
+     */
+    Uint16 next;
+    /**
+     * Total path cost, or INFINITY if unreachable
+     */
+    float cost;
+};
+
+/**
+ * Immutable navigation graph with precomputed connectivity
+ *
+ * Build once per room with build(), then share the returned pointer between all agents. Every query is const and uses
+ * no locks (A* scratch space is thread local), so queries from any number of threads (or jobs) are fine.
+ *
+ * Small graphs (<= NAV_TABLE_MAX_NODES) answer queries from all pairs tables in O(1) per hop, larger graphs run A*
+ * after an O(1) connected component check, so queries between disconnected parts never search.
+ */
+class nav_graph_t
+{
+public:
+    /**
+     * @param positions 3 floats per node
+     * @param num_nodes Number of nodes (< NAV_NODE_NONE)
+     * @param edges Edges between nodes
+     *
+     * @returns Graph, or NULL if the input was invalid
+     */
+    static std::shared_ptr<const nav_graph_t> build(const float* positions, size_t num_nodes, const std::vector<nav_edge_desc_t>& edges);
+
+    inline size_t get_node_count() const { return _num_nodes; }
+    inline const float* get_node_pos(Uint16 node) const { return &_positions[node * 3]; }
+    inline bool has_tables() const { return _next_hop.size() != 0; }
+
+    inline int get_component(Uint16 node) const { return _component[node]; }
+    inline bool is_reachable(Uint16 from, Uint16 to) const { return _component[from] == _component[to]; }
+
+    /**
+     * Returns the closest node to a position (Linear scan), or NAV_NODE_NONE if the graph is empty
+     */
+    Uint16 nearest_node(const float pos[3]) const;
+
+    /**
+     * Next node on the cheapest path from `from` to `to`
+     */
+    nav_hop_t next_hop(Uint16 from, Uint16 to) const;
+
+    /**
+     * Full path from `from` to `to` (Both included)
+     *
+     * @returns false if unreachable
+     */
+    bool find_path(Uint16 from, Uint16 to, std::vector<Uint16>& out) const;
+
+    /**
+     * Answers a batch of queries in parallel on the job system
+     */
+    void next_hops(const nav_query_t* queries, size_t count, nav_hop_t* out) const;
+
+private:
+    nav_graph_t() = default;
+
+    void compute_components();
+    void compute_tables();
+
+    /**
+     * Cheapest path cost, fills came_from for path reconstruction
+     *
+     * @returns INFINITY if unreachable
+     */
+    float astar(Uint16 from, Uint16 to, std::vector<Uint16>* path) const;
+
+    inline float heuristic(Uint16 a, Uint16 b) const;
+
+    size_t _num_nodes;
+    std::vector<float> _positions;
+
+    /* Compressed sparse rows */
+    std::vector<Uint32> _edge_begin;
+    std::vector<Uint16> _edge_to;
+    std::vector<float> _edge_cost;
+
+    std::vector<int> _component;
+
+    /**
+     * Euclidean distance scale that keeps the A* heuristic admissible when edge costs are below the distances
+     */
+    float _heuristic_scale;
+
+    /* [from * _num_nodes + to], empty for large graphs */
+    std::vector<Uint16> _next_hop;
+    std::vector<float> _distance;
+};
+
+namespace navigation
+{
+/**
+ * Registers the ai_nav_bench and ai_nav_selftest console commands
+ */
+void init();
+};
+
+#endif
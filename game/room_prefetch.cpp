@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "room_prefetch.h"
+
+#include "game/level_bundle.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <string.h>
+
+static convar_float_t room_prefetch_distance("room_prefetch_distance", 24.0f, 1.0f, 1000.0f,
+    "Neighbouring rooms are prefetched when the player is heading toward a door closer than this");
+static convar_float_t room_prefetch_near_distance(
+    "room_prefetch_near_distance", 4.0f, 0.0f, 100.0f, "Neighbouring rooms are prefetched when the player is this close to a door, no matter the heading");
+static convar_float_t room_prefetch_start_dot("room_prefetch_start_dot", 0.5f, -1.0f, 1.0f,
+    "Cosine of the largest angle between the heading and the direction to a door that starts a prefetch");
+static convar_float_t room_prefetch_cancel_dot("room_prefetch_cancel_dot", -0.2f, -1.0f, 1.0f,
+    "Cosine of the smallest angle between the heading and the direction to a door that cancels a prefetch (Below room_prefetch_start_dot)");
+
+/**
+ * Prefetches are kept until the player is this many times room_prefetch_distance away from the door
+ */
+#define ROOM_PREFETCH_KEEP_SCALE 1.5f
+
+static profiler_zone_t zone_update("room_prefetcher_t::update");
+
+Uint32 room_graph_t::add_room(const char* name, const std::vector<std::string>& files)
+{
+    room_t room;
+    room.name = name;
+    room.files = files;
+    _rooms.push_back(room);
+    return Uint32(_rooms.size() - 1);
+}
+
+void room_graph_t::add_door(Uint32 room_a, Uint32 room_b, const float pos[3])
+{
+    door_t door;
+    memcpy(door.pos, pos, sizeof(door.pos));
+
+    door.to = room_b;
+    _rooms[room_a].doors.push_back(door);
+    door.to = room_a;
+    _rooms[room_b].doors.push_back(door);
+}
+
+bool room_graph_t::is_resident(Uint32 room) const
+{
+    for (const std::string& path : _rooms[room].files)
+        if (!asset_cache::contains(path.c_str()))
+            return false;
+    return true;
+}
+
+room_prefetcher_t::room_prefetcher_t(const room_graph_t* graph)
+{
+    _graph = graph;
+    _room = UINT32_MAX;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+room_prefetcher_t::~room_prefetcher_t() { cancel_all(); }
+
+bool room_prefetcher_t::is_prefetching(Uint32 room) const { return room < _preloads.size() && _preloads[room] && !_preloads[room]->is_done(); }
+
+void room_prefetcher_t::start(Uint32 room)
+{
+    _preloads[room] = asset_cache::preload(_graph->get_room(room).files);
+    _stats.started++;
+}
+
+void room_prefetcher_t::cancel(Uint32 room)
+{
+    if (!_preloads[room])
+        return;
+
+    /* A finished prefetch only drops the handle, so coming back starts a new one for anything evicted since */
+    if (!_preloads[room]->is_done())
+    {
+        _preloads[room]->cancel();
+        _stats.cancelled++;
+    }
+    _preloads[room].reset();
+}
+
+void room_prefetcher_t::cancel_all()
+{
+    for (Uint32 i = 0; i < _preloads.size(); i++)
+        cancel(i);
+}
+
+void room_prefetcher_t::update(Uint32 room, const float pos[3], const float heading[3])
+{
+    PROFILER_SCOPE(zone_update);
+
+    if (room >= _graph->get_room_count())
+        return;
+    _preloads.resize(_graph->get_room_count());
+
+    const room_graph_t::room_t& current = _graph->get_room(room);
+
+    if (room != _room)
+    {
+        if (_room != UINT32_MAX)
+        {
+            _stats.transitions++;
+            _stats.resident_transitions += _graph->is_resident(room);
+        }
+        _room = room;
+
+        /* The room just entered keeps its prefetch (It is about to be asked for), everything not next to it goes */
+        for (Uint32 i = 0; i < _preloads.size(); i++)
+        {
+            bool adjacent = false;
+            for (const room_graph_t::door_t& door : current.doors)
+                adjacent |= door.to == i;
+            if (i != room && !adjacent)
+                cancel(i);
+        }
+    }
+
+    const float heading_len = sqrtf(heading[0] * heading[0] + heading[1] * heading[1] + heading[2] * heading[2]);
+    const float distance = room_prefetch_distance.get();
+    const float near_distance = room_prefetch_near_distance.get();
+    const float start_dot = room_prefetch_start_dot.get();
+    const float cancel_dot = SDL_min(room_prefetch_cancel_dot.get(), start_dot);
+
+    /* A neighbour can have more than one door, it is wanted if any of them wants it */
+    _want.assign(_preloads.size(), WANT_NONE);
+    for (const room_graph_t::door_t& door : current.doors)
+    {
+        float to_door[3] = { door.pos[0] - pos[0], door.pos[1] - pos[1], door.pos[2] - pos[2] };
+        float dist = sqrtf(to_door[0] * to_door[0] + to_door[1] * to_door[1] + to_door[2] * to_door[2]);
+        float approach = 0.0f;
+        if (heading_len > 0.0f && dist > 0.0f)
+            approach = (heading[0] * to_door[0] + heading[1] * to_door[1] + heading[2] * to_door[2]) / (heading_len * dist);
+
+        Uint8 want = WANT_NONE;
+        if (dist <= near_distance || (dist <= distance && approach >= start_dot))
+            want = WANT_START;
+        else if (dist <= distance * ROOM_PREFETCH_KEEP_SCALE && approach >= cancel_dot)
+            want = WANT_KEEP;
+
+        _want[door.to] = SDL_max(_want[door.to], want);
+    }
+
+    for (const room_graph_t::door_t& door : current.doors)
+    {
+        Uint32 to = door.to;
+        if (to == room)
+            continue;
+
+        if (_want[to] == WANT_START && !_preloads[to])
+            start(to);
+        else if (_want[to] == WANT_NONE && _preloads[to])
+            cancel(to);
+    }
+}
+
+/* ================================ Selftest ================================ */
+
+/**
+ * Splits the files of a ROM into a chain of rooms and walks a player along it: away from a door, toward it, turning
+ * back, then through it once the prefetch is done, checking that the room on the other side is already cached
+ */
+static int command_room_prefetch_selftest(const int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        dc_log("Usage: %s <rom root>", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    level_bundle::find_level_files(argv[1], "", files);
+    const Uint32 room_count = 4;
+    if (files.size() < room_count)
+    {
+        dc_log_error("%s: Not enough files in %s", argv[0], argv[1]);
+        return 1;
+    }
+
+    /* Rooms are 20 units long along x, door i is between room i and i + 1 */
+    room_graph_t graph;
+    for (Uint32 i = 0; i < room_count; i++)
+    {
+        std::vector<std::string> room_files;
+        for (size_t j = files.size() * i / room_count; j < files.size() * (i + 1) / room_count; j++)
+            room_files.push_back(std::string(argv[1]) + "/" + files[j]);
+        graph.add_room(("room_" + std::to_string(i)).c_str(), room_files);
+    }
+    for (Uint32 i = 0; i + 1 < room_count; i++)
+    {
+        const float door[3] = { 20.0f * (i + 1), 0.0f, 0.0f };
+        graph.add_door(i, i + 1, door);
+    }
+
+    asset_cache::clear();
+
+    int failed = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok)
+        {
+            dc_log_error("%s: %s", argv[0], what);
+            failed++;
+        }
+    };
+    auto wait = [](room_prefetcher_t& p, Uint32 room) {
+        for (int i = 0; i < 5000 && p.is_prefetching(room); i++)
+            SDL_Delay(1);
+    };
+
+    const float forward[3] = { 1.0f, 0.0f, 0.0f };
+    const float back[3] = { -1.0f, 0.0f, 0.0f };
+
+    room_prefetcher_t prefetcher(&graph);
+    float pos[3] = { 10.0f, 0.0f, 0.0f };
+    Uint32 room = 0;
+
+    /* Moves the player, entering a room loads all of it the way the game would */
+    auto step = [&](float x, const float heading[3]) {
+        pos[0] = x;
+        Uint32 new_room = Uint32(SDL_max(x, 0.0f) / 20.0f);
+        prefetcher.update(new_room, pos, heading);
+        if (new_room != room)
+            for (const std::string& path : graph.get_room(new_room).files)
+                asset_cache::load(path.c_str());
+        room = new_room;
+    };
+
+    for (const std::string& path : graph.get_room(0).files)
+        asset_cache::load(path.c_str());
+
+    step(10.0f, back);
+    check(prefetcher.get_stats().started == 0, "Prefetch started while heading away from the door");
+
+    step(10.0f, forward);
+    check(prefetcher.get_stats().started == 1, "Prefetch not started while heading toward the door");
+
+    step(10.0f, back);
+    check(!prefetcher.is_prefetching(1), "Prefetch not cancelled after turning back");
+
+    /* Stand at the door until the prefetch is done, like waiting for it to open */
+    for (float x = 10.0f; x < 19.5f; x += 0.5f)
+        step(x, forward);
+    wait(prefetcher, 1);
+    for (float x = 19.5f; x < 30.0f; x += 0.5f)
+        step(x, forward);
+    check(prefetcher.get_stats().transitions == 1 && prefetcher.get_stats().resident_transitions == 1, "Room 1 was not resident when entered");
+
+    /* Room 2 starts loading, then the player heads back to room 0, which should still be cached */
+    for (float x = 30.0f; x < 35.0f; x += 0.5f)
+        step(x, forward);
+    check(prefetcher.get_stats().started >= 3, "Room 2 prefetch not started");
+    for (float x = 35.0f; x > 10.0f; x -= 0.5f)
+        step(x, back);
+    check(!prefetcher.is_prefetching(2), "Room 2 prefetch not cancelled after leaving for room 0");
+    check(prefetcher.get_stats().resident_transitions == 2, "Room 0 was not resident when entered again");
+
+    const room_prefetcher_t::stats_t& s = prefetcher.get_stats();
+    dc_log("%s: %u started, %u cancelled, %u/%u transitions resident, cache %.2f/%.2f MiB", argv[0], s.started, s.cancelled, s.resident_transitions,
+        s.transitions, asset_cache::get_used_bytes() / (1024.0 * 1024.0), asset_cache::get_budget_bytes() / (1024.0 * 1024.0));
+
+    if (failed)
+        dc_log_error("%s: %d checks failed", argv[0], failed);
+    else
+        dc_log("%s: Passed", argv[0]);
+
+    return failed != 0;
+}
+
+void room_prefetch::init() { dev_console::add_command("room_prefetch_selftest", command_room_prefetch_selftest); }
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_ROOM_PREFETCH_H
+#define MPH_TETRA_GAME_ROOM_PREFETCH_H
+
+#include "util/asset_cache.h"
+
+#include <SDL_bits.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Rooms of a level and the doors between them
+ */
+class room_graph_t
+{
+public:
+    struct door_t
+    {
+        /** Room on the other side */
+        Uint32 to;
+        /** Center of the door */
+        float pos[3];
+    };
+
+    struct room_t
+    {
+        std::string name;
+        /** PhysFS paths of everything the room loads, ideally in ROM order (See MPH_TETRA_PHYSFS_loadPreloadManifest()) */
+        std::vector<std::string> files;
+        std::vector<door_t> doors;
+    };
+
+    /**
+     * @returns Id of the room
+     */
+    Uint32 add_room(const char* name, const std::vector<std::string>& files);
+
+    /**
+     * Connects two rooms both ways
+     *
+     * @param pos Center of the door
+     */
+    void add_door(Uint32 room_a, Uint32 room_b, const float pos[3]);
+
+    inline size_t get_room_count() const { return _rooms.size(); }
+
+    inline const room_t& get_room(Uint32 room) const { return _rooms[room]; }
+
+    /**
+     * @returns True if every file of the room is in the asset cache
+     */
+    bool is_resident(Uint32 room) const;
+
+private:
+    std::vector<room_t> _rooms;
+};
+
+/**
+ * Predictive prefetch of the rooms next to the player
+ *
+ * Every update() looks at the doors of the current room. A neighbour is prefetched (asset_cache::preload(), low
+ * priority) once the player is within room_prefetch_distance of the door and heading toward it, or is standing right
+ * in front of it (room_prefetch_near_distance). The prefetch is cancelled when the player turns away from the door
+ * (room_prefetch_cancel_dot), walks off, or leaves for a room the neighbour is not next to. Starting and cancelling use
+ * different thresholds so looking around near a door does not start and stop loads every tick.
+ *
+ * Memory is bounded by the asset cache: a prefetch only fills free budget or replaces older prefetched data that was
+ * never used, so it never pushes out what the current room is using.
+ *
+ * update() is cheap (A few dot products per door), call it every tick from the game thread.
+ */
+class room_prefetcher_t
+{
+public:
+    struct stats_t
+    {
+        Uint32 started;
+        Uint32 cancelled;
+        /** Room changes */
+        Uint32 transitions;
+        /** Room changes where every file of the new room was already cached */
+        Uint32 resident_transitions;
+    };
+
+    /**
+     * @param graph Must outlive the prefetcher
+     */
+    room_prefetcher_t(const room_graph_t* graph);
+
+    /**
+     * Cancels every running prefetch
+     */
+    ~room_prefetcher_t();
+
+    /**
+     * @param room Room the player is in
+     * @param pos Position of the player
+     * @param heading Direction the player is moving (Or looking) in, does not need to be normalized
+     */
+    void update(Uint32 room, const float pos[3], const float heading[3]);
+
+    void cancel_all();
+
+    /**
+     * @returns True if a prefetch of the room is running
+     */
+    bool is_prefetching(Uint32 room) const;
+
+    inline const stats_t& get_stats() const { return _stats; }
+
+private:
+    void start(Uint32 room);
+    void cancel(Uint32 room);
+
+    enum want_t : Uint8
+    {
+        WANT_NONE,
+        /** Keep a running prefetch, but don't start one */
+        WANT_KEEP,
+        WANT_START,
+    };
+
+    const room_graph_t* _graph;
+    /** Current room, UINT32_MAX before the first update() */
+    Uint32 _room;
+    /** Per room, NULL when no prefetch was started (Or it was cancelled) */
+    std::vector<std::shared_ptr<asset_cache::preload_t>> _preloads;
+    /** Per room want_t, scratch for update() */
+    std::vector<Uint8> _want;
+    stats_t _stats;
+};
+
+namespace room_prefetch
+{
+/**
+ * Registers the room_prefetch_selftest console command
+ */
+void init();
+};
+
+#endif
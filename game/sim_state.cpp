@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "sim_state.h"
+
+#include "gui/console.h"
+#include "util/hash.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+static profiler_zone_t zone_capture("sim_snapshot_ring_t::capture");
+static profiler_zone_t zone_restore("sim_snapshot_ring_t::restore");
+
+static inline size_t align_up(size_t x, size_t alignment) { return (x + alignment - 1) & ~(alignment - 1); }
+
+static Uint8* align_storage(std::vector<Uint8>& storage, size_t size)
+{
+    storage.assign(size + SIM_ARENA_ALIGN, 0);
+    return storage.data() + (SIM_ARENA_ALIGN - (uintptr_t(storage.data()) % SIM_ARENA_ALIGN)) % SIM_ARENA_ALIGN;
+}
+
+/* ================================ Arena ================================ */
+
+sim_arena_t::sim_arena_t(const char* name, size_t capacity)
+{
+    _name = name;
+    _capacity = align_up(capacity, SIM_ARENA_ALIGN);
+    _data = align_storage(_storage, _capacity);
+    _used = 0;
+}
+
+void* sim_arena_t::alloc(size_t bytes, size_t alignment)
+{
+    size_t start = align_up(_used, SDL_max(alignment, size_t(1)));
+    if (start + bytes > _capacity)
+    {
+        dc_log_error("Arena \"%s\" is out of space (%zu + %zu > %zu)", _name, start, bytes, _capacity);
+        return NULL;
+    }
+
+    /* Everything past _used is kept zeroed, by reset() and by sim_snapshot_ring_t::restore() */
+    _used = start + bytes;
+    return _data + start;
+}
+
+void sim_arena_t::reset()
+{
+    memset(_data, 0, _used);
+    _used = 0;
+}
+
+/* ================================ Snapshots ================================ */
+
+/*
+ * Delta format, repeated until every word is covered:
+ *   Uint32 zero_words, Uint32 literal_words, Uint64 literals[literal_words]
+ */
+struct delta_run_t
+{
+    Uint32 zero_words;
+    Uint32 literal_words;
+};
+
+sim_snapshot_ring_t::sim_snapshot_ring_t(const std::vector<sim_arena_t*>& arenas, int slots, bool delta, int keyframe_interval)
+{
+    _arenas = arenas;
+    _delta = delta;
+    _keyframe_interval = SDL_max(keyframe_interval, 1);
+
+    _snapshot_size = 0;
+    for (sim_arena_t* arena : _arenas)
+    {
+        _offsets.push_back(_snapshot_size);
+        _snapshot_size += arena->get_capacity();
+    }
+
+    slots = SDL_max(slots, 1);
+    Uint8* base = align_storage(_storage, _snapshot_size * (slots + (delta ? 1 : 0)));
+    _slots.resize(slots);
+    for (int i = 0; i < slots; i++)
+    {
+        _slots[i].data = base + _snapshot_size * i;
+        _slots[i].used.resize(_arenas.size());
+    }
+    _previous = delta ? base + _snapshot_size * slots : NULL;
+    _previous_used.assign(_arenas.size(), 0);
+
+    _oldest = 0;
+    _count = 0;
+    _since_keyframe = 0;
+}
+
+void sim_snapshot_ring_t::copy_in(Uint8* dst) const
+{
+    for (size_t i = 0; i < _arenas.size(); i++)
+        memcpy(dst + _offsets[i], _arenas[i]->_data, _arenas[i]->_used);
+}
+
+void sim_snapshot_ring_t::copy_out(const Uint8* src, const std::vector<size_t>& used)
+{
+    for (size_t i = 0; i < _arenas.size(); i++)
+    {
+        sim_arena_t* arena = _arenas[i];
+        memcpy(arena->_data, src + _offsets[i], used[i]);
+        if (arena->_used > used[i])
+            memset(arena->_data + used[i], 0, arena->_used - used[i]);
+        arena->_used = used[i];
+    }
+}
+
+void sim_snapshot_ring_t::set_previous(const Uint8* src, const std::vector<size_t>& used)
+{
+    for (size_t i = 0; i < _arenas.size(); i++)
+    {
+        memcpy(_previous + _offsets[i], src + _offsets[i], used[i]);
+        if (_previous_used[i] > used[i])
+            memset(_previous + _offsets[i] + used[i], 0, _previous_used[i] - used[i]);
+        _previous_used[i] = used[i];
+    }
+}
+
+size_t sim_snapshot_ring_t::encode_delta(Uint8* dst)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < _arenas.size(); i++)
+    {
+        /* Both sides are zero past their fill level, capacities are multiples of 8 */
+        size_t words = align_up(SDL_max(_arenas[i]->_used, _previous_used[i]), 8) / 8;
+        const Uint8* cur = _arenas[i]->_data;
+        Uint8* prev = _previous + _offsets[i];
+
+        size_t w = 0;
+        while (w < words)
+        {
+            delta_run_t run = { 0, 0 };
+            Uint64 a, b;
+            for (; w < words; w++, run.zero_words++)
+            {
+                memcpy(&a, cur + w * 8, 8);
+                memcpy(&b, prev + w * 8, 8);
+                if (a != b)
+                    break;
+            }
+
+            size_t run_pos = out;
+            out += sizeof(run);
+            for (; w < words; w++, run.literal_words++)
+            {
+                memcpy(&a, cur + w * 8, 8);
+                memcpy(&b, prev + w * 8, 8);
+                if (a == b)
+                    break;
+                if (out + 8 >= _snapshot_size)
+                    return 0;
+                Uint64 x = a ^ b;
+                memcpy(dst + out, &x, 8);
+                memcpy(prev + w * 8, &a, 8);
+                out += 8;
+            }
+
+            if (out >= _snapshot_size)
+                return 0;
+            memcpy(dst + run_pos, &run, sizeof(run));
+        }
+        _previous_used[i] = _arenas[i]->_used;
+    }
+    return out;
+}
+
+void sim_snapshot_ring_t::apply_delta(const slot_t& slot)
+{
+    size_t in = 0;
+    for (size_t i = 0; i < _arenas.size(); i++)
+    {
+        size_t words = align_up(SDL_max(slot.used[i], _previous_used[i]), 8) / 8;
+        Uint8* prev = _previous + _offsets[i];
+
+        size_t w = 0;
+        while (w < words)
+        {
+            delta_run_t run;
+            memcpy(&run, slot.data + in, sizeof(run));
+            in += sizeof(run);
+            w += run.zero_words;
+            for (Uint32 k = 0; k < run.literal_words; k++, w++, in += 8)
+            {
+                Uint64 a, x;
+                memcpy(&a, prev + w * 8, 8);
+                memcpy(&x, slot.data + in, 8);
+                a ^= x;
+                memcpy(prev + w * 8, &a, 8);
+            }
+        }
+        _previous_used[i] = slot.used[i];
+    }
+}
+
+void sim_snapshot_ring_t::capture(Uint32 tick)
+{
+    PROFILER_SCOPE(zone_capture);
+
+    if (_count == int(_slots.size()))
+        _oldest = (_oldest + 1) % _slots.size();
+    else
+        _count++;
+    slot_t& slot = _slots[get_slot(_count - 1)];
+
+    slot.tick = tick;
+    for (size_t i = 0; i < _arenas.size(); i++)
+        slot.used[i] = _arenas[i]->_used;
+
+    if (_delta && _count > 1 && _since_keyframe + 1 < _keyframe_interval)
+    {
+        /* encode_delta() updates _previous word by word, only as far as it got when it gives up */
+        slot.size = encode_delta(slot.data);
+        if (slot.size)
+        {
+            slot.keyframe = false;
+            _since_keyframe++;
+            return;
+        }
+    }
+
+    copy_in(slot.data);
+    slot.keyframe = true;
+    slot.size = 0;
+    for (size_t i = 0; i < _arenas.size(); i++)
+        slot.size += slot.used[i];
+    _since_keyframe = 0;
+
+    if (_delta)
+        set_previous(slot.data, slot.used);
+}
+
+int sim_snapshot_ring_t::find(Uint32 tick) const
+{
+    for (int i = _count - 1; i >= 0; i--)
+    {
+        if (_slots[get_slot(i)].tick != tick)
+            continue;
+
+        /* The chain back to a keyframe has to still be in the ring */
+        for (int k = i; k >= 0; k--)
+            if (_slots[get_slot(k)].keyframe)
+                return i;
+        return -1;
+    }
+    return -1;
+}
+
+bool sim_snapshot_ring_t::has(Uint32 tick) const { return find(tick) >= 0; }
+
+bool sim_snapshot_ring_t::restore(Uint32 tick)
+{
+    PROFILER_SCOPE(zone_restore);
+
+    int pos = find(tick);
+    if (pos < 0)
+        return false;
+
+    int key = pos;
+    while (!_slots[get_slot(key)].keyframe)
+        key--;
+
+    const slot_t& keyframe = _slots[get_slot(key)];
+    if (_delta)
+    {
+        set_previous(keyframe.data, keyframe.used);
+        for (int i = key + 1; i <= pos; i++)
+            apply_delta(_slots[get_slot(i)]);
+        copy_out(_previous, _previous_used);
+    }
+    else
+        copy_out(keyframe.data, keyframe.used);
+
+    _count = pos + 1;
+    _since_keyframe = pos - key;
+    return true;
+}
+
+size_t sim_snapshot_ring_t::get_stored_bytes() const
+{
+    size_t total = 0;
+    for (int i = 0; i < _count; i++)
+        total += _slots[get_slot(i)].size;
+    return total;
+}
+
+/**
+ * Mutates a few percent of the state each tick like a simulation would, then times capture and restore and checks
+ * restored state against hashes taken at capture time
+ */
+static int command_sim_snapshot_bench(const int argc, const char** argv)
+{
+    size_t kib = argc > 1 ? SDL_clamp(atoi(argv[1]), 1, 1 << 20) : 256;
+    const int snapshots = 64;
+    int failures = 0;
+
+    for (int delta = 0; delta < 2; delta++)
+    {
+        sim_arena_t entities("entities", kib * 1024 * 3 / 4);
+        sim_arena_t misc("misc", kib * 1024 / 4);
+        Uint8* entity_data = (Uint8*)entities.alloc(entities.get_capacity() - 4096);
+        Uint32* rng = misc.alloc_array<Uint32>(1);
+        Uint8* misc_data = (Uint8*)misc.alloc(misc.get_capacity() / 2);
+        if (!entity_data || !rng || !misc_data)
+            return 1;
+
+        *rng = 12345;
+        auto rand_next = [rng]() {
+            *rng = *rng * 1664525u + 1013904223u;
+            return *rng >> 8;
+        };
+
+        sim_snapshot_ring_t ring({ &entities, &misc }, snapshots, delta, 8);
+        std::vector<Uint64> hashes;
+        double capture_s = 0.0, restore_s = 0.0, freq = double(SDL_GetPerformanceFrequency());
+        for (int tick = 0; tick < snapshots; tick++)
+        {
+            /* A few hundred scattered writes, and the odd allocation */
+            for (int i = 0; i < 256; i++)
+                entity_data[rand_next() % (entities.get_capacity() - 4096)] = rand_next();
+            if (tick % 16 == 15)
+                misc.alloc(rand_next() % 256 + 1);
+
+            Uint64 hash = util::fnv1a64(entities.get_data(), entities.get_capacity());
+            hashes.push_back(util::fnv1a64(misc.get_data(), misc.get_capacity(), hash) ^ misc.get_used());
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            ring.capture(tick);
+            capture_s += (SDL_GetPerformanceCounter() - start) / freq;
+        }
+        size_t stored = ring.get_stored_bytes();
+
+        /* Newest to oldest, each restore drops the snapshots after it */
+        int restores = 0;
+        for (int tick = snapshots - 1; tick >= 0; tick -= 3)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            bool ok = ring.restore(tick);
+            restore_s += (SDL_GetPerformanceCounter() - start) / freq;
+            restores++;
+
+            Uint64 hash = util::fnv1a64(entities.get_data(), entities.get_capacity());
+            hash = util::fnv1a64(misc.get_data(), misc.get_capacity(), hash) ^ misc.get_used();
+            if (!ok || hash != hashes[tick])
+            {
+                dc_log_error("sim_snapshot_bench: Tick %d restored %s", tick, ok ? "incorrectly" : "nothing");
+                failures++;
+            }
+        }
+
+        dc_log("sim_snapshot_bench: %s, %zu KiB: capture %.1f us, restore %.1f us, %zu KiB stored for %d snapshots", delta ? "XOR delta" : "Plain",
+            ring.get_snapshot_size() >> 10, capture_s * 1000000.0 / snapshots, restore_s * 1000000.0 / restores, stored >> 10, snapshots);
+    }
+
+    return failures ? 1 : 0;
+}
+
+void sim_state::init() { dev_console::add_command("sim_snapshot_bench", command_sim_snapshot_bench); }
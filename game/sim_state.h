@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_SIM_STATE_H
+#define MPH_TETRA_GAME_SIM_STATE_H
+
+#include <SDL_bits.h>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Alignment of arena allocations and snapshot buffers
+ */
+#define SIM_ARENA_ALIGN 64
+
+/**
+ * Fixed capacity bump allocator holding simulation state (Entity pools, transforms, RNG state, timers, ...)
+ *
+ * Everything in an arena must be trivially copyable and must not point outside of its own arena set by address (Use
+ * indices), since sim_snapshot_ring_t copies the bytes back as they were. The storage never moves.
+ */
+class sim_arena_t
+{
+public:
+    sim_arena_t(const char* name, size_t capacity);
+
+    /**
+     * @returns Zeroed memory, or NULL if the arena is full
+     */
+    void* alloc(size_t bytes, size_t alignment = 16);
+
+    template <typename T>
+    T* alloc_array(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Arena contents are copied with memcpy");
+        return (T*)alloc(sizeof(T) * count, alignof(T));
+    }
+
+    /**
+     * Frees everything (Contents are zeroed)
+     */
+    void reset();
+
+    inline const char* get_name() const { return _name; }
+    inline Uint8* get_data() { return _data; }
+    inline size_t get_used() const { return _used; }
+    inline size_t get_capacity() const { return _capacity; }
+
+private:
+    friend class sim_snapshot_ring_t;
+
+    const char* _name;
+    std::vector<Uint8> _storage;
+    Uint8* _data;
+    size_t _used;
+    size_t _capacity;
+};
+
+/**
+ * Ring of preallocated whole-world snapshots (Save states, rollback)
+ *
+ * capture() copies the used part of every arena into the oldest slot, restore() copies a snapshot back (Including each
+ * arena's fill level). No allocations happen after construction.
+ *
+ * With delta compression every keyframe_interval'th snapshot is a plain copy and the rest store the XOR against the
+ * previous snapshot as runs of zero and literal 8 byte words. This shrinks snapshots of mostly static state a lot,
+ * but restoring has to replay the deltas since the last keyframe, and a snapshot whose keyframe has been overwritten
+ * can't be restored. A delta that would not be smaller than a copy is stored as a keyframe instead.
+ *
+ * Restoring drops every snapshot newer than the restored one, since the simulation diverges from them.
+ */
+class sim_snapshot_ring_t
+{
+public:
+    /**
+     * @param arenas Arenas to capture (Must outlive the ring)
+     * @param slots Number of snapshots kept
+     * @param delta Use XOR delta compression
+     * @param keyframe_interval Snapshots per keyframe with delta compression
+     */
+    sim_snapshot_ring_t(const std::vector<sim_arena_t*>& arenas, int slots, bool delta = false, int keyframe_interval = 8);
+
+    /**
+     * Captures the arenas, overwriting the oldest snapshot when the ring is full
+     */
+    void capture(Uint32 tick);
+
+    /**
+     * Restores the newest snapshot taken at tick
+     *
+     * @returns false if there is no restorable snapshot for tick
+     */
+    bool restore(Uint32 tick);
+
+    /**
+     * @returns true if tick can be restored
+     */
+    bool has(Uint32 tick) const;
+
+    inline int get_count() const { return _count; }
+
+    /**
+     * Bytes stored for all snapshots currently in the ring
+     */
+    size_t get_stored_bytes() const;
+
+    /**
+     * Bytes a plain copy of the arenas takes
+     */
+    inline size_t get_snapshot_size() const { return _snapshot_size; }
+
+private:
+    struct slot_t
+    {
+        Uint32 tick;
+        bool keyframe;
+        /** Bytes of data used */
+        size_t size;
+        /** Fill level of each arena */
+        std::vector<size_t> used;
+        Uint8* data;
+    };
+
+    /** Slot index of the i'th oldest snapshot */
+    inline int get_slot(int i) const { return (_oldest + i) % int(_slots.size()); }
+
+    /** Position (0 = oldest) of the newest restorable snapshot at tick, -1 if none */
+    int find(Uint32 tick) const;
+
+    /** Offset of each arena in a plain snapshot */
+    std::vector<size_t> _offsets;
+
+    void copy_in(Uint8* dst) const;
+    void copy_out(const Uint8* src, const std::vector<size_t>& used);
+
+    /**
+     * XORs the arenas against _previous into dst and updates _previous
+     *
+     * @returns Encoded size, or 0 if it would not be smaller than a plain copy
+     */
+    size_t encode_delta(Uint8* dst);
+
+    /**
+     * Applies a delta to _previous
+     */
+    void apply_delta(const slot_t& slot);
+
+    /**
+     * Makes _previous a copy of a plain snapshot
+     */
+    void set_previous(const Uint8* src, const std::vector<size_t>& used);
+
+    std::vector<sim_arena_t*> _arenas;
+    size_t _snapshot_size;
+    bool _delta;
+    int _keyframe_interval;
+
+    std::vector<Uint8> _storage;
+    std::vector<slot_t> _slots;
+    int _oldest;
+    int _count;
+    int _since_keyframe;
+
+    /** State as of the newest snapshot, what the next delta is taken against (Delta compression only) */
+    Uint8* _previous;
+    std::vector<size_t> _previous_used;
+};
+
+namespace sim_state
+{
+/**
+ * Registers the sim_snapshot_bench console command
+ */
+void init();
+};
+
+#endif
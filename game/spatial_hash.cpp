@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "spatial_hash.h"
+
+#include "gui/console.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPATIAL_SLOT_NONE 0xFFFFFFFF
+
+/* Queries per chunk in query_radius_batch() */
+#define SPATIAL_BATCH_GRAIN 64
+
+static profiler_zone_t zone_update("spatial_hash_t::update");
+static profiler_zone_t zone_query_batch("spatial_hash_t::query_radius_batch");
+
+spatial_hash_t::spatial_hash_t(float cell_size)
+{
+    _cell_size = cell_size > 0.0f ? cell_size : 1.0f;
+    _inv_cell_size = 1.0f / _cell_size;
+    _needs_rebuild = false;
+    _bucket_mask = 0;
+    _max_radius = 0.0f;
+}
+
+inline void spatial_hash_t::get_cell(const float pos[3], int cell[3]) const
+{
+    for (int i = 0; i < 3; i++)
+        cell[i] = (int)floorf(pos[i] * _inv_cell_size);
+}
+
+inline Uint32 spatial_hash_t::get_bucket(const int cell[3]) const
+{
+    Uint32 h = Uint32(cell[0]) * 73856093u ^ Uint32(cell[1]) * 19349663u ^ Uint32(cell[2]) * 83492791u;
+    return (h ^ (h >> 16)) & _bucket_mask;
+}
+
+void spatial_hash_t::set(Uint32 id, const float pos[3], float radius)
+{
+    if (id >= _entities.size())
+    {
+        entity_t blank = {};
+        blank.slot = SPATIAL_SLOT_NONE;
+        _entities.resize(id + 1, blank);
+    }
+
+    entity_t& e = _entities[id];
+    int cell[3];
+    get_cell(pos, cell);
+
+    if (!e.alive || cell[0] != e.cell[0] || cell[1] != e.cell[1] || cell[2] != e.cell[2])
+        _needs_rebuild = true;
+    else if (!e.dirty)
+        _dirty.push_back(id);
+
+    e.alive = true;
+    e.dirty = true;
+    e.radius = radius;
+    for (int i = 0; i < 3; i++)
+    {
+        e.pos[i] = pos[i];
+        e.cell[i] = cell[i];
+    }
+}
+
+void spatial_hash_t::remove(Uint32 id)
+{
+    if (id >= _entities.size() || !_entities[id].alive)
+        return;
+    _entities[id].alive = false;
+    _needs_rebuild = true;
+}
+
+void spatial_hash_t::clear()
+{
+    _entities.clear();
+    _dirty.clear();
+    _bucket_start.clear();
+    _entries.clear();
+    _bucket_mask = 0;
+    _max_radius = 0.0f;
+    _needs_rebuild = false;
+}
+
+void spatial_hash_t::rebuild()
+{
+    size_t alive = 0;
+    for (const entity_t& e : _entities)
+        alive += e.alive;
+
+    /* About two buckets per entity keeps collisions rare without wasting much on empty buckets */
+    Uint32 num_buckets = 64;
+    while (num_buckets < alive * 2)
+        num_buckets *= 2;
+    _bucket_mask = num_buckets - 1;
+
+    _bucket_start.assign(num_buckets + 1, 0);
+    for (const entity_t& e : _entities)
+        if (e.alive)
+            _bucket_start[get_bucket(e.cell) + 1]++;
+    for (Uint32 i = 0; i < num_buckets; i++)
+        _bucket_start[i + 1] += _bucket_start[i];
+
+    /* Scatter, using the next bucket's start as a cursor and shifting it back afterwards */
+    _entries.resize(alive);
+    _max_radius = 0.0f;
+    for (size_t id = 0; id < _entities.size(); id++)
+    {
+        entity_t& e = _entities[id];
+        e.dirty = false;
+        if (!e.alive)
+        {
+            e.slot = SPATIAL_SLOT_NONE;
+            continue;
+        }
+
+        Uint32 slot = _bucket_start[get_bucket(e.cell)]++;
+        entry_t& entry = _entries[slot];
+        for (int i = 0; i < 3; i++)
+        {
+            entry.pos[i] = e.pos[i];
+            entry.cell[i] = e.cell[i];
+        }
+        entry.radius = e.radius;
+        entry.id = id;
+        e.slot = slot;
+        _max_radius = SDL_max(_max_radius, e.radius);
+    }
+    for (Uint32 i = num_buckets; i > 0; i--)
+        _bucket_start[i] = _bucket_start[i - 1];
+    _bucket_start[0] = 0;
+}
+
+void spatial_hash_t::update()
+{
+    PROFILER_SCOPE(zone_update);
+
+    if (_needs_rebuild)
+        rebuild();
+    else
+    {
+        for (Uint32 id : _dirty)
+        {
+            entity_t& e = _entities[id];
+            entry_t& entry = _entries[e.slot];
+            for (int i = 0; i < 3; i++)
+                entry.pos[i] = e.pos[i];
+            entry.radius = e.radius;
+            /* Only ever grows between rebuilds, which just makes queries a bit more conservative */
+            _max_radius = SDL_max(_max_radius, e.radius);
+            e.dirty = false;
+        }
+    }
+
+    _dirty.clear();
+    _needs_rebuild = false;
+}
+
+template <typename F>
+void spatial_hash_t::for_each_candidate(const float min[3], const float max[3], F func) const
+{
+    if (_entries.empty())
+        return;
+
+    float grown_min[3], grown_max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        grown_min[i] = min[i] - _max_radius;
+        grown_max[i] = max[i] + _max_radius;
+    }
+
+    int cell_min[3], cell_max[3];
+    get_cell(grown_min, cell_min);
+    get_cell(grown_max, cell_max);
+
+    double num_cells = double(cell_max[0] - cell_min[0] + 1) * double(cell_max[1] - cell_min[1] + 1) * double(cell_max[2] - cell_min[2] + 1);
+    /* Huge queries would visit the same buckets over and over, scan every entry instead */
+    if (num_cells > double(_bucket_mask + 1))
+    {
+        for (const entry_t& entry : _entries)
+            func(entry);
+        return;
+    }
+
+    int cell[3];
+    for (cell[2] = cell_min[2]; cell[2] <= cell_max[2]; cell[2]++)
+        for (cell[1] = cell_min[1]; cell[1] <= cell_max[1]; cell[1]++)
+            for (cell[0] = cell_min[0]; cell[0] <= cell_max[0]; cell[0]++)
+            {
+                Uint32 bucket = get_bucket(cell);
+                const entry_t* it = _entries.data() + _bucket_start[bucket];
+                const entry_t* end = _entries.data() + _bucket_start[bucket + 1];
+                for (; it != end; it++)
+                {
+                    /* Other cells hashing to the same bucket are visited (or skipped) on their own iteration */
+                    if (it->cell[0] == cell[0] && it->cell[1] == cell[1] && it->cell[2] == cell[2])
+                        func(*it);
+                }
+            }
+}
+
+size_t spatial_hash_t::query_radius(const float center[3], float radius, std::vector<Uint32>& out) const
+{
+    size_t before = out.size();
+    float min[3] = { center[0] - radius, center[1] - radius, center[2] - radius };
+    float max[3] = { center[0] + radius, center[1] + radius, center[2] + radius };
+    for_each_candidate(min, max, [&](const entry_t& entry) {
+        float dx = entry.pos[0] - center[0], dy = entry.pos[1] - center[1], dz = entry.pos[2] - center[2];
+        float r = radius + entry.radius;
+        if (dx * dx + dy * dy + dz * dz <= r * r)
+            out.push_back(entry.id);
+    });
+    return out.size() - before;
+}
+
+size_t spatial_hash_t::query_aabb(const float min[3], const float max[3], std::vector<Uint32>& out) const
+{
+    size_t before = out.size();
+    for_each_candidate(min, max, [&](const entry_t& entry) {
+        float dist2 = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            float d = SDL_max(SDL_max(min[i] - entry.pos[i], entry.pos[i] - max[i]), 0.0f);
+            dist2 += d * d;
+        }
+        if (dist2 <= entry.radius * entry.radius)
+            out.push_back(entry.id);
+    });
+    return out.size() - before;
+}
+
+void spatial_hash_t::query_radius_batch(const spatial_radius_query_t* queries, size_t count, std::vector<Uint32>& ids, std::vector<Uint32>& offsets) const
+{
+    PROFILER_SCOPE(zone_query_batch);
+
+    /* Chunks fill their own lists, then everything is stitched together in query order */
+    size_t num_chunks = (count + SPATIAL_BATCH_GRAIN - 1) / SPATIAL_BATCH_GRAIN;
+    std::vector<std::vector<Uint32>> chunk_ids(num_chunks);
+    offsets.resize(count + 1);
+
+    jobs::parallel_for(count, SPATIAL_BATCH_GRAIN, [&](int begin, int end) {
+        for (int chunk = begin / SPATIAL_BATCH_GRAIN; chunk * SPATIAL_BATCH_GRAIN < end; chunk++)
+        {
+            std::vector<Uint32>& out = chunk_ids[chunk];
+            out.clear();
+            int chunk_end = SDL_min(end, (chunk + 1) * SPATIAL_BATCH_GRAIN);
+            for (int i = chunk * SPATIAL_BATCH_GRAIN; i < chunk_end; i++)
+                offsets[i + 1] = query_radius(queries[i].center, queries[i].radius, out);
+        }
+    });
+
+    offsets[0] = 0;
+    for (size_t i = 0; i < count; i++)
+        offsets[i + 1] += offsets[i];
+
+    ids.resize(offsets[count]);
+    for (size_t chunk = 0; chunk < num_chunks; chunk++)
+        if (chunk_ids[chunk].size())
+            memcpy(ids.data() + offsets[chunk * SPATIAL_BATCH_GRAIN], chunk_ids[chunk].data(), chunk_ids[chunk].size() * sizeof(Uint32));
+}
+
+/**
+ * Random walk at constant density (About one entity per 4x4x4 units), one radius query per entity per tick, checked
+ * against brute force on a sample
+ */
+static int command_spatial_hash_bench(const int argc, const char** argv)
+{
+    std::vector<int> counts;
+    if (argc > 1)
+        counts.push_back(SDL_clamp(atoi(argv[1]), 1, 1000000));
+    else
+        counts = { 1000, 10000, 100000 };
+
+    const int ticks = 10;
+    const float query_radius = 6.0f;
+    int failures = 0;
+
+    for (int count : counts)
+    {
+        Uint32 seed = 12345;
+        auto rand_float = [&seed](float range) {
+            seed = seed * 1664525u + 1013904223u;
+            return ((seed >> 8) / float(1 << 24) * 2.0f - 1.0f) * range;
+        };
+
+        float half_extent = cbrtf(float(count)) * 2.0f;
+        std::vector<float> pos(count * 3);
+        std::vector<float> radius(count);
+        for (int i = 0; i < count; i++)
+        {
+            for (int j = 0; j < 3; j++)
+                pos[i * 3 + j] = rand_float(half_extent);
+            radius[i] = 0.25f + rand_float(0.25f) + 0.25f;
+        }
+
+        spatial_hash_t hash(8.0f);
+        std::vector<spatial_radius_query_t> queries(count);
+        std::vector<Uint32> ids, offsets;
+        double update_s = 0.0, query_s = 0.0;
+        double freq = double(SDL_GetPerformanceFrequency());
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                for (int j = 0; j < 3; j++)
+                    pos[i * 3 + j] = SDL_clamp(pos[i * 3 + j] + rand_float(0.5f), -half_extent, half_extent);
+                hash.set(i, &pos[i * 3], radius[i]);
+                queries[i] = { { pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2] }, query_radius };
+            }
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            hash.update();
+            Uint64 updated = SDL_GetPerformanceCounter();
+            hash.query_radius_batch(queries.data(), queries.size(), ids, offsets);
+            Uint64 queried = SDL_GetPerformanceCounter();
+
+            update_s += (updated - start) / freq;
+            query_s += (queried - updated) / freq;
+        }
+
+        /* Sets compared by count and membership, results are not in any particular order */
+        int mismatches = 0;
+        for (int q = 0; q < count; q += SDL_max(count / 64, 1))
+        {
+            std::vector<bool> expected(count, false);
+            Uint32 num_expected = 0;
+            for (int i = 0; i < count; i++)
+            {
+                float dx = pos[i * 3] - queries[q].center[0], dy = pos[i * 3 + 1] - queries[q].center[1], dz = pos[i * 3 + 2] - queries[q].center[2];
+                float r = query_radius + radius[i];
+                if (dx * dx + dy * dy + dz * dz <= r * r)
+                {
+                    expected[i] = true;
+                    num_expected++;
+                }
+            }
+
+            bool match = offsets[q + 1] - offsets[q] == num_expected;
+            for (Uint32 k = offsets[q]; match && k < offsets[q + 1]; k++)
+                match = expected[ids[k]];
+            mismatches += !match;
+        }
+        failures += mismatches;
+
+        dc_log("spatial_hash_bench: %d entities, %zu buckets, update %.3f ms/tick, %d queries %.3f ms/tick (%.1f hits/query)%s", count,
+            hash.get_bucket_count(), update_s * 1000.0 / ticks, count, query_s * 1000.0 / ticks, double(ids.size()) / count,
+            mismatches ? ", MISMATCHED BRUTE FORCE" : "");
+    }
+
+    return failures ? 1 : 0;
+}
+
+void spatial_hash::init() { dev_console::add_command("spatial_hash_bench", command_spatial_hash_bench); }
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_SPATIAL_HASH_H
+#define MPH_TETRA_GAME_SPATIAL_HASH_H
+
+#include <SDL_bits.h>
+#include <vector>
+
+/**
+ * Query for spatial_hash_t::query_radius_batch()
+ */
+struct spatial_radius_query_t
+{
+    float center[3];
+    float radius;
+};
+
+/**
+ * Loose spatial hash for moving entities (Triggers, pickups, splash damage, homing, AI perception)
+ *
+ * Entities are bounding spheres keyed by dense ids (Entity indices). Each one lives in the cell containing its center,
+ * and queries grow by the largest radius in the table, so nothing has to be inserted into more than one cell.
+ *
+ * Cells are hashed into a power of two number of buckets, and update() lays all entries out bucket by bucket in one
+ * array (Counting sort), so a query touches a few contiguous runs instead of chasing per-cell lists. When nothing
+ * crossed a cell boundary since the last update(), moved entries are patched in place instead.
+ *
+ * set() and remove() only record changes, call update() once per tick before querying. Queries are const and can run
+ * from any number of threads.
+ */
+class spatial_hash_t
+{
+public:
+    /**
+     * @param cell_size Edge length of a cell, around the typical query radius works best
+     */
+    spatial_hash_t(float cell_size = 8.0f);
+
+    /**
+     * Inserts or moves an entity
+     */
+    void set(Uint32 id, const float pos[3], float radius);
+
+    void remove(Uint32 id);
+
+    void clear();
+
+    /**
+     * Applies set() and remove() calls since the last update()
+     */
+    void update();
+
+    /**
+     * Appends the ids of entities whose sphere overlaps the query sphere
+     *
+     * @returns Number of ids appended
+     */
+    size_t query_radius(const float center[3], float radius, std::vector<Uint32>& out) const;
+
+    /**
+     * Appends the ids of entities whose sphere overlaps the box
+     *
+     * @returns Number of ids appended
+     */
+    size_t query_aabb(const float min[3], const float max[3], std::vector<Uint32>& out) const;
+
+    /**
+     * Runs radius queries in parallel on the job system
+     *
+     * @param queries Queries
+     * @param count Number of queries
+     * @param ids Results of all queries back to back (Overwritten)
+     * @param offsets Results of query i are ids[offsets[i]] to ids[offsets[i + 1]] (Overwritten, count + 1 entries)
+     */
+    void query_radius_batch(const spatial_radius_query_t* queries, size_t count, std::vector<Uint32>& ids, std::vector<Uint32>& offsets) const;
+
+    inline size_t get_entity_count() const { return _entries.size(); }
+    inline size_t get_bucket_count() const { return _bucket_start.empty() ? 0 : _bucket_start.size() - 1; }
+
+private:
+    struct entry_t
+    {
+        float pos[3];
+        float radius;
+        int cell[3];
+        Uint32 id;
+    };
+
+    struct entity_t
+    {
+        float pos[3];
+        float radius;
+        int cell[3];
+        /** Index in _entries, or SPATIAL_SLOT_NONE if not in the table yet */
+        Uint32 slot;
+        bool alive;
+        bool dirty;
+    };
+
+    inline void get_cell(const float pos[3], int cell[3]) const;
+    inline Uint32 get_bucket(const int cell[3]) const;
+
+    void rebuild();
+
+    /**
+     * Calls func(entry) for every entry in cells overlapping [min, max] grown by the largest radius
+     */
+    template <typename F>
+    void for_each_candidate(const float min[3], const float max[3], F func) const;
+
+    float _cell_size;
+    float _inv_cell_size;
+
+    std::vector<entity_t> _entities;
+    std::vector<Uint32> _dirty;
+    bool _needs_rebuild;
+
+    Uint32 _bucket_mask;
+    std::vector<Uint32> _bucket_start;
+    std::vector<entry_t> _entries;
+    float _max_radius;
+};
+
+namespace spatial_hash
+{
+/**
+ * Registers the spatial_hash_bench console command
+ */
+void init();
+};
+
+#endif
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "transform.h"
+
+#include "gui/console.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define INDEX_NONE ((Uint32)-1)
+
+/* Subtrees smaller than this are not worth splitting up for the job system */
+#define SPLIT_THRESHOLD 2048
+/* Below this many dirty nodes update() stays on the calling thread */
+#define PARALLEL_THRESHOLD 4096
+
+static profiler_zone_t zone_update("transform_hierarchy_t::update");
+
+mat4x3_t mat4x3_t::identity()
+{
+    mat4x3_t out = {
+        { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } },
+    };
+    return out;
+}
+
+mat4x3_t mat4x3_t::from_srt(const float scale[3], const float rotation[3], const float translation[3])
+{
+    float sx = sinf(rotation[0]), cx = cosf(rotation[0]);
+    float sy = sinf(rotation[1]), cy = cosf(rotation[1]);
+    float sz = sinf(rotation[2]), cz = cosf(rotation[2]);
+
+    /* R = Rz * Ry * Rx */
+    float r[3][3] = {
+        { cy * cz, sx * sy * cz - cx * sz, cx * sy * cz + sx * sz },
+        { cy * sz, sx * sy * sz + cx * cz, cx * sy * sz - sx * cz },
+        { -sy, sx * cy, cx * cy },
+    };
+
+    mat4x3_t out;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            out.m[i][j] = r[i][j] * scale[j];
+        out.m[i][3] = translation[i];
+    }
+    return out;
+}
+
+void mat4x3_t::mul(const mat4x3_t& a, const mat4x3_t& b, mat4x3_t& out)
+{
+#ifdef __SSE__
+    /* Each output row is a linear combination of the rows of b (plus translation), 3 rows = 12 multiply-adds in 4 wide */
+    const __m128 b0 = _mm_loadu_ps(b.m[0]);
+    const __m128 b1 = _mm_loadu_ps(b.m[1]);
+    const __m128 b2 = _mm_loadu_ps(b.m[2]);
+    const __m128 w_mask = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < 3; i++)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), w_mask));
+        _mm_storeu_ps(out.m[i], row);
+    }
+#else
+    mat4x3_t tmp;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            tmp.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+        tmp.m[i][3] += a.m[i][3];
+    }
+    out = tmp;
+#endif
+}
+
+transform_handle_t transform_hierarchy_t::create(transform_handle_t parent, const mat4x3_t& local)
+{
+    Uint32 parent_index = parent == TRANSFORM_NONE ? INDEX_NONE : _handle_to_index[parent];
+    Uint32 index = parent_index == INDEX_NONE ? _local.size() : parent_index + _subtree_size[parent_index];
+
+    for (Uint32 i = parent_index; i != INDEX_NONE; i = _parent[i])
+        _subtree_size[i]++;
+
+    /* Only nodes after the insertion point can have a parent at or after it */
+    for (Uint32 i = index; i < _parent.size(); i++)
+        if (_parent[i] != INDEX_NONE && _parent[i] >= index)
+            _parent[i]++;
+
+    transform_handle_t handle;
+    if (_free_handles.size())
+    {
+        handle = _free_handles.back();
+        _free_handles.pop_back();
+    }
+    else
+    {
+        handle = _handle_to_index.size();
+        _handle_to_index.push_back(INDEX_NONE);
+    }
+
+    _local.insert(_local.begin() + index, local);
+    _world.insert(_world.begin() + index, local);
+    _parent.insert(_parent.begin() + index, parent_index);
+    _subtree_size.insert(_subtree_size.begin() + index, 1);
+    _index_to_handle.insert(_index_to_handle.begin() + index, handle);
+
+    for (Uint32 i = index; i < _index_to_handle.size(); i++)
+        _handle_to_index[_index_to_handle[i]] = i;
+
+    _dirty.push_back(handle);
+
+    return handle;
+}
+
+void transform_hierarchy_t::destroy(transform_handle_t handle)
+{
+    Uint32 index = _handle_to_index[handle];
+    if (index == INDEX_NONE)
+        return;
+
+    Uint32 count = _subtree_size[index];
+    Uint32 end = index + count;
+
+    for (Uint32 i = _parent[index]; i != INDEX_NONE; i = _parent[i])
+        _subtree_size[i] -= count;
+
+    for (Uint32 i = index; i < end; i++)
+    {
+        _handle_to_index[_index_to_handle[i]] = INDEX_NONE;
+        _free_handles.push_back(_index_to_handle[i]);
+    }
+
+    for (Uint32 i = end; i < _parent.size(); i++)
+        if (_parent[i] != INDEX_NONE && _parent[i] >= end)
+            _parent[i] -= count;
+
+    _local.erase(_local.begin() + index, _local.begin() + end);
+    _world.erase(_world.begin() + index, _world.begin() + end);
+    _parent.erase(_parent.begin() + index, _parent.begin() + end);
+    _subtree_size.erase(_subtree_size.begin() + index, _subtree_size.begin() + end);
+    _index_to_handle.erase(_index_to_handle.begin() + index, _index_to_handle.begin() + end);
+
+    for (Uint32 i = index; i < _index_to_handle.size(); i++)
+        _handle_to_index[_index_to_handle[i]] = i;
+}
+
+void transform_hierarchy_t::set_local(transform_handle_t handle, const mat4x3_t& local)
+{
+    _local[_handle_to_index[handle]] = local;
+    _dirty.push_back(handle);
+}
+
+transform_handle_t transform_hierarchy_t::get_parent(transform_handle_t handle)
+{
+    Uint32 parent = _parent[_handle_to_index[handle]];
+    return parent == INDEX_NONE ? TRANSFORM_NONE : _index_to_handle[parent];
+}
+
+void transform_hierarchy_t::update_range(Uint32 begin, Uint32 end)
+{
+    for (Uint32 i = begin; i < end; i++)
+    {
+        if (_parent[i] == INDEX_NONE)
+            _world[i] = _local[i];
+        else
+            mat4x3_t::mul(_world[_parent[i]], _local[i], _world[i]);
+    }
+}
+
+void transform_hierarchy_t::update()
+{
+    PROFILER_SCOPE(zone_update);
+
+    _dirty_indices.clear();
+    for (size_t i = 0; i < _dirty.size(); i++)
+        if (_handle_to_index[_dirty[i]] != INDEX_NONE)
+            _dirty_indices.push_back(_handle_to_index[_dirty[i]]);
+    _dirty.clear();
+
+    /* Merge dirty nodes into disjoint subtree ranges, a node inside an already dirty subtree adds nothing */
+    _ranges.clear();
+    size_t total = 0;
+
+    /* Sorting is cheaper while few nodes are dirty, past that a linear scan over per node flags wins */
+    if (_dirty_indices.size() * 16 < _local.size())
+    {
+        std::sort(_dirty_indices.begin(), _dirty_indices.end());
+        Uint32 covered_end = 0;
+        for (size_t i = 0; i < _dirty_indices.size(); i++)
+        {
+            Uint32 index = _dirty_indices[i];
+            if (index < covered_end)
+                continue;
+            range_t range = { index, index + _subtree_size[index] };
+            _ranges.push_back(range);
+            covered_end = range.end;
+            total += range.end - range.begin;
+        }
+    }
+    else
+    {
+        _dirty_flags.assign(_local.size(), 0);
+        for (size_t i = 0; i < _dirty_indices.size(); i++)
+            _dirty_flags[_dirty_indices[i]] = 1;
+
+        for (Uint32 index = 0; index < _dirty_flags.size();)
+        {
+            if (!_dirty_flags[index])
+            {
+                index++;
+                continue;
+            }
+            range_t range = { index, index + _subtree_size[index] };
+            _ranges.push_back(range);
+            total += range.end - range.begin;
+            index = range.end;
+        }
+    }
+
+    _last_update_count = total;
+
+    int num_threads = jobs::get_thread_count();
+    if (total < PARALLEL_THRESHOLD || num_threads == 1)
+    {
+        for (size_t i = 0; i < _ranges.size(); i++)
+            update_range(_ranges[i].begin, _ranges[i].end);
+        return;
+    }
+
+    /**
+     * A moving root would otherwise be a single range, split large ranges into the subtrees of their children
+     * (after computing the root itself) until the work can be spread over every thread
+     */
+    size_t split_size = SDL_max(size_t(SPLIT_THRESHOLD), total / (num_threads * 4));
+    for (size_t i = 0; i < _ranges.size(); i++)
+    {
+        range_t range = _ranges[i];
+        if (range.end - range.begin <= split_size)
+            continue;
+
+        update_range(range.begin, range.begin + 1);
+
+        Uint32 child = range.begin + 1;
+        if (child == range.end)
+            continue;
+
+        _ranges[i] = { child, child + _subtree_size[child] };
+        for (child += _subtree_size[child]; child < range.end; child += _subtree_size[child])
+            _ranges.push_back({ child, child + _subtree_size[child] });
+
+        /* Re-examine the replacement range, it may still be too large */
+        i--;
+    }
+
+    int grain = SDL_max(1, int(_ranges.size() / (num_threads * 4)));
+    jobs::parallel_for(_ranges.size(), grain, [this](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            update_range(_ranges[i].begin, _ranges[i].end);
+    });
+}
+
+/**
+ * Builds a forest of random trees and measures update() with a percentage of nodes moving each frame
+ */
+static int command_transform_bench(const int argc, const char** argv)
+{
+    int num_nodes = 100000;
+    int moving_percent = 5;
+    int iterations = 100;
+
+    if (argc > 1)
+        num_nodes = SDL_max(atoi(argv[1]), 1);
+    if (argc > 2)
+        moving_percent = SDL_clamp(atoi(argv[2]), 0, 100);
+    if (argc > 3)
+        iterations = SDL_max(atoi(argv[3]), 1);
+
+    Uint32 seed = 0xC0FFEE;
+    auto rand_next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    transform_hierarchy_t hierarchy;
+    std::vector<transform_handle_t> handles;
+    std::vector<transform_handle_t> stack;
+    handles.reserve(num_nodes);
+
+    /**
+     * Always attaching to a node on the current DFS path keeps create() appending at the end
+     *
+     * Trees are kept to ~64 nodes and 8 levels, roughly a model with attached effects
+     */
+    for (int i = 0; i < num_nodes; i++)
+    {
+        if (stack.size() && rand_next() % 64 == 0)
+            stack.clear();
+        while (stack.size() > 1 && (stack.size() >= 8 || rand_next() % 2 == 0))
+            stack.pop_back();
+
+        float scale[3] = { 1, 1, 1 };
+        float rot[3] = { (rand_next() % 628) / 100.0f, (rand_next() % 628) / 100.0f, 0 };
+        float pos[3] = { (rand_next() % 200) / 100.0f, 1, 0 };
+        transform_handle_t handle = hierarchy.create(stack.size() ? stack.back() : TRANSFORM_NONE, mat4x3_t::from_srt(scale, rot, pos));
+        handles.push_back(handle);
+        stack.push_back(handle);
+    }
+    hierarchy.update();
+
+    int num_moving = (Sint64)num_nodes * moving_percent / 100;
+    Uint64 recomputed = 0;
+    Uint64 elapsed = 0;
+    for (int it = 0; it < iterations; it++)
+    {
+        for (int i = 0; i < num_moving; i++)
+        {
+            transform_handle_t handle = handles[rand_next() % handles.size()];
+            mat4x3_t local = hierarchy.get_local(handle);
+            local.m[1][3] += 0.01f;
+            hierarchy.set_local(handle, local);
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        hierarchy.update();
+        elapsed += SDL_GetPerformanceCounter() - start;
+        recomputed += hierarchy.get_last_update_count();
+    }
+
+    double us = double(elapsed) * 1000000.0 / double(SDL_GetPerformanceFrequency()) / iterations;
+    dc_log("transform_bench: %d nodes, %d moving (%d%%), %d threads", num_nodes, num_moving, moving_percent, jobs::get_thread_count());
+    dc_log("transform_bench: %.1f us per update, %.0f matrices recomputed per update", us, double(recomputed) / iterations);
+
+    return 0;
+}
+
+void transform::init() { dev_console::add_command("transform_bench", command_transform_bench); }
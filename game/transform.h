@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GAME_TRANSFORM_H
+#define MPH_TETRA_GAME_TRANSFORM_H
+
+#include <SDL_bits.h>
+#include <vector>
+
+/**
+ * Affine transform, 3 rows of [rotation/scale | translation] (The implied 4th row is 0 0 0 1)
+ */
+struct mat4x3_t
+{
+    float m[3][4];
+
+    static mat4x3_t identity();
+
+    /**
+     * Builds a matrix from scale, XYZ euler rotation (radians), and translation (Applied in that order)
+     */
+    static mat4x3_t from_srt(const float scale[3], const float rotation[3], const float translation[3]);
+
+    /**
+     * out = a * b, out may alias a or b
+     */
+    static void mul(const mat4x3_t& a, const mat4x3_t& b, mat4x3_t& out);
+};
+
+typedef Uint32 transform_handle_t;
+#define TRANSFORM_NONE ((transform_handle_t)-1)
+
+/**
+ * Transform hierarchy stored as flat arrays in depth first order
+ *
+ * Every subtree occupies a contiguous range [index, index + subtree_size), so a parent is always before its children
+ * and a dirty node's subtree can be recomputed with a single forward pass. Nodes that were not touched since the
+ * last update() are not visited at all, so the cost of update() follows the amount of movement, not the node count.
+ *
+ * Nodes are referenced through stable handles, indices shift when nodes are created or destroyed.
+ * Creating and destroying nodes is O(n) and is meant for load time / spawning, not per frame use.
+ */
+class transform_hierarchy_t
+{
+public:
+    /**
+     * Creates a node as the last child of `parent` (or as a new root)
+     */
+    transform_handle_t create(transform_handle_t parent = TRANSFORM_NONE, const mat4x3_t& local = mat4x3_t::identity());
+
+    /**
+     * Destroys a node and all of its children
+     */
+    void destroy(transform_handle_t handle);
+
+    void set_local(transform_handle_t handle, const mat4x3_t& local);
+    inline const mat4x3_t& get_local(transform_handle_t handle) { return _local[_handle_to_index[handle]]; }
+
+    /**
+     * World transform as of the last update()
+     */
+    inline const mat4x3_t& get_world(transform_handle_t handle) { return _world[_handle_to_index[handle]]; }
+
+    transform_handle_t get_parent(transform_handle_t handle);
+
+    /**
+     * Recomputes world transforms of all dirty subtrees, independent subtrees are spread over the job system
+     */
+    void update();
+
+    inline size_t size() { return _local.size(); }
+
+    /**
+     * Number of world matrices recomputed by the last update()
+     */
+    inline size_t get_last_update_count() { return _last_update_count; }
+
+private:
+    struct range_t
+    {
+        Uint32 begin;
+        Uint32 end;
+    };
+
+    void update_range(Uint32 begin, Uint32 end);
+
+    /* Per index (Depth first order) */
+    std::vector<mat4x3_t> _local;
+    std::vector<mat4x3_t> _world;
+    std::vector<Uint32> _parent;
+    std::vector<Uint32> _subtree_size;
+    std::vector<transform_handle_t> _index_to_handle;
+
+    /* Per handle */
+    std::vector<Uint32> _handle_to_index;
+    std::vector<transform_handle_t> _free_handles;
+
+    /**
+     * Handles of nodes changed since the last update(), handles instead of indices since indices shift on create/destroy
+     */
+    std::vector<transform_handle_t> _dirty;
+    std::vector<Uint32> _dirty_indices;
+    std::vector<Uint8> _dirty_flags;
+    std::vector<range_t> _ranges;
+
+    size_t _last_update_count = 0;
+};
+
+namespace transform
+{
+/**
+ * Registers the transform_bench console command
+ */
+void init();
+};
+
+#endif
@@ -23,10 +23,13 @@
 
 #include "gui_registrar.h"
 #include "imgui.h"
+#include "thumbnail_cache.h"
 #include "util/convar.h"
 #include "util/physfs/physfs.h"
 
 static convar_int_t cl_physfs_browser("cl_physfs_browser", 0, 0, 1, "Display the PhysicsFS (physfs) browser", CONVAR_FLAG_INT_IS_BOOL);
+static convar_int_t cl_physfs_browser_thumbnails(
+    "cl_physfs_browser_thumbnails", 1, 0, 1, "Show thumbnails for supported files in the PhysicsFS (physfs) browser", CONVAR_FLAG_INT_IS_BOOL);
 
 static const ImGuiTreeNodeFlags tree_flags_dir = ImGuiTreeNodeFlags_SpanAllColumns;
 static const ImGuiTreeNodeFlags tree_flags_file = tree_flags_dir | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_Bullet | ImGuiTreeNodeFlags_NoTreePushOnOpen;
@@ -74,6 +77,13 @@ static void recurse_path(std::string& path, const char* name)
     ImGui::TableNextColumn();
     ImGui::TextUnformatted(stat.readonly ? "R" : "RW");
 
+    if (cl_physfs_browser_thumbnails.get())
+    {
+        ImGui::TableNextColumn();
+        if (!is_dir)
+            thumbnail_cache::draw(path.c_str(), ImGui::GetTextLineHeight());
+    }
+
     if (open)
     {
         char** rc = PHYSFS_enumerateFiles(path.c_str());
@@ -98,12 +108,18 @@ static void display_fs(std::string path = "", const char* name = "/")
     ImGuiTableFlags flags = ImGuiTableFlags_BordersV | ImGuiTableFlags_BordersOuterH | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg
         | ImGuiTableFlags_NoBordersInBody | ImGuiTableFlags_NoSavedSettings;
 
-    if (ImGui::BeginTable("physfs_dir_browser", 4, flags))
+    bool thumbnails = cl_physfs_browser_thumbnails.get();
+    if (thumbnails)
+        thumbnail_cache::update();
+
+    if (ImGui::BeginTable("physfs_dir_browser", thumbnails ? 5 : 4, flags))
     {
         ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_NoHide);
         ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("1234567890").x);
         ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("Directory ").x);
         ImGui::TableSetupColumn("Flags", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("Flags").x);
+        if (thumbnails)
+            ImGui::TableSetupColumn("Preview", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("Preview").x);
         ImGui::TableHeadersRow();
 
         recurse_path(path, name);
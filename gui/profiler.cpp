@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gui_registrar.h"
+#include "imgui.h"
+#include "util/convar.h"
+#include "util/profiler.h"
+
+#include <SDL_timer.h>
+
+static convar_int_t cl_profiler("cl_profiler", 0, 0, 1, "Display the profiler zones window", CONVAR_FLAG_INT_IS_BOOL);
+
+static bool render_profiler()
+{
+    if (!cl_profiler.get())
+        return false;
+
+    ImGui::SetNextWindowSize(ImVec2(720, 300), ImGuiCond_FirstUseEver);
+
+    if (ImGui::BeginCVR("Profiler", &cl_profiler))
+    {
+        convar_t* hw_counters = convar_t::get_convar("dev_profiler_hw_counters");
+        if (hw_counters)
+            hw_counters->imgui_edit();
+
+        if (profiler::counters_enabled())
+        {
+            const char* reason = profiler::counters_unavailable_reason();
+            if (reason)
+                ImGui::TextDisabled("Hardware counters unavailable: %s", reason);
+        }
+
+        std::vector<profiler_zone_t*>* zones = profiler_zone_t::get_zone_list();
+
+        if (ImGui::Button("Reset"))
+            for (size_t i = 0; i < zones->size(); i++)
+                zones->at(i)->reset();
+
+        ImGuiTableFlags flags = ImGuiTableFlags_BordersV | ImGuiTableFlags_BordersOuterH | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg
+            | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_SizingFixedFit;
+
+        if (ImGui::BeginTable("profiler_zones", 7, flags))
+        {
+            ImGui::TableSetupColumn("Zone", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Calls");
+            ImGui::TableSetupColumn("Total (ms)");
+            ImGui::TableSetupColumn("Avg (us)");
+            ImGui::TableSetupColumn("IPC");
+            ImGui::TableSetupColumn("LLC MPKI");
+            ImGui::TableSetupColumn("Branch MPKI");
+            ImGui::TableHeadersRow();
+
+            double freq = (double)SDL_GetPerformanceFrequency();
+
+            for (size_t i = 0; i < zones->size(); i++)
+            {
+                profiler_zone_t::stats_t stats = zones->at(i)->get_stats();
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(zones->at(i)->get_name());
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)stats.calls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.ticks * 1000.0 / freq);
+                ImGui::TableNextColumn();
+                if (stats.calls)
+                    ImGui::Text("%.2f", stats.ticks * 1000000.0 / freq / stats.calls);
+                else
+                    ImGui::TextDisabled("--");
+
+                if (stats.counted_calls && stats.cycles && stats.instructions)
+                {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", (double)stats.instructions / (double)stats.cycles);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", stats.llc_misses * 1000.0 / stats.instructions);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", stats.branch_misses * 1000.0 / stats.instructions);
+                }
+                else
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        ImGui::TableNextColumn();
+                        ImGui::TextDisabled("--");
+                    }
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+
+    return cl_profiler.get();
+}
+
+static gui_register_menu reg_gui(render_profiler);
@@ -0,0 +1,672 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "thumbnail_cache.h"
+
+#include "console.h"
+#include "imgui.h"
+
+#include "render/gl.h"
+#include "render/sprite_batch.h"
+#include "util/convar.h"
+#include "util/hash.h"
+#include "util/jobs.h"
+#include "util/nds.h"
+#include "util/physfs/physfs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define THUMBNAIL_CACHE_DIR "/cache/thumbnails"
+/* "MTTN" */
+#define THUMBNAIL_CACHE_MAGIC 0x4E54544D
+/* Bump whenever a generator changes its output */
+#define THUMBNAIL_CACHE_VERSION 1
+
+#define THUMBNAIL_ATLAS_SIZE 1024
+#define THUMBNAIL_ATLAS_CELLS_PER_ROW (THUMBNAIL_ATLAS_SIZE / THUMBNAIL_SIZE)
+#define THUMBNAIL_ATLAS_CELLS (THUMBNAIL_ATLAS_CELLS_PER_ROW * THUMBNAIL_ATLAS_CELLS_PER_ROW)
+
+/* Whole file generators give up on anything larger than this */
+#define THUMBNAIL_MAX_FILE_SIZE (16 << 20)
+
+#define THUMBNAIL_BYTES (THUMBNAIL_SIZE * THUMBNAIL_SIZE * 4)
+
+static convar_int_t thumbnail_cache_disk("thumbnail_cache_disk", 1, 0, 1, "Store generated thumbnails in " THUMBNAIL_CACHE_DIR, CONVAR_FLAG_INT_IS_BOOL);
+
+static profiler_zone_t zone_update("thumbnail_cache::update");
+
+/* ================================ Generators (Run on worker threads) ================================ */
+
+struct generator_t
+{
+    const char* extension;
+    /**
+     * Reads the bytes the thumbnail depends on (From fd, or other files next to path), the cache key is a hash of these
+     */
+    bool (*load)(const char* path, PHYSFS_File* fd, std::vector<Uint8>& data);
+    /**
+     * Renders data into a THUMBNAIL_SIZE x THUMBNAIL_SIZE RGBA image (Zeroed beforehand)
+     */
+    bool (*generate)(const std::vector<Uint8>& data, Uint8* rgba);
+};
+
+static bool load_whole_file(const char*, PHYSFS_File* fd, std::vector<Uint8>& data)
+{
+    PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+    if (len <= 0 || len > THUMBNAIL_MAX_FILE_SIZE)
+        return false;
+
+    data.resize(len);
+    return PHYSFS_readBytes(fd, data.data(), len) == len;
+}
+
+/**
+ * Scales an RGBA image to fit the thumbnail while keeping its aspect ratio
+ *
+ * Box filtered when shrinking and nearest neighbor when growing, so palettes and icons stay sharp
+ */
+static void fit_rgba(const Uint8* src, int w, int h, int stride, Uint8* dst)
+{
+    int dw = THUMBNAIL_SIZE;
+    int dh = THUMBNAIL_SIZE;
+    if (w > h)
+        dh = SDL_max(1, h * THUMBNAIL_SIZE / w);
+    else
+        dw = SDL_max(1, w * THUMBNAIL_SIZE / h);
+
+    dst += ((THUMBNAIL_SIZE - dh) / 2 * THUMBNAIL_SIZE + (THUMBNAIL_SIZE - dw) / 2) * 4;
+
+    for (int y = 0; y < dh; y++)
+    {
+        int sy0 = (Sint64)y * h / dh;
+        int sy1 = SDL_max(sy0 + 1, (int)((Sint64)(y + 1) * h / dh));
+
+        for (int x = 0; x < dw; x++)
+        {
+            int sx0 = (Sint64)x * w / dw;
+            int sx1 = SDL_max(sx0 + 1, (int)((Sint64)(x + 1) * w / dw));
+
+            /* Alpha weighted so transparent texels don't darken the edges */
+            Uint64 sum[4] = { 0, 0, 0, 0 };
+            for (int sy = sy0; sy < sy1; sy++)
+            {
+                const Uint8* p = src + (size_t)sy * stride + sx0 * 4;
+                for (int sx = sx0; sx < sx1; sx++, p += 4)
+                {
+                    sum[0] += p[0] * p[3];
+                    sum[1] += p[1] * p[3];
+                    sum[2] += p[2] * p[3];
+                    sum[3] += p[3];
+                }
+            }
+
+            Uint8* out = dst + (y * THUMBNAIL_SIZE + x) * 4;
+            if (sum[3])
+            {
+                out[0] = sum[0] / sum[3];
+                out[1] = sum[1] / sum[3];
+                out[2] = sum[2] / sum[3];
+                out[3] = sum[3] / ((sy1 - sy0) * (sx1 - sx0));
+            }
+        }
+    }
+}
+
+static inline void bgr555_to_rgba(Uint16 color, Uint8* out)
+{
+    Uint8 r = color & 0x1F, g = (color >> 5) & 0x1F, b = (color >> 10) & 0x1F;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 3) | (g >> 2);
+    out[2] = (b << 3) | (b >> 2);
+    out[3] = 255;
+}
+
+static bool generate_bmp(const std::vector<Uint8>& data, Uint8* rgba)
+{
+    SDL_Surface* loaded = SDL_LoadBMP_RW(SDL_RWFromConstMem(data.data(), data.size()), 1);
+    if (!loaded)
+        return false;
+
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface)
+        return false;
+
+    SDL_LockSurface(surface);
+    fit_rgba((const Uint8*)surface->pixels, surface->w, surface->h, surface->pitch, rgba);
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+
+    return true;
+}
+
+/**
+ * Raw NDS palettes (BGR555), drawn as a grid of swatches
+ */
+static bool generate_palette(const std::vector<Uint8>& data, Uint8* rgba)
+{
+    int count = SDL_min(data.size() / 2, 256);
+    if (!count)
+        return false;
+
+    int cols = 1;
+    while (cols * cols < count)
+        cols++;
+    int rows = (count + cols - 1) / cols;
+
+    std::vector<Uint8> swatches(cols * rows * 4, 0);
+    for (int i = 0; i < count; i++)
+        bgr555_to_rgba(data[i * 2] | (data[i * 2 + 1] << 8), &swatches[i * 4]);
+
+    fit_rgba(swatches.data(), cols, rows, cols * 4, rgba);
+    return true;
+}
+
+/* From GBATEK: DS Cartridge Icon/Title */
+#define NDS_ICON_BITMAP_OFFSET 0x20
+#define NDS_ICON_BITMAP_SIZE 0x200
+#define NDS_ICON_PALETTE_SIZE 0x20
+
+/**
+ * ROM images, only the banner icon is read
+ */
+static bool load_nds(const char*, PHYSFS_File* fd, std::vector<Uint8>& data)
+{
+    char raw[NDS_CARTRIDGE_HEADER_SIZE];
+    if (PHYSFS_readBytes(fd, raw, sizeof(raw)) != sizeof(raw))
+        return false;
+
+    nds_cartridge_header_t header(raw);
+    if (!header.seems_valid_enough(false) || !header.icon_title_offset)
+        return false;
+
+    data.resize(NDS_ICON_BITMAP_SIZE + NDS_ICON_PALETTE_SIZE);
+    if (!PHYSFS_seek(fd, header.icon_title_offset + NDS_ICON_BITMAP_OFFSET))
+        return false;
+    return PHYSFS_readBytes(fd, data.data(), data.size()) == (PHYSFS_sint64)data.size();
+}
+
+/**
+ * 32x32 4bpp icon stored as 4x4 tiles of 8x8 texels, palette index 0 is transparent
+ */
+static bool generate_nds(const std::vector<Uint8>& data, Uint8* rgba)
+{
+    Uint8 palette[16][4];
+    for (int i = 0; i < 16; i++)
+        bgr555_to_rgba(data[NDS_ICON_BITMAP_SIZE + i * 2] | (data[NDS_ICON_BITMAP_SIZE + i * 2 + 1] << 8), palette[i]);
+    palette[0][3] = 0;
+
+    Uint8 icon[32 * 32 * 4];
+    for (int i = 0; i < NDS_ICON_BITMAP_SIZE * 2; i++)
+    {
+        int tile = i / 64, texel = i % 64;
+        int x = (tile % 4) * 8 + texel % 8;
+        int y = (tile / 4) * 8 + texel / 8;
+        int index = (data[i / 2] >> ((i & 1) * 4)) & 0xF;
+        memcpy(&icon[(y * 32 + x) * 4], palette[index], 4);
+    }
+
+    fit_rgba(icon, 32, 32, 32 * 4, rgba);
+    return true;
+}
+
+/* Tiled texture sheets are laid out this many tiles wide, like most tile viewers do */
+#define THUMBNAIL_TILES_PER_ROW 16
+/* Only the start of large sheets is shown */
+#define THUMBNAIL_MAX_TILES (THUMBNAIL_TILES_PER_ROW * THUMBNAIL_TILES_PER_ROW)
+
+/**
+ * Raw NDS character data (Tiled 4bpp/8bpp textures), with the palette of the same name (.pal) if there is one
+ *
+ * data is the size of the character data (Uint32), the character data, then the palette
+ */
+static bool load_chr(const char* path, PHYSFS_File* fd, std::vector<Uint8>& data)
+{
+    std::vector<Uint8> chars;
+    if (!load_whole_file(path, fd, chars))
+        return false;
+
+    Uint32 chars_size = chars.size();
+    data.resize(sizeof(chars_size));
+    memcpy(data.data(), &chars_size, sizeof(chars_size));
+    data.insert(data.end(), chars.begin(), chars.end());
+
+    std::string palette_path(path);
+    palette_path.replace(palette_path.size() - 4, 4, ".pal");
+    PHYSFS_File* palette_fd = PHYSFS_openRead(palette_path.c_str());
+    if (palette_fd)
+    {
+        std::vector<Uint8> palette;
+        if (load_whole_file(palette_path.c_str(), palette_fd, palette))
+            data.insert(data.end(), palette.begin(), palette.end());
+        PHYSFS_close(palette_fd);
+    }
+
+    return true;
+}
+
+/**
+ * A palette of at most 16 colors means 4bpp data, anything larger 8bpp. Without a palette the data is assumed to be
+ * 4bpp and drawn with a grayscale ramp.
+ */
+static bool generate_chr(const std::vector<Uint8>& data, Uint8* rgba)
+{
+    Uint32 chars_size;
+    memcpy(&chars_size, data.data(), sizeof(chars_size));
+    const Uint8* chars = data.data() + sizeof(chars_size);
+    size_t palette_colors = SDL_min((data.size() - sizeof(chars_size) - chars_size) / 2, 256);
+
+    std::vector<Uint8> palette(chars + chars_size, chars + chars_size + palette_colors * 2);
+    int bpp = palette_colors > 16 ? 8 : 4;
+    if (!palette_colors)
+    {
+        palette_colors = 16;
+        for (int i = 0; i < 16; i++)
+        {
+            Uint16 level = i * 31 / 15;
+            Uint16 color = level | (level << 5) | (level << 10);
+            palette.push_back(color & 0xFF);
+            palette.push_back(color >> 8);
+        }
+    }
+
+    int tiles = SDL_min(chars_size / (8 * bpp), THUMBNAIL_MAX_TILES);
+    if (!tiles)
+        return false;
+
+    int width = SDL_min(tiles, THUMBNAIL_TILES_PER_ROW) * 8;
+    int height = (tiles + THUMBNAIL_TILES_PER_ROW - 1) / THUMBNAIL_TILES_PER_ROW * 8;
+
+    /* The last row of tiles may be partial, pad it with transparent tiles */
+    std::vector<Uint8> padded(chars, chars + tiles * 8 * bpp);
+    padded.resize(size_t(width / 8) * (height / 8) * 8 * bpp, 0);
+
+    std::vector<Uint8> sheet(size_t(width) * height * 4);
+    render::decode_tiles(padded.data(), palette.data(), palette_colors, width, height, bpp, 0, sheet.data());
+    fit_rgba(sheet.data(), width, height, width * 4, rgba);
+    return true;
+}
+
+/**
+ * Model files are not covered, nothing in the tree parses them yet
+ */
+static const generator_t generators[] = {
+    { ".bmp", load_whole_file, generate_bmp },
+    { ".pal", load_whole_file, generate_palette },
+    { ".chr", load_chr, generate_chr },
+    { ".nds", load_nds, generate_nds },
+};
+
+static const generator_t* find_generator(const char* path)
+{
+    size_t len = strlen(path);
+    for (size_t i = 0; i < SDL_arraysize(generators); i++)
+    {
+        size_t ext_len = strlen(generators[i].extension);
+        if (len >= ext_len && !SDL_strcasecmp(path + len - ext_len, generators[i].extension))
+            return &generators[i];
+    }
+    return NULL;
+}
+
+/* ================================ Disk cache ================================ */
+
+struct cache_file_header_t
+{
+    Uint32 magic;
+    Uint32 version;
+    /* Failed generations are cached too, so broken files aren't retried every launch */
+    Uint32 has_image;
+};
+
+static std::string get_cache_path(Uint64 key)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), THUMBNAIL_CACHE_DIR "/%016llx.bin", (unsigned long long)key);
+    return buf;
+}
+
+static bool load_from_disk(Uint64 key, std::vector<Uint8>& rgba)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(get_cache_path(key).c_str());
+    if (!fd)
+        return false;
+
+    cache_file_header_t header;
+    bool success = PHYSFS_readBytes(fd, &header, sizeof(header)) == sizeof(header) && header.magic == THUMBNAIL_CACHE_MAGIC
+        && header.version == THUMBNAIL_CACHE_VERSION;
+
+    if (success && header.has_image)
+    {
+        rgba.resize(THUMBNAIL_BYTES);
+        success = PHYSFS_readBytes(fd, rgba.data(), rgba.size()) == THUMBNAIL_BYTES;
+    }
+    PHYSFS_close(fd);
+
+    if (!success)
+        rgba.clear();
+    return success;
+}
+
+static void store_to_disk(Uint64 key, const std::vector<Uint8>& rgba)
+{
+    if (!PHYSFS_mkdir(THUMBNAIL_CACHE_DIR))
+    {
+        dc_log_warn("Unable to create " THUMBNAIL_CACHE_DIR ": %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    std::string path = get_cache_path(key);
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+    {
+        dc_log_warn("Unable to open %s for writing: %s", path.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    cache_file_header_t header = { THUMBNAIL_CACHE_MAGIC, THUMBNAIL_CACHE_VERSION, !rgba.empty() };
+    bool success = PHYSFS_writeBytes(fd, &header, sizeof(header)) == sizeof(header)
+        && PHYSFS_writeBytes(fd, rgba.data(), rgba.size()) == (PHYSFS_sint64)rgba.size();
+    PHYSFS_close(fd);
+
+    if (!success)
+        PHYSFS_delete(path.c_str());
+}
+
+/* ================================ Jobs ================================ */
+
+struct result_t
+{
+    std::string path;
+    /* Empty if there is no thumbnail */
+    std::vector<Uint8> rgba;
+};
+
+static SDL_mutex* results_lock = NULL;
+static std::vector<result_t> results;
+
+static struct
+{
+    SDL_atomic_t disk_hits;
+    SDL_atomic_t generated;
+    SDL_atomic_t failed;
+} stats;
+
+static void generate_job(const std::string& path, const generator_t* generator, bool use_disk)
+{
+    result_t result;
+    result.path = path;
+
+    std::vector<Uint8> data;
+    PHYSFS_File* fd = PHYSFS_openRead(path.c_str());
+    bool loaded = fd && generator->load(path.c_str(), fd, data);
+    if (fd)
+        PHYSFS_close(fd);
+
+    if (loaded)
+    {
+        Uint32 version = THUMBNAIL_CACHE_VERSION;
+        Uint64 key = util::fnv1a64(&version, sizeof(version));
+        key = util::fnv1a64(generator->extension, strlen(generator->extension) + 1, key);
+        key = util::fnv1a64(data.data(), data.size(), key);
+
+        if (use_disk && load_from_disk(key, result.rgba))
+            SDL_AtomicAdd(&stats.disk_hits, 1);
+        else
+        {
+            result.rgba.assign(THUMBNAIL_BYTES, 0);
+            if (!generator->generate(data, result.rgba.data()))
+                result.rgba.clear();
+            if (use_disk)
+                store_to_disk(key, result.rgba);
+            SDL_AtomicAdd(&stats.generated, 1);
+        }
+    }
+
+    if (result.rgba.empty())
+        SDL_AtomicAdd(&stats.failed, 1);
+
+    SDL_LockMutex(results_lock);
+    results.push_back(std::move(result));
+    SDL_UnlockMutex(results_lock);
+}
+
+/* ================================ Atlas (Main thread) ================================ */
+
+enum entry_state_t
+{
+    ENTRY_IDLE,
+    /** Drawn this frame, waiting for a free job slot */
+    ENTRY_WANTED,
+    ENTRY_QUEUED,
+    ENTRY_READY,
+    /** Nothing to show (Unreadable, unsupported contents) */
+    ENTRY_EMPTY,
+};
+
+struct entry_t
+{
+    entry_state_t state = ENTRY_IDLE;
+    int cell = -1;
+    int last_used = 0;
+};
+
+static std::unordered_map<std::string, entry_t> entries;
+/* Requests from the last frame in draw order, so the top of the view is generated first */
+static std::vector<std::string> wanted;
+static int in_flight = 0;
+
+static GLuint atlas = 0;
+static std::string cell_owners[THUMBNAIL_ATLAS_CELLS];
+static int cells_used = 0;
+
+/**
+ * @returns A free atlas cell, evicting the least recently drawn thumbnail if needed, or -1 if every cell was drawn this frame
+ */
+static int alloc_cell(int frame)
+{
+    if (cells_used < THUMBNAIL_ATLAS_CELLS)
+        return cells_used++;
+
+    int oldest_cell = -1;
+    int oldest_frame = frame;
+    for (int i = 0; i < THUMBNAIL_ATLAS_CELLS; i++)
+    {
+        const entry_t& entry = entries[cell_owners[i]];
+        if (entry.last_used < oldest_frame)
+        {
+            oldest_frame = entry.last_used;
+            oldest_cell = i;
+        }
+    }
+
+    if (oldest_cell >= 0)
+    {
+        entry_t& evicted = entries[cell_owners[oldest_cell]];
+        evicted.state = ENTRY_IDLE;
+        evicted.cell = -1;
+    }
+    return oldest_cell;
+}
+
+static void upload(int cell, const std::vector<Uint8>& rgba)
+{
+    if (!atlas)
+    {
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, THUMBNAIL_ATLAS_SIZE, THUMBNAIL_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    int x = (cell % THUMBNAIL_ATLAS_CELLS_PER_ROW) * THUMBNAIL_SIZE;
+    int y = (cell / THUMBNAIL_ATLAS_CELLS_PER_ROW) * THUMBNAIL_SIZE;
+
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, THUMBNAIL_SIZE, THUMBNAIL_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void thumbnail_cache::update()
+{
+    PROFILER_SCOPE(zone_update);
+
+    int frame = ImGui::GetFrameCount();
+
+    std::vector<result_t> done;
+    SDL_LockMutex(results_lock);
+    done.swap(results);
+    SDL_UnlockMutex(results_lock);
+
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        in_flight--;
+
+        /* Cleared while the job was running */
+        auto it = entries.find(done[i].path);
+        if (it == entries.end() || it->second.state != ENTRY_QUEUED)
+            continue;
+        entry_t& entry = it->second;
+
+        if (done[i].rgba.empty())
+        {
+            entry.state = ENTRY_EMPTY;
+            continue;
+        }
+
+        int cell = alloc_cell(frame);
+        if (cell < 0)
+        {
+            entry.state = ENTRY_IDLE;
+            continue;
+        }
+
+        upload(cell, done[i].rgba);
+        cell_owners[cell] = done[i].path;
+        entry.cell = cell;
+        entry.state = ENTRY_READY;
+    }
+
+    /* Only a couple of jobs per thread at a time, anything left over is asked for again next frame if it is still visible */
+    int max_in_flight = jobs::get_thread_count() * 2;
+    bool use_disk = thumbnail_cache_disk.get();
+    for (size_t i = 0; i < wanted.size(); i++)
+    {
+        entry_t& entry = entries[wanted[i]];
+        if (entry.state != ENTRY_WANTED)
+            continue;
+
+        if (in_flight >= max_in_flight)
+        {
+            entry.state = ENTRY_IDLE;
+            continue;
+        }
+
+        entry.state = ENTRY_QUEUED;
+        in_flight++;
+
+        std::string path = wanted[i];
+        const generator_t* generator = find_generator(path.c_str());
+        jobs::submit([path, generator, use_disk]() { generate_job(path, generator, use_disk); }, jobs::PRIORITY_LOW);
+    }
+    wanted.clear();
+}
+
+bool thumbnail_cache::is_supported(const char* path) { return find_generator(path) != NULL; }
+
+void thumbnail_cache::draw(const char* path, float size)
+{
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImVec2 end(pos.x + size, pos.y + size);
+    ImGui::Dummy(ImVec2(size, size));
+
+    if (!ImGui::IsItemVisible() || !is_supported(path))
+        return;
+
+    entry_t& entry = entries[path];
+    entry.last_used = ImGui::GetFrameCount();
+
+    if (entry.state == ENTRY_IDLE)
+    {
+        entry.state = ENTRY_WANTED;
+        wanted.push_back(path);
+    }
+
+    if (entry.state == ENTRY_EMPTY)
+        return;
+
+    if (entry.state != ENTRY_READY)
+    {
+        ImGui::GetWindowDrawList()->AddRectFilled(pos, end, ImGui::GetColorU32(ImGuiCol_FrameBg));
+        return;
+    }
+
+    /* Half a texel in so linear filtering doesn't pick up the neighboring cells */
+    const float texel = 1.0f / THUMBNAIL_ATLAS_SIZE;
+    ImVec2 uv0(((entry.cell % THUMBNAIL_ATLAS_CELLS_PER_ROW) * THUMBNAIL_SIZE + 0.5f) * texel,
+        ((entry.cell / THUMBNAIL_ATLAS_CELLS_PER_ROW) * THUMBNAIL_SIZE + 0.5f) * texel);
+    ImVec2 uv1(uv0.x + (THUMBNAIL_SIZE - 1) * texel, uv0.y + (THUMBNAIL_SIZE - 1) * texel);
+
+    ImTextureID texture = (ImTextureID)(intptr_t)atlas;
+    ImGui::GetWindowDrawList()->AddImage(texture, pos, end, uv0, uv1);
+
+    if (ImGui::BeginItemTooltip())
+    {
+        ImGui::Image(texture, ImVec2(THUMBNAIL_SIZE, THUMBNAIL_SIZE), uv0, uv1);
+        ImGui::EndTooltip();
+    }
+}
+
+void thumbnail_cache::init()
+{
+    results_lock = SDL_CreateMutex();
+
+    dev_console::add_command("thumbnail_cache_clear", []() -> int {
+        char** files = PHYSFS_enumerateFiles(THUMBNAIL_CACHE_DIR);
+        int deleted = 0;
+        for (int i = 0; files && files[i]; i++)
+            deleted += PHYSFS_delete((std::string(THUMBNAIL_CACHE_DIR "/") + files[i]).c_str()) != 0;
+        PHYSFS_freeList(files);
+
+        /* Results of jobs that are still running are dropped when they arrive */
+        entries.clear();
+        wanted.clear();
+        cells_used = 0;
+
+        dc_log("Deleted %d cached thumbnails", deleted);
+        return 0;
+    });
+
+    dev_console::add_command("thumbnail_cache_stats", []() -> int {
+        dc_log("Atlas: %d/%d cells, Entries: %zu, In flight: %d", cells_used, THUMBNAIL_ATLAS_CELLS, entries.size(), in_flight);
+        dc_log("Disk hits: %d, Generated: %d, Failed: %d", SDL_AtomicGet(&stats.disk_hits), SDL_AtomicGet(&stats.generated), SDL_AtomicGet(&stats.failed));
+        return 0;
+    });
+}
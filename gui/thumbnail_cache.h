@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_GUI_THUMBNAIL_CACHE_H
+#define MPH_TETRA_GUI_THUMBNAIL_CACHE_H
+
+#define THUMBNAIL_SIZE 64
+
+/**
+ * Previews for files in the PhysFS tree
+ *
+ * Thumbnails are generated by low priority jobs, stored on disk under /cache/thumbnails keyed by a hash of the bytes
+ * they were generated from, and packed into a single atlas texture for drawing. Files are only looked at once something
+ * asks to draw them, so large directories cost nothing until they are scrolled into view.
+ */
+namespace thumbnail_cache
+{
+/**
+ * Registers the console commands
+ */
+void init();
+
+/**
+ * Uploads finished thumbnails to the atlas and starts jobs for newly requested ones
+ *
+ * Call once per frame before drawing any thumbnails
+ */
+void update();
+
+/**
+ * @returns True if there is a thumbnail generator for the extension of path
+ */
+bool is_supported(const char* path);
+
+/**
+ * Draws the thumbnail of a file as an ImGui item, a placeholder is drawn until it is ready
+ *
+ * @param path PhysFS path of the file
+ * @param size Width and height of the item
+ */
+void draw(const char* path, float size);
+}
+
+#endif
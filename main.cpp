@@ -22,13 +22,19 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "util/asset_cache.h"
 #include "util/cli_parser.h"
 #include "util/convar.h"
+#include "util/jobs.h"
+#include "util/lz_scan.h"
 #include "util/misc.h"
 #include "util/nds.h"
 #include "util/nfd.h"
 #include "util/physfs/archiver_nds.h"
+#include "util/physfs/io_trace.h"
+#include "util/physfs/nested_mount.h"
 #include "util/physfs/physfs.h"
+#include "util/rom_diff.h"
 
 #include "gui/console.h"
 #include "gui/file_picker.h"
@@ -39,6 +45,28 @@
 #include "gui/overlay_loading.h"
 #include "gui/overlay_performance.h"
 #include "gui/styles.h"
+#include "gui/thumbnail_cache.h"
+
+#include "game/ai_scheduler.h"
+#include "game/event_bus.h"
+#include "game/level_bundle.h"
+#include "game/navigation.h"
+#include "game/room_prefetch.h"
+#include "game/sim_state.h"
+#include "game/spatial_hash.h"
+#include "game/transform.h"
+
+#include "net/netcode.h"
+
+#include "render/capture.h"
+#include "render/gl.h"
+#include "render/gx_transform.h"
+#include "render/palette_texture.h"
+#include "render/shader.h"
+#include "render/sprite_batch.h"
+#include "render/swr.h"
+#include "render/texture_upload.h"
+#include "render/vertex_format.h"
 
 #include <SDL2/SDL.h>
 #include <stdio.h>
@@ -80,8 +108,8 @@ static convar_int_t cl_wait_for_events(
 static convar_int_t cl_show_menu("cl_show_main_menu", 1, 0, 1, "Enable/Disable main menu", CONVAR_FLAG_INT_IS_BOOL);
 static convar_int_t dev_show_demo_window_complex("dev_show_demo_window_complex", 0, 0, 1, "Show Dear ImGui demo window", CONVAR_FLAG_INT_IS_BOOL);
 
-static convar_string_t rom_release("rom_release", "", "Force specific Release ROM", CONVAR_FLAG_HIDDEN);
-static convar_string_t rom_first_hunt("rom_first_hunt", "", "Force specific First Hunt ROM", CONVAR_FLAG_HIDDEN);
+static convar_string_t rom_release("rom_release", "", "Force specific Release ROM (.nds, or .zip containing one)", CONVAR_FLAG_HIDDEN);
+static convar_string_t rom_first_hunt("rom_first_hunt", "", "Force specific First Hunt ROM (.nds, or .zip containing one)", CONVAR_FLAG_HIDDEN);
 
 static convar_int_t rom_release_append("rom_release_append", 1, 0, 1, "Append release rom to search path", CONVAR_FLAG_INT_IS_BOOL);
 static convar_int_t rom_first_hunt_append("rom_first_hunt_append", 1, 0, 1, "Append first hunt rom to search path", CONVAR_FLAG_INT_IS_BOOL);
@@ -128,6 +156,18 @@ void process_event(SDL_Event& event, bool* done, int* win_width, int* win_height
     /* Game bind logic here */
 }
 
+/**
+ * Mounts a ROM, ROMs inside zips are mounted in place instead of being extracted
+ */
+static void mount_rom(const char* path, const char* mount_point, int append)
+{
+    size_t len = SDL_strlen(path);
+    bool is_zip = len >= 4 && !SDL_strcasecmp(path + len - 4, ".zip");
+
+    if (!(is_zip ? MPH_TETRA_PHYSFS_mountNested(path, NULL, mount_point, append) : PHYSFS_mount(path, mount_point, append)))
+        dc_log_error("Unable to mount %s: %s", path, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+}
+
 // Main code
 int main(const int argc, const char** argv)
 {
@@ -155,11 +195,26 @@ int main(const int argc, const char** argv)
     /* Set convars from command line */
     cli_parser::apply();
 
-    assert(PHYSFS_init(argv[0]));
-    assert(PHYSFS_setSaneConfig("icrashstuff", "mph_tetra", NULL, 0, 0));
+    /* Not in assert(), these have to run when NDEBUG is defined too */
+    if (!PHYSFS_init(argv[0]))
+        util::die("Error: PHYSFS_init(): %s\n", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+
+    /* Every cache (Shader binaries, thumbnails, inflate indices, preload manifests), captures, and cooked level bundles
+     * are written here, and read back from the root of the search path */
+    const char* pref_dir = PHYSFS_getPrefDir("icrashstuff", "mph_tetra");
+    if (!pref_dir || !PHYSFS_setWriteDir(pref_dir))
+        util::die("Error: Unable to set the write directory: %s\n", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    if (!PHYSFS_mount(pref_dir, NULL, 0))
+        util::die("Error: Unable to mount \"%s\": %s\n", pref_dir, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    PHYSFS_mount(PHYSFS_getBaseDir(), NULL, 1);
+    dc_log("Write dir: \"%s\"", PHYSFS_getWriteDir());
 
     PHYSFS_registerArchiver(&MPH_TETRA_PHYSFS_Archiver_NDS);
 
+    MPH_TETRA_PHYSFS_registerNestedCommands();
+
+    MPH_TETRA_PHYSFS_registerTraceCommands();
+
     const PHYSFS_ArchiveInfo** supported_archives = PHYSFS_supportedArchiveTypes();
 
     for (int i = 0; supported_archives[i] != NULL; i++)
@@ -167,6 +222,50 @@ int main(const int argc, const char** argv)
 
     overlay::loading::push();
 
+    jobs::init();
+
+    rom_diff::init();
+
+    asset_cache::init();
+
+    level_bundle::init();
+
+    util::lz_scan_init();
+
+    transform::init();
+
+    navigation::init();
+
+    event_bus::init();
+
+    spatial_hash::init();
+
+    ai_scheduler::init();
+
+    sim_state::init();
+
+    room_prefetch::init();
+
+    net::init();
+
+    render::shader_cache_init();
+
+    render::gx_transform_init();
+
+    render::vertex_format_init();
+
+    render::capture_init();
+
+    render::swr_init();
+
+    render::texture_upload_init();
+
+    render::sprite_batch_init();
+
+    render::palette_texture_init();
+
+    thumbnail_cache::init();
+
     NFD_Init();
 
     // Setup SDL
@@ -177,10 +276,10 @@ int main(const int argc, const char** argv)
     }
 
     if (rom_release.get().length() > 0)
-        PHYSFS_mount(rom_release.get().c_str(), "/nds/rom_release", rom_release_append.get());
+        mount_rom(rom_release.get().c_str(), "/nds/rom_release", rom_release_append.get());
 
     if (rom_first_hunt.get().length() > 0)
-        PHYSFS_mount(rom_first_hunt.get().c_str(), "/nds/rom_first_hunt", rom_first_hunt_append.get());
+        mount_rom(rom_first_hunt.get().c_str(), "/nds/rom_first_hunt", rom_first_hunt_append.get());
 
     const char* glsl_version = "#version 150";
 #if defined(__APPLE__)
@@ -251,6 +350,9 @@ int main(const int argc, const char** argv)
     if (!ImGui_ImplOpenGL3_Init(glsl_version))
         util::die("Failed to initialize Dear Imgui OpenGL3 backend\n");
 
+    if (!render::gl_init())
+        util::die("Failed to load OpenGL functions\n");
+
     log_gl_attribute(SDL_GL_RED_SIZE);
     log_gl_attribute(SDL_GL_GREEN_SIZE);
     log_gl_attribute(SDL_GL_BLUE_SIZE);
@@ -308,6 +410,8 @@ int main(const int argc, const char** argv)
         SDL_SetWindowMouseGrab(window, (SDL_bool)(cl_grab_mouse.get() && !dev_console::shown));
         SDL_SetRelativeMouseMode((SDL_bool)(cl_grab_mouse.get() && !dev_console::shown));
 
+        net::frame(!dev_console::shown && !io.WantCaptureKeyboard);
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
@@ -344,10 +448,22 @@ int main(const int argc, const char** argv)
 
         // Actual Rendering
         ImGui::Render();
+        render::texture_upload_update();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
         glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
         glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (render::swr_is_enabled())
+        {
+            ImVec4 premultiplied(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
+            render::swr_render_imgui(ImGui::GetDrawData(), ImGui::ColorConvertFloat4ToU32(premultiplied));
+        }
+        else
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            int drawable_w, drawable_h;
+            SDL_GL_GetDrawableSize(window, &drawable_w, &drawable_h);
+            render::capture_frame(drawable_w, drawable_h);
+        }
         last_loop_time = SDL_GetPerformanceCounter() - loop_start_time;
         SDL_GL_SwapWindow(window);
 
@@ -372,6 +488,17 @@ int main(const int argc, const char** argv)
 
     convar_t::atexit_callback();
 
+    net::shutdown();
+
+    asset_cache::shutdown();
+
+    jobs::shutdown();
+
+    render::capture_shutdown();
+    render::swr_shutdown();
+    render::sprite_batch_shutdown();
+    render::texture_upload_shutdown();
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
@@ -381,7 +508,7 @@ int main(const int argc, const char** argv)
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    assert(PHYSFS_deinit());
+    PHYSFS_deinit();
 
     return 0;
 }
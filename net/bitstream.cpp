@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "bitstream.h"
+
+bit_writer_t::bit_writer_t(Uint8* buf, size_t size)
+{
+    _buf = buf;
+    _size = size;
+    _bit_pos = 0;
+    _overflow = false;
+}
+
+void bit_writer_t::write_bits(Uint32 value, int bits)
+{
+    if (_bit_pos + bits > _size * 8)
+    {
+        _overflow = true;
+        return;
+    }
+
+    while (bits > 0)
+    {
+        size_t byte = _bit_pos / 8;
+        int bit = _bit_pos % 8;
+        int n = 8 - bit;
+        if (n > bits)
+            n = bits;
+
+        Uint8 mask = ((1u << n) - 1) << bit;
+        _buf[byte] = (_buf[byte] & ~mask) | ((value << bit) & mask);
+
+        value >>= n;
+        bits -= n;
+        _bit_pos += n;
+    }
+}
+
+bit_reader_t::bit_reader_t(const Uint8* buf, size_t size)
+{
+    _buf = buf;
+    _size = size;
+    _bit_pos = 0;
+    _overflow = false;
+}
+
+Uint32 bit_reader_t::read_bits(int bits)
+{
+    if (_bit_pos + bits > _size * 8)
+    {
+        _overflow = true;
+        return 0;
+    }
+
+    Uint32 value = 0;
+    int shift = 0;
+    while (bits > 0)
+    {
+        size_t byte = _bit_pos / 8;
+        int bit = _bit_pos % 8;
+        int n = 8 - bit;
+        if (n > bits)
+            n = bits;
+
+        value |= (Uint32)((_buf[byte] >> bit) & ((1u << n) - 1)) << shift;
+
+        shift += n;
+        bits -= n;
+        _bit_pos += n;
+    }
+
+    return value;
+}
+
+Sint32 bit_reader_t::read_signed(int bits)
+{
+    Uint32 value = read_bits(bits);
+    if (bits < 32 && (value & (1u << (bits - 1))))
+        value |= ~((1u << bits) - 1);
+    return (Sint32)value;
+}
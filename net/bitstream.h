@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_NET_BITSTREAM_H
+#define MPH_TETRA_NET_BITSTREAM_H
+
+#include <SDL_bits.h>
+#include <stddef.h>
+
+/**
+ * Writes values LSB first into a byte buffer, byte order independent
+ *
+ * Writing past the end of the buffer sets the overflow flag instead of writing
+ */
+class bit_writer_t
+{
+public:
+    bit_writer_t(Uint8* buf, size_t size);
+
+    /**
+     * @param value Value to write, bits above `bits` are ignored
+     * @param bits Number of bits to write [0, 32]
+     */
+    void write_bits(Uint32 value, int bits);
+
+    inline void write_bool(bool value) { write_bits(value, 1); }
+
+    /**
+     * Writes a two's complement value, value must fit in `bits`
+     */
+    inline void write_signed(Sint32 value, int bits) { write_bits((Uint32)value, bits); }
+
+    /**
+     * Returns the number of bytes used so far (Partial bytes are counted)
+     */
+    inline size_t get_bytes_written() { return (_bit_pos + 7) / 8; }
+
+    inline size_t get_bits_written() { return _bit_pos; }
+
+    inline bool overflowed() { return _overflow; }
+
+private:
+    Uint8* _buf;
+    size_t _size;
+    size_t _bit_pos;
+    bool _overflow;
+};
+
+/**
+ * Reads values written by bit_writer_t
+ *
+ * Reading past the end of the buffer returns zeros and sets the overflow flag
+ */
+class bit_reader_t
+{
+public:
+    bit_reader_t(const Uint8* buf, size_t size);
+
+    Uint32 read_bits(int bits);
+
+    inline bool read_bool() { return read_bits(1); }
+
+    /**
+     * Reads and sign extends a value written with bit_writer_t::write_signed()
+     */
+    Sint32 read_signed(int bits);
+
+    inline bool overflowed() { return _overflow; }
+
+private:
+    const Uint8* _buf;
+    size_t _size;
+    size_t _bit_pos;
+    bool _overflow;
+};
+
+#endif
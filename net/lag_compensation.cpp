@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "lag_compensation.h"
+
+#include "gui/console.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Player hull, in world units */
+#define HULL_HALF_WIDTH 0.5f
+#define HULL_HEIGHT 1.8f
+#define HULL_HEIGHT_ALT_FORM 0.9f
+
+static profiler_zone_t zone_record("lag_compensation_t::record");
+
+lag_compensation_t::lag_compensation_t(int max_entities, size_t memory_budget)
+{
+    SDL_assert(max_entities > 0 && max_entities <= 64);
+    _max_entities = max_entities;
+    _stride = (max_entities + 3) & ~3;
+
+    size_t bytes_per_tick = sizeof(tick_header_t) + sizeof(float) * 6 * _stride;
+    _capacity = memory_budget / bytes_per_tick;
+    if (_capacity < 2)
+        _capacity = 2;
+
+    _headers.resize(_capacity);
+    _proxies.resize((size_t)_capacity * 6 * _stride);
+    _scratch.resize(6 * _stride);
+
+    clear();
+}
+
+void lag_compensation_t::clear()
+{
+    _count = 0;
+    _newest_tick = 0;
+}
+
+void lag_compensation_t::entity_bounds(const net_entity_state_t& state, float min[3], float max[3])
+{
+    const float scale = 1.0f / (1 << NET_FIXED_SHIFT);
+    float height = (state.flags & net_entity_state_t::FLAG_ALT_FORM) ? HULL_HEIGHT_ALT_FORM : HULL_HEIGHT;
+
+    min[0] = state.pos[0] * scale - HULL_HALF_WIDTH;
+    min[1] = state.pos[1] * scale;
+    min[2] = state.pos[2] * scale - HULL_HALF_WIDTH;
+    max[0] = state.pos[0] * scale + HULL_HALF_WIDTH;
+    max[1] = state.pos[1] * scale + height;
+    max[2] = state.pos[2] * scale + HULL_HALF_WIDTH;
+}
+
+void lag_compensation_t::record(Uint32 tick, const net_entity_state_t* entities, int count)
+{
+    PROFILER_SCOPE(zone_record);
+
+    /* A gap or a step backwards invalidates the history, interpolation assumes consecutive ticks */
+    if (_count && tick != _newest_tick + 1)
+        clear();
+
+    int ring_index = tick % _capacity;
+    tick_header_t& header = _headers[ring_index];
+    float* block = get_block(ring_index);
+
+    header.tick = tick;
+    header.active_mask = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        header.bounds_min[i] = INFINITY;
+        header.bounds_max[i] = -INFINITY;
+    }
+
+    if (count > _max_entities)
+        count = _max_entities;
+
+    for (int i = 0; i < _stride; i++)
+    {
+        float min[3] = { 0, 0, 0 };
+        float max[3] = { -1, -1, -1 };
+
+        if (i < count && (entities[i].flags & net_entity_state_t::FLAG_ACTIVE))
+        {
+            entity_bounds(entities[i], min, max);
+            header.active_mask |= Uint64(1) << i;
+            for (int j = 0; j < 3; j++)
+            {
+                header.bounds_min[j] = SDL_min(header.bounds_min[j], min[j]);
+                header.bounds_max[j] = SDL_max(header.bounds_max[j], max[j]);
+            }
+        }
+
+        /* Inactive slots get an inverted box so the SIMD path can test them without branching */
+        for (int j = 0; j < 3; j++)
+        {
+            block[j * _stride + i] = min[j];
+            block[(j + 3) * _stride + i] = max[j];
+        }
+    }
+
+    _newest_tick = tick;
+    if (_count < _capacity)
+        _count++;
+}
+
+const float* lag_compensation_t::resolve_tick(Uint32 tick, float fraction, float* scratch, Uint64& active_mask, float bounds_min[3], float bounds_max[3])
+{
+    Uint32 oldest = get_oldest_tick();
+    if (tick < oldest)
+        tick = oldest, fraction = 0.0f;
+    if (tick >= _newest_tick)
+        tick = _newest_tick, fraction = 0.0f;
+
+    int a_index = tick % _capacity;
+    const tick_header_t& a = _headers[a_index];
+
+    if (fraction <= 0.0f)
+    {
+        active_mask = a.active_mask;
+        memcpy(bounds_min, a.bounds_min, sizeof(a.bounds_min));
+        memcpy(bounds_max, a.bounds_max, sizeof(a.bounds_max));
+        return get_block(a_index);
+    }
+
+    int b_index = (tick + 1) % _capacity;
+    const tick_header_t& b = _headers[b_index];
+    const float* block_a = get_block(a_index);
+    const float* block_b = get_block(b_index);
+
+    /* Entities that spawned or despawned between the two ticks are left out, a shot can't be blamed on either state */
+    active_mask = a.active_mask & b.active_mask;
+    for (int i = 0; i < 3; i++)
+    {
+        bounds_min[i] = SDL_min(a.bounds_min[i], b.bounds_min[i]);
+        bounds_max[i] = SDL_max(a.bounds_max[i], b.bounds_max[i]);
+    }
+
+    int n = 6 * _stride;
+    for (int i = 0; i < n; i++)
+        scratch[i] = block_a[i] + (block_b[i] - block_a[i]) * fraction;
+
+    return scratch;
+}
+
+/**
+ * Slab test of a ray against an AABB
+ *
+ * @returns Entry distance, or INFINITY on a miss
+ */
+static inline float ray_aabb(const float origin[3], const float inv_dir[3], float max_distance, const float min[3], const float max[3])
+{
+    float t_near = 0.0f;
+    float t_far = max_distance;
+    for (int i = 0; i < 3; i++)
+    {
+        float t0 = (min[i] - origin[i]) * inv_dir[i];
+        float t1 = (max[i] - origin[i]) * inv_dir[i];
+        t_near = SDL_max(t_near, SDL_min(t0, t1));
+        t_far = SDL_min(t_far, SDL_max(t0, t1));
+    }
+    return t_near <= t_far ? t_near : INFINITY;
+}
+
+bool lag_compensation_t::raycast(Uint32 tick, float fraction, const float origin[3], const float dir[3], float max_distance, int ignore_entity, hit_t& out)
+{
+    if (!_count)
+        return false;
+
+    if (_world_raycast)
+        max_distance = _world_raycast(origin, dir, max_distance);
+
+    /* Axis aligned rays would divide by zero, nudge them so the slab test still works with INFINITY free math */
+    float inv_dir[3];
+    for (int i = 0; i < 3; i++)
+        inv_dir[i] = 1.0f / (fabsf(dir[i]) > 1e-8f ? dir[i] : (dir[i] < 0.0f ? -1e-8f : 1e-8f));
+
+    Uint64 active_mask;
+    float bounds_min[3], bounds_max[3];
+    const float* block = resolve_tick(tick, fraction, _scratch.data(), active_mask, bounds_min, bounds_max);
+
+    if (ignore_entity >= 0 && ignore_entity < 64)
+        active_mask &= ~(Uint64(1) << ignore_entity);
+
+    if (!active_mask || ray_aabb(origin, inv_dir, max_distance, bounds_min, bounds_max) == INFINITY)
+        return false;
+
+    float best = INFINITY;
+    int best_entity = -1;
+
+#ifdef __SSE2__
+    const __m128 o[3] = { _mm_set1_ps(origin[0]), _mm_set1_ps(origin[1]), _mm_set1_ps(origin[2]) };
+    const __m128 inv[3] = { _mm_set1_ps(inv_dir[0]), _mm_set1_ps(inv_dir[1]), _mm_set1_ps(inv_dir[2]) };
+    const __m128 max_dist = _mm_set1_ps(max_distance);
+
+    for (int i = 0; i < _stride; i += 4)
+    {
+        if (!((active_mask >> i) & 0xF))
+            continue;
+
+        __m128 t_near = _mm_setzero_ps();
+        __m128 t_far = max_dist;
+        for (int j = 0; j < 3; j++)
+        {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block + j * _stride + i), o[j]), inv[j]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block + (j + 3) * _stride + i), o[j]), inv[j]);
+            t_near = _mm_max_ps(t_near, _mm_min_ps(t0, t1));
+            t_far = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+        }
+
+        int hits = _mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & (int)((active_mask >> i) & 0xF);
+        if (!hits)
+            continue;
+
+        float near[4];
+        _mm_storeu_ps(near, t_near);
+        for (int k = 0; k < 4; k++)
+        {
+            if ((hits & (1 << k)) && near[k] < best)
+            {
+                best = near[k];
+                best_entity = i + k;
+            }
+        }
+    }
+#else
+    for (int i = 0; i < _stride; i++)
+    {
+        if (!((active_mask >> i) & 1))
+            continue;
+        float min[3] = { block[i], block[_stride + i], block[2 * _stride + i] };
+        float max[3] = { block[3 * _stride + i], block[4 * _stride + i], block[5 * _stride + i] };
+        float t = ray_aabb(origin, inv_dir, max_distance, min, max);
+        if (t < best)
+        {
+            best = t;
+            best_entity = i;
+        }
+    }
+#endif
+
+    if (best_entity < 0)
+        return false;
+
+    out.entity = best_entity;
+    out.distance = best;
+    return true;
+}
+
+/**
+ * Fills a history with randomly walking entities and measures how many rewound raycasts can be done per second
+ */
+static int command_lagcomp_bench(const int argc, const char** argv)
+{
+    int num_entities = NET_MAX_ENTITIES;
+    int budget_kb = 256;
+    int num_queries = 1000000;
+
+    if (argc > 1)
+        num_entities = SDL_clamp(atoi(argv[1]), 1, 64);
+    if (argc > 2)
+        budget_kb = SDL_max(atoi(argv[2]), 1);
+    if (argc > 3)
+        num_queries = SDL_max(atoi(argv[3]), 1);
+
+    lag_compensation_t history(num_entities, (size_t)budget_kb * 1024);
+
+    Uint32 seed = 0x1234567;
+    auto rand_next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    net_entity_state_t entities[64];
+    memset(entities, 0, sizeof(entities));
+    for (int i = 0; i < num_entities; i++)
+    {
+        entities[i].flags = net_entity_state_t::FLAG_ACTIVE;
+        entities[i].pos[0] = (Sint32)(rand_next() % (64 << NET_FIXED_SHIFT)) - (32 << NET_FIXED_SHIFT);
+        entities[i].pos[2] = (Sint32)(rand_next() % (64 << NET_FIXED_SHIFT)) - (32 << NET_FIXED_SHIFT);
+    }
+
+    Uint32 ticks = history.get_capacity();
+    for (Uint32 tick = 1; tick <= ticks; tick++)
+    {
+        for (int i = 0; i < num_entities; i++)
+        {
+            entities[i].pos[0] += (Sint32)(rand_next() % 65) - 32;
+            entities[i].pos[2] += (Sint32)(rand_next() % 65) - 32;
+        }
+        history.record(tick, entities, num_entities);
+    }
+
+    /* Queries are generated up front so the RNG is not part of the measurement */
+    struct query_t
+    {
+        Uint32 tick;
+        float fraction;
+        float origin[3];
+        float dir[3];
+    };
+    std::vector<query_t> queries(SDL_min(num_queries, 4096));
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        query_t& q = queries[i];
+        q.tick = history.get_oldest_tick() + rand_next() % ticks;
+        q.fraction = (rand_next() % 256) / 256.0f;
+        float angle = (rand_next() % 4096) * (2.0f * M_PI / 4096.0f);
+        q.origin[0] = -40.0f * cosf(angle);
+        q.origin[1] = 1.0f;
+        q.origin[2] = -40.0f * sinf(angle);
+        q.dir[0] = cosf(angle);
+        q.dir[1] = 0.0f;
+        q.dir[2] = sinf(angle);
+    }
+
+    Uint64 hits = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < num_queries; i++)
+    {
+        const query_t& q = queries[i % queries.size()];
+        lag_compensation_t::hit_t hit;
+        hits += history.raycast(q.tick, q.fraction, q.origin, q.dir, 100.0f, -1, hit);
+    }
+    double elapsed = double(SDL_GetPerformanceCounter() - start) / double(SDL_GetPerformanceFrequency());
+
+    dc_log("sv_lagcomp_bench: %d entities, %u ticks of history (%d KiB)", num_entities, ticks, budget_kb);
+    dc_log("sv_lagcomp_bench: %d rewinds in %.3f ms, %.0f rewinds/s, %.1f%% hit", num_queries, elapsed * 1000.0, num_queries / elapsed,
+        hits * 100.0 / num_queries);
+
+    return 0;
+}
+
+void net::lag_compensation_init()
+{
+    dev_console::add_command("sv_lagcomp_bench", command_lagcomp_bench);
+}
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_NET_LAG_COMPENSATION_H
+#define MPH_TETRA_NET_LAG_COMPENSATION_H
+
+#include "snapshot.h"
+
+#include <SDL_bits.h>
+
+#include <functional>
+#include <vector>
+
+/**
+ * Server side history of per-entity collision proxies (AABBs) for rewinding instant hit weapons
+ *
+ * Each recorded tick is stored as a fixed size SoA block (min/max per axis for every entity slot) in a ring buffer,
+ * the number of ticks kept is derived from a memory budget
+ */
+class lag_compensation_t
+{
+public:
+    struct hit_t
+    {
+        int entity;
+        /**
+         * Distance along the ray
+         */
+        float distance;
+    };
+
+    /**
+     * Returns the distance to the first world hit along the ray, or max_distance if nothing was hit
+     */
+    typedef std::function<float(const float origin[3], const float dir[3], float max_distance)> world_raycast_t;
+
+    /**
+     * @param max_entities Number of entity slots per tick
+     * @param memory_budget Maximum number of bytes to use for the history
+     */
+    lag_compensation_t(int max_entities, size_t memory_budget);
+
+    /**
+     * Records the proxies for a tick, ticks must be recorded in increasing order
+     *
+     * Inactive entities (FLAG_ACTIVE not set) get no proxy
+     */
+    void record(Uint32 tick, const net_entity_state_t* entities, int count);
+
+    /**
+     * Casts a ray against the proxies as they were at `tick` + `fraction`
+     *
+     * If the tick is older than the history the oldest recorded tick is used, if it is newer the newest is used
+     *
+     * @param tick Tick to rewind to
+     * @param fraction Position between tick and tick + 1 [0, 1)
+     * @param origin Ray origin (World units)
+     * @param dir Normalized ray direction
+     * @param max_distance Ray length
+     * @param ignore_entity Entity slot to skip (The shooter), or -1
+     * @param out First hit
+     *
+     * @returns true if an entity was hit before any world geometry
+     */
+    bool raycast(Uint32 tick, float fraction, const float origin[3], const float dir[3], float max_distance, int ignore_entity, hit_t& out);
+
+    /**
+     * Optional world occlusion test, called before testing proxies to clip the ray
+     */
+    inline void set_world_raycast(world_raycast_t func) { _world_raycast = func; }
+
+    inline Uint32 get_oldest_tick() { return _count ? _newest_tick - _count + 1 : 0; }
+    inline Uint32 get_newest_tick() { return _newest_tick; }
+    inline int get_capacity() { return _capacity; }
+
+    void clear();
+
+    /**
+     * Builds the player hull proxy for an entity state
+     */
+    static void entity_bounds(const net_entity_state_t& state, float min[3], float max[3]);
+
+private:
+    struct tick_header_t
+    {
+        Uint32 tick;
+        Uint64 active_mask;
+        float bounds_min[3];
+        float bounds_max[3];
+    };
+
+    /**
+     * Returns the SoA block of a tick, layout is [min_x, min_y, min_z, max_x, max_y, max_z][_stride]
+     */
+    inline float* get_block(int ring_index) { return &_proxies[(size_t)ring_index * 6 * _stride]; }
+
+    const float* resolve_tick(Uint32 tick, float fraction, float* scratch, Uint64& active_mask, float bounds_min[3], float bounds_max[3]);
+
+    int _max_entities;
+    /**
+     * _max_entities rounded up to a multiple of 4 for SIMD
+     */
+    int _stride;
+    int _capacity;
+    int _count;
+    Uint32 _newest_tick;
+    std::vector<tick_header_t> _headers;
+    std::vector<float> _proxies;
+    std::vector<float> _scratch;
+    world_raycast_t _world_raycast;
+};
+
+namespace net
+{
+/**
+ * Registers the sv_lagcomp_bench console command
+ */
+void lag_compensation_init();
+};
+
+#endif
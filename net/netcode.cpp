@@ -0,0 +1,855 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "netcode.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NET_MAGIC 0x4D54
+#define NET_TIMEOUT_MS 5000
+#define NET_CONNECT_RETRY_MS 250
+
+/* Instant hit weapon, in world units */
+#define WEAPON_RANGE 200.0f
+#define WEAPON_DAMAGE 10
+#define WEAPON_EYE_HEIGHT 1.5f
+#define WEAPON_EYE_HEIGHT_ALT_FORM 0.45f
+
+static convar_int_t sv_lagcomp("sv_lagcomp", 1, 0, 1, "Rewind other players to what the shooter saw when testing instant hit weapons", CONVAR_FLAG_INT_IS_BOOL);
+static convar_int_t sv_lagcomp_max_ms("sv_lagcomp_max_ms", 250, 0, 1000, "Maximum amount of time a shot can be rewound (ms)");
+static convar_int_t sv_lagcomp_budget_kb("sv_lagcomp_budget_kb", 256, 16, 16384, "Memory budget for the lag compensation history (KiB), applied on net_listen");
+
+enum net_packet_type_t
+{
+    PACKET_CONNECT = 1,
+    PACKET_ACCEPT,
+    PACKET_REJECT,
+    PACKET_INPUT,
+    PACKET_SNAPSHOT,
+    PACKET_DISCONNECT,
+};
+
+static const net_snapshot_t zero_snapshot = {};
+
+static void write_header(bit_writer_t& writer, net_packet_type_t type)
+{
+    writer.write_bits(NET_MAGIC, 16);
+    writer.write_bits(type, 4);
+}
+
+/**
+ * @returns packet type, or -1 if the packet isn't ours
+ */
+static int read_header(bit_reader_t& reader)
+{
+    if (reader.read_bits(16) != NET_MAGIC)
+        return -1;
+    int type = reader.read_bits(4);
+    return reader.overflowed() ? -1 : type;
+}
+
+static void send_simple(udp_socket_t& socket, const net_address_t& to, net_packet_type_t type, int extra = -1)
+{
+    Uint8 buf[8];
+    bit_writer_t writer(buf, sizeof(buf));
+    write_header(writer, type);
+    if (extra >= 0)
+        writer.write_bits(extra, 8);
+    socket.send_to(to, buf, writer.get_bytes_written());
+}
+
+/* ================================ Server ================================ */
+
+/**
+ * Clips shots against the flat floor at y = 0, the only geometry simulate_player() collides with
+ */
+static float floor_raycast(const float origin[3], const float dir[3], float max_distance)
+{
+    if (origin[1] < 0.0f || dir[1] >= 0.0f)
+        return max_distance;
+    return SDL_min(max_distance, origin[1] / -dir[1]);
+}
+
+net_server_t::net_server_t()
+    : _lagcomp(NET_MAX_ENTITIES, (size_t)sv_lagcomp_budget_kb.get() * 1024)
+{
+    _lagcomp.set_world_raycast(floor_raycast);
+    _tick = 0;
+    memset(&_world, 0, sizeof(_world));
+    memset(_history, 0, sizeof(_history));
+    memset(_clients, 0, sizeof(_clients));
+}
+
+bool net_server_t::start(Uint16 port)
+{
+    if (!_socket.open(port))
+        return false;
+
+    _tick = 0;
+    memset(&_world, 0, sizeof(_world));
+    memset(_history, 0, sizeof(_history));
+    memset(_clients, 0, sizeof(_clients));
+    _lagcomp.clear();
+
+    return true;
+}
+
+void net_server_t::stop()
+{
+    for (int i = 0; i < NET_MAX_CLIENTS; i++)
+        if (_clients[i].stats.connected)
+            send_simple(_socket, _clients[i].stats.address, PACKET_DISCONNECT);
+    _socket.update((Uint64)-1);
+    _socket.close();
+}
+
+const net_snapshot_t* net_server_t::get_snapshot(Uint32 tick)
+{
+    if (tick == 0 || tick > _tick)
+        return NULL;
+    const net_snapshot_t* snapshot = &_history[tick % NET_SNAPSHOT_HISTORY];
+    return snapshot->tick == tick ? snapshot : NULL;
+}
+
+net_server_t::client_stats_t net_server_t::get_client_stats(int slot) { return _clients[slot].stats; }
+
+void net_server_t::drop_client(int slot)
+{
+    memset(&_clients[slot], 0, sizeof(_clients[slot]));
+    memset(&_world.entities[slot], 0, sizeof(_world.entities[slot]));
+}
+
+void net_server_t::fire_weapon(int slot, Uint32 view_tick)
+{
+    const net_entity_state_t& shooter = _world.entities[slot];
+
+    Uint32 max_rewind = sv_lagcomp.get() ? sv_lagcomp_max_ms.get() * NET_TICK_RATE / 1000 : 0;
+    if (view_tick == 0 || view_tick > _tick || _tick - view_tick > max_rewind)
+        view_tick = _tick - SDL_min(_tick, max_rewind);
+
+    const float to_radians = 2.0f * M_PI / (1 << NET_ANGLE_BITS);
+    float yaw = shooter.yaw * to_radians;
+    float pitch = (shooter.pitch >= (1 << (NET_ANGLE_BITS - 1)) ? int(shooter.pitch) - (1 << NET_ANGLE_BITS) : shooter.pitch) * to_radians;
+
+    float eye_height = (shooter.flags & net_entity_state_t::FLAG_ALT_FORM) ? WEAPON_EYE_HEIGHT_ALT_FORM : WEAPON_EYE_HEIGHT;
+    float origin[3] = {
+        shooter.pos[0] / float(1 << NET_FIXED_SHIFT),
+        shooter.pos[1] / float(1 << NET_FIXED_SHIFT) + eye_height,
+        shooter.pos[2] / float(1 << NET_FIXED_SHIFT),
+    };
+    float dir[3] = { sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch) };
+
+    lag_compensation_t::hit_t hit;
+    if (!_lagcomp.raycast(view_tick, 0.0f, origin, dir, WEAPON_RANGE, slot, hit))
+        return;
+
+    net_entity_state_t& victim = _world.entities[hit.entity];
+    if (!(victim.flags & net_entity_state_t::FLAG_ACTIVE))
+        return;
+    victim.health = victim.health > WEAPON_DAMAGE ? victim.health - WEAPON_DAMAGE : 0;
+
+    dc_log_trace("Client %d hit entity %d at %.2f units, rewound %u ticks", slot, hit.entity, hit.distance, _tick - view_tick);
+}
+
+void net_server_t::handle_packet(const net_address_t& from, const Uint8* data, int len, Uint64 now_ms)
+{
+    bit_reader_t reader(data, len);
+    int type = read_header(reader);
+
+    int slot = -1;
+    for (int i = 0; i < NET_MAX_CLIENTS && slot < 0; i++)
+        if (_clients[i].stats.connected && _clients[i].stats.address == from)
+            slot = i;
+
+    switch (type)
+    {
+    case PACKET_CONNECT:
+    {
+        Uint32 version = reader.read_bits(8);
+        if (reader.overflowed() || version != NET_PROTOCOL_VERSION)
+        {
+            send_simple(_socket, from, PACKET_REJECT);
+            return;
+        }
+
+        for (int i = 0; i < NET_MAX_CLIENTS && slot < 0; i++)
+        {
+            if (_clients[i].stats.connected)
+                continue;
+            slot = i;
+            memset(&_clients[slot], 0, sizeof(_clients[slot]));
+            _clients[slot].stats.connected = true;
+            _clients[slot].stats.address = from;
+
+            net_entity_state_t& player = _world.entities[slot];
+            memset(&player, 0, sizeof(player));
+            player.flags = net_entity_state_t::FLAG_ACTIVE | net_entity_state_t::FLAG_ON_GROUND;
+            player.health = 100;
+            player.pos[0] = (slot - NET_MAX_CLIENTS / 2) * (8 << NET_FIXED_SHIFT);
+        }
+
+        if (slot < 0)
+        {
+            send_simple(_socket, from, PACKET_REJECT);
+            return;
+        }
+
+        /* Duplicate connects are answered again in case the previous accept got lost */
+        _clients[slot].last_packet_time = now_ms;
+        send_simple(_socket, from, PACKET_ACCEPT, slot);
+        break;
+    }
+    case PACKET_INPUT:
+    {
+        if (slot < 0)
+            return;
+        client_t& client = _clients[slot];
+        client.last_packet_time = now_ms;
+
+        Uint32 ack = reader.read_bits(32);
+        Uint32 count = reader.read_bits(4);
+        if (reader.overflowed())
+            return;
+
+        if (ack > client.stats.last_acked_tick && get_snapshot(ack))
+            client.stats.last_acked_tick = ack;
+
+        for (Uint32 i = 0; i < count && i < NET_INPUT_REDUNDANCY; i++)
+        {
+            net_input_t input = net::read_input(reader);
+            if (reader.overflowed())
+                break;
+            if (input.sequence <= client.last_input_sequence)
+                continue;
+            net::simulate_player(_world.entities[slot], input);
+            client.last_input_sequence = input.sequence;
+
+            /* The client saw at most the snapshot it acknowledged in this packet when it pressed fire */
+            if ((input.buttons & net_input_t::BUTTON_FIRE) && !(client.last_buttons & net_input_t::BUTTON_FIRE))
+                fire_weapon(slot, client.stats.last_acked_tick);
+            client.last_buttons = input.buttons;
+        }
+        break;
+    }
+    case PACKET_DISCONNECT:
+        if (slot >= 0)
+            drop_client(slot);
+        break;
+    default:
+        break;
+    }
+}
+
+void net_server_t::send_snapshot(int slot)
+{
+    client_t& client = _clients[slot];
+    const net_snapshot_t* baseline = get_snapshot(client.stats.last_acked_tick);
+
+    Uint8 buf[NET_MAX_PACKET];
+    bit_writer_t writer(buf, sizeof(buf));
+    write_header(writer, PACKET_SNAPSHOT);
+    writer.write_bits(_tick, 32);
+    writer.write_bits(baseline ? baseline->tick : 0, 32);
+    writer.write_bits(client.last_input_sequence, 32);
+    net::write_snapshot_delta(writer, baseline ? *baseline : zero_snapshot, _world);
+
+    if (writer.overflowed())
+    {
+        static bool warned = false;
+        if (!warned)
+            dc_log_error("Snapshot for tick %u does not fit in %d bytes", _tick, NET_MAX_PACKET);
+        warned = true;
+        return;
+    }
+
+    _socket.send_to(client.stats.address, buf, writer.get_bytes_written());
+    client.stats.bytes_sent += writer.get_bytes_written() + 28;
+    client.stats.snapshots_sent++;
+    if (!baseline)
+        client.stats.full_snapshots_sent++;
+}
+
+void net_server_t::tick(Uint64 now_ms)
+{
+    if (!_socket.is_open())
+        return;
+
+    _socket.update(now_ms);
+
+    Uint8 buf[NET_MAX_PACKET];
+    net_address_t from;
+    int len;
+    while ((len = _socket.recv_from(from, buf, sizeof(buf))) > 0)
+        handle_packet(from, buf, len, now_ms);
+
+    for (int i = 0; i < NET_MAX_CLIENTS; i++)
+    {
+        if (_clients[i].stats.connected && now_ms - _clients[i].last_packet_time > NET_TIMEOUT_MS)
+        {
+            dc_log("Client %d (%s) timed out", i, _clients[i].stats.address.to_string().c_str());
+            drop_client(i);
+        }
+    }
+
+    _tick++;
+    _world.tick = _tick;
+    _history[_tick % NET_SNAPSHOT_HISTORY] = _world;
+    _lagcomp.record(_tick, _world.entities, NET_MAX_ENTITIES);
+
+    for (int i = 0; i < NET_MAX_CLIENTS; i++)
+        if (_clients[i].stats.connected)
+            send_snapshot(i);
+}
+
+/* ================================ Client ================================ */
+
+net_client_t::net_client_t()
+{
+    _slot = -1;
+    _last_connect_time = 0;
+    _now_ms = 0;
+    _latest_tick = 0;
+    _first_reconciled_sequence = 0;
+    memset(_snapshots, 0, sizeof(_snapshots));
+    _next_sequence = 1;
+    memset(_inputs, 0, sizeof(_inputs));
+    memset(_predicted_states, 0, sizeof(_predicted_states));
+    memset(&_predicted, 0, sizeof(_predicted));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool net_client_t::connect(const net_address_t& server)
+{
+    disconnect();
+
+    if (!_socket.open(0))
+        return false;
+
+    _server = server;
+    _slot = -1;
+    _latest_tick = 0;
+    _first_reconciled_sequence = 0;
+    memset(_snapshots, 0, sizeof(_snapshots));
+    _next_sequence = 1;
+    memset(&_predicted, 0, sizeof(_predicted));
+    memset(&_stats, 0, sizeof(_stats));
+
+    _last_connect_time = _now_ms;
+    send_simple(_socket, _server, PACKET_CONNECT, NET_PROTOCOL_VERSION);
+
+    return true;
+}
+
+void net_client_t::disconnect()
+{
+    if (!_socket.is_open())
+        return;
+
+    if (_slot >= 0)
+        send_simple(_socket, _server, PACKET_DISCONNECT);
+    _socket.update((Uint64)-1);
+    _socket.close();
+    _slot = -1;
+}
+
+net_client_t::stats_t net_client_t::get_stats()
+{
+    stats_t stats = _stats;
+    stats.bytes_received = _socket.get_bytes_received();
+    stats.bytes_sent = _socket.get_bytes_sent();
+    return stats;
+}
+
+void net_client_t::reconcile(const net_entity_state_t& server_state, Uint32 last_sequence)
+{
+    if (_first_reconciled_sequence == 0)
+        _first_reconciled_sequence = _next_sequence;
+    else if (last_sequence >= _first_reconciled_sequence && last_sequence < _next_sequence && _next_sequence - last_sequence <= NET_INPUT_HISTORY)
+        if (_predicted_states[last_sequence % NET_INPUT_HISTORY] != server_state)
+            _stats.mispredictions++;
+
+    Uint32 replay_start = last_sequence + 1;
+    if (_next_sequence - replay_start > NET_INPUT_HISTORY)
+        replay_start = _next_sequence - NET_INPUT_HISTORY;
+
+    net_entity_state_t state = server_state;
+    for (Uint32 seq = replay_start; seq < _next_sequence; seq++)
+    {
+        net::simulate_player(state, _inputs[seq % NET_INPUT_HISTORY]);
+        _predicted_states[seq % NET_INPUT_HISTORY] = state;
+    }
+    _predicted = state;
+}
+
+void net_client_t::handle_packet(const Uint8* data, int len)
+{
+    bit_reader_t reader(data, len);
+
+    switch (read_header(reader))
+    {
+    case PACKET_ACCEPT:
+    {
+        Uint32 slot = reader.read_bits(8);
+        if (_slot < 0 && !reader.overflowed() && slot < NET_MAX_CLIENTS)
+        {
+            _slot = slot;
+            dc_log("Connected to %s as client %d", _server.to_string().c_str(), _slot);
+        }
+        break;
+    }
+    case PACKET_REJECT:
+        dc_log_warn("Connection rejected by %s", _server.to_string().c_str());
+        _socket.close();
+        _slot = -1;
+        break;
+    case PACKET_DISCONNECT:
+        dc_log("Disconnected by %s", _server.to_string().c_str());
+        _socket.close();
+        _slot = -1;
+        break;
+    case PACKET_SNAPSHOT:
+    {
+        if (_slot < 0)
+            break;
+
+        Uint32 tick = reader.read_bits(32);
+        Uint32 baseline_tick = reader.read_bits(32);
+        Uint32 last_sequence = reader.read_bits(32);
+        if (reader.overflowed() || tick <= _latest_tick)
+            break;
+
+        const net_snapshot_t* baseline = &zero_snapshot;
+        if (baseline_tick)
+        {
+            baseline = &_snapshots[baseline_tick % NET_SNAPSHOT_HISTORY];
+            if (baseline->tick != baseline_tick)
+            {
+                _stats.snapshots_dropped++;
+                break;
+            }
+        }
+
+        net_snapshot_t decoded;
+        if (!net::read_snapshot_delta(reader, *baseline, decoded))
+        {
+            _stats.snapshots_dropped++;
+            break;
+        }
+        decoded.tick = tick;
+
+        _snapshots[tick % NET_SNAPSHOT_HISTORY] = decoded;
+        _latest_tick = tick;
+        _stats.snapshots_received++;
+
+        reconcile(decoded.entities[_slot], last_sequence);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void net_client_t::tick(const net_input_t& input, Uint64 now_ms)
+{
+    if (!_socket.is_open())
+        return;
+
+    _now_ms = now_ms;
+    _socket.update(now_ms);
+
+    Uint8 buf[NET_MAX_PACKET];
+    net_address_t from;
+    int len;
+    while (_socket.is_open() && (len = _socket.recv_from(from, buf, sizeof(buf))) > 0)
+        if (from == _server)
+            handle_packet(buf, len);
+
+    if (!_socket.is_open())
+        return;
+
+    if (_slot < 0)
+    {
+        if (now_ms - _last_connect_time >= NET_CONNECT_RETRY_MS)
+        {
+            _last_connect_time = now_ms;
+            send_simple(_socket, _server, PACKET_CONNECT, NET_PROTOCOL_VERSION);
+        }
+        return;
+    }
+
+    net_input_t current = input;
+    current.sequence = _next_sequence++;
+    _inputs[current.sequence % NET_INPUT_HISTORY] = current;
+    net::simulate_player(_predicted, current);
+    _predicted_states[current.sequence % NET_INPUT_HISTORY] = _predicted;
+
+    Uint32 count = current.sequence < NET_INPUT_REDUNDANCY ? current.sequence : NET_INPUT_REDUNDANCY;
+
+    bit_writer_t writer(buf, sizeof(buf));
+    write_header(writer, PACKET_INPUT);
+    writer.write_bits(_latest_tick, 32);
+    writer.write_bits(count, 4);
+    for (Uint32 seq = _next_sequence - count; seq < _next_sequence; seq++)
+        net::write_input(writer, _inputs[seq % NET_INPUT_HISTORY]);
+
+    _socket.send_to(_server, buf, writer.get_bytes_written());
+}
+
+/* ================================ Glue ================================ */
+
+static net_server_t* listen_server = NULL;
+static net_client_t* local_client = NULL;
+
+/**
+ * Fixed rate tick pacing for frame(), decoupled from the clock so it can be tested with fake time
+ */
+struct tick_pacer_t
+{
+    Uint64 base_time = 0;
+    Uint64 ticks_since_base = 0;
+
+    /**
+     * Calls func(tick_time) for every tick due at now (At most 4 per call)
+     *
+     * @returns Number of ticks run
+     */
+    template <typename func_t> int advance(Uint64 now, func_t func)
+    {
+        /* Resync after long stalls instead of trying to catch up, the next tick is usually in the future so no subtraction */
+        Uint64 expected = base_time + ticks_since_base * 1000 / NET_TICK_RATE;
+        if (base_time == 0 || now > expected + 250)
+        {
+            base_time = now;
+            ticks_since_base = 0;
+        }
+
+        int ticks = 0;
+        for (; ticks < 4; ticks++)
+        {
+            Uint64 tick_time = base_time + ticks_since_base * 1000 / NET_TICK_RATE;
+            if (tick_time > now)
+                break;
+
+            func(tick_time);
+            ticks_since_base++;
+        }
+        return ticks;
+    }
+};
+
+static tick_pacer_t tick_pacer;
+
+static void stop_all()
+{
+    if (local_client)
+        local_client->disconnect();
+    if (listen_server)
+        listen_server->stop();
+    delete local_client;
+    delete listen_server;
+    local_client = NULL;
+    listen_server = NULL;
+}
+
+static net_input_t sample_input(bool accept_input)
+{
+    static Uint16 yaw = 0;
+
+    net_input_t input;
+    memset(&input, 0, sizeof(input));
+
+    if (accept_input)
+    {
+        const Uint8* keys = SDL_GetKeyboardState(NULL);
+        input.forward = (keys[SDL_SCANCODE_W] ? 127 : 0) - (keys[SDL_SCANCODE_S] ? 127 : 0);
+        input.strafe = (keys[SDL_SCANCODE_D] ? 127 : 0) - (keys[SDL_SCANCODE_A] ? 127 : 0);
+        if (keys[SDL_SCANCODE_LEFT])
+            yaw += 8;
+        if (keys[SDL_SCANCODE_RIGHT])
+            yaw -= 8;
+        if (keys[SDL_SCANCODE_SPACE])
+            input.buttons |= net_input_t::BUTTON_JUMP;
+    }
+
+    input.yaw = yaw & ((1 << NET_ANGLE_BITS) - 1);
+
+    return input;
+}
+
+void net::frame(bool accept_input)
+{
+    if (!listen_server && !local_client)
+        return;
+
+    tick_pacer.advance(SDL_GetTicks64(), [accept_input](Uint64 tick_time) {
+        if (listen_server)
+            listen_server->tick(tick_time);
+        if (local_client)
+            local_client->tick(sample_input(accept_input), tick_time);
+    });
+}
+
+void net::shutdown() { stop_all(); }
+
+/**
+ * Runs a server and NET_MAX_CLIENTS clients over loopback in simulated time and reports bandwidth and prediction stats
+ */
+static int loopback_test(int seconds, int lag_ms, int loss_percent)
+{
+    net_server_t* server = new net_server_t();
+    net_client_t* clients = new net_client_t[NET_MAX_CLIENTS];
+
+    int ret = 0;
+
+    if (!server->start(0))
+    {
+        dc_log_error("Unable to open server socket");
+        ret = 1;
+    }
+
+    net_address_t address;
+    address.host = 0x7F000001;
+    address.port = server->get_socket().get_port();
+    server->get_socket().set_simulation(lag_ms, loss_percent);
+
+    for (int i = 0; i < NET_MAX_CLIENTS && ret == 0; i++)
+    {
+        clients[i].get_socket().set_simulation(lag_ms, loss_percent);
+        if (!clients[i].connect(address))
+        {
+            dc_log_error("Unable to open client socket");
+            ret = 1;
+        }
+    }
+
+    net_input_t inputs[NET_MAX_CLIENTS];
+    memset(inputs, 0, sizeof(inputs));
+    Uint32 rng = 0x9E3779B9;
+
+    int total_ticks = seconds * NET_TICK_RATE;
+    for (int t = 0; t < total_ticks && ret == 0; t++)
+    {
+        Uint64 now = (Uint64)t * 1000 / NET_TICK_RATE;
+
+        /* Some static pickups and moving platforms so the snapshots are not just the players */
+        for (int e = NET_MAX_CLIENTS; e < NET_MAX_ENTITIES; e++)
+        {
+            net_entity_state_t& ent = server->get_entity(e);
+            ent.flags = net_entity_state_t::FLAG_ACTIVE;
+            ent.health = 1;
+            ent.pos[0] = (e % 8) * (16 << NET_FIXED_SHIFT);
+            ent.pos[2] = (e / 8) * (16 << NET_FIXED_SHIFT);
+            if (e < NET_MAX_CLIENTS + 8)
+            {
+                int phase = (t + e * 37) % 240;
+                ent.pos[1] = (phase < 120 ? phase : 240 - phase) << 4;
+                ent.yaw = (t * 4 + e * 50) & ((1 << NET_ANGLE_BITS) - 1);
+            }
+        }
+
+        server->tick(now);
+
+        for (int i = 0; i < NET_MAX_CLIENTS; i++)
+        {
+            if (t % 30 == i)
+            {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                inputs[i].forward = (Sint8)((rng & 0xFF) - 128);
+                inputs[i].strafe = (Sint8)(((rng >> 8) & 0xFF) - 128);
+                inputs[i].yaw = (rng >> 16) & ((1 << NET_ANGLE_BITS) - 1);
+                inputs[i].buttons = (rng >> 28) & net_input_t::BUTTON_JUMP;
+            }
+            clients[i].tick(inputs[i], now);
+        }
+    }
+
+    if (ret == 0)
+    {
+        dc_log("Loopback test: %d s, %d ms lag (one way), %d%% loss, %d Hz", seconds, lag_ms, loss_percent, NET_TICK_RATE);
+        for (int i = 0; i < NET_MAX_CLIENTS; i++)
+        {
+            net_client_t::stats_t cl_stats = clients[i].get_stats();
+            if (!clients[i].is_connected())
+            {
+                dc_log_error("Client %d: never connected", i);
+                ret = 1;
+                continue;
+            }
+            net_server_t::client_stats_t sv_stats = server->get_client_stats(clients[i].get_slot());
+            dc_log("Client %d: down %.2f KB/s, up %.2f KB/s, snapshots %llu/%llu (%llu full, %llu undecodable), mispredictions: %llu", i,
+                sv_stats.bytes_sent / 1024.0 / seconds, cl_stats.bytes_sent / 1024.0 / seconds, (unsigned long long)cl_stats.snapshots_received,
+                (unsigned long long)sv_stats.snapshots_sent, (unsigned long long)sv_stats.full_snapshots_sent,
+                (unsigned long long)cl_stats.snapshots_dropped, (unsigned long long)cl_stats.mispredictions);
+            if (cl_stats.snapshots_received == 0)
+                ret = 1;
+        }
+    }
+
+    for (int i = 0; i < NET_MAX_CLIENTS; i++)
+        clients[i].disconnect();
+    server->stop();
+
+    delete[] clients;
+    delete server;
+
+    return ret;
+}
+
+/**
+ * Steps a tick_pacer_t with a fake clock at a few frame rates (Including stalls) and checks the tick rate holds
+ */
+static int tick_pacer_selftest()
+{
+    int failed = 0;
+    const int seconds = 10;
+    const int frame_rates[] = { 30, 60, 75, 144, 240, 1000 };
+    for (int fps : frame_rates)
+    {
+        tick_pacer_t pacer;
+        Uint64 ticks = 0;
+        /* Start away from zero, base_time == 0 means unset */
+        for (Uint64 frame = 0; frame <= Uint64(seconds * fps); frame++)
+            ticks += pacer.advance(1000 + frame * 1000 / fps, [](Uint64) {});
+
+        Uint64 expected = seconds * NET_TICK_RATE + 1;
+        if (ticks + 1 >= expected && ticks <= expected + 1)
+            dc_log("net_tick_selftest: %4d fps: %llu ticks in %d s", fps, (unsigned long long)ticks, seconds);
+        else
+        {
+            dc_log_error("net_tick_selftest: %4d fps: %llu ticks in %d s (Expected %llu)", fps, (unsigned long long)ticks, seconds,
+                (unsigned long long)expected);
+            failed++;
+        }
+    }
+
+    /* A stall resyncs instead of running a burst of catch up ticks */
+    tick_pacer_t pacer;
+    for (Uint64 now = 1000; now < 2000; now += 7)
+        pacer.advance(now, [](Uint64) {});
+    int ticks = pacer.advance(3000, [](Uint64) {});
+    if (ticks != 1)
+    {
+        dc_log_error("net_tick_selftest: %d ticks after a 1 s stall (Expected 1)", ticks);
+        failed++;
+    }
+
+    if (!failed)
+        dc_log("net_tick_selftest: Passed");
+    return failed != 0;
+}
+
+void net::init()
+{
+    net::lag_compensation_init();
+
+    dev_console::add_command("net_listen", [=](const int argc, const char** argv) -> int {
+        stop_all();
+        Uint16 port = argc > 1 ? atoi(argv[1]) : NET_DEFAULT_PORT;
+        listen_server = new net_server_t();
+        if (!listen_server->start(port))
+        {
+            dc_log_error("Unable to listen on port %u", port);
+            stop_all();
+            return 1;
+        }
+
+        net_address_t address;
+        address.host = 0x7F000001;
+        address.port = listen_server->get_socket().get_port();
+        local_client = new net_client_t();
+        local_client->connect(address);
+        dc_log("Listening on port %u", address.port);
+        return 0;
+    });
+
+    dev_console::add_command("net_connect", [=](const int argc, const char** argv) -> int {
+        if (argc < 2)
+        {
+            dc_log("Usage: net_connect <host> [port]");
+            return 1;
+        }
+        stop_all();
+        net_address_t address;
+        if (!net_address_t::resolve(argv[1], argc > 2 ? atoi(argv[2]) : NET_DEFAULT_PORT, address))
+        {
+            dc_log_error("Unable to resolve \"%s\"", argv[1]);
+            return 1;
+        }
+        local_client = new net_client_t();
+        if (!local_client->connect(address))
+        {
+            dc_log_error("Unable to open client socket");
+            stop_all();
+            return 1;
+        }
+        dc_log("Connecting to %s", address.to_string().c_str());
+        return 0;
+    });
+
+    dev_console::add_command("net_disconnect", [=]() -> int {
+        stop_all();
+        return 0;
+    });
+
+    dev_console::add_command("net_status", [=]() -> int {
+        if (listen_server)
+        {
+            dc_log("Server: tick %u, port %u", listen_server->get_tick(), listen_server->get_socket().get_port());
+            for (int i = 0; i < NET_MAX_CLIENTS; i++)
+            {
+                net_server_t::client_stats_t stats = listen_server->get_client_stats(i);
+                if (stats.connected)
+                    dc_log("- Client %d: %s, acked tick %u, %llu bytes sent", i, stats.address.to_string().c_str(), stats.last_acked_tick,
+                        (unsigned long long)stats.bytes_sent);
+            }
+        }
+        if (local_client)
+        {
+            net_client_t::stats_t stats = local_client->get_stats();
+            dc_log("Client: slot %d, %llu snapshots, %llu mispredictions, %llu bytes received, %llu bytes sent", local_client->get_slot(),
+                (unsigned long long)stats.snapshots_received, (unsigned long long)stats.mispredictions, (unsigned long long)stats.bytes_received,
+                (unsigned long long)stats.bytes_sent);
+        }
+        if (!listen_server && !local_client)
+            dc_log("Not connected");
+        return 0;
+    });
+
+    dev_console::add_command("net_loopback_test", [=](const int argc, const char** argv) -> int {
+        int seconds = argc > 1 ? atoi(argv[1]) : 10;
+        int lag_ms = argc > 2 ? atoi(argv[2]) : 50;
+        int loss_percent = argc > 3 ? atoi(argv[3]) : 5;
+        if (seconds < 1)
+            seconds = 1;
+        return loopback_test(seconds, lag_ms, loss_percent);
+    });
+
+    dev_console::add_command("net_tick_selftest", tick_pacer_selftest);
+}
@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_NET_NETCODE_H
+#define MPH_TETRA_NET_NETCODE_H
+
+#include "lag_compensation.h"
+#include "snapshot.h"
+#include "udp_socket.h"
+
+#define NET_DEFAULT_PORT 27960
+#define NET_PROTOCOL_VERSION 1
+#define NET_MAX_PACKET 1400
+/**
+ * Number of snapshots kept for use as delta baselines (Power of 2)
+ */
+#define NET_SNAPSHOT_HISTORY 64
+/**
+ * Number of inputs kept for replaying during reconciliation (Power of 2)
+ */
+#define NET_INPUT_HISTORY 128
+/**
+ * Number of inputs resent in every input packet to cover packet loss
+ */
+#define NET_INPUT_REDUNDANCY 8
+
+/**
+ * Authoritative server
+ *
+ * Every tick() a snapshot of the world is sent to each client, delta compressed against the last snapshot that client acknowledged
+ */
+class net_server_t
+{
+public:
+    struct client_stats_t
+    {
+        bool connected;
+        net_address_t address;
+        Uint64 bytes_sent;
+        Uint64 snapshots_sent;
+        Uint64 full_snapshots_sent;
+        Uint32 last_acked_tick;
+    };
+
+    net_server_t();
+
+    bool start(Uint16 port);
+    void stop();
+
+    inline bool is_running() { return _socket.is_open(); }
+
+    /**
+     * Receives and applies client inputs, then advances the tick counter and sends snapshots
+     *
+     * @param now_ms Clock used for the network simulator and timeouts
+     */
+    void tick(Uint64 now_ms);
+
+    inline Uint32 get_tick() { return _tick; }
+
+    /**
+     * Entities [0, NET_MAX_CLIENTS) belong to players, the rest are free for game code to fill in before tick()
+     */
+    inline net_entity_state_t& get_entity(int i) { return _world.entities[i]; }
+
+    /**
+     * Returns the snapshot of a past tick, or NULL if it is no longer in the history
+     */
+    const net_snapshot_t* get_snapshot(Uint32 tick);
+
+    client_stats_t get_client_stats(int slot);
+
+    inline udp_socket_t& get_socket() { return _socket; }
+
+    inline lag_compensation_t& get_lag_compensation() { return _lagcomp; }
+
+private:
+    struct client_t
+    {
+        client_stats_t stats;
+        Uint32 last_input_sequence;
+        Uint64 last_packet_time;
+        Uint8 last_buttons;
+    };
+
+    void handle_packet(const net_address_t& from, const Uint8* data, int len, Uint64 now_ms);
+    void send_snapshot(int slot);
+    void drop_client(int slot);
+
+    /**
+     * Fires an instant hit shot for a player, other entities are rewound to the tick the client was looking at
+     */
+    void fire_weapon(int slot, Uint32 view_tick);
+
+    udp_socket_t _socket;
+    Uint32 _tick;
+    net_snapshot_t _world;
+    net_snapshot_t _history[NET_SNAPSHOT_HISTORY];
+    client_t _clients[NET_MAX_CLIENTS];
+    lag_compensation_t _lagcomp;
+};
+
+/**
+ * Client with client side prediction of the local player
+ *
+ * Inputs are applied locally as soon as they are made, when a snapshot arrives the local player is reset to the server
+ * state and all inputs the server has not processed yet are replayed on top of it
+ */
+class net_client_t
+{
+public:
+    struct stats_t
+    {
+        Uint64 snapshots_received;
+        /**
+         * Snapshots that could not be decoded because the baseline was missing
+         */
+        Uint64 snapshots_dropped;
+        /**
+         * Number of times the server state disagreed with the predicted state for the same input
+         */
+        Uint64 mispredictions;
+        Uint64 bytes_received;
+        Uint64 bytes_sent;
+    };
+
+    net_client_t();
+
+    bool connect(const net_address_t& server);
+    void disconnect();
+
+    inline bool is_connected() { return _slot >= 0; }
+    inline bool is_active() { return _socket.is_open(); }
+
+    /**
+     * Receives snapshots, reconciles, then predicts and sends `input`
+     *
+     * @param input Input for this tick, sequence is assigned by the client
+     * @param now_ms Clock used for the network simulator
+     */
+    void tick(const net_input_t& input, Uint64 now_ms);
+
+    /**
+     * Locally predicted state of the local player
+     */
+    inline const net_entity_state_t& get_predicted() { return _predicted; }
+
+    /**
+     * Latest snapshot received from the server
+     */
+    inline const net_snapshot_t& get_latest_snapshot() { return _snapshots[_latest_tick % NET_SNAPSHOT_HISTORY]; }
+
+    inline int get_slot() { return _slot; }
+
+    stats_t get_stats();
+
+    inline udp_socket_t& get_socket() { return _socket; }
+
+private:
+    void handle_packet(const Uint8* data, int len);
+    void reconcile(const net_entity_state_t& server_state, Uint32 last_sequence);
+
+    udp_socket_t _socket;
+    net_address_t _server;
+    int _slot;
+    Uint64 _last_connect_time;
+    Uint64 _now_ms;
+
+    Uint32 _latest_tick;
+    /**
+     * First input sequence predicted after the first snapshot, mispredictions are only counted from here on
+     */
+    Uint32 _first_reconciled_sequence;
+    net_snapshot_t _snapshots[NET_SNAPSHOT_HISTORY];
+
+    Uint32 _next_sequence;
+    net_input_t _inputs[NET_INPUT_HISTORY];
+    net_entity_state_t _predicted_states[NET_INPUT_HISTORY];
+    net_entity_state_t _predicted;
+
+    stats_t _stats;
+};
+
+namespace net
+{
+/**
+ * Registers the net_* console commands
+ */
+void init();
+
+/**
+ * Runs the listen server and/or client started from the console at NET_TICK_RATE
+ *
+ * @param accept_input Whether keyboard state should be turned into player input
+ */
+void frame(bool accept_input);
+
+void shutdown();
+};
+
+#endif
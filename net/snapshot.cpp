@@ -0,0 +1,245 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "snapshot.h"
+
+#include <math.h>
+
+#define NET_FLAG_BITS 3
+
+#define POS_MAX ((1 << (NET_POS_BITS - 1)) - 1)
+#define VEL_MAX ((1 << (NET_VEL_BITS - 1)) - 1)
+
+/* Movement tuning, in 24.8 fixed point units (per tick) */
+#define MOVE_MAX_SPEED 320
+#define MOVE_ACCEL_GROUND 48
+#define MOVE_ACCEL_AIR 8
+#define MOVE_GRAVITY 10
+#define MOVE_JUMP_SPEED 307
+#define MOVE_TERMINAL_VELOCITY 1024
+
+bool net_entity_state_t::operator==(const net_entity_state_t& other) const
+{
+    return pos[0] == other.pos[0] && pos[1] == other.pos[1] && pos[2] == other.pos[2] && vel[0] == other.vel[0] && vel[1] == other.vel[1]
+        && vel[2] == other.vel[2] && yaw == other.yaw && pitch == other.pitch && health == other.health && flags == other.flags
+        && weapon == other.weapon;
+}
+
+/**
+ * Returns sin(angle) in Q12 fixed point, angle is in units of 1 / (1 << NET_ANGLE_BITS) of a turn
+ *
+ * The table is built from double precision sin() and rounded to 12 bits, so every platform ends up with the same table
+ */
+static Sint32 sin_q12(Uint32 angle)
+{
+    struct table_t
+    {
+        Sint32 values[1 << NET_ANGLE_BITS];
+        table_t()
+        {
+            for (int i = 0; i < (1 << NET_ANGLE_BITS); i++)
+                values[i] = (Sint32)floor(sin(i * 2.0 * M_PI / (1 << NET_ANGLE_BITS)) * 4096.0 + 0.5);
+        }
+    };
+    static const table_t table;
+    return table.values[angle & ((1 << NET_ANGLE_BITS) - 1)];
+}
+
+static inline Sint32 cos_q12(Uint32 angle) { return sin_q12(angle + (1 << (NET_ANGLE_BITS - 2))); }
+
+static inline Sint32 mul_q12(Sint32 a, Sint32 b) { return (Sint32)(((Sint64)a * (Sint64)b) / 4096); }
+
+static inline Sint32 clamp(Sint32 x, Sint32 min, Sint32 max) { return x < min ? min : (x > max ? max : x); }
+
+static inline Sint32 approach(Sint32 cur, Sint32 target, Sint32 step)
+{
+    if (cur < target)
+        return cur + step > target ? target : cur + step;
+    return cur - step < target ? target : cur - step;
+}
+
+void net::simulate_player(net_entity_state_t& state, const net_input_t& input)
+{
+    state.yaw = input.yaw & ((1 << NET_ANGLE_BITS) - 1);
+    state.pitch = input.pitch & ((1 << NET_ANGLE_BITS) - 1);
+
+    if (input.buttons & net_input_t::BUTTON_ALT_FORM)
+        state.flags |= net_entity_state_t::FLAG_ALT_FORM;
+    else
+        state.flags &= ~net_entity_state_t::FLAG_ALT_FORM;
+
+    Sint32 wish_fwd = input.forward * MOVE_MAX_SPEED / 127;
+    Sint32 wish_strafe = input.strafe * MOVE_MAX_SPEED / 127;
+
+    Sint32 sin_yaw = sin_q12(state.yaw);
+    Sint32 cos_yaw = cos_q12(state.yaw);
+
+    Sint32 wish_x = mul_q12(wish_fwd, sin_yaw) + mul_q12(wish_strafe, cos_yaw);
+    Sint32 wish_z = mul_q12(wish_fwd, cos_yaw) - mul_q12(wish_strafe, sin_yaw);
+
+    bool on_ground = state.flags & net_entity_state_t::FLAG_ON_GROUND;
+    Sint32 accel = on_ground ? MOVE_ACCEL_GROUND : MOVE_ACCEL_AIR;
+
+    state.vel[0] = approach(state.vel[0], wish_x, accel);
+    state.vel[2] = approach(state.vel[2], wish_z, accel);
+
+    if (on_ground && (input.buttons & net_input_t::BUTTON_JUMP))
+        state.vel[1] = MOVE_JUMP_SPEED;
+    else
+        state.vel[1] = clamp(state.vel[1] - MOVE_GRAVITY, -MOVE_TERMINAL_VELOCITY, MOVE_TERMINAL_VELOCITY);
+
+    for (int i = 0; i < 3; i++)
+    {
+        state.vel[i] = clamp(state.vel[i], -VEL_MAX, VEL_MAX);
+        state.pos[i] = clamp(state.pos[i] + state.vel[i], -POS_MAX, POS_MAX);
+    }
+
+    /* Rooms are not loaded, so the only collision is a flat floor at y = 0 (Walls and ledges are not simulated) */
+    if (state.pos[1] <= 0)
+    {
+        state.pos[1] = 0;
+        state.vel[1] = 0;
+        state.flags |= net_entity_state_t::FLAG_ON_GROUND;
+    }
+    else
+        state.flags &= ~net_entity_state_t::FLAG_ON_GROUND;
+}
+
+void net::write_snapshot_delta(bit_writer_t& writer, const net_snapshot_t& baseline, const net_snapshot_t& current)
+{
+    for (int i = 0; i < NET_MAX_ENTITIES; i++)
+    {
+        const net_entity_state_t& b = baseline.entities[i];
+        const net_entity_state_t& c = current.entities[i];
+
+        if (b == c)
+        {
+            writer.write_bool(0);
+            continue;
+        }
+        writer.write_bool(1);
+
+        bool pos_changed = b.pos[0] != c.pos[0] || b.pos[1] != c.pos[1] || b.pos[2] != c.pos[2];
+        writer.write_bool(pos_changed);
+        if (pos_changed)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                Sint32 delta = c.pos[j] - b.pos[j];
+                bool is_short = -(1 << (NET_POS_DELTA_BITS - 1)) <= delta && delta < (1 << (NET_POS_DELTA_BITS - 1));
+                writer.write_bool(is_short);
+                if (is_short)
+                    writer.write_signed(delta, NET_POS_DELTA_BITS);
+                else
+                    writer.write_signed(c.pos[j], NET_POS_BITS);
+            }
+        }
+
+        bool vel_changed = b.vel[0] != c.vel[0] || b.vel[1] != c.vel[1] || b.vel[2] != c.vel[2];
+        writer.write_bool(vel_changed);
+        if (vel_changed)
+            for (int j = 0; j < 3; j++)
+                writer.write_signed(c.vel[j], NET_VEL_BITS);
+
+        bool angles_changed = b.yaw != c.yaw || b.pitch != c.pitch;
+        writer.write_bool(angles_changed);
+        if (angles_changed)
+        {
+            writer.write_bits(c.yaw, NET_ANGLE_BITS);
+            writer.write_bits(c.pitch, NET_ANGLE_BITS);
+        }
+
+        bool misc_changed = b.health != c.health || b.flags != c.flags || b.weapon != c.weapon;
+        writer.write_bool(misc_changed);
+        if (misc_changed)
+        {
+            writer.write_bits(c.health, 8);
+            writer.write_bits(c.flags, NET_FLAG_BITS);
+            writer.write_bits(c.weapon, NET_WEAPON_BITS);
+        }
+    }
+}
+
+bool net::read_snapshot_delta(bit_reader_t& reader, const net_snapshot_t& baseline, net_snapshot_t& out)
+{
+    for (int i = 0; i < NET_MAX_ENTITIES; i++)
+    {
+        const net_entity_state_t& b = baseline.entities[i];
+        net_entity_state_t& c = out.entities[i];
+        c = b;
+
+        if (!reader.read_bool())
+            continue;
+
+        if (reader.read_bool())
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                if (reader.read_bool())
+                    c.pos[j] = b.pos[j] + reader.read_signed(NET_POS_DELTA_BITS);
+                else
+                    c.pos[j] = reader.read_signed(NET_POS_BITS);
+            }
+        }
+
+        if (reader.read_bool())
+            for (int j = 0; j < 3; j++)
+                c.vel[j] = reader.read_signed(NET_VEL_BITS);
+
+        if (reader.read_bool())
+        {
+            c.yaw = reader.read_bits(NET_ANGLE_BITS);
+            c.pitch = reader.read_bits(NET_ANGLE_BITS);
+        }
+
+        if (reader.read_bool())
+        {
+            c.health = reader.read_bits(8);
+            c.flags = reader.read_bits(NET_FLAG_BITS);
+            c.weapon = reader.read_bits(NET_WEAPON_BITS);
+        }
+    }
+
+    return !reader.overflowed();
+}
+
+void net::write_input(bit_writer_t& writer, const net_input_t& input)
+{
+    writer.write_bits(input.sequence, 32);
+    writer.write_signed(input.forward, 8);
+    writer.write_signed(input.strafe, 8);
+    writer.write_bits(input.yaw, NET_ANGLE_BITS);
+    writer.write_bits(input.pitch, NET_ANGLE_BITS);
+    writer.write_bits(input.buttons, 3);
+}
+
+net_input_t net::read_input(bit_reader_t& reader)
+{
+    net_input_t input;
+    input.sequence = reader.read_bits(32);
+    input.forward = reader.read_signed(8);
+    input.strafe = reader.read_signed(8);
+    input.yaw = reader.read_bits(NET_ANGLE_BITS);
+    input.pitch = reader.read_bits(NET_ANGLE_BITS);
+    input.buttons = reader.read_bits(3);
+    return input;
+}
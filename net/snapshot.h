@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_NET_SNAPSHOT_H
+#define MPH_TETRA_NET_SNAPSHOT_H
+
+#include "bitstream.h"
+
+#include <SDL_bits.h>
+
+#define NET_MAX_CLIENTS 4
+#define NET_MAX_ENTITIES 64
+#define NET_TICK_RATE 60
+
+/**
+ * Positions are 24.8 fixed point world units, velocities are 24.8 fixed point units per tick
+ *
+ * The simulation runs directly on these values so that a state decoded from a snapshot is bit identical to the
+ * server's state, which keeps client side prediction from drifting
+ */
+#define NET_FIXED_SHIFT 8
+#define NET_POS_BITS 24
+#define NET_POS_DELTA_BITS 12
+#define NET_VEL_BITS 16
+#define NET_ANGLE_BITS 10
+#define NET_WEAPON_BITS 4
+
+struct net_entity_state_t
+{
+    enum net_entity_flags_t_
+    {
+        FLAG_ACTIVE = (1 << 0),
+        FLAG_ON_GROUND = (1 << 1),
+        FLAG_ALT_FORM = (1 << 2),
+    };
+
+    Sint32 pos[3];
+    Sint32 vel[3];
+    /**
+     * [0, 1 << NET_ANGLE_BITS)
+     */
+    Uint16 yaw;
+    Uint16 pitch;
+    Uint8 health;
+    Uint8 flags;
+    Uint8 weapon;
+
+    bool operator==(const net_entity_state_t& other) const;
+    inline bool operator!=(const net_entity_state_t& other) const { return !(*this == other); }
+};
+
+struct net_snapshot_t
+{
+    Uint32 tick;
+    net_entity_state_t entities[NET_MAX_ENTITIES];
+};
+
+/**
+ * One tick worth of player input
+ */
+struct net_input_t
+{
+    enum net_input_buttons_t_
+    {
+        BUTTON_JUMP = (1 << 0),
+        BUTTON_FIRE = (1 << 1),
+        BUTTON_ALT_FORM = (1 << 2),
+    };
+
+    Uint32 sequence;
+    /**
+     * Movement axes [-127, 127]
+     */
+    Sint8 forward;
+    Sint8 strafe;
+    Uint16 yaw;
+    Uint16 pitch;
+    Uint8 buttons;
+};
+
+namespace net
+{
+/**
+ * Advances a player entity by one tick
+ *
+ * Shared by the server and the client side prediction, this must stay deterministic (Integer only)
+ */
+void simulate_player(net_entity_state_t& state, const net_input_t& input);
+
+/**
+ * Delta encodes `current` against `baseline`
+ *
+ * Per entity there is a changed bit, followed by per field group changed bits.
+ * Positions are sent as a short delta when close to the baseline.
+ */
+void write_snapshot_delta(bit_writer_t& writer, const net_snapshot_t& baseline, const net_snapshot_t& current);
+
+/**
+ * Decodes a snapshot written by write_snapshot_delta()
+ *
+ * @param out Decoded snapshot, `out.tick` is not touched
+ *
+ * @returns true on success, false if the reader overflowed
+ */
+bool read_snapshot_delta(bit_reader_t& reader, const net_snapshot_t& baseline, net_snapshot_t& out);
+
+void write_input(bit_writer_t& writer, const net_input_t& input);
+net_input_t read_input(bit_reader_t& reader);
+};
+
+#endif
@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "udp_socket.h"
+
+#include "util/convar.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_handle_t;
+typedef int socklen_t;
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_handle_t;
+#define close_socket ::close
+#endif
+
+static convar_int_t net_fakelag("net_fakelag", 0, 0, 1000, "Simulated one way latency added to outgoing packets (ms)");
+static convar_int_t net_fakeloss("net_fakeloss", 0, 0, 100, "Simulated packet loss for outgoing packets (percent)");
+
+std::string net_address_t::to_string() const
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u:%u", (host >> 24) & 0xFF, (host >> 16) & 0xFF, (host >> 8) & 0xFF, host & 0xFF, port);
+    return std::string(buf);
+}
+
+bool net_address_t::resolve(const char* hostname, Uint16 port, net_address_t& out)
+{
+    if (!udp_socket_t::init_platform())
+        return false;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(hostname, NULL, &hints, &result) != 0 || !result)
+        return false;
+
+    out.host = ntohl(((struct sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+    out.port = port;
+    freeaddrinfo(result);
+
+    return true;
+}
+
+bool udp_socket_t::init_platform()
+{
+#ifdef _WIN32
+    static bool initialized = false;
+    if (!initialized)
+    {
+        WSADATA wsa_data;
+        initialized = WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+    }
+    return initialized;
+#else
+    return true;
+#endif
+}
+
+udp_socket_t::udp_socket_t()
+{
+    _fd = INVALID_FD;
+    _now_ms = 0;
+    _rng_state = 0x2545F491;
+    _lag_override = -1;
+    _loss_override = -1;
+    _bytes_sent = 0;
+    _bytes_received = 0;
+}
+
+udp_socket_t::~udp_socket_t() { close(); }
+
+bool udp_socket_t::open(Uint16 port)
+{
+    close();
+
+    if (!init_platform())
+        return false;
+
+    socket_handle_t fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+#ifdef _WIN32
+    if (fd == INVALID_SOCKET)
+        return false;
+#else
+    if (fd < 0)
+        return false;
+#endif
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close_socket(fd);
+        return false;
+    }
+
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    bool ok = ioctlsocket(fd, FIONBIO, &non_blocking) == 0;
+#else
+    bool ok = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+    if (!ok)
+    {
+        close_socket(fd);
+        return false;
+    }
+
+    _fd = (long long)fd;
+    _bytes_sent = 0;
+    _bytes_received = 0;
+
+    return true;
+}
+
+void udp_socket_t::close()
+{
+    if (_fd != INVALID_FD)
+        close_socket((socket_handle_t)_fd);
+    _fd = INVALID_FD;
+    _delayed.clear();
+}
+
+Uint16 udp_socket_t::get_port()
+{
+    if (_fd == INVALID_FD)
+        return 0;
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname((socket_handle_t)_fd, (struct sockaddr*)&addr, &len) != 0)
+        return 0;
+
+    return ntohs(addr.sin_port);
+}
+
+bool udp_socket_t::send_now(const net_address_t& to, const void* data, size_t len)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(to.host);
+    addr.sin_port = htons(to.port);
+
+    if (sendto((socket_handle_t)_fd, (const char*)data, len, 0, (struct sockaddr*)&addr, sizeof(addr)) != (int)len)
+        return false;
+
+    return true;
+}
+
+bool udp_socket_t::send_to(const net_address_t& to, const void* data, size_t len)
+{
+    if (_fd == INVALID_FD)
+        return false;
+
+    /* UDP + IPv4 header overhead is counted so that the stats reflect what actually goes over the wire */
+    _bytes_sent += len + 28;
+
+    int loss = _loss_override >= 0 ? _loss_override : net_fakeloss.get();
+    int lag = _lag_override >= 0 ? _lag_override : net_fakelag.get();
+
+    if (loss > 0)
+    {
+        /* xorshift32 */
+        _rng_state ^= _rng_state << 13;
+        _rng_state ^= _rng_state >> 17;
+        _rng_state ^= _rng_state << 5;
+        if ((int)(_rng_state % 100) < loss)
+            return true;
+    }
+
+    if (lag <= 0)
+        return send_now(to, data, len);
+
+    delayed_packet_t packet;
+    packet.deliver_time = _now_ms + lag;
+    packet.to = to;
+    packet.data.assign((const Uint8*)data, (const Uint8*)data + len);
+    _delayed.push_back(packet);
+
+    return true;
+}
+
+int udp_socket_t::recv_from(net_address_t& from, void* data, size_t len)
+{
+    if (_fd == INVALID_FD)
+        return -1;
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int r = recvfrom((socket_handle_t)_fd, (char*)data, len, 0, (struct sockaddr*)&addr, &addr_len);
+
+    if (r < 0)
+    {
+#ifdef _WIN32
+        int err = WSAGetLastError();
+        /* WSAECONNRESET is reported for ICMP port unreachable, which is harmless for a connectionless protocol */
+        if (err == WSAEWOULDBLOCK || err == WSAECONNRESET)
+            return 0;
+#else
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED)
+            return 0;
+#endif
+        return -1;
+    }
+
+    from.host = ntohl(addr.sin_addr.s_addr);
+    from.port = ntohs(addr.sin_port);
+    _bytes_received += r + 28;
+
+    return r;
+}
+
+void udp_socket_t::update(Uint64 now_ms)
+{
+    _now_ms = now_ms;
+
+    while (!_delayed.empty() && _delayed.front().deliver_time <= _now_ms)
+    {
+        send_now(_delayed.front().to, _delayed.front().data.data(), _delayed.front().data.size());
+        _delayed.pop_front();
+    }
+}
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_NET_UDP_SOCKET_H
+#define MPH_TETRA_NET_UDP_SOCKET_H
+
+#include <SDL_bits.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * IPv4 address and port, both in host byte order
+ */
+struct net_address_t
+{
+    Uint32 host;
+    Uint16 port;
+
+    inline bool operator==(const net_address_t& other) const { return host == other.host && port == other.port; }
+
+    std::string to_string() const;
+
+    /**
+     * Resolves `hostname` (Dotted IPv4 or a name) into an address
+     *
+     * @returns true on success, false on error
+     */
+    static bool resolve(const char* hostname, Uint16 port, net_address_t& out);
+};
+
+/**
+ * Non-blocking IPv4 UDP socket
+ *
+ * Outgoing packets pass through a network simulator controlled by the convars net_fakelag and net_fakeloss,
+ * delayed packets are sent by update()
+ */
+class udp_socket_t
+{
+public:
+    udp_socket_t();
+    ~udp_socket_t();
+
+    /**
+     * Opens the socket and binds it to `port` on all interfaces, a port of 0 picks any free port
+     *
+     * @returns true on success, false on error
+     */
+    bool open(Uint16 port);
+
+    void close();
+
+    inline bool is_open() { return _fd != INVALID_FD; }
+
+    /**
+     * Returns the port the socket is bound to
+     */
+    Uint16 get_port();
+
+    /**
+     * Queues or sends a packet
+     *
+     * @returns true if the packet was queued/sent (or dropped by the simulator), false on socket error
+     */
+    bool send_to(const net_address_t& to, const void* data, size_t len);
+
+    /**
+     * Receive a single packet without blocking
+     *
+     * @returns length of the packet, 0 if there are no packets waiting, and -1 on error
+     */
+    int recv_from(net_address_t& from, void* data, size_t len);
+
+    /**
+     * Sets the simulator clock and flushes packets whose delay has expired
+     *
+     * @param now_ms Current time in milliseconds (Does not have to be real time)
+     */
+    void update(Uint64 now_ms);
+
+    /**
+     * Overrides the net_fakelag/net_fakeloss convars for this socket, negative values use the convars
+     */
+    inline void set_simulation(int lag_ms, int loss_percent)
+    {
+        _lag_override = lag_ms;
+        _loss_override = loss_percent;
+    }
+
+    inline Uint64 get_bytes_sent() { return _bytes_sent; }
+    inline Uint64 get_bytes_received() { return _bytes_received; }
+
+    static bool init_platform();
+
+private:
+    static const long long INVALID_FD = -1;
+
+    struct delayed_packet_t
+    {
+        Uint64 deliver_time;
+        net_address_t to;
+        std::vector<Uint8> data;
+    };
+
+    bool send_now(const net_address_t& to, const void* data, size_t len);
+
+    long long _fd;
+    Uint64 _now_ms;
+    Uint32 _rng_state;
+    int _lag_override;
+    int _loss_override;
+    Uint64 _bytes_sent;
+    Uint64 _bytes_received;
+    std::deque<delayed_packet_t> _delayed;
+};
+
+#endif
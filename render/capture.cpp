@@ -0,0 +1,576 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "capture.h"
+
+#include "gl.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/physfs/physfs.h"
+#include "util/png.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <deque>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#define CAPTURE_DIR "/captures"
+#define CAPTURE_RING_SIZE 4
+
+enum capture_format_t
+{
+    CAPTURE_FORMAT_NONE = -1,
+    CAPTURE_FORMAT_PNG,
+    CAPTURE_FORMAT_Y4M,
+};
+
+static convar_int_t capture_format("capture_format", CAPTURE_FORMAT_PNG, CAPTURE_FORMAT_PNG, CAPTURE_FORMAT_Y4M,
+    "Default format for capture_toggle (0: PNG sequence, 1: Y4M video)");
+static convar_int_t capture_y4m_fps("capture_y4m_fps", 60, 1, 240, "Frame rate written to Y4M headers (Dropped frames are not compensated for)");
+
+static profiler_zone_t zone_capture_frame("render::capture_frame");
+
+enum slot_state_t
+{
+    SLOT_FREE,
+    /** glReadPixels() issued, waiting on the fence */
+    SLOT_READING,
+    /** Mapped and owned by the writer thread */
+    SLOT_WRITING,
+    /** Writer thread is done with the mapping, needs to be unmapped by the main thread */
+    SLOT_WRITTEN,
+};
+
+/**
+ * Everything except the state is only touched by the main thread while the slot is free/reading, and only by the writer
+ * thread while it is writing
+ */
+struct capture_slot_t
+{
+    GLuint buffer;
+    size_t buffer_size;
+    GLsync fence;
+    SDL_atomic_t state;
+
+    int width;
+    int height;
+    const Uint8* pixels;
+
+    std::string screenshot_path;
+    capture_format_t video_format;
+    /** PNG: Path of this frame, Y4M: Path of the video file */
+    std::string video_path;
+    int video_fps;
+
+    std::string error;
+};
+
+static capture_slot_t slots[CAPTURE_RING_SIZE];
+/** Slots in the reading state oldest first, a negative index is a video close queued behind them */
+static std::deque<int> reading;
+
+static struct
+{
+    capture_format_t format = CAPTURE_FORMAT_NONE;
+    std::string path;
+    int fps;
+    int width;
+    int height;
+    int frames;
+    int dropped;
+} video;
+
+static std::string screenshot_path;
+
+/* Writer thread queue, a negative index closes the open video file */
+static SDL_Thread* writer_thread = NULL;
+static SDL_mutex* writer_lock = NULL;
+static SDL_cond* writer_cond = NULL;
+static std::deque<int> writer_queue;
+static bool writer_quit = false;
+
+static void writer_push(int index)
+{
+    SDL_LockMutex(writer_lock);
+    writer_queue.push_back(index);
+    SDL_CondSignal(writer_cond);
+    SDL_UnlockMutex(writer_lock);
+}
+
+static bool write_bytes(PHYSFS_File* fd, const std::vector<Uint8>& data)
+{
+    return PHYSFS_writeBytes(fd, data.data(), data.size()) == (PHYSFS_sint64)data.size();
+}
+
+static std::string physfs_error(const char* what, const std::string& path)
+{
+    return std::string(what) + " " + path + ": " + PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+}
+
+static bool write_png(const capture_slot_t& slot, const std::string& path, std::vector<Uint8>& rgb, std::vector<Uint8>& encoded, std::string& error)
+{
+    /* Readbacks are bottom up and the alpha channel of the default framebuffer is meaningless */
+    rgb.resize(size_t(slot.width) * slot.height * 3);
+    for (int y = 0; y < slot.height; y++)
+    {
+        const Uint8* src = slot.pixels + size_t(slot.height - 1 - y) * slot.width * 4;
+        Uint8* dst = &rgb[size_t(y) * slot.width * 3];
+        for (int x = 0; x < slot.width; x++, src += 4, dst += 3)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+    }
+
+    encoded.clear();
+    util::encode_png(rgb.data(), slot.width, slot.height, 3, slot.width * 3, encoded);
+
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+    {
+        error = physfs_error("Unable to open", path);
+        return false;
+    }
+
+    bool success = write_bytes(fd, encoded);
+    PHYSFS_close(fd);
+    if (!success)
+        error = physfs_error("Unable to write", path);
+    return success;
+}
+
+static inline Uint8 clamp_u8(int x) { return x < 0 ? 0 : (x > 255 ? 255 : x); }
+
+/**
+ * Converts a bottom up RGBA frame to full range BT.601 4:2:0 planes (Y4M C420jpeg), odd dimensions are cropped
+ */
+static void rgba_to_yuv420(const capture_slot_t& slot, std::vector<Uint8>& out)
+{
+    int w = slot.width & ~1;
+    int h = slot.height & ~1;
+    out.resize(size_t(w) * h * 3 / 2);
+
+    Uint8* plane_y = out.data();
+    Uint8* plane_u = plane_y + size_t(w) * h;
+    Uint8* plane_v = plane_u + size_t(w / 2) * (h / 2);
+
+    for (int y = 0; y < h; y += 2)
+    {
+        const Uint8* src[2] = {
+            slot.pixels + size_t(slot.height - 1 - y) * slot.width * 4,
+            slot.pixels + size_t(slot.height - 2 - y) * slot.width * 4,
+        };
+
+        for (int x = 0; x < w; x += 2)
+        {
+            int sum_r = 0, sum_g = 0, sum_b = 0;
+            for (int j = 0; j < 2; j++)
+            {
+                for (int i = 0; i < 2; i++)
+                {
+                    const Uint8* p = src[j] + (x + i) * 4;
+                    plane_y[size_t(y + j) * w + x + i] = (19595 * p[0] + 38470 * p[1] + 7471 * p[2] + 32768) >> 16;
+                    sum_r += p[0];
+                    sum_g += p[1];
+                    sum_b += p[2];
+                }
+            }
+
+            int r = (sum_r + 2) >> 2, g = (sum_g + 2) >> 2, b = (sum_b + 2) >> 2;
+            size_t c = size_t(y / 2) * (w / 2) + x / 2;
+            plane_u[c] = clamp_u8((-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16);
+            plane_v[c] = clamp_u8((32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16);
+        }
+    }
+}
+
+static int writer_main(void*)
+{
+    PHYSFS_File* video_fd = NULL;
+    std::string video_fd_path;
+    std::vector<Uint8> scratch;
+    std::vector<Uint8> encoded;
+
+    SDL_LockMutex(writer_lock);
+    while (1)
+    {
+        while (!writer_quit && writer_queue.empty())
+            SDL_CondWait(writer_cond, writer_lock);
+
+        /* Outstanding frames are still written when quitting */
+        if (writer_queue.empty())
+            break;
+
+        int index = writer_queue.front();
+        writer_queue.pop_front();
+        SDL_UnlockMutex(writer_lock);
+
+        if (index < 0)
+        {
+            if (video_fd)
+                PHYSFS_close(video_fd);
+            video_fd = NULL;
+            video_fd_path.clear();
+
+            SDL_LockMutex(writer_lock);
+            continue;
+        }
+
+        capture_slot_t& slot = slots[index];
+        slot.error.clear();
+
+        if (slot.screenshot_path.length())
+            write_png(slot, slot.screenshot_path, scratch, encoded, slot.error);
+
+        if (slot.video_format == CAPTURE_FORMAT_PNG)
+            write_png(slot, slot.video_path, scratch, encoded, slot.error);
+        else if (slot.video_format == CAPTURE_FORMAT_Y4M)
+        {
+            if (video_fd_path != slot.video_path)
+            {
+                if (video_fd)
+                    PHYSFS_close(video_fd);
+                video_fd_path = slot.video_path;
+                video_fd = PHYSFS_openWrite(video_fd_path.c_str());
+                if (!video_fd)
+                    slot.error = physfs_error("Unable to open", video_fd_path);
+                else
+                {
+                    char header[128];
+                    snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", slot.width & ~1, slot.height & ~1, slot.video_fps);
+                    if (PHYSFS_writeBytes(video_fd, header, strlen(header)) != (PHYSFS_sint64)strlen(header))
+                        slot.error = physfs_error("Unable to write", video_fd_path);
+                }
+            }
+
+            if (video_fd && slot.error.empty())
+            {
+                static const char frame_header[] = "FRAME\n";
+                rgba_to_yuv420(slot, scratch);
+                if (PHYSFS_writeBytes(video_fd, frame_header, sizeof(frame_header) - 1) != sizeof(frame_header) - 1 || !write_bytes(video_fd, scratch))
+                    slot.error = physfs_error("Unable to write", video_fd_path);
+            }
+        }
+
+        SDL_AtomicSet(&slot.state, SLOT_WRITTEN);
+
+        SDL_LockMutex(writer_lock);
+    }
+    SDL_UnlockMutex(writer_lock);
+
+    if (video_fd)
+        PHYSFS_close(video_fd);
+
+    return 0;
+}
+
+/**
+ * @returns Path under CAPTURE_DIR that does not exist yet
+ */
+static std::string unique_path(const char* prefix, const char* suffix)
+{
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+
+    std::string base = std::string(CAPTURE_DIR "/") + prefix + "_" + stamp;
+    std::string path = base + suffix;
+    for (int i = 2; PHYSFS_exists(path.c_str()); i++)
+        path = base + "_" + std::to_string(i) + suffix;
+    return path;
+}
+
+static void video_stop()
+{
+    if (video.format == CAPTURE_FORMAT_NONE)
+        return;
+
+    dc_log("Capture stopped: %s (%d frames, %d dropped)", video.path.c_str(), video.frames, video.dropped);
+
+    video.format = CAPTURE_FORMAT_NONE;
+    reading.push_back(-1);
+}
+
+static bool video_start(capture_format_t format)
+{
+    if (!PHYSFS_mkdir(CAPTURE_DIR))
+    {
+        dc_log_error("Unable to create " CAPTURE_DIR ": %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return false;
+    }
+
+    if (format == CAPTURE_FORMAT_PNG)
+    {
+        video.path = unique_path("capture", "");
+        if (!PHYSFS_mkdir(video.path.c_str()))
+        {
+            dc_log_error("Unable to create %s: %s", video.path.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            return false;
+        }
+    }
+    else
+        video.path = unique_path("capture", ".y4m");
+
+    video.format = format;
+    video.fps = capture_y4m_fps.get();
+    video.width = 0;
+    video.height = 0;
+    video.frames = 0;
+    video.dropped = 0;
+
+    dc_log("Capture started: %s", video.path.c_str());
+    return true;
+}
+
+/**
+ * Hands finished readbacks to the writer thread and recycles slots the writer is done with
+ *
+ * @param block Wait for every outstanding readback instead of only taking the ones that are ready
+ */
+static void service_ring(bool block)
+{
+    while (reading.size())
+    {
+        if (reading.front() < 0)
+        {
+            writer_push(reading.front());
+            reading.pop_front();
+            continue;
+        }
+
+        capture_slot_t& slot = slots[reading.front()];
+
+        GLenum result = glClientWaitSync(slot.fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000000 : 0);
+        if (result == GL_TIMEOUT_EXPIRED && !block)
+            break;
+
+        glDeleteSync(slot.fence);
+        slot.fence = NULL;
+
+        slot.pixels = NULL;
+        if (result != GL_WAIT_FAILED)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            slot.pixels = (const Uint8*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_t(slot.width) * slot.height * 4, GL_MAP_READ_BIT);
+        }
+
+        if (!slot.pixels)
+        {
+            dc_log_error("Unable to map capture buffer");
+            SDL_AtomicSet(&slot.state, SLOT_FREE);
+        }
+        else
+        {
+            SDL_AtomicSet(&slot.state, SLOT_WRITING);
+            writer_push(reading.front());
+        }
+        reading.pop_front();
+    }
+
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        capture_slot_t& slot = slots[i];
+        if (SDL_AtomicGet(&slot.state) != SLOT_WRITTEN)
+            continue;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        slot.pixels = NULL;
+
+        if (slot.error.length())
+        {
+            dc_log_error("%s", slot.error.c_str());
+            /* Don't repeat the same error for every remaining frame */
+            if (slot.video_format != CAPTURE_FORMAT_NONE && video.format != CAPTURE_FORMAT_NONE)
+                video_stop();
+        }
+        else if (slot.screenshot_path.length())
+            dc_log("Saved %s", slot.screenshot_path.c_str());
+
+        SDL_AtomicSet(&slot.state, SLOT_FREE);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void render::capture_frame(int width, int height)
+{
+    if (!writer_thread)
+        return;
+
+    PROFILER_SCOPE(zone_capture_frame);
+
+    service_ring(false);
+
+    if (video.format == CAPTURE_FORMAT_Y4M && video.frames && (video.width != width || video.height != height))
+    {
+        dc_log_warn("Window resized, Y4M can not change resolution mid-stream");
+        video_stop();
+    }
+
+    bool want_video = video.format != CAPTURE_FORMAT_NONE;
+    if (!want_video && screenshot_path.empty())
+        return;
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    int index = -1;
+    for (int i = 0; i < CAPTURE_RING_SIZE && index < 0; i++)
+        if (SDL_AtomicGet(&slots[i].state) == SLOT_FREE)
+            index = i;
+
+    /* Every buffer is busy, the writer thread can't keep up. Stalling here would just drop frames from the game instead. A
+     * pending screenshot is retried next frame */
+    if (index < 0)
+    {
+        if (want_video)
+            video.dropped++;
+        return;
+    }
+
+    capture_slot_t& slot = slots[index];
+    slot.width = width;
+    slot.height = height;
+    slot.screenshot_path.swap(screenshot_path);
+    screenshot_path.clear();
+    slot.video_format = video.format;
+    slot.video_fps = video.fps;
+    if (video.format == CAPTURE_FORMAT_PNG)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%06d.png", video.frames);
+        slot.video_path = video.path + name;
+    }
+    else
+        slot.video_path = video.path;
+
+    if (want_video)
+    {
+        video.width = width;
+        video.height = height;
+        video.frames++;
+    }
+
+    if (!slot.buffer)
+        glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+    size_t size = size_t(width) * height * 4;
+    if (slot.buffer_size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.buffer_size = size;
+    }
+
+    /* Rows of RGBA8 are always 4 byte aligned, so the default pack alignment never pads */
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    SDL_AtomicSet(&slot.state, SLOT_READING);
+    reading.push_back(index);
+}
+
+void render::capture_init()
+{
+    writer_lock = SDL_CreateMutex();
+    writer_cond = SDL_CreateCond();
+    writer_quit = false;
+    writer_thread = SDL_CreateThread(writer_main, "capture_writer", NULL);
+    if (!writer_thread)
+        dc_log_error("Unable to create capture writer thread: %s", SDL_GetError());
+
+    dev_console::add_command("screenshot", []() -> int {
+        if (!writer_thread)
+            return 1;
+        if (!PHYSFS_mkdir(CAPTURE_DIR))
+        {
+            dc_log_error("Unable to create " CAPTURE_DIR ": %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            return 1;
+        }
+        screenshot_path = unique_path("screenshot", ".png");
+        return 0;
+    });
+
+    dev_console::add_command("capture_toggle", [](const int argc, const char** argv) -> int {
+        if (video.format != CAPTURE_FORMAT_NONE)
+        {
+            video_stop();
+            return 0;
+        }
+
+        if (!writer_thread)
+            return 1;
+
+        capture_format_t format = (capture_format_t)capture_format.get();
+        if (argc > 1 && !strcmp(argv[1], "png"))
+            format = CAPTURE_FORMAT_PNG;
+        else if (argc > 1 && !strcmp(argv[1], "y4m"))
+            format = CAPTURE_FORMAT_Y4M;
+        else if (argc > 1)
+        {
+            dc_log("Usage: %s [png|y4m]", argv[0]);
+            return 1;
+        }
+
+        return video_start(format) ? 0 : 1;
+    });
+}
+
+void render::capture_shutdown()
+{
+    if (!writer_thread)
+        return;
+
+    video_stop();
+    screenshot_path.clear();
+
+    /* Finish everything in flight so no frames are lost, then let the writer drain its queue */
+    service_ring(true);
+
+    SDL_LockMutex(writer_lock);
+    writer_quit = true;
+    SDL_CondSignal(writer_cond);
+    SDL_UnlockMutex(writer_lock);
+    SDL_WaitThread(writer_thread, NULL);
+    writer_thread = NULL;
+
+    service_ring(false);
+
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        if (slots[i].buffer)
+            glDeleteBuffers(1, &slots[i].buffer);
+        slots[i].buffer = 0;
+        slots[i].buffer_size = 0;
+    }
+
+    SDL_DestroyCond(writer_cond);
+    SDL_DestroyMutex(writer_lock);
+    writer_cond = NULL;
+    writer_lock = NULL;
+}
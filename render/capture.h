@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_CAPTURE_H
+#define MPH_TETRA_RENDER_CAPTURE_H
+
+/**
+ * Screenshot and video capture of the default framebuffer
+ *
+ * Frames are read back into a small ring of pixel pack buffers and only mapped once their fence has signalled, so the
+ * render thread never waits on the GPU. Mapped frames are handed to a writer thread that flips, converts, encodes and
+ * writes them to /captures/ in the write directory. When every buffer in the ring is still busy the frame is dropped
+ * instead of stalling.
+ */
+namespace render
+{
+/**
+ * Registers the capture commands and starts the writer thread
+ */
+void capture_init();
+
+/**
+ * Reads back the current back buffer if a capture is active and services finished readbacks
+ *
+ * Call after all drawing for the frame, before swapping buffers
+ *
+ * @param width Drawable width in pixels
+ * @param height Drawable height in pixels
+ */
+void capture_frame(int width, int height);
+
+/**
+ * Finishes any outstanding captures and releases the GL objects, must be called before the GL context is destroyed
+ */
+void capture_shutdown();
+}
+
+#endif
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "gl.h"
+
+#include "gui/console.h"
+
+#include <SDL.h>
+#include <set>
+#include <string>
+
+#define MPH_TETRA_GL_DEFINE(type, name) type mph_tetra_##name = NULL;
+MPH_TETRA_GL_FUNCTIONS_REQUIRED(MPH_TETRA_GL_DEFINE)
+MPH_TETRA_GL_FUNCTIONS_OPTIONAL(MPH_TETRA_GL_DEFINE)
+#undef MPH_TETRA_GL_DEFINE
+
+static std::set<std::string> extensions;
+static bool program_binary_supported = false;
+
+bool render::gl_init()
+{
+    bool success = true;
+
+#define MPH_TETRA_GL_LOAD_REQUIRED(type, name)                          \
+    if (!(mph_tetra_##name = (type)SDL_GL_GetProcAddress(#name)))      \
+    {                                                                   \
+        dc_log_error("Unable to load required OpenGL function " #name); \
+        success = false;                                                \
+    }
+#define MPH_TETRA_GL_LOAD_OPTIONAL(type, name) mph_tetra_##name = (type)SDL_GL_GetProcAddress(#name);
+
+    MPH_TETRA_GL_FUNCTIONS_REQUIRED(MPH_TETRA_GL_LOAD_REQUIRED);
+    MPH_TETRA_GL_FUNCTIONS_OPTIONAL(MPH_TETRA_GL_LOAD_OPTIONAL);
+
+#undef MPH_TETRA_GL_LOAD_REQUIRED
+#undef MPH_TETRA_GL_LOAD_OPTIONAL
+
+    if (!success)
+        return false;
+
+    extensions.clear();
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; i++)
+    {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext)
+            extensions.insert(ext);
+    }
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    /* Some drivers expose the extension but report zero formats, in which case there is nothing to cache */
+    GLint num_binary_formats = 0;
+    if (gl_has_extension("GL_ARB_get_program_binary") || major > 4 || (major == 4 && minor >= 1))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+
+    program_binary_supported = num_binary_formats > 0 && glProgramParameteri && glGetProgramBinary && glProgramBinary;
+
+    dc_log("GL_VENDOR: %s", (const char*)glGetString(GL_VENDOR));
+    dc_log("GL_RENDERER: %s", (const char*)glGetString(GL_RENDERER));
+    dc_log("GL_VERSION: %s", (const char*)glGetString(GL_VERSION));
+    dc_log("GL_SHADING_LANGUAGE_VERSION: %s", (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
+    dc_log("Program binary formats: %d", num_binary_formats);
+
+    return true;
+}
+
+bool render::gl_has_extension(const char* name) { return extensions.count(name) != 0; }
+
+bool render::gl_has_program_binary() { return program_binary_supported; }
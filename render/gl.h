@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_GL_H
+#define MPH_TETRA_RENDER_GL_H
+
+#include <SDL_opengl.h>
+
+/**
+ * Entry points above OpenGL 1.1 are loaded at runtime with SDL_GL_GetProcAddress()
+ *
+ * Each function pointer is named mph_tetra_<function> and aliased to the regular name with a define (Like glad does),
+ * this keeps them from colliding with the prototypes exported by libGL on some platforms
+ */
+
+/**
+ * Functions that are part of the OpenGL 3.2 core profile
+ */
+#define MPH_TETRA_GL_FUNCTIONS_REQUIRED(X)                           \
+    X(PFNGLCREATESHADERPROC, glCreateShader)                         \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource)                         \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader)                       \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv)                           \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog)                 \
+    X(PFNGLDELETESHADERPROC, glDeleteShader)                         \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram)                       \
+    X(PFNGLATTACHSHADERPROC, glAttachShader)                         \
+    X(PFNGLDETACHSHADERPROC, glDetachShader)                         \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram)                           \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv)                         \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog)               \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram)                       \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram)                             \
+    X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation)             \
+    X(PFNGLBINDFRAGDATALOCATIONPROC, glBindFragDataLocation)         \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation)             \
+    X(PFNGLUNIFORM1IPROC, glUniform1i)                               \
+    X(PFNGLUNIFORM1FPROC, glUniform1f)                               \
+    X(PFNGLUNIFORM2FPROC, glUniform2f)                               \
+    X(PFNGLUNIFORM3FPROC, glUniform3f)                               \
+    X(PFNGLUNIFORM4FPROC, glUniform4f)                               \
+    X(PFNGLUNIFORM4FVPROC, glUniform4fv)                             \
+    X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv)                 \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers)                             \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers)                       \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer)                             \
+    X(PFNGLBUFFERDATAPROC, glBufferData)                             \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData)                       \
+    X(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange)                     \
+    X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer)                           \
+    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays)                   \
+    X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays)             \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray)                   \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)           \
+    X(PFNGLVERTEXATTRIBIPOINTERPROC, glVertexAttribIPointer)         \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray)   \
+    X(PFNGLDISABLEVERTEXATTRIBARRAYPROC, glDisableVertexAttribArray) \
+    X(PFNGLACTIVETEXTUREPROC, glActiveTexture)                       \
+    X(PFNGLBLENDFUNCSEPARATEPROC, glBlendFuncSeparate)               \
+    X(PFNGLTEXIMAGE3DPROC, glTexImage3D)                             \
+    X(PFNGLTEXSUBIMAGE3DPROC, glTexSubImage3D)                       \
+    X(PFNGLGENERATEMIPMAPPROC, glGenerateMipmap)                     \
+    X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers)                   \
+    X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers)             \
+    X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer)                   \
+    X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D)         \
+    X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus)     \
+    X(PFNGLBLITFRAMEBUFFERPROC, glBlitFramebuffer)                   \
+    X(PFNGLFENCESYNCPROC, glFenceSync)                               \
+    X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync)                     \
+    X(PFNGLDELETESYNCPROC, glDeleteSync)                             \
+    X(PFNGLGETSTRINGIPROC, glGetStringi)
+
+/**
+ * Functions that may be missing (NULL after render::gl_init())
+ *
+ * GL_ARB_get_program_binary / OpenGL 4.1
+ */
+#define MPH_TETRA_GL_FUNCTIONS_OPTIONAL(X)             \
+    X(PFNGLPROGRAMPARAMETERIPROC, glProgramParameteri) \
+    X(PFNGLGETPROGRAMBINARYPROC, glGetProgramBinary)   \
+    X(PFNGLPROGRAMBINARYPROC, glProgramBinary)
+
+#define MPH_TETRA_GL_DECLARE(type, name) extern type mph_tetra_##name;
+MPH_TETRA_GL_FUNCTIONS_REQUIRED(MPH_TETRA_GL_DECLARE)
+MPH_TETRA_GL_FUNCTIONS_OPTIONAL(MPH_TETRA_GL_DECLARE)
+#undef MPH_TETRA_GL_DECLARE
+
+#define glCreateShader mph_tetra_glCreateShader
+#define glShaderSource mph_tetra_glShaderSource
+#define glCompileShader mph_tetra_glCompileShader
+#define glGetShaderiv mph_tetra_glGetShaderiv
+#define glGetShaderInfoLog mph_tetra_glGetShaderInfoLog
+#define glDeleteShader mph_tetra_glDeleteShader
+#define glCreateProgram mph_tetra_glCreateProgram
+#define glAttachShader mph_tetra_glAttachShader
+#define glDetachShader mph_tetra_glDetachShader
+#define glLinkProgram mph_tetra_glLinkProgram
+#define glGetProgramiv mph_tetra_glGetProgramiv
+#define glGetProgramInfoLog mph_tetra_glGetProgramInfoLog
+#define glDeleteProgram mph_tetra_glDeleteProgram
+#define glUseProgram mph_tetra_glUseProgram
+#define glBindAttribLocation mph_tetra_glBindAttribLocation
+#define glBindFragDataLocation mph_tetra_glBindFragDataLocation
+#define glGetUniformLocation mph_tetra_glGetUniformLocation
+#define glUniform1i mph_tetra_glUniform1i
+#define glUniform1f mph_tetra_glUniform1f
+#define glUniform2f mph_tetra_glUniform2f
+#define glUniform3f mph_tetra_glUniform3f
+#define glUniform4f mph_tetra_glUniform4f
+#define glUniform4fv mph_tetra_glUniform4fv
+#define glUniformMatrix4fv mph_tetra_glUniformMatrix4fv
+#define glGenBuffers mph_tetra_glGenBuffers
+#define glDeleteBuffers mph_tetra_glDeleteBuffers
+#define glBindBuffer mph_tetra_glBindBuffer
+#define glBufferData mph_tetra_glBufferData
+#define glBufferSubData mph_tetra_glBufferSubData
+#define glMapBufferRange mph_tetra_glMapBufferRange
+#define glUnmapBuffer mph_tetra_glUnmapBuffer
+#define glGenVertexArrays mph_tetra_glGenVertexArrays
+#define glDeleteVertexArrays mph_tetra_glDeleteVertexArrays
+#define glBindVertexArray mph_tetra_glBindVertexArray
+#define glVertexAttribPointer mph_tetra_glVertexAttribPointer
+#define glVertexAttribIPointer mph_tetra_glVertexAttribIPointer
+#define glEnableVertexAttribArray mph_tetra_glEnableVertexAttribArray
+#define glDisableVertexAttribArray mph_tetra_glDisableVertexAttribArray
+#define glActiveTexture mph_tetra_glActiveTexture
+#define glBlendFuncSeparate mph_tetra_glBlendFuncSeparate
+#define glTexImage3D mph_tetra_glTexImage3D
+#define glTexSubImage3D mph_tetra_glTexSubImage3D
+#define glGenerateMipmap mph_tetra_glGenerateMipmap
+#define glGenFramebuffers mph_tetra_glGenFramebuffers
+#define glDeleteFramebuffers mph_tetra_glDeleteFramebuffers
+#define glBindFramebuffer mph_tetra_glBindFramebuffer
+#define glFramebufferTexture2D mph_tetra_glFramebufferTexture2D
+#define glCheckFramebufferStatus mph_tetra_glCheckFramebufferStatus
+#define glBlitFramebuffer mph_tetra_glBlitFramebuffer
+#define glFenceSync mph_tetra_glFenceSync
+#define glClientWaitSync mph_tetra_glClientWaitSync
+#define glDeleteSync mph_tetra_glDeleteSync
+#define glGetStringi mph_tetra_glGetStringi
+#define glProgramParameteri mph_tetra_glProgramParameteri
+#define glGetProgramBinary mph_tetra_glGetProgramBinary
+#define glProgramBinary mph_tetra_glProgramBinary
+
+/**
+ * Ownership of GL objects
+ *
+ * Classes that wrap GL objects (shader_t, stream_buffer_t, sprite_batch_t, palette_texture_t, ...) never free them in
+ * their destructors, since many of them are statics that are destroyed after the context is gone. Their owner calls
+ * destroy() while the context is still current, destroy() may be called any number of times.
+ */
+namespace render
+{
+/**
+ * Loads all OpenGL entry points, must be called with a current context
+ *
+ * @returns false if any required function is missing
+ */
+bool gl_init();
+
+/**
+ * Checks the extension list of the current context (Cached by gl_init())
+ */
+bool gl_has_extension(const char* name);
+
+/**
+ * Returns true if program binaries can be retrieved and loaded (GL_ARB_get_program_binary with at least one format)
+ */
+bool gl_has_program_binary();
+};
+
+#endif
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "gx_transform.h"
+
+#include "gui/console.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static profiler_zone_t zone_transform_instances("render::gx_transform_instances");
+
+void gx_mesh_t::build(const float* positions, const float* normals, const Uint8* matrix_ids, size_t count)
+{
+    _groups.clear();
+    _old_to_new.assign(count, 0);
+    for (int i = 0; i < 6; i++)
+        _soa[i].clear();
+
+    /* Counting sort by matrix slot, vertices keep their relative order within a group */
+    Uint32 counts[GX_MATRIX_STACK_SIZE] = {};
+    for (size_t i = 0; i < count; i++)
+    {
+        SDL_assert(matrix_ids[i] < GX_MATRIX_STACK_SIZE);
+        counts[matrix_ids[i]]++;
+    }
+
+    Uint32 begin = 0;
+    Uint32 out_begin = 0;
+    Uint32 group_index[GX_MATRIX_STACK_SIZE];
+    for (int i = 0; i < GX_MATRIX_STACK_SIZE; i++)
+    {
+        if (!counts[i])
+            continue;
+        group_index[i] = _groups.size();
+        _groups.push_back({ (Uint8)i, begin, out_begin, 0 });
+        begin += (counts[i] + 3) & ~3;
+        out_begin += counts[i];
+    }
+
+    for (int i = 0; i < 6; i++)
+        _soa[i].assign(begin, 0.0f);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        group_t& group = _groups[group_index[matrix_ids[i]]];
+        Uint32 soa_index = group.begin + group.count;
+        _old_to_new[i] = group.out_begin + group.count;
+        group.count++;
+
+        for (int j = 0; j < 3; j++)
+        {
+            _soa[j][soa_index] = positions[i * 3 + j];
+            _soa[j + 3][soa_index] = normals[i * 3 + j];
+        }
+    }
+}
+
+void gx_mesh_t::transform_reference(const mat4x3_t* matrices, gx_vertex_t* out) const
+{
+    for (size_t g = 0; g < _groups.size(); g++)
+    {
+        const group_t& group = _groups[g];
+        const float(*m)[4] = matrices[group.matrix_id].m;
+
+        for (Uint32 i = 0; i < group.count; i++)
+        {
+            Uint32 src = group.begin + i;
+            gx_vertex_t& v = out[group.out_begin + i];
+
+            float x = _soa[0][src], y = _soa[1][src], z = _soa[2][src];
+            float nx = _soa[3][src], ny = _soa[4][src], nz = _soa[5][src];
+
+            for (int r = 0; r < 3; r++)
+            {
+                v.pos[r] = ((m[r][0] * x + m[r][1] * y) + m[r][2] * z) + m[r][3];
+                v.normal[r] = (m[r][0] * nx + m[r][1] * ny) + m[r][2] * nz;
+            }
+        }
+    }
+}
+
+void gx_mesh_t::transform(const mat4x3_t* matrices, gx_vertex_t* out) const
+{
+#ifdef __SSE__
+    for (size_t g = 0; g < _groups.size(); g++)
+    {
+        const group_t& group = _groups[g];
+        const float(*m)[4] = matrices[group.matrix_id].m;
+
+        __m128 mat[3][4];
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                mat[r][c] = _mm_set1_ps(m[r][c]);
+
+        float* dst = out[group.out_begin].pos;
+
+        for (Uint32 i = 0; i < group.count; i += 4)
+        {
+            Uint32 src = group.begin + i;
+            __m128 x = _mm_loadu_ps(&_soa[0][src]);
+            __m128 y = _mm_loadu_ps(&_soa[1][src]);
+            __m128 z = _mm_loadu_ps(&_soa[2][src]);
+            __m128 nx = _mm_loadu_ps(&_soa[3][src]);
+            __m128 ny = _mm_loadu_ps(&_soa[4][src]);
+            __m128 nz = _mm_loadu_ps(&_soa[5][src]);
+
+            __m128 p[3], n[3];
+            for (int r = 0; r < 3; r++)
+            {
+                n[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mat[r][0], nx), _mm_mul_ps(mat[r][1], ny)), _mm_mul_ps(mat[r][2], nz));
+                p[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(mat[r][0], x), _mm_mul_ps(mat[r][1], y)), _mm_mul_ps(mat[r][2], z)), mat[r][3]);
+            }
+
+            /* SoA -> 4 interleaved vertices (24 floats) */
+            __m128 r0 = p[0], r1 = p[1], r2 = p[2], r3 = n[0];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            __m128 t01 = _mm_unpacklo_ps(n[1], n[2]);
+            __m128 t23 = _mm_unpackhi_ps(n[1], n[2]);
+
+            __m128 o[6] = {
+                r0,
+                _mm_movelh_ps(t01, r1),
+                _mm_shuffle_ps(r1, t01, _MM_SHUFFLE(3, 2, 3, 2)),
+                r2,
+                _mm_movelh_ps(t23, r3),
+                _mm_shuffle_ps(r3, t23, _MM_SHUFFLE(3, 2, 3, 2)),
+            };
+
+            Uint32 remaining = group.count - i;
+            if (remaining >= 4)
+            {
+                for (int k = 0; k < 6; k++)
+                    _mm_storeu_ps(dst + k * 4, o[k]);
+            }
+            else
+            {
+                float tmp[24];
+                for (int k = 0; k < 6; k++)
+                    _mm_storeu_ps(tmp + k * 4, o[k]);
+                memcpy(dst, tmp, remaining * sizeof(gx_vertex_t));
+            }
+            dst += 24;
+        }
+    }
+#else
+    transform_reference(matrices, out);
+#endif
+}
+
+bool render::gx_transform_instances(std::vector<gx_instance_t>& instances, stream_buffer_t& buffer)
+{
+    PROFILER_SCOPE(zone_transform_instances);
+
+    size_t total = 0;
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        instances[i].base_vertex = total;
+        total += instances[i].mesh->get_vertex_count();
+    }
+
+    if (!total)
+        return true;
+
+    size_t offset;
+    gx_vertex_t* out = (gx_vertex_t*)buffer.map(total * sizeof(gx_vertex_t), sizeof(gx_vertex_t), offset);
+    if (!out)
+        return false;
+
+    /* Writing mapped memory from other threads is fine, only the map/unmap calls need the context */
+    jobs::parallel_for(instances.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            instances[i].mesh->transform(instances[i].matrices, out + instances[i].base_vertex);
+    });
+
+    buffer.unmap();
+
+    Uint32 base = offset / sizeof(gx_vertex_t);
+    for (size_t i = 0; i < instances.size(); i++)
+        instances[i].base_vertex += base;
+
+    return true;
+}
+
+static Uint32 test_seed;
+static float test_rand(float range)
+{
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return ((test_seed >> 8) / float(1 << 24) * 2.0f - 1.0f) * range;
+}
+
+static void build_test_mesh(gx_mesh_t& mesh, size_t count)
+{
+    std::vector<float> positions(count * 3), normals(count * 3);
+    std::vector<Uint8> ids(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            positions[i * 3 + j] = test_rand(64.0f);
+            normals[i * 3 + j] = test_rand(1.0f);
+        }
+        ids[i] = Uint32(test_rand(1.0f) * 1000.0f + 1000.0f) % GX_MATRIX_STACK_SIZE;
+    }
+    mesh.build(positions.data(), normals.data(), ids.data(), count);
+}
+
+static void build_test_matrices(mat4x3_t* matrices)
+{
+    for (int i = 0; i < GX_MATRIX_STACK_SIZE; i++)
+    {
+        float scale[3] = { 1.0f + test_rand(0.5f), 1.0f + test_rand(0.5f), 1.0f + test_rand(0.5f) };
+        float rot[3] = { test_rand(3.14f), test_rand(3.14f), test_rand(3.14f) };
+        float pos[3] = { test_rand(100.0f), test_rand(100.0f), test_rand(100.0f) };
+        matrices[i] = mat4x3_t::from_srt(scale, rot, pos);
+    }
+}
+
+/**
+ * Checks that transform() matches transform_reference() bit for bit over odd sized groups
+ */
+static int command_gx_transform_selftest()
+{
+    test_seed = 12345;
+    int failures = 0;
+
+    const size_t sizes[] = { 1, 3, 4, 5, 31, 97, 1000, 4099 };
+    for (size_t s = 0; s < SDL_arraysize(sizes); s++)
+    {
+        gx_mesh_t mesh;
+        build_test_mesh(mesh, sizes[s]);
+
+        mat4x3_t matrices[GX_MATRIX_STACK_SIZE];
+        build_test_matrices(matrices);
+
+        /* Guard vertex at the end catches tail writes past the mesh */
+        std::vector<gx_vertex_t> simd(sizes[s] + 1), reference(sizes[s] + 1);
+        memset(simd.data(), 0xCD, simd.size() * sizeof(gx_vertex_t));
+        memset(reference.data(), 0xCD, reference.size() * sizeof(gx_vertex_t));
+
+        mesh.transform(matrices, simd.data());
+        mesh.transform_reference(matrices, reference.data());
+
+        if (memcmp(simd.data(), reference.data(), simd.size() * sizeof(gx_vertex_t)))
+        {
+            dc_log_error("r_gx_transform_selftest: Mismatch with %zu vertices", sizes[s]);
+            failures++;
+        }
+    }
+
+    if (failures)
+        return 1;
+
+    dc_log("r_gx_transform_selftest: Passed");
+    return 0;
+}
+
+/**
+ * Times transforming a crowd of animated models (Defaults to 48 models of 3000 vertices)
+ */
+static int command_gx_transform_bench(const int argc, const char** argv)
+{
+    int num_instances = argc > 1 ? SDL_max(atoi(argv[1]), 1) : 48;
+    int num_vertices = argc > 2 ? SDL_max(atoi(argv[2]), 1) : 3000;
+    const int iterations = 50;
+
+    test_seed = 6789;
+    gx_mesh_t mesh;
+    build_test_mesh(mesh, num_vertices);
+
+    std::vector<mat4x3_t> matrices(num_instances * GX_MATRIX_STACK_SIZE);
+    for (int i = 0; i < num_instances; i++)
+        build_test_matrices(&matrices[i * GX_MATRIX_STACK_SIZE]);
+
+    std::vector<gx_vertex_t> out(size_t(num_instances) * num_vertices);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int it = 0; it < iterations; it++)
+        for (int i = 0; i < num_instances; i++)
+            mesh.transform_reference(&matrices[i * GX_MATRIX_STACK_SIZE], &out[size_t(i) * num_vertices]);
+    Uint64 reference_ticks = SDL_GetPerformanceCounter() - start;
+
+    start = SDL_GetPerformanceCounter();
+    for (int it = 0; it < iterations; it++)
+        for (int i = 0; i < num_instances; i++)
+            mesh.transform(&matrices[i * GX_MATRIX_STACK_SIZE], &out[size_t(i) * num_vertices]);
+    Uint64 simd_ticks = SDL_GetPerformanceCounter() - start;
+
+    start = SDL_GetPerformanceCounter();
+    for (int it = 0; it < iterations; it++)
+        jobs::parallel_for(num_instances, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                mesh.transform(&matrices[i * GX_MATRIX_STACK_SIZE], &out[size_t(i) * num_vertices]);
+        });
+    Uint64 parallel_ticks = SDL_GetPerformanceCounter() - start;
+
+    double to_us = 1000000.0 / double(SDL_GetPerformanceFrequency()) / iterations;
+    dc_log("r_gx_transform_bench: %d models x %d vertices", num_instances, num_vertices);
+    dc_log("r_gx_transform_bench: Scalar: %.1f us, SIMD: %.1f us, SIMD on %d threads: %.1f us", reference_ticks * to_us, simd_ticks * to_us,
+        jobs::get_thread_count(), parallel_ticks * to_us);
+
+    return 0;
+}
+
+void render::gx_transform_init()
+{
+    dev_console::add_command("r_gx_transform_selftest", command_gx_transform_selftest);
+    dev_console::add_command("r_gx_transform_bench", command_gx_transform_bench);
+}
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_GX_TRANSFORM_H
+#define MPH_TETRA_RENDER_GX_TRANSFORM_H
+
+#include "stream_buffer.h"
+
+#include "game/transform.h"
+
+#include <SDL_bits.h>
+#include <vector>
+
+/**
+ * Number of entries in the GX position/normal matrix stack
+ */
+#define GX_MATRIX_STACK_SIZE 31
+
+struct gx_vertex_t
+{
+    float pos[3];
+    float normal[3];
+};
+
+/**
+ * Mesh whose vertices are bound to GX matrix stack slots (restore-matrix commands in the display lists)
+ *
+ * At build time vertices are grouped by matrix slot and stored as SoA, padded to a multiple of 4 per group, so the
+ * per frame transform is one matrix load per group followed by straight 4 wide multiply-adds.
+ *
+ * Output vertices are in group order, index buffers need to be remapped with get_old_to_new() once at load time.
+ */
+class gx_mesh_t
+{
+public:
+    /**
+     * @param positions Model space positions, 3 floats per vertex
+     * @param normals Model space normals, 3 floats per vertex
+     * @param matrix_ids Matrix stack slot of each vertex [0, GX_MATRIX_STACK_SIZE)
+     * @param count Number of vertices
+     */
+    void build(const float* positions, const float* normals, const Uint8* matrix_ids, size_t count);
+
+    /**
+     * Transforms all vertices with SSE (When available)
+     *
+     * Results are bit identical to transform_reference(), both evaluate ((m0 * x + m1 * y) + m2 * z) + m3 per component
+     * (This relies on the file being built without floating point contraction)
+     *
+     * @param matrices Matrix stack, indexed by matrix slot
+     * @param out Destination for get_vertex_count() vertices
+     */
+    void transform(const mat4x3_t* matrices, gx_vertex_t* out) const;
+
+    /**
+     * Scalar version of transform()
+     */
+    void transform_reference(const mat4x3_t* matrices, gx_vertex_t* out) const;
+
+    inline size_t get_vertex_count() const { return _old_to_new.size(); }
+
+    /**
+     * Maps original vertex indices to output vertex indices
+     */
+    inline const std::vector<Uint32>& get_old_to_new() const { return _old_to_new; }
+
+private:
+    struct group_t
+    {
+        Uint8 matrix_id;
+        /**
+         * First vertex in the padded SoA arrays
+         */
+        Uint32 begin;
+        /**
+         * First vertex in the output
+         */
+        Uint32 out_begin;
+        Uint32 count;
+    };
+
+    std::vector<group_t> _groups;
+    /**
+     * pos x, pos y, pos z, normal x, normal y, normal z
+     */
+    std::vector<float> _soa[6];
+    std::vector<Uint32> _old_to_new;
+};
+
+/**
+ * One mesh to transform this frame
+ */
+struct gx_instance_t
+{
+    const gx_mesh_t* mesh;
+    /**
+     * GX_MATRIX_STACK_SIZE matrices
+     */
+    const mat4x3_t* matrices;
+
+    /**
+     * Set by gx_transform_instances(), index of the first vertex of this instance in the stream buffer
+     */
+    Uint32 base_vertex;
+};
+
+namespace render
+{
+/**
+ * Transforms all instances in parallel on the job system, straight into the mapped stream buffer
+ *
+ * @returns false if the stream buffer is out of space for this frame
+ */
+bool gx_transform_instances(std::vector<gx_instance_t>& instances, stream_buffer_t& buffer);
+
+/**
+ * Registers the r_gx_transform_selftest and r_gx_transform_bench console commands
+ */
+void gx_transform_init();
+};
+
+#endif
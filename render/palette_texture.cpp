@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "palette_texture.h"
+
+#include "shader.h"
+#include "vertex_format.h"
+
+#include "gui/console.h"
+
+#include <SDL.h>
+#include <string.h>
+
+/* ================================ Palettes ================================ */
+
+palette_texture_t::palette_texture_t(int rows)
+{
+    _rows = SDL_max(rows, 1);
+    _texture = 0;
+    _used.assign(_rows, false);
+}
+
+GLuint palette_texture_t::get_texture()
+{
+    if (_texture)
+        return _texture;
+
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    std::vector<Uint8> zero(size_t(PALETTE_TEXTURE_WIDTH) * _rows * 4, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PALETTE_TEXTURE_WIDTH, _rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, zero.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+    return _texture;
+}
+
+int palette_texture_t::alloc_row()
+{
+    for (int i = 0; i < _rows; i++)
+        if (!_used[i])
+        {
+            _used[i] = true;
+            return i;
+        }
+    return -1;
+}
+
+void palette_texture_t::free_row(int row)
+{
+    if (row >= 0 && row < _rows)
+        _used[row] = false;
+}
+
+void palette_texture_t::set_row(int row, const Uint8* rgba, int count)
+{
+    if (row < 0 || row >= _rows || count <= 0)
+        return;
+    count = SDL_min(count, PALETTE_TEXTURE_WIDTH);
+
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glBindTexture(GL_TEXTURE_2D, get_texture());
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, count, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+}
+
+void palette_texture_t::set_row_bgr555(int row, const Uint16* colors, int count, bool color0_transparent)
+{
+    count = SDL_clamp(count, 0, PALETTE_TEXTURE_WIDTH);
+    Uint8 rgba[PALETTE_TEXTURE_WIDTH * 4];
+    for (int i = 0; i < count; i++)
+        gx_color_from_bgr555(colors[i], rgba + i * 4);
+    if (color0_transparent && count)
+        rgba[3] = 0;
+    set_row(row, rgba, count);
+}
+
+void palette_texture_t::destroy()
+{
+    if (_texture)
+        glDeleteTextures(1, &_texture);
+    _texture = 0;
+}
+
+/* ================================ Indices ================================ */
+
+indexed_texture_t::indexed_texture_t()
+{
+    _texture = 0;
+    _width = 0;
+    _height = 0;
+    _frames = 0;
+    _index_bits = 8;
+}
+
+bool indexed_texture_t::create(const Uint8* texels, int width, int height, int frames, int index_bits, bool repeat)
+{
+    if (width <= 0 || height <= 0 || frames <= 0 || index_bits < 1 || index_bits > 8)
+        return false;
+
+    destroy();
+    _width = width;
+    _height = height;
+    _frames = frames;
+    _index_bits = index_bits;
+
+    GLint last_texture, last_alignment;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &last_texture);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &last_alignment);
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, width, height, frames, 0, GL_RED, GL_UNSIGNED_BYTE, texels);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, last_alignment);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, last_texture);
+    return true;
+}
+
+void indexed_texture_t::set_frame(int frame, const Uint8* texels)
+{
+    if (!_texture || frame < 0 || frame >= _frames)
+        return;
+
+    GLint last_texture, last_alignment;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &last_texture);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &last_alignment);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, frame, _width, _height, 1, GL_RED, GL_UNSIGNED_BYTE, texels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, last_alignment);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, last_texture);
+}
+
+void indexed_texture_t::destroy()
+{
+    if (_texture)
+        glDeleteTextures(1, &_texture);
+    _texture = 0;
+}
+
+/* ================================ Lookup ================================ */
+
+void render::palette_lookup_bind(GLuint program, const indexed_texture_t& indices, int frame, palette_texture_t& palettes, int row, int indices_unit,
+    int palettes_unit)
+{
+    glActiveTexture(GL_TEXTURE0 + indices_unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, indices.get_texture());
+    glActiveTexture(GL_TEXTURE0 + palettes_unit);
+    glBindTexture(GL_TEXTURE_2D, palettes.get_texture());
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(program, "u_indices"), indices_unit);
+    glUniform1i(glGetUniformLocation(program, "u_palettes"), palettes_unit);
+    glUniform1f(glGetUniformLocation(program, "u_frame"), float(SDL_clamp(frame, 0, SDL_max(indices.get_frame_count() - 1, 0))));
+    glUniform1i(glGetUniformLocation(program, "u_palette_row"), row);
+    glUniform1i(glGetUniformLocation(program, "u_index_bits"), indices.get_index_bits());
+}
+
+void render::palette_lookup_cpu(const Uint8* texels, size_t count, int index_bits, const Uint8* palette_rgba, Uint8* out_rgba)
+{
+    int mask = (1 << index_bits) - 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        const Uint8* color = palette_rgba + (texels[i] & mask) * 4;
+        memcpy(out_rgba + i * 4, color, 4);
+        if (index_bits < 8)
+        {
+            float alpha = float(texels[i] >> index_bits) / float((1 << (8 - index_bits)) - 1);
+            out_rgba[i * 4 + 3] = Uint8(color[3] / 255.0f * alpha * 255.0f + 0.5f);
+        }
+    }
+}
+
+/* ================================ Selftest ================================ */
+
+static Uint32 test_seed;
+static Uint32 test_rand()
+{
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return test_seed >> 8;
+}
+
+/**
+ * Renders index textures through PALETTE_LOOKUP_GLSL into an offscreen target and compares against
+ * render::palette_lookup_cpu() for every frame, before and after animating a palette row
+ */
+static int command_palette_selftest()
+{
+    const int size = 32, frames = 3;
+    const char* vertex_src = "out vec2 v_uv;\n"
+                             "void main()\n"
+                             "{\n"
+                             "    vec2 pos = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4.0 - 1.0;\n"
+                             "    v_uv = pos * 0.5 + 0.5;\n"
+                             "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+                             "}\n";
+    const char* fragment_src = PALETTE_LOOKUP_GLSL "in vec2 v_uv;\n"
+                                                   "out vec4 out_color;\n"
+                                                   "void main() { out_color = palette_lookup(v_uv); }\n";
+
+    shader_t shader("palette_selftest", vertex_src, fragment_src);
+    if (!shader.build())
+    {
+        dc_log_error("r_palette_selftest: Shader failed to build");
+        return 1;
+    }
+
+    GLint last_fbo, last_viewport[4], last_program, last_vao;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_fbo);
+    glGetIntegerv(GL_VIEWPORT, last_viewport);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+    GLboolean last_blend = glIsEnabled(GL_BLEND);
+    GLboolean last_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+    /* palette_lookup_bind() uses units 0 and 1 */
+    GLint last_active_texture, last_texture_2d[2], last_texture_2d_array[2];
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
+    for (int unit = 0; unit < 2; unit++)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture_2d[unit]);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &last_texture_2d_array[unit]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    GLuint target, fbo, vao;
+    glGenTextures(1, &target);
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glViewport(0, 0, size, size);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+
+    test_seed = 12345;
+    palette_texture_t palettes(4);
+    indexed_texture_t indices;
+    int failures = 0;
+    const int index_bits[] = { 8, 4, 5, 3 };
+    for (int b = 0; b < int(SDL_arraysize(index_bits)); b++)
+    {
+        std::vector<Uint8> texels(size * size * frames);
+        for (Uint8& t : texels)
+            t = test_rand();
+        indices.create(texels.data(), size, size, frames, index_bits[b]);
+
+        int row = palettes.alloc_row();
+        Uint8 palette[PALETTE_TEXTURE_WIDTH * 4];
+        for (int step = 0; step < 2; step++)
+        {
+            /* Second pass is the palette animation, only the row changes */
+            for (Uint8& c : palette)
+                c = test_rand();
+            palettes.set_row(row, palette, PALETTE_TEXTURE_WIDTH);
+
+            for (int f = 0; f < frames; f++)
+            {
+                shader.use();
+                render::palette_lookup_bind(shader.get_program(), indices, f, palettes, row);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+
+                std::vector<Uint8> gpu(size * size * 4), cpu(size * size * 4);
+                glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, gpu.data());
+                render::palette_lookup_cpu(texels.data() + size * size * f, size * size, index_bits[b], palette, cpu.data());
+
+                int mismatches = 0;
+                for (size_t i = 0; i < gpu.size(); i++)
+                    mismatches += abs(gpu[i] - cpu[i]) > 1;
+                if (mismatches)
+                {
+                    dc_log_error("r_palette_selftest: %d index bits, frame %d, step %d: %d channels differ", index_bits[b], f, step, mismatches);
+                    failures++;
+                }
+            }
+        }
+        palettes.free_row(row);
+    }
+
+    indices.destroy();
+    palettes.destroy();
+    glDeleteVertexArrays(1, &vao);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &target);
+    shader.destroy();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, last_fbo);
+    glViewport(last_viewport[0], last_viewport[1], last_viewport[2], last_viewport[3]);
+    glUseProgram(last_program);
+    glBindVertexArray(last_vao);
+    if (last_blend)
+        glEnable(GL_BLEND);
+    if (last_scissor_test)
+        glEnable(GL_SCISSOR_TEST);
+    for (int unit = 0; unit < 2; unit++)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, last_texture_2d[unit]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, last_texture_2d_array[unit]);
+    }
+    glActiveTexture(last_active_texture);
+
+    if (failures)
+        dc_log_error("r_palette_selftest: %d failures", failures);
+    else
+        dc_log("r_palette_selftest: GPU lookups match for 8, 4, 5 (A3I5), and 3 (A5I3) index bits");
+    return failures ? 1 : 0;
+}
+
+void render::palette_texture_init() { dev_console::add_command("r_palette_selftest", command_palette_selftest); }
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_PALETTE_TEXTURE_H
+#define MPH_TETRA_RENDER_PALETTE_TEXTURE_H
+
+#include "gl.h"
+
+#include <SDL_bits.h>
+#include <vector>
+
+#define PALETTE_TEXTURE_WIDTH 256
+
+/**
+ * Fragment shader declarations for palette lookups, paste after the #version line
+ *
+ * palette_lookup(uv) samples the index texture (Nearest, frame u_frame) and fetches the color from row u_palette_row.
+ * Texels hold (alpha << u_index_bits) | index, which covers the plain 2/4/8 bpp formats (u_index_bits = 8) as well as
+ * A3I5 (5) and A5I3 (3), whose alpha is multiplied into the palette color.
+ */
+#define PALETTE_LOOKUP_GLSL                                                                                \
+    "uniform sampler2DArray u_indices;\n"                                                                  \
+    "uniform sampler2D u_palettes;\n"                                                                      \
+    "uniform float u_frame;\n"                                                                             \
+    "uniform int u_palette_row;\n"                                                                         \
+    "uniform int u_index_bits;\n"                                                                          \
+    "vec4 palette_lookup(vec2 uv)\n"                                                                       \
+    "{\n"                                                                                                  \
+    "    int texel = int(texture(u_indices, vec3(uv, u_frame)).r * 255.0 + 0.5);\n"                        \
+    "    int index = texel & ((1 << u_index_bits) - 1);\n"                                                 \
+    "    vec4 color = texelFetch(u_palettes, ivec2(index, u_palette_row), 0);\n"                           \
+    "    if (u_index_bits < 8)\n"                                                                          \
+    "        color.a *= float(texel >> u_index_bits) / float((1 << (8 - u_index_bits)) - 1);\n"            \
+    "    return color;\n"                                                                                  \
+    "}\n"
+
+/**
+ * Bank of 256 entry RGBA palettes, one per row of a single texture
+ *
+ * Palette animations rewrite a row with set_row(), a 16 color palette is a 64 byte upload.
+ *
+ * GL objects are created on first use, so instances can be static
+ */
+class palette_texture_t
+{
+public:
+    /**
+     * @param rows Number of palettes
+     */
+    palette_texture_t(int rows = 64);
+
+    /**
+     * @returns Free row, or -1 if every row is taken
+     */
+    int alloc_row();
+
+    void free_row(int row);
+
+    /**
+     * Uploads colors to the start of a row
+     *
+     * @param rgba 4 bytes per color, straight alpha
+     * @param count Number of colors [1, PALETTE_TEXTURE_WIDTH]
+     */
+    void set_row(int row, const Uint8* rgba, int count);
+
+    /**
+     * set_row() for NDS palettes
+     *
+     * @param colors BGR555 colors
+     * @param color0_transparent Give color 0 zero alpha (Texture parameter bit 29 on the NDS)
+     */
+    void set_row_bgr555(int row, const Uint16* colors, int count, bool color0_transparent);
+
+    GLuint get_texture();
+    inline int get_rows() const { return _rows; }
+
+    void destroy();
+
+private:
+    int _rows;
+    GLuint _texture;
+    std::vector<bool> _used;
+};
+
+/**
+ * Texture of palette indices, with one array layer per animation frame
+ *
+ * Always sampled with nearest filtering, the NDS doesn't filter textures and filtering indices is meaningless anyway.
+ */
+class indexed_texture_t
+{
+public:
+    indexed_texture_t();
+
+    /**
+     * @param texels width * height bytes per frame, frames back to back, each (alpha << index_bits) | index
+     * @param frames Number of frames
+     * @param index_bits Bits of each texel that are the index (8 when there is no alpha)
+     * @param repeat GL_REPEAT instead of GL_CLAMP_TO_EDGE
+     */
+    bool create(const Uint8* texels, int width, int height, int frames, int index_bits = 8, bool repeat = true);
+
+    /**
+     * Replaces the texels of one frame
+     */
+    void set_frame(int frame, const Uint8* texels);
+
+    inline GLuint get_texture() const { return _texture; }
+    inline int get_width() const { return _width; }
+    inline int get_height() const { return _height; }
+    inline int get_frame_count() const { return _frames; }
+    inline int get_index_bits() const { return _index_bits; }
+
+    void destroy();
+
+private:
+    GLuint _texture;
+    int _width;
+    int _height;
+    int _frames;
+    int _index_bits;
+};
+
+namespace render
+{
+/**
+ * Binds both textures and sets the uniforms of PALETTE_LOOKUP_GLSL, program must be in use
+ *
+ * @param indices_unit Texture unit for the index texture
+ * @param palettes_unit Texture unit for the palette texture
+ */
+void palette_lookup_bind(GLuint program, const indexed_texture_t& indices, int frame, palette_texture_t& palettes, int row, int indices_unit = 0,
+    int palettes_unit = 1);
+
+/**
+ * Decodes on the CPU exactly like palette_lookup() at texel centers, for tools and tests
+ */
+void palette_lookup_cpu(const Uint8* texels, size_t count, int index_bits, const Uint8* palette_rgba, Uint8* out_rgba);
+
+/**
+ * Registers the r_palette_selftest console command
+ */
+void palette_texture_init();
+}
+
+#endif
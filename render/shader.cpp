@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "shader.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/hash.h"
+#include "util/physfs/physfs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+
+#define SHADER_CACHE_DIR "/cache/shaders"
+#define SHADER_CACHE_MAGIC 0x5348504D /* "MPHS" */
+/* Bump when the key or file layout changes */
+#define SHADER_CACHE_VERSION 1
+
+static convar_int_t r_shader_cache("r_shader_cache", 1, 0, 1, "Store linked shader programs on disk and load them on later launches", CONVAR_FLAG_INT_IS_BOOL);
+
+static profiler_zone_t zone_build("shader_t::build");
+
+struct shader_cache_header_t
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint64 key;
+    Uint32 format;
+    Uint32 length;
+};
+
+static struct
+{
+    int hits;
+    int misses;
+    int rejected;
+} cache_stats;
+
+shader_t::shader_t(const char* name, const char* vertex_src, const char* fragment_src, const std::vector<std::string>& attributes, const char* frag_output)
+{
+    _name = name;
+    _vertex_src = vertex_src;
+    _fragment_src = fragment_src;
+    _attributes = attributes;
+    _frag_output = frag_output;
+    _program = 0;
+    _from_cache = false;
+}
+
+void shader_t::destroy()
+{
+    if (_program)
+        glDeleteProgram(_program);
+    _program = 0;
+    _from_cache = false;
+}
+
+Uint64 shader_t::get_cache_key()
+{
+    Uint32 version = SHADER_CACHE_VERSION;
+    Uint64 key = util::fnv1a64(&version, sizeof(version));
+
+    /* The separators keep ("ab", "c") and ("a", "bc") from hashing to the same key */
+    key = util::fnv1a64(SHADER_GLSL_VERSION, sizeof(SHADER_GLSL_VERSION), key);
+    key = util::fnv1a64(_vertex_src.c_str(), _vertex_src.length() + 1, key);
+    key = util::fnv1a64(_fragment_src.c_str(), _fragment_src.length() + 1, key);
+    for (size_t i = 0; i < _attributes.size(); i++)
+        key = util::fnv1a64(_attributes[i].c_str(), _attributes[i].length() + 1, key);
+    key = util::fnv1a64(_frag_output.c_str(), _frag_output.length() + 1, key);
+
+    const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : driver_strings)
+    {
+        /* glGetString() may return NULL, which fnv1a64_str() hashes as "", the separator is hashed either way */
+        key = util::fnv1a64_str((const char*)glGetString(name), key);
+        key = util::fnv1a64("", 1, key);
+    }
+
+    return key;
+}
+
+std::string shader_t::get_cache_path(Uint64 key)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "_%016llx.bin", (unsigned long long)key);
+    return SHADER_CACHE_DIR "/" + _name + buf;
+}
+
+bool shader_t::load_from_cache(Uint64 key)
+{
+    std::string path = get_cache_path(key);
+
+    PHYSFS_File* fd = PHYSFS_openRead(path.c_str());
+    if (!fd)
+        return false;
+
+    shader_cache_header_t header;
+    std::vector<Uint8> binary;
+    bool valid = PHYSFS_readBytes(fd, &header, sizeof(header)) == sizeof(header) && header.magic == SHADER_CACHE_MAGIC
+        && header.version == SHADER_CACHE_VERSION && header.key == key && PHYSFS_fileLength(fd) == PHYSFS_sint64(sizeof(header) + header.length);
+
+    if (valid)
+    {
+        binary.resize(header.length);
+        valid = PHYSFS_readBytes(fd, binary.data(), binary.size()) == PHYSFS_sint64(binary.size());
+    }
+    PHYSFS_close(fd);
+
+    GLint status = GL_FALSE;
+    if (valid)
+    {
+        _program = glCreateProgram();
+        glProgramBinary(_program, header.format, binary.data(), binary.size());
+        glGetProgramiv(_program, GL_LINK_STATUS, &status);
+    }
+
+    if (status != GL_TRUE)
+    {
+        /* Drivers are allowed to reject any binary at any time, compiling from source is always the fallback */
+        dc_log_warn("Discarding cached binary for shader \"%s\"", _name.c_str());
+        cache_stats.rejected++;
+        destroy();
+        PHYSFS_delete(path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void shader_t::store_to_cache(Uint64 key)
+{
+    GLint length = 0;
+    glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<Uint8> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(_program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+
+    shader_cache_header_t header;
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = written;
+
+    if (!PHYSFS_mkdir(SHADER_CACHE_DIR))
+    {
+        dc_log_warn("Unable to create " SHADER_CACHE_DIR ": %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    std::string path = get_cache_path(key);
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+    {
+        dc_log_warn("Unable to open %s for writing: %s", path.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    bool success = PHYSFS_writeBytes(fd, &header, sizeof(header)) == sizeof(header) && PHYSFS_writeBytes(fd, binary.data(), written) == written;
+    PHYSFS_close(fd);
+
+    /* A truncated entry would be rejected by the length check, but there is no reason to keep it around */
+    if (!success)
+        PHYSFS_delete(path.c_str());
+}
+
+/**
+ * @returns Shader object, or 0 on failure
+ */
+static GLuint compile_stage(const std::string& name, GLenum type, const std::string& source)
+{
+    GLuint shader = glCreateShader(type);
+    const GLchar* sources[] = { SHADER_GLSL_VERSION, source.c_str() };
+    glShaderSource(shader, SDL_arraysize(sources), sources, NULL);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log[1024] = "";
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        dc_log_error("Failed to compile %s shader \"%s\": %s", type == GL_VERTEX_SHADER ? "vertex" : "fragment", name.c_str(), log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+bool shader_t::compile()
+{
+    GLuint vertex = compile_stage(_name, GL_VERTEX_SHADER, _vertex_src);
+    GLuint fragment = compile_stage(_name, GL_FRAGMENT_SHADER, _fragment_src);
+
+    if (!vertex || !fragment)
+    {
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return false;
+    }
+
+    _program = glCreateProgram();
+    glAttachShader(_program, vertex);
+    glAttachShader(_program, fragment);
+    for (size_t i = 0; i < _attributes.size(); i++)
+        glBindAttribLocation(_program, i, _attributes[i].c_str());
+    glBindFragDataLocation(_program, 0, _frag_output.c_str());
+
+    if (r_shader_cache.get() && render::gl_has_program_binary())
+        glProgramParameteri(_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(_program);
+
+    glDetachShader(_program, vertex);
+    glDetachShader(_program, fragment);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(_program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log[1024] = "";
+        glGetProgramInfoLog(_program, sizeof(log), NULL, log);
+        dc_log_error("Failed to link shader \"%s\": %s", _name.c_str(), log);
+        destroy();
+        return false;
+    }
+
+    return true;
+}
+
+bool shader_t::build()
+{
+    PROFILER_SCOPE(zone_build);
+
+    destroy();
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    bool use_cache = r_shader_cache.get() && render::gl_has_program_binary();
+    Uint64 key = use_cache ? get_cache_key() : 0;
+
+    if (use_cache && load_from_cache(key))
+    {
+        _from_cache = true;
+        cache_stats.hits++;
+    }
+    else
+    {
+        if (!compile())
+            return false;
+
+        if (use_cache)
+        {
+            cache_stats.misses++;
+            store_to_cache(key);
+        }
+    }
+
+    double elapsed = double(SDL_GetPerformanceCounter() - start) * 1000.0 / double(SDL_GetPerformanceFrequency());
+    dc_log_trace("Shader \"%s\" %s in %.2f ms", _name.c_str(), _from_cache ? "loaded from cache" : "compiled", elapsed);
+
+    return true;
+}
+
+static int command_shader_cache_clear()
+{
+    std::vector<std::string> files;
+    PHYSFS_enumerate(
+        SHADER_CACHE_DIR,
+        [](void* data, const char* dir, const char* fname) -> PHYSFS_EnumerateCallbackResult {
+            ((std::vector<std::string>*)data)->push_back(std::string(dir) + "/" + fname);
+            return PHYSFS_ENUM_OK;
+        },
+        &files);
+
+    int deleted = 0;
+    for (size_t i = 0; i < files.size(); i++)
+        deleted += PHYSFS_delete(files[i].c_str()) != 0;
+
+    dc_log("Deleted %d cached shader binaries", deleted);
+    return 0;
+}
+
+void render::shader_cache_init()
+{
+    dev_console::add_command("r_shader_cache_clear", command_shader_cache_clear);
+    dev_console::add_command("r_shader_cache_stats", []() -> int {
+        dc_log("Program binaries supported: %d", render::gl_has_program_binary());
+        dc_log("Hits: %d, Misses: %d, Rejected: %d", cache_stats.hits, cache_stats.misses, cache_stats.rejected);
+        return 0;
+    });
+}
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_SHADER_H
+#define MPH_TETRA_RENDER_SHADER_H
+
+#include "gl.h"
+
+#include <SDL_bits.h>
+#include <string>
+#include <vector>
+
+#define SHADER_GLSL_VERSION "#version 150\n"
+
+/**
+ * GLSL program with an on-disk binary cache
+ *
+ * When the driver supports program binaries, linked programs are written to /cache/shaders in the PhysFS write dir.
+ * The cache key covers the sources, attribute bindings, GL_VENDOR, GL_RENDERER, and GL_VERSION, so a driver update or
+ * a different GPU misses the cache instead of feeding the driver a foreign binary. If the driver rejects a cached
+ * binary anyway, the entry is deleted and the program is compiled from source.
+ */
+class shader_t
+{
+public:
+    /**
+     * @param name Name for logs and the cache file
+     * @param vertex_src Vertex shader source, without the #version line (SHADER_GLSL_VERSION is prepended)
+     * @param fragment_src Fragment shader source, without the #version line
+     * @param attributes Vertex attribute names, bound to their index in this list
+     * @param frag_output Name of the fragment shader output, bound to color number 0
+     */
+    shader_t(const char* name, const char* vertex_src, const char* fragment_src, const std::vector<std::string>& attributes = {},
+        const char* frag_output = "out_color");
+
+    /**
+     * Loads the program from the cache or compiles it, must be called with a current context
+     *
+     * @returns true on success
+     */
+    bool build();
+
+    void destroy();
+
+    inline GLuint get_program() { return _program; }
+    inline bool is_from_cache() { return _from_cache; }
+
+    inline void use() { glUseProgram(_program); }
+    inline GLint get_uniform(const char* uniform) { return glGetUniformLocation(_program, uniform); }
+
+private:
+    Uint64 get_cache_key();
+    std::string get_cache_path(Uint64 key);
+
+    bool load_from_cache(Uint64 key);
+    void store_to_cache(Uint64 key);
+    bool compile();
+
+    std::string _name;
+    std::string _vertex_src;
+    std::string _fragment_src;
+    std::vector<std::string> _attributes;
+    std::string _frag_output;
+
+    GLuint _program;
+    bool _from_cache;
+};
+
+namespace render
+{
+/**
+ * Registers the r_shader_cache_clear console command
+ */
+void shader_cache_init();
+};
+
+#endif
@@ -0,0 +1,619 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "sprite_batch.h"
+
+#include "shader.h"
+#include "texture_upload.h"
+#include "vertex_format.h"
+
+#include "gui/console.h"
+#include "util/asset_cache.h"
+#include "util/physfs/physfs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+/* Character and palette files larger than this are certainly not sprites */
+#define SPRITE_MAX_FILE_SIZE (4 << 20)
+
+struct sprite_vertex_t
+{
+    float pos[2];
+    Uint16 uv[2];
+    Uint8 color[4];
+};
+static_assert(sizeof(sprite_vertex_t) == 16, "sprite_vertex_t size incorrect");
+
+static profiler_zone_t zone_build("sprite_atlas_t::build");
+static profiler_zone_t zone_end("sprite_batch_t::end");
+
+static const char* sprite_vertex_src = "in vec2 a_pos;\n"
+                                       "in vec2 a_uv;\n"
+                                       "in vec4 a_color;\n"
+                                       "uniform vec2 u_viewport;\n"
+                                       "out vec2 v_uv;\n"
+                                       "out vec4 v_color;\n"
+                                       "void main()\n"
+                                       "{\n"
+                                       "    v_uv = a_uv;\n"
+                                       "    v_color = a_color;\n"
+                                       "    gl_Position = vec4(a_pos.x / u_viewport.x * 2.0 - 1.0, 1.0 - a_pos.y / u_viewport.y * 2.0, 0.0, 1.0);\n"
+                                       "}\n";
+
+static const char* sprite_fragment_src = "in vec2 v_uv;\n"
+                                         "in vec4 v_color;\n"
+                                         "uniform sampler2D u_texture;\n"
+                                         "out vec4 out_color;\n"
+                                         "void main() { out_color = texture(u_texture, v_uv) * v_color; }\n";
+
+static shader_t sprite_shader("sprite_batch", sprite_vertex_src, sprite_fragment_src, { "a_pos", "a_uv", "a_color" });
+static int sprite_shader_state = 0; /* 0: Not built, 1: Built, -1: Failed */
+
+/* ================================ Atlas ================================ */
+
+/**
+ * Reads a file through the asset cache, palettes are shared between sprites so most of them are hits
+ */
+static asset_cache::data_t load_file(const char* path)
+{
+    asset_cache::data_t data = asset_cache::load(path);
+    if (!data)
+    {
+        dc_log_error("Unable to read \"%s\": %s", path, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return NULL;
+    }
+
+    if (data->empty() || data->size() > SPRITE_MAX_FILE_SIZE)
+    {
+        dc_log_error("Unable to read \"%s\"", path);
+        return NULL;
+    }
+    return data;
+}
+
+void render::decode_tiles(const Uint8* chars, const Uint8* palette, size_t palette_colors, int width, int height, int bpp, int palette_index, Uint8* rgba)
+{
+    int tiles_x = width / 8;
+    int tile_bytes = 8 * bpp;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            const Uint8* tile = chars + ((y / 8) * tiles_x + x / 8) * tile_bytes;
+            int tx = x % 8, ty = y % 8;
+
+            size_t index;
+            if (bpp == 4)
+            {
+                Uint8 pair = tile[ty * 4 + tx / 2];
+                index = (tx & 1) ? (pair >> 4) : (pair & 0x0F);
+                if (index)
+                    index += palette_index * 16;
+            }
+            else
+                index = tile[ty * 8 + tx];
+
+            Uint8* out = rgba + (size_t(y) * width + x) * 4;
+            if (!index || index >= palette_colors)
+            {
+                memset(out, 0, 4);
+                continue;
+            }
+            gx_color_from_bgr555(palette[index * 2] | (palette[index * 2 + 1] << 8), out);
+        }
+}
+
+sprite_atlas_t::sprite_atlas_t(int page_size) { _page_size = page_size; }
+
+bool sprite_atlas_t::add_rgba(const char* name, const Uint8* rgba, int width, int height)
+{
+    if (width <= 0 || height <= 0 || _sources.count(name))
+        return false;
+
+    source_t& source = _sources[name];
+    source.width = width;
+    source.height = height;
+    source.rgba.assign(rgba, rgba + size_t(width) * height * 4);
+    return true;
+}
+
+bool sprite_atlas_t::add_nitrofs(const char* name, const char* char_path, const char* palette_path, int width, int height, int bpp, int palette_index)
+{
+    if ((bpp != 4 && bpp != 8) || width <= 0 || height <= 0 || width % 8 || height % 8)
+    {
+        dc_log_error("Sprite \"%s\": Unsupported size %dx%d at %d bpp", name, width, height, bpp);
+        return false;
+    }
+
+    asset_cache::data_t chars = load_file(char_path);
+    asset_cache::data_t palette = load_file(palette_path);
+    if (!chars || !palette)
+        return false;
+
+    if (chars->size() < size_t(width) * height * bpp / 8)
+    {
+        dc_log_error("Sprite \"%s\": \"%s\" is too small for %dx%d at %d bpp", name, char_path, width, height, bpp);
+        return false;
+    }
+
+    std::vector<Uint8> rgba(size_t(width) * height * 4);
+    render::decode_tiles(chars->data(), palette->data(), palette->size() / 2, width, height, bpp, palette_index, rgba.data());
+    return add_rgba(name, rgba.data(), width, height);
+}
+
+bool sprite_atlas_t::build()
+{
+    PROFILER_SCOPE(zone_build);
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    int size = SDL_min(_page_size, max_size);
+
+    /* Tallest first keeps shelves tight */
+    std::vector<std::map<std::string, source_t>::iterator> order;
+    for (auto it = _sources.begin(); it != _sources.end(); it++)
+    {
+        if (it->second.width + 2 > size || it->second.height + 2 > size)
+        {
+            dc_log_error("Sprite \"%s\" (%dx%d) does not fit in a %dx%d page", it->first.c_str(), it->second.width, it->second.height, size, size);
+            return false;
+        }
+        order.push_back(it);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const std::map<std::string, source_t>::iterator& a, const std::map<std::string, source_t>::iterator& b) {
+        return a->second.height != b->second.height ? a->second.height > b->second.height : a->second.width > b->second.width;
+    });
+
+    for (GLuint texture : _pages)
+    {
+        render::texture_upload_cancel(texture);
+        glDeleteTextures(1, &texture);
+    }
+    _pages.clear();
+
+    std::vector<std::vector<Uint8>> pixels;
+    int x = 0, y = 0, shelf_height = 0;
+    for (auto& it : order)
+    {
+        const source_t& source = it->second;
+        int w = source.width + 2, h = source.height + 2;
+        if (x + w > size)
+        {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        if (pixels.empty() || y + h > size)
+        {
+            pixels.emplace_back(size_t(size) * size * 4, 0);
+            x = y = shelf_height = 0;
+        }
+
+        /* Copy with a 1 texel border of clamped edge texels */
+        Uint8* page = pixels.back().data();
+        for (int dy = 0; dy < h; dy++)
+        {
+            int sy = SDL_clamp(dy - 1, 0, source.height - 1);
+            for (int dx = 0; dx < w; dx++)
+            {
+                int sx = SDL_clamp(dx - 1, 0, source.width - 1);
+                memcpy(page + ((size_t(y) + dy) * size + x + dx) * 4, source.rgba.data() + (size_t(sy) * source.width + sx) * 4, 4);
+            }
+        }
+
+        sprite_t& sprite = _sprites[it->first];
+        sprite.texture = 0;
+        sprite.page = pixels.size() - 1;
+        sprite.width = source.width;
+        sprite.height = source.height;
+        sprite.uv0[0] = float(x + 1) / size;
+        sprite.uv0[1] = float(y + 1) / size;
+        sprite.uv1[0] = float(x + 1 + source.width) / size;
+        sprite.uv1[1] = float(y + 1 + source.height) / size;
+
+        x += w;
+        shelf_height = SDL_max(shelf_height, h);
+    }
+
+    for (std::vector<Uint8>& page : pixels)
+        _pages.push_back(render::texture_upload(std::move(page), size, size, TEXTURE_MIP_NONE));
+
+    for (auto& it : _sprites)
+        it.second.texture = _pages[it.second.page];
+
+    return true;
+}
+
+const sprite_t* sprite_atlas_t::find(const char* name) const
+{
+    auto it = _sprites.find(name);
+    return it == _sprites.end() ? NULL : &it->second;
+}
+
+void sprite_atlas_t::destroy()
+{
+    for (GLuint texture : _pages)
+    {
+        render::texture_upload_cancel(texture);
+        glDeleteTextures(1, &texture);
+    }
+    _pages.clear();
+    _sprites.clear();
+    _sources.clear();
+}
+
+/* ================================ Batch ================================ */
+
+sprite_batch_t::sprite_batch_t()
+    : _vertices(GL_ARRAY_BUFFER, SPRITE_BATCH_MAX_QUADS * 4 * sizeof(sprite_vertex_t))
+{
+    _width = 1;
+    _height = 1;
+    _vao = 0;
+    _indices = 0;
+}
+
+void sprite_batch_t::begin(int width, int height)
+{
+    _quads.clear();
+    _width = SDL_max(width, 1);
+    _height = SDL_max(height, 1);
+}
+
+void sprite_batch_t::draw(const sprite_t* sprite, float x, float y, float w, float h, Uint32 color, int layer)
+{
+    if (!sprite)
+        return;
+
+    quad_t quad;
+    quad.layer = layer;
+    quad.texture = sprite->texture;
+    quad.pos[0] = x;
+    quad.pos[1] = y;
+    quad.pos[2] = x + w;
+    quad.pos[3] = y + h;
+    quad.uv[0] = sprite->uv0[0];
+    quad.uv[1] = sprite->uv0[1];
+    quad.uv[2] = sprite->uv1[0];
+    quad.uv[3] = sprite->uv1[1];
+    quad.color = color;
+
+    /* Keep quads wound the same way regardless of flips, culling is off but this keeps the corners predictable */
+    if (w < 0)
+    {
+        std::swap(quad.pos[0], quad.pos[2]);
+        std::swap(quad.uv[0], quad.uv[2]);
+    }
+    if (h < 0)
+    {
+        std::swap(quad.pos[1], quad.pos[3]);
+        std::swap(quad.uv[1], quad.uv[3]);
+    }
+
+    _quads.push_back(quad);
+}
+
+static inline Uint16 to_unorm16(float f) { return Uint16(SDL_clamp(f, 0.0f, 1.0f) * 65535.0f + 0.5f); }
+
+int sprite_batch_t::end()
+{
+    PROFILER_SCOPE(zone_end);
+
+    if (_quads.empty())
+        return 0;
+
+    if (!sprite_shader_state)
+        sprite_shader_state = sprite_shader.build() ? 1 : -1;
+    if (sprite_shader_state < 0)
+    {
+        _quads.clear();
+        return 0;
+    }
+
+    size_t count = _quads.size();
+    if (count > SPRITE_BATCH_MAX_QUADS)
+    {
+        dc_log_warn("%zu sprites queued, only drawing the first %d", count, SPRITE_BATCH_MAX_QUADS);
+        count = SPRITE_BATCH_MAX_QUADS;
+    }
+
+    _order.resize(count);
+    for (size_t i = 0; i < count; i++)
+        _order[i] = i;
+    std::stable_sort(_order.begin(), _order.end(), [this](Uint32 a, Uint32 b) {
+        const quad_t& qa = _quads[a];
+        const quad_t& qb = _quads[b];
+        return qa.layer != qb.layer ? qa.layer < qb.layer : qa.texture < qb.texture;
+    });
+
+    /* u_texture reads unit 0, whatever unit the caller left active */
+    GLint last_program, last_vao, last_active_texture, last_texture, last_array_buffer;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+
+    if (!_vao)
+    {
+        glGenVertexArrays(1, &_vao);
+        glBindVertexArray(_vao);
+
+        /* Every quad is 0 1 2, 2 1 3 with corners in the order top left, bottom left, top right, bottom right */
+        std::vector<Uint16> indices(SPRITE_BATCH_MAX_QUADS * 6);
+        for (Uint32 i = 0; i < SPRITE_BATCH_MAX_QUADS; i++)
+        {
+            const Uint16 corners[6] = { 0, 1, 2, 2, 1, 3 };
+            for (int k = 0; k < 6; k++)
+                indices[i * 6 + k] = i * 4 + corners[k];
+        }
+        glGenBuffers(1, &_indices);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indices);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(Uint16), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+    }
+    else
+        glBindVertexArray(_vao);
+
+    size_t offset;
+    sprite_vertex_t* out = (sprite_vertex_t*)_vertices.map(count * 4 * sizeof(sprite_vertex_t), sizeof(sprite_vertex_t), offset);
+    int draw_calls = 0;
+    if (out)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const quad_t& q = _quads[_order[i]];
+            const int corners[4][2] = { { 0, 1 }, { 0, 3 }, { 2, 1 }, { 2, 3 } };
+            for (int c = 0; c < 4; c++)
+            {
+                sprite_vertex_t& v = out[i * 4 + c];
+                v.pos[0] = q.pos[corners[c][0]];
+                v.pos[1] = q.pos[corners[c][1]];
+                v.uv[0] = to_unorm16(q.uv[corners[c][0]]);
+                v.uv[1] = to_unorm16(q.uv[corners[c][1]]);
+                memcpy(v.color, &q.color, 4);
+            }
+        }
+        _vertices.unmap();
+
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex_t), (void*)(offset + offsetof(sprite_vertex_t, pos)));
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(sprite_vertex_t), (void*)(offset + offsetof(sprite_vertex_t, uv)));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(sprite_vertex_t), (void*)(offset + offsetof(sprite_vertex_t, color)));
+
+        GLboolean last_blend = glIsEnabled(GL_BLEND);
+        GLboolean last_depth_test = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean last_cull_face = glIsEnabled(GL_CULL_FACE);
+        GLboolean last_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+        GLint last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha;
+        glGetIntegerv(GL_BLEND_SRC_RGB, &last_blend_src_rgb);
+        glGetIntegerv(GL_BLEND_DST_RGB, &last_blend_dst_rgb);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &last_blend_src_alpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &last_blend_dst_alpha);
+
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_SCISSOR_TEST);
+
+        sprite_shader.use();
+        glUniform2f(sprite_shader.get_uniform("u_viewport"), _width, _height);
+        glUniform1i(sprite_shader.get_uniform("u_texture"), 0);
+
+        /* One draw per run of the same page, the sort already put each layer's runs in order */
+        size_t run_start = 0;
+        for (size_t i = 1; i <= count; i++)
+        {
+            GLuint texture = _quads[_order[run_start]].texture;
+            if (i < count && _quads[_order[i]].texture == texture)
+                continue;
+
+            if (texture && !render::texture_upload_pending(texture))
+            {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glDrawElements(GL_TRIANGLES, (i - run_start) * 6, GL_UNSIGNED_SHORT, (void*)(run_start * 6 * sizeof(Uint16)));
+                draw_calls++;
+            }
+            run_start = i;
+        }
+
+        glBlendFuncSeparate(last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha);
+        if (!last_blend)
+            glDisable(GL_BLEND);
+        if (last_depth_test)
+            glEnable(GL_DEPTH_TEST);
+        if (last_cull_face)
+            glEnable(GL_CULL_FACE);
+        if (last_scissor_test)
+            glEnable(GL_SCISSOR_TEST);
+    }
+    else
+        dc_log_warn("Out of vertex space, dropping %zu sprites", count);
+
+    glUseProgram(last_program);
+    glBindVertexArray(last_vao);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+    glActiveTexture(last_active_texture);
+    glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+
+    _vertices.end_frame();
+    _quads.clear();
+    return draw_calls;
+}
+
+void sprite_batch_t::destroy()
+{
+    if (_vao)
+        glDeleteVertexArrays(1, &_vao);
+    if (_indices)
+        glDeleteBuffers(1, &_indices);
+    _vao = 0;
+    _indices = 0;
+    _vertices.destroy();
+    _quads.clear();
+}
+
+/* ================================ Selftest ================================ */
+
+static Uint32 test_seed;
+static int test_rand(int min, int max)
+{
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return min + int((test_seed >> 8) % Uint32(max - min + 1));
+}
+
+/**
+ * Checks tile decoding, that packed sprites stay inside their page without overlapping (Gutters included), and that
+ * batches collapse to one draw call per page used in each layer
+ */
+static int command_sprite_batch_selftest()
+{
+    test_seed = 12345;
+    int failures = 0;
+
+    /* 16x8 4bpp: Left tile is all index 1, right tile alternates 0 and 2, palette bank 1 */
+    Uint8 chars[64];
+    memset(chars, 0x11, 32);
+    memset(chars + 32, 0x20, 32);
+    Uint8 palette[64] = {};
+    palette[17 * 2] = 0x1F; /* Red */
+    palette[18 * 2 + 1] = 0x7C; /* Blue */
+    Uint8 rgba[16 * 8 * 4];
+    render::decode_tiles(chars, palette, sizeof(palette) / 2, 16, 8, 4, 1, rgba);
+    const Uint8 expect[3][4] = { { 255, 0, 0, 255 }, { 0, 0, 0, 0 }, { 0, 0, 255, 255 } };
+    if (memcmp(rgba, expect[0], 4) || memcmp(rgba + 8 * 4, expect[1], 4) || memcmp(rgba + 9 * 4, expect[2], 4))
+    {
+        dc_log_error("r_sprite_batch_selftest: 4bpp tile decode mismatch");
+        failures++;
+    }
+
+    sprite_atlas_t atlas(256);
+    std::vector<std::string> names;
+    for (int i = 0; i < 200; i++)
+    {
+        int w = test_rand(1, 48), h = test_rand(1, 48);
+        std::vector<Uint8> pixels(size_t(w) * h * 4, Uint8(i));
+        names.push_back("test_" + std::to_string(i));
+        atlas.add_rgba(names.back().c_str(), pixels.data(), w, h);
+    }
+    if (!atlas.build())
+    {
+        dc_log_error("r_sprite_batch_selftest: Build failed");
+        return 1;
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const sprite_t* a = atlas.find(names[i].c_str());
+        if (!a || !a->texture || a->uv0[0] < 0.0f || a->uv0[1] < 0.0f || a->uv1[0] > 1.0f || a->uv1[1] > 1.0f)
+        {
+            dc_log_error("r_sprite_batch_selftest: \"%s\" missing or out of bounds", names[i].c_str());
+            failures++;
+            continue;
+        }
+
+        const float texel = 1.0f / 256.0f;
+        for (size_t j = i + 1; j < names.size(); j++)
+        {
+            const sprite_t* b = atlas.find(names[j].c_str());
+            if (a->page != b->page)
+                continue;
+            if (a->uv0[0] - texel < b->uv1[0] + texel && b->uv0[0] - texel < a->uv1[0] + texel && a->uv0[1] - texel < b->uv1[1] + texel
+                && b->uv0[1] - texel < a->uv1[1] + texel)
+            {
+                dc_log_error("r_sprite_batch_selftest: \"%s\" overlaps \"%s\"", names[i].c_str(), names[j].c_str());
+                failures++;
+            }
+        }
+    }
+
+    /* The pages have to be resident to be drawn */
+    for (size_t i = 0; i < atlas.get_page_count(); i++)
+        while (render::texture_upload_pending(atlas.get_page_texture(i)))
+            render::texture_upload_update();
+
+    sprite_batch_t batch;
+    int pages = atlas.get_page_count();
+
+    /* Every layer on one page, the whole batch should be a single draw */
+    batch.begin(640, 480);
+    for (int i = 0; i < 1000;)
+    {
+        const sprite_t* sprite = atlas.find(names[test_rand(0, names.size() - 1)].c_str());
+        if (sprite->page)
+            continue;
+        batch.draw(sprite, test_rand(0, 600), test_rand(0, 440), 0xFFFFFFFF, test_rand(0, 3));
+        i++;
+    }
+    int draw_calls = batch.end();
+    if (draw_calls != 1)
+    {
+        dc_log_error("r_sprite_batch_selftest: %d draw calls for a single page", draw_calls);
+        failures++;
+    }
+
+    /* Mixed pages, one draw per page used in each layer */
+    bool used[4][16] = {};
+    int expected = 0;
+    batch.begin(640, 480);
+    for (int i = 0; i < 1000; i++)
+    {
+        const sprite_t* sprite = atlas.find(names[test_rand(0, names.size() - 1)].c_str());
+        int layer = test_rand(0, 3);
+        if (sprite->page < 16 && !used[layer][sprite->page])
+        {
+            used[layer][sprite->page] = true;
+            expected++;
+        }
+        batch.draw(sprite, test_rand(0, 600), test_rand(0, 440), 0xFFFFFFFF, layer);
+    }
+    int mixed_draw_calls = batch.end();
+    if (mixed_draw_calls != expected)
+    {
+        dc_log_error("r_sprite_batch_selftest: %d draw calls for %d layer/page pairs", mixed_draw_calls, expected);
+        failures++;
+    }
+
+    batch.destroy();
+    atlas.destroy();
+
+    if (failures)
+        dc_log_error("r_sprite_batch_selftest: %d failures", failures);
+    else
+        dc_log("r_sprite_batch_selftest: 200 sprites on %d pages, 1000 quads in %d draw call(s), %d when mixing pages", pages, draw_calls, mixed_draw_calls);
+    return failures ? 1 : 0;
+}
+
+void render::sprite_batch_init() { dev_console::add_command("r_sprite_batch_selftest", command_sprite_batch_selftest); }
+
+void render::sprite_batch_shutdown()
+{
+    sprite_shader.destroy();
+    sprite_shader_state = 0;
+}
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_SPRITE_BATCH_H
+#define MPH_TETRA_RENDER_SPRITE_BATCH_H
+
+#include "stream_buffer.h"
+
+#include <SDL_bits.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Max quads per sprite_batch_t::end(), keeps indices 16-bit
+ */
+#define SPRITE_BATCH_MAX_QUADS 16384
+
+/**
+ * Packed atlas entry
+ */
+struct sprite_t
+{
+    /** Page texture, 0 until sprite_atlas_t::build() */
+    GLuint texture;
+    int page;
+    int width;
+    int height;
+    /** Normalized texcoords of the top left and bottom right corners */
+    float uv0[2];
+    float uv1[2];
+};
+
+/**
+ * Named sprites packed into as few pages (Textures) as possible
+ *
+ * Sprites are added, then build() shelf packs them (tallest first, with a 1 texel gutter copied from the sprite edge so
+ * linear filtering never picks up a neighbor) and queues each page with render::texture_upload().
+ */
+class sprite_atlas_t
+{
+public:
+    /**
+     * @param page_size Width and height of each page (Clamped to GL_MAX_TEXTURE_SIZE by build())
+     */
+    sprite_atlas_t(int page_size = 1024);
+
+    /**
+     * Adds a sprite from straight alpha RGBA8
+     *
+     * @returns false if the name is taken or the sprite is empty
+     */
+    bool add_rgba(const char* name, const Uint8* rgba, int width, int height);
+
+    /**
+     * Adds a sprite from NDS 2D graphics data in the PhysFS tree
+     *
+     * Character data is a grid of 8x8 tiles (Row major), 4bpp tiles store the left texel in the low nibble. Palettes are
+     * BGR555 and index 0 is transparent.
+     *
+     * @param name Sprite name
+     * @param char_path Path to the character (Tile) data
+     * @param palette_path Path to the palette
+     * @param width Width in texels (Multiple of 8)
+     * @param height Height in texels (Multiple of 8)
+     * @param bpp 4 or 8
+     * @param palette_index 16 color bank to use for 4bpp data
+     *
+     * @returns false if either file is missing or too small
+     */
+    bool add_nitrofs(const char* name, const char* char_path, const char* palette_path, int width, int height, int bpp, int palette_index = 0);
+
+    /**
+     * Packs all sprites added so far and queues the pages for upload, must be called with a current context
+     *
+     * @returns false if a sprite is larger than a page
+     */
+    bool build();
+
+    /**
+     * @returns Sprite, or NULL if not found (Pointers stay valid until destroy())
+     */
+    const sprite_t* find(const char* name) const;
+
+    inline size_t get_page_count() const { return _pages.size(); }
+    inline GLuint get_page_texture(int page) const { return _pages[page]; }
+
+    void destroy();
+
+private:
+    struct source_t
+    {
+        int width;
+        int height;
+        std::vector<Uint8> rgba;
+    };
+
+    int _page_size;
+    std::map<std::string, sprite_t> _sprites;
+    std::map<std::string, source_t> _sources;
+    std::vector<GLuint> _pages;
+};
+
+/**
+ * Accumulates sprites for one draw per page
+ *
+ * Quads are written to a stream_buffer_t, then end() sorts them by layer and page (Submission order is kept within each)
+ * and issues one glDrawElements() per run of the same page, so a HUD on a single page is a single draw call. Layers
+ * are drawn lowest first.
+ *
+ * Positions are in pixels with the origin in the top left of the viewport.
+ *
+ * Call begin() and end() once per frame per instance, as end() advances the stream buffer.
+ */
+class sprite_batch_t
+{
+public:
+    sprite_batch_t();
+
+    /**
+     * @param width Viewport width in pixels
+     * @param height Viewport height in pixels
+     */
+    void begin(int width, int height);
+
+    /**
+     * Queues a sprite
+     *
+     * @param sprite Atlas entry (Ignored if NULL)
+     * @param x Left edge
+     * @param y Top edge
+     * @param w Width, negative flips horizontally
+     * @param h Height, negative flips vertically
+     * @param color Tint as packed RGBA (Red in the low byte, like IM_COL32)
+     * @param layer Draw order, higher is drawn on top
+     */
+    void draw(const sprite_t* sprite, float x, float y, float w, float h, Uint32 color = 0xFFFFFFFF, int layer = 0);
+
+    /**
+     * Same as draw() with the sprite's size
+     */
+    inline void draw(const sprite_t* sprite, float x, float y, Uint32 color = 0xFFFFFFFF, int layer = 0)
+    {
+        if (sprite)
+            draw(sprite, x, y, sprite->width, sprite->height, color, layer);
+    }
+
+    /**
+     * Sorts, uploads, and draws everything since begin()
+     *
+     * Blending, the program, the VAO, and the texture binding are restored afterwards. Sprites on pages that are still
+     * being uploaded are skipped.
+     *
+     * @returns Number of draw calls issued
+     */
+    int end();
+
+    void destroy();
+
+    /** Number of quads queued since begin() */
+    inline size_t get_quad_count() const { return _quads.size(); }
+
+private:
+    struct quad_t
+    {
+        int layer;
+        GLuint texture;
+        float pos[4];
+        float uv[4];
+        Uint32 color;
+    };
+
+    std::vector<quad_t> _quads;
+    std::vector<Uint32> _order;
+    int _width;
+    int _height;
+
+    stream_buffer_t _vertices;
+    GLuint _vao;
+    GLuint _indices;
+};
+
+namespace render
+{
+/**
+ * Decodes NDS tiled 4bpp/8bpp character data (See sprite_atlas_t::add_nitrofs()) to straight alpha RGBA8
+ *
+ * Index 0 and indices past the end of the palette are transparent
+ *
+ * @param chars At least width * height * bpp / 8 bytes
+ * @param palette BGR555 colors
+ * @param palette_colors Number of colors in palette
+ * @param palette_index 16 color bank to use for 4bpp data
+ */
+void decode_tiles(const Uint8* chars, const Uint8* palette, size_t palette_colors, int width, int height, int bpp, int palette_index, Uint8* rgba);
+
+/**
+ * Registers the r_sprite_batch_selftest console command
+ */
+void sprite_batch_init();
+
+/**
+ * Destroys the shared shader
+ */
+void sprite_batch_shutdown();
+}
+
+#endif
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "stream_buffer.h"
+
+#include "gui/console.h"
+
+#include <SDL.h>
+
+/* Waiting on a fence longer than this means something is seriously wrong, don't hang forever */
+#define FENCE_TIMEOUT_NS 1000000000ull
+
+stream_buffer_t::stream_buffer_t(GLenum target, size_t frame_size, int frames)
+{
+    _target = target;
+    _buffer = 0;
+    _frame_size = frame_size;
+    _frames = SDL_clamp(frames, 2, STREAM_BUFFER_MAX_FRAMES);
+    _current = 0;
+    _used = 0;
+    for (int i = 0; i < STREAM_BUFFER_MAX_FRAMES; i++)
+        _fences[i] = NULL;
+}
+
+void stream_buffer_t::destroy()
+{
+    for (int i = 0; i < STREAM_BUFFER_MAX_FRAMES; i++)
+    {
+        if (_fences[i])
+            glDeleteSync(_fences[i]);
+        _fences[i] = NULL;
+    }
+
+    if (_buffer)
+        glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+    _current = 0;
+    _used = 0;
+}
+
+void* stream_buffer_t::map(size_t bytes, size_t alignment, size_t& offset)
+{
+    if (!_buffer)
+    {
+        glGenBuffers(1, &_buffer);
+        glBindBuffer(_target, _buffer);
+        glBufferData(_target, _frame_size * _frames, NULL, GL_STREAM_DRAW);
+    }
+
+    /* Alignment is relative to the start of the buffer object, regions don't have to be multiples of it */
+    size_t region = _current * _frame_size;
+    if (alignment > 1)
+        offset = (region + _used + alignment - 1) / alignment * alignment;
+    else
+        offset = region + _used;
+
+    if (offset + bytes > region + _frame_size || bytes == 0)
+        return NULL;
+
+    _used = offset + bytes - region;
+
+    glBindBuffer(_target, _buffer);
+    return glMapBufferRange(_target, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void stream_buffer_t::unmap()
+{
+    glBindBuffer(_target, _buffer);
+    if (!glUnmapBuffer(_target))
+        dc_log_warn("Stream buffer contents were lost while mapped");
+}
+
+void stream_buffer_t::end_frame()
+{
+    if (!_buffer)
+        return;
+
+    if (_used)
+        _fences[_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    _current = (_current + 1) % _frames;
+    _used = 0;
+
+    if (_fences[_current])
+    {
+        if (glClientWaitSync(_fences[_current], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+            dc_log_warn("Timed out waiting for stream buffer region %d", _current);
+        glDeleteSync(_fences[_current]);
+        _fences[_current] = NULL;
+    }
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_STREAM_BUFFER_H
+#define MPH_TETRA_RENDER_STREAM_BUFFER_H
+
+#include "gl.h"
+
+#include <SDL_bits.h>
+#include <stddef.h>
+
+#define STREAM_BUFFER_MAX_FRAMES 4
+
+/**
+ * Buffer object for data that is rewritten every frame
+ *
+ * The buffer is split into one region per frame in flight, writes go to the current frame's region with unsynchronized
+ * maps, and end_frame() fences the region before moving on. The driver never has to stall or orphan storage unless
+ * the GPU falls more than `frames` frames behind.
+ *
+ * GL objects are created on first use, so instances can be static
+ */
+class stream_buffer_t
+{
+public:
+    /**
+     * @param target Buffer binding target (GL_ARRAY_BUFFER, GL_PIXEL_UNPACK_BUFFER, ...)
+     * @param frame_size Bytes available per frame
+     * @param frames Number of frames in flight [2, STREAM_BUFFER_MAX_FRAMES]
+     */
+    stream_buffer_t(GLenum target, size_t frame_size, int frames = 3);
+
+    /**
+     * Reserves and maps space in the current frame's region, the buffer is left bound to the target
+     *
+     * @param bytes Number of bytes to reserve
+     * @param alignment Alignment of the returned offset
+     * @param offset Byte offset of the reservation in the buffer object
+     *
+     * @returns Pointer to write to, or NULL if the region is out of space
+     */
+    void* map(size_t bytes, size_t alignment, size_t& offset);
+
+    /**
+     * Unmaps the last map(), must be called before drawing from the buffer
+     */
+    void unmap();
+
+    /**
+     * Fences the current region and waits until the next one is no longer in use
+     */
+    void end_frame();
+
+    void destroy();
+
+    inline GLuint get_buffer() { return _buffer; }
+    inline size_t get_frame_size() { return _frame_size; }
+    inline size_t get_frame_used() { return _used; }
+
+private:
+    GLenum _target;
+    GLuint _buffer;
+    size_t _frame_size;
+    int _frames;
+    int _current;
+    size_t _used;
+    GLsync _fences[STREAM_BUFFER_MAX_FRAMES];
+};
+
+#endif
@@ -0,0 +1,837 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "swr.h"
+
+#include "gl.h"
+
+#include "gui/console.h"
+#include "gui/imgui.h"
+#include "util/convar.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Vertices outside this many pixels from the origin are rejected, this keeps every per tile edge value in 32 bits
+ * (Callers are expected to clip to a guard band anyway)
+ */
+#define SWR_COORD_LIMIT 16384.0f
+
+enum swr_attribute_t
+{
+    ATTRIBUTE_Z,
+    ATTRIBUTE_INV_W,
+    ATTRIBUTE_U,
+    ATTRIBUTE_V,
+    ATTRIBUTE_R,
+    ATTRIBUTE_G,
+    ATTRIBUTE_B,
+    ATTRIBUTE_A,
+};
+
+static convar_int_t r_software_rasterizer("r_software_rasterizer", 0, 0, 1,
+    "Draw the UI with the built in software rasterizer instead of OpenGL (For machines without a usable GPU)", CONVAR_FLAG_INT_IS_BOOL);
+#ifdef __SSE2__
+static convar_int_t r_swr_simd("r_swr_simd", 1, 0, 1, "Rasterize 4 pixels at a time with SSE2 (The scalar path is what r_swr_selftest compares against)",
+    CONVAR_FLAG_INT_IS_BOOL);
+#endif
+
+static profiler_zone_t zone_flush("swr_context_t::flush");
+static profiler_zone_t zone_render_imgui("render::swr_render_imgui");
+
+void swr_context_t::resize(int width, int height)
+{
+    flush();
+
+    _width = SDL_max(width, 0);
+    _height = SDL_max(height, 0);
+    _tiles_x = (_width + SWR_TILE_SIZE - 1) / SWR_TILE_SIZE;
+    _tiles_y = (_height + SWR_TILE_SIZE - 1) / SWR_TILE_SIZE;
+    _color.resize(size_t(_width) * _height * 4);
+    _depth.resize(size_t(_width) * _height);
+    _bins.resize(size_t(_tiles_x) * _tiles_y);
+}
+
+void swr_context_t::clear(Uint32 color, float depth)
+{
+    flush();
+
+    Uint8 rgba[4] = { Uint8(color), Uint8(color >> 8), Uint8(color >> 16), Uint8(color >> 24) };
+    for (size_t i = 0; i < _color.size(); i += 4)
+        memcpy(&_color[i], rgba, 4);
+    for (size_t i = 0; i < _depth.size(); i++)
+        _depth[i] = depth;
+}
+
+void swr_context_t::draw(const swr_vertex_t* vertices, const Uint16* indices, size_t count, const swr_state_t& state)
+{
+    draw_indexed(vertices, indices, count, state);
+}
+
+void swr_context_t::draw(const swr_vertex_t* vertices, const Uint32* indices, size_t count, const swr_state_t& state)
+{
+    draw_indexed(vertices, indices, count, state);
+}
+
+template <typename T> void swr_context_t::draw_indexed(const swr_vertex_t* vertices, const T* indices, size_t count, const swr_state_t& state)
+{
+    if (count < 3 || !_tiles_x || !_tiles_y)
+        return;
+
+    _states.push_back(state);
+    for (size_t i = 0; i + 2 < count; i += 3)
+        setup(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+}
+
+void swr_context_t::setup(const swr_vertex_t& v0, const swr_vertex_t& v1, const swr_vertex_t& v2)
+{
+    const swr_vertex_t* v[3] = { &v0, &v1, &v2 };
+    for (int i = 0; i < 3; i++)
+    {
+        /* Written so NaNs fail too */
+        if (!(fabsf(v[i]->x) <= SWR_COORD_LIMIT && fabsf(v[i]->y) <= SWR_COORD_LIMIT && v[i]->w > 0.0f))
+            return;
+    }
+
+    /* 28.4 fixed point, same snapping as the DS */
+    Sint32 x[3], y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = Sint32(floorf(v[i]->x * 16.0f + 0.5f));
+        y[i] = Sint32(floorf(v[i]->y * 16.0f + 0.5f));
+    }
+
+    Sint64 area = Sint64(x[1] - x[0]) * (y[2] - y[0]) - Sint64(x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0)
+        return;
+
+    /* No culling, flip clockwise triangles so inside is always E >= 0 */
+    if (area < 0)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(v[1], v[2]);
+    }
+
+    const swr_state_t& state = _states.back();
+
+    /* Pixel centers are at 16 * p + 8 */
+    triangle_t tri;
+    tri.state = int(_states.size() - 1);
+    tri.min_x = (SDL_min(x[0], SDL_min(x[1], x[2])) + 7) >> 4;
+    tri.min_y = (SDL_min(y[0], SDL_min(y[1], y[2])) + 7) >> 4;
+    tri.max_x = ((SDL_max(x[0], SDL_max(x[1], x[2])) - 8) >> 4) + 1;
+    tri.max_y = ((SDL_max(y[0], SDL_max(y[1], y[2])) - 8) >> 4) + 1;
+    tri.min_x = SDL_max(tri.min_x, SDL_max(state.clip_min_x, 0));
+    tri.min_y = SDL_max(tri.min_y, SDL_max(state.clip_min_y, 0));
+    tri.max_x = SDL_min(tri.max_x, SDL_min(state.clip_max_x, _width));
+    tri.max_y = SDL_min(tri.max_y, SDL_min(state.clip_max_y, _height));
+    if (tri.min_x >= tri.max_x || tri.min_y >= tri.max_y)
+        return;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        Sint32 a = y[j] - y[k];
+        Sint32 b = x[k] - x[j];
+        Sint64 c = Sint64(x[j]) * y[k] - Sint64(y[j]) * x[k];
+
+        /* Top-left fill rule: pixels exactly on an edge only belong to the triangle if it is a left or top edge */
+        bool top_left = a > 0 || (a == 0 && b > 0);
+
+        tri.step_x[i] = a * 16;
+        tri.step_y[i] = b * 16;
+        tri.origin[i] = Sint64(a) * 8 + Sint64(b) * 8 + c - (top_left ? 0 : 1);
+    }
+
+    float fx[3], fy[3], attr[3][8];
+    for (int i = 0; i < 3; i++)
+    {
+        fx[i] = float(x[i]) / 16.0f;
+        fy[i] = float(y[i]) / 16.0f;
+
+        float inv_w = 1.0f / v[i]->w;
+        Uint32 color = v[i]->color;
+        attr[i][ATTRIBUTE_Z] = v[i]->z;
+        attr[i][ATTRIBUTE_INV_W] = inv_w;
+        attr[i][ATTRIBUTE_U] = v[i]->u * inv_w;
+        attr[i][ATTRIBUTE_V] = v[i]->v * inv_w;
+        attr[i][ATTRIBUTE_R] = float(color & 0xFF) * inv_w;
+        attr[i][ATTRIBUTE_G] = float((color >> 8) & 0xFF) * inv_w;
+        attr[i][ATTRIBUTE_B] = float((color >> 16) & 0xFF) * inv_w;
+        attr[i][ATTRIBUTE_A] = float((color >> 24) & 0xFF) * inv_w;
+    }
+
+    float d1x = fx[1] - fx[0];
+    float d1y = fy[1] - fy[0];
+    float d2x = fx[2] - fx[0];
+    float d2y = fy[2] - fy[0];
+    float inv_det = 1.0f / (d1x * d2y - d2x * d1y);
+
+    tri.x0 = fx[0];
+    tri.y0 = fy[0];
+    for (int n = 0; n < 8; n++)
+    {
+        float df1 = attr[1][n] - attr[0][n];
+        float df2 = attr[2][n] - attr[0][n];
+        tri.base[n] = attr[0][n];
+        tri.ddx[n] = (df1 * d2y - df2 * d1y) * inv_det;
+        tri.ddy[n] = (df2 * d1x - df1 * d2x) * inv_det;
+    }
+
+    Uint32 index = Uint32(_triangles.size());
+    _triangles.push_back(tri);
+
+    for (int ty = tri.min_y / SWR_TILE_SIZE; ty <= (tri.max_y - 1) / SWR_TILE_SIZE; ty++)
+        for (int tx = tri.min_x / SWR_TILE_SIZE; tx <= (tri.max_x - 1) / SWR_TILE_SIZE; tx++)
+            _bins[size_t(ty) * _tiles_x + tx].push_back(index);
+}
+
+void swr_context_t::flush(bool parallel)
+{
+    if (_triangles.empty())
+    {
+        _states.clear();
+        return;
+    }
+
+    PROFILER_SCOPE(zone_flush);
+
+    int num_tiles = _tiles_x * _tiles_y;
+    if (parallel)
+        jobs::parallel_for(num_tiles, 1, [this](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                raster_tile(i);
+        });
+    else
+        for (int i = 0; i < num_tiles; i++)
+            raster_tile(i);
+
+    for (size_t i = 0; i < _bins.size(); i++)
+        _bins[i].clear();
+    _triangles.clear();
+    _states.clear();
+}
+
+void swr_context_t::raster_tile(int tile)
+{
+    const std::vector<Uint32>& bin = _bins[tile];
+    if (bin.empty())
+        return;
+
+    int tile_x = (tile % _tiles_x) * SWR_TILE_SIZE;
+    int tile_y = (tile / _tiles_x) * SWR_TILE_SIZE;
+
+    for (size_t i = 0; i < bin.size(); i++)
+    {
+        const triangle_t& tri = _triangles[bin[i]];
+        int x0 = SDL_max(tri.min_x, tile_x);
+        int y0 = SDL_max(tri.min_y, tile_y);
+        int x1 = SDL_min(tri.max_x, tile_x + SWR_TILE_SIZE);
+        int y1 = SDL_min(tri.max_y, tile_y + SWR_TILE_SIZE);
+        if (x0 < x1 && y0 < y1)
+            raster_triangle(tri, x0, y0, x1, y1);
+    }
+}
+
+/**
+ * Float to int conversions avoid floorf(), it is a library call without SSE4.1
+ */
+static inline int wrap_texcoord(float coord, int size, swr_wrap_t wrap)
+{
+    float f = coord * float(size);
+    /* Also catches NaN */
+    if (!(fabsf(f) < 16777216.0f))
+        f = 0.0f;
+    int i = int(f);
+    if (float(i) > f)
+        i--;
+
+    /* DS textures are always powers of two, skip the divisions for them */
+    bool pow2 = !(size & (size - 1));
+    switch (wrap)
+    {
+    case SWR_WRAP_REPEAT:
+        i = pow2 ? i & (size - 1) : i % size;
+        return i < 0 ? i + size : i;
+    case SWR_WRAP_MIRROR:
+        i = pow2 ? i & (size * 2 - 1) : i % (size * 2);
+        if (i < 0)
+            i += size * 2;
+        return i < size ? i : size * 2 - 1 - i;
+    default:
+        return SDL_clamp(i, 0, size - 1);
+    }
+}
+
+static inline float to_unorm8(float value) { return float(int(SDL_clamp(value, 0.0f, 255.0f) + 0.5f)); }
+
+/**
+ * Perspective corrected values at a pixel, shade() reads them with a stride so SIMD results can be used in place
+ */
+enum swr_fragment_t
+{
+    FRAGMENT_Z,
+    FRAGMENT_U,
+    FRAGMENT_V,
+    FRAGMENT_R,
+    FRAGMENT_G,
+    FRAGMENT_B,
+    FRAGMENT_A,
+    FRAGMENT_COUNT,
+};
+
+/**
+ * Evaluates the attribute planes at one pixel, dx/dy are relative to vertex 0 of the triangle
+ *
+ * interpolate4() has to perform the exact same operations in the same order
+ */
+static inline void interpolate(const float* base, const float* ddx, const float* ddy, float dx, float dy, float* frag)
+{
+#define PLANE(n) (base[n] + ddx[n] * dx + ddy[n] * dy)
+    float w = 1.0f / PLANE(ATTRIBUTE_INV_W);
+    frag[FRAGMENT_Z] = PLANE(ATTRIBUTE_Z);
+    frag[FRAGMENT_U] = PLANE(ATTRIBUTE_U) * w;
+    frag[FRAGMENT_V] = PLANE(ATTRIBUTE_V) * w;
+    frag[FRAGMENT_R] = PLANE(ATTRIBUTE_R) * w;
+    frag[FRAGMENT_G] = PLANE(ATTRIBUTE_G) * w;
+    frag[FRAGMENT_B] = PLANE(ATTRIBUTE_B) * w;
+    frag[FRAGMENT_A] = PLANE(ATTRIBUTE_A) * w;
+#undef PLANE
+}
+
+#ifdef __SSE2__
+/**
+ * interpolate() for 4 horizontally adjacent pixels, results are stored as frag[FRAGMENT_*][lane]
+ */
+static inline void interpolate4(const float* base, const float* ddx, const float* ddy, __m128 dx, __m128 dy, float (*frag)[4])
+{
+#define PLANE(n) _mm_add_ps(_mm_add_ps(_mm_set1_ps(base[n]), _mm_mul_ps(_mm_set1_ps(ddx[n]), dx)), _mm_mul_ps(_mm_set1_ps(ddy[n]), dy))
+    __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), PLANE(ATTRIBUTE_INV_W));
+    _mm_storeu_ps(frag[FRAGMENT_Z], PLANE(ATTRIBUTE_Z));
+    _mm_storeu_ps(frag[FRAGMENT_U], _mm_mul_ps(PLANE(ATTRIBUTE_U), w));
+    _mm_storeu_ps(frag[FRAGMENT_V], _mm_mul_ps(PLANE(ATTRIBUTE_V), w));
+    _mm_storeu_ps(frag[FRAGMENT_R], _mm_mul_ps(PLANE(ATTRIBUTE_R), w));
+    _mm_storeu_ps(frag[FRAGMENT_G], _mm_mul_ps(PLANE(ATTRIBUTE_G), w));
+    _mm_storeu_ps(frag[FRAGMENT_B], _mm_mul_ps(PLANE(ATTRIBUTE_B), w));
+    _mm_storeu_ps(frag[FRAGMENT_A], _mm_mul_ps(PLANE(ATTRIBUTE_A), w));
+#undef PLANE
+}
+#endif
+
+/**
+ * Textures, tests, fogs, blends and writes one pixel
+ *
+ * @param frag Output of interpolate(), element n is at frag[n * stride]
+ */
+static inline void shade(const float* frag, int stride, const swr_state_t& state, Uint8* color, float* depth)
+{
+    float z = frag[FRAGMENT_Z * stride];
+    if (state.depth_test && !(z < *depth))
+        return;
+
+    float rgba[4];
+    for (int c = 0; c < 4; c++)
+        rgba[c] = frag[(FRAGMENT_R + c) * stride];
+
+    if (state.texture)
+    {
+        const swr_texture_t& tex = *state.texture;
+        int s = wrap_texcoord(frag[FRAGMENT_U * stride], tex.width, tex.wrap_s);
+        int t = wrap_texcoord(frag[FRAGMENT_V * stride], tex.height, tex.wrap_t);
+        const Uint8* texel = tex.texels + (size_t(t) * tex.width + s) * 4;
+        for (int c = 0; c < 4; c++)
+            rgba[c] = rgba[c] * float(texel[c]) * (1.0f / 255.0f);
+    }
+
+    for (int c = 0; c < 4; c++)
+        rgba[c] = to_unorm8(rgba[c]);
+
+    if (state.alpha_test && !(rgba[3] > float(state.alpha_ref)))
+        return;
+
+    if (state.fog)
+    {
+        float f = SDL_clamp((z - state.fog_start) / (state.fog_end - state.fog_start), 0.0f, 1.0f);
+        for (int c = 0; c < 4; c++)
+            rgba[c] = to_unorm8(rgba[c] + (float((state.fog_color >> (c * 8)) & 0xFF) - rgba[c]) * f);
+    }
+
+    if (state.blend)
+    {
+        float a = rgba[3] * (1.0f / 255.0f);
+        for (int c = 0; c < 3; c++)
+            rgba[c] = to_unorm8(rgba[c] * a + float(color[c]) * (1.0f - a));
+        rgba[3] = to_unorm8(rgba[3] + float(color[3]) * (1.0f - a));
+    }
+
+    for (int c = 0; c < 4; c++)
+        color[c] = Uint8(rgba[c]);
+
+    if (state.depth_write)
+        *depth = z;
+}
+
+void swr_context_t::raster_triangle(const triangle_t& tri, int x0, int y0, int x1, int y1)
+{
+    /**
+     * Edges that pass over the whole rectangle are dropped from the per pixel test, edges that miss it reject the
+     * triangle. Any remaining edge crosses the rectangle, so its values inside are bounded by the rectangle size and
+     * fit in 32 bits.
+     */
+    Sint32 row[3] = {};
+    Sint32 step_x[3] = {};
+    Sint32 step_y[3] = {};
+    for (int i = 0, n = 0; i < 3; i++)
+    {
+        Sint64 corner = tri.origin[i] + Sint64(tri.step_x[i]) * x0 + Sint64(tri.step_y[i]) * y0;
+        Sint64 span_x = Sint64(tri.step_x[i]) * (x1 - 1 - x0);
+        Sint64 span_y = Sint64(tri.step_y[i]) * (y1 - 1 - y0);
+        Sint64 lo = corner + SDL_min(span_x, 0) + SDL_min(span_y, 0);
+        Sint64 hi = corner + SDL_max(span_x, 0) + SDL_max(span_y, 0);
+        if (hi < 0)
+            return;
+        if (lo >= 0)
+            continue;
+        row[n] = Sint32(corner);
+        step_x[n] = tri.step_x[i];
+        step_y[n] = tri.step_y[i];
+        n++;
+    }
+
+    const swr_state_t& state = _states[tri.state];
+
+#ifdef __SSE2__
+    bool use_simd = r_swr_simd.get();
+    __m128i lane_offset[3], step4[3];
+    for (int i = 0; i < 3; i++)
+    {
+        lane_offset[i] = _mm_set_epi32(step_x[i] * 3, step_x[i] * 2, step_x[i], 0);
+        step4[i] = _mm_set1_epi32(step_x[i] * 4);
+    }
+#endif
+
+    for (int y = y0; y < y1; y++)
+    {
+        Uint8* color_row = &_color[size_t(y) * _width * 4];
+        float* depth_row = &_depth[size_t(y) * _width];
+        float dy = float(y) + 0.5f - tri.y0;
+
+#ifdef __SSE2__
+        if (use_simd)
+        {
+            __m128 dy4 = _mm_set1_ps(dy);
+            __m128i e0 = _mm_add_epi32(_mm_set1_epi32(row[0]), lane_offset[0]);
+            __m128i e1 = _mm_add_epi32(_mm_set1_epi32(row[1]), lane_offset[1]);
+            __m128i e2 = _mm_add_epi32(_mm_set1_epi32(row[2]), lane_offset[2]);
+            for (int x = x0; x < x1; x += 4)
+            {
+                /* Sign bit set in any edge means outside */
+                __m128i outside = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+                int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+                if (x1 - x < 4)
+                    mask &= (1 << (x1 - x)) - 1;
+
+                if (mask)
+                {
+                    __m128i lane_x = _mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0));
+                    __m128 dx4 = _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(lane_x), _mm_set1_ps(0.5f)), _mm_set1_ps(tri.x0));
+                    float frag[FRAGMENT_COUNT][4];
+                    interpolate4(tri.base, tri.ddx, tri.ddy, dx4, dy4, frag);
+
+                    for (int l = 0; mask; l++, mask >>= 1)
+                        if (mask & 1)
+                            shade(&frag[0][l], 4, state, &color_row[(x + l) * 4], &depth_row[x + l]);
+                }
+
+                e0 = _mm_add_epi32(e0, step4[0]);
+                e1 = _mm_add_epi32(e1, step4[1]);
+                e2 = _mm_add_epi32(e2, step4[2]);
+            }
+        }
+        else
+#endif
+        {
+            Sint32 e0 = row[0], e1 = row[1], e2 = row[2];
+            for (int x = x0; x < x1; x++)
+            {
+                if ((e0 | e1 | e2) >= 0)
+                {
+                    float frag[FRAGMENT_COUNT];
+                    interpolate(tri.base, tri.ddx, tri.ddy, float(x) + 0.5f - tri.x0, dy, frag);
+                    shade(frag, 1, state, &color_row[x * 4], &depth_row[x]);
+                }
+                e0 += step_x[0];
+                e1 += step_x[1];
+                e2 += step_x[2];
+            }
+        }
+
+        for (int i = 0; i < 3; i++)
+            row[i] += step_y[i];
+    }
+}
+
+bool render::swr_is_enabled() { return r_software_rasterizer.get(); }
+
+static swr_context_t imgui_context;
+static std::vector<swr_vertex_t> imgui_vertices;
+static GLuint present_texture = 0;
+static GLuint present_framebuffer = 0;
+static int present_width = 0;
+static int present_height = 0;
+
+void render::swr_render_imgui(ImDrawData* draw_data, Uint32 clear_color)
+{
+    PROFILER_SCOPE(zone_render_imgui);
+
+    int width = int(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
+    int height = int(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (imgui_context.get_width() != width || imgui_context.get_height() != height)
+        imgui_context.resize(width, height);
+    imgui_context.clear(clear_color);
+
+    ImGuiIO& io = ImGui::GetIO();
+    swr_texture_t font = {};
+    unsigned char* font_texels = NULL;
+    io.Fonts->GetTexDataAsRGBA32(&font_texels, &font.width, &font.height);
+    font.texels = font_texels;
+    font.wrap_s = SWR_WRAP_CLAMP;
+    font.wrap_t = SWR_WRAP_CLAMP;
+
+    ImVec2 clip_off = draw_data->DisplayPos;
+    ImVec2 clip_scale = draw_data->FramebufferScale;
+
+    swr_state_t state;
+    state.blend = true;
+
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* list = draw_data->CmdLists[n];
+
+        imgui_vertices.resize(list->VtxBuffer.Size);
+        for (int i = 0; i < list->VtxBuffer.Size; i++)
+        {
+            const ImDrawVert& src = list->VtxBuffer[i];
+            swr_vertex_t& dst = imgui_vertices[i];
+            dst.x = (src.pos.x - clip_off.x) * clip_scale.x;
+            dst.y = (src.pos.y - clip_off.y) * clip_scale.y;
+            dst.z = 0.0f;
+            dst.w = 1.0f;
+            dst.u = src.uv.x;
+            dst.v = src.uv.y;
+            dst.color = src.col;
+        }
+
+        for (int i = 0; i < list->CmdBuffer.Size; i++)
+        {
+            const ImDrawCmd& cmd = list->CmdBuffer[i];
+
+            /* Callbacks expect the OpenGL backend's state, and other textures only exist on the GPU */
+            if (cmd.UserCallback || cmd.GetTexID() != io.Fonts->TexID || !font_texels)
+                continue;
+
+            state.texture = &font;
+            state.clip_min_x = int((cmd.ClipRect.x - clip_off.x) * clip_scale.x);
+            state.clip_min_y = int((cmd.ClipRect.y - clip_off.y) * clip_scale.y);
+            state.clip_max_x = int((cmd.ClipRect.z - clip_off.x) * clip_scale.x);
+            state.clip_max_y = int((cmd.ClipRect.w - clip_off.y) * clip_scale.y);
+
+            const ImDrawIdx* indices = list->IdxBuffer.Data + cmd.IdxOffset;
+            imgui_context.draw(imgui_vertices.data() + cmd.VtxOffset, indices, cmd.ElemCount, state);
+        }
+    }
+
+    imgui_context.flush();
+
+    if (!present_texture)
+    {
+        glGenTextures(1, &present_texture);
+        glBindTexture(GL_TEXTURE_2D, present_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenFramebuffers(1, &present_framebuffer);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, present_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (present_width != width || present_height != height)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imgui_context.get_pixels());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, present_framebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, present_texture, 0);
+        if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            dc_log_error("Software rasterizer present framebuffer is incomplete");
+        present_width = width;
+        present_height = height;
+    }
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, imgui_context.get_pixels());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* Rows are stored top down, flip while blitting */
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, present_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, height, width, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void render::swr_shutdown()
+{
+    if (present_framebuffer)
+        glDeleteFramebuffers(1, &present_framebuffer);
+    if (present_texture)
+        glDeleteTextures(1, &present_texture);
+    present_framebuffer = 0;
+    present_texture = 0;
+    present_width = 0;
+    present_height = 0;
+}
+
+static Uint32 test_seed = 1;
+static float test_rand(float range)
+{
+    test_seed = test_seed * 1103515245 + 12345;
+    return (float((test_seed >> 8) & 0xFFFF) / 65535.0f * 2.0f - 1.0f) * range;
+}
+
+/**
+ * Random triangles exercising every state, some of them partially off screen
+ */
+static void draw_test_scene(swr_context_t& ctx, const swr_texture_t* texture, int num_triangles)
+{
+    std::vector<swr_vertex_t> vertices(num_triangles * 3);
+    std::vector<Uint32> indices(num_triangles * 3);
+    float w = float(ctx.get_width());
+    float h = float(ctx.get_height());
+
+    float cx = 0.0f, cy = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (i % 3 == 0)
+        {
+            cx = w * 0.5f + test_rand(w * 0.6f);
+            cy = h * 0.5f + test_rand(h * 0.6f);
+        }
+
+        swr_vertex_t& v = vertices[i];
+        v.x = cx + test_rand(w * 0.05f);
+        v.y = cy + test_rand(h * 0.05f);
+        v.z = test_rand(0.5f) + 0.5f;
+        v.w = test_rand(0.5f) + 1.0f;
+        v.u = test_rand(2.0f);
+        v.v = test_rand(2.0f);
+        v.color = test_seed;
+        indices[i] = Uint32(i);
+    }
+
+    for (int i = 0; i < num_triangles; i += 64)
+    {
+        swr_state_t state;
+        state.texture = (i / 64) % 2 ? texture : NULL;
+        state.blend = (i / 64) % 3 == 0;
+        state.depth_test = (i / 64) % 4 != 0;
+        state.depth_write = true;
+        state.alpha_test = (i / 64) % 5 == 0;
+        state.alpha_ref = 96;
+        state.fog = (i / 64) % 6 == 0;
+        state.fog_color = 0xFF806040;
+        state.fog_start = 0.25f;
+        state.fog_end = 0.75f;
+        int count = SDL_min(64, num_triangles - i);
+        ctx.draw(vertices.data(), &indices[i * 3], count * 3, state);
+    }
+}
+
+static void build_test_texture(std::vector<Uint8>& texels, swr_texture_t& texture)
+{
+    texture.width = 16;
+    texture.height = 8;
+    texture.wrap_s = SWR_WRAP_REPEAT;
+    texture.wrap_t = SWR_WRAP_MIRROR;
+    texels.resize(texture.width * texture.height * 4);
+    for (size_t i = 0; i < texels.size(); i++)
+        texels[i] = Uint8(i * 37 + (i >> 4) * 11);
+    texture.texels = texels.data();
+}
+
+/**
+ * Checks that output does not depend on threading or on the SIMD path, and that a jittered grid mesh covers every
+ * pixel exactly once
+ */
+static int command_swr_selftest()
+{
+    int failures = 0;
+
+    std::vector<Uint8> texels;
+    swr_texture_t texture;
+    build_test_texture(texels, texture);
+
+    swr_context_t serial, parallel;
+    serial.resize(333, 211);
+    parallel.resize(333, 211);
+    serial.clear(0xFF000000);
+    parallel.clear(0xFF000000);
+
+    test_seed = 4321;
+    draw_test_scene(serial, &texture, 2000);
+    serial.flush(false);
+    test_seed = 4321;
+    draw_test_scene(parallel, &texture, 2000);
+    parallel.flush(true);
+
+    size_t bytes = size_t(serial.get_width()) * serial.get_height() * 4;
+    if (memcmp(serial.get_pixels(), parallel.get_pixels(), bytes))
+    {
+        dc_log_error("r_swr_selftest: Serial and parallel output differ");
+        failures++;
+    }
+
+#ifdef __SSE2__
+    swr_context_t scalar;
+    scalar.resize(333, 211);
+    scalar.clear(0xFF000000);
+
+    int prev_simd = r_swr_simd.get();
+    r_swr_simd.set(0);
+    test_seed = 4321;
+    draw_test_scene(scalar, &texture, 2000);
+    scalar.flush(false);
+    r_swr_simd.set(prev_simd);
+
+    if (prev_simd && memcmp(serial.get_pixels(), scalar.get_pixels(), bytes))
+    {
+        dc_log_error("r_swr_selftest: SIMD and scalar output differ");
+        failures++;
+    }
+#endif
+
+    /* Shared edges must not leave gaps or blend twice, mixed windings and sub-pixel jitter included */
+    const int grid = 23;
+    std::vector<swr_vertex_t> vertices((grid + 1) * (grid + 1));
+    std::vector<Uint16> indices;
+    for (int y = 0; y <= grid; y++)
+    {
+        for (int x = 0; x <= grid; x++)
+        {
+            swr_vertex_t& v = vertices[y * (grid + 1) + x];
+            bool border_x = x == 0 || x == grid;
+            bool border_y = y == 0 || y == grid;
+            v.x = (float(x) / grid) * (serial.get_width() + 8) - 4 + (border_x ? 0.0f : test_rand(2.0f));
+            v.y = (float(y) / grid) * (serial.get_height() + 8) - 4 + (border_y ? 0.0f : test_rand(2.0f));
+            v.z = 0.0f;
+            v.w = 1.0f;
+            v.u = v.v = 0.0f;
+            v.color = 0x80FFFFFF;
+        }
+    }
+    for (int y = 0; y < grid; y++)
+    {
+        for (int x = 0; x < grid; x++)
+        {
+            Uint16 i0 = y * (grid + 1) + x, i1 = i0 + 1, i2 = i0 + grid + 1, i3 = i2 + 1;
+            Uint16 quad[2][6] = { { i0, i1, i3, i0, i3, i2 }, { i0, i2, i1, i1, i2, i3 } };
+            indices.insert(indices.end(), quad[(x + y) & 1], quad[(x + y) & 1] + 6);
+        }
+    }
+
+    swr_state_t state;
+    state.blend = true;
+    serial.clear(0xFF000000);
+    serial.draw(vertices.data(), indices.data(), indices.size(), state);
+    serial.flush();
+
+    int bad_pixels = 0;
+    for (size_t i = 0; i < bytes; i += 4)
+        if (serial.get_pixels()[i] != 0x80)
+            bad_pixels++;
+    if (bad_pixels)
+    {
+        dc_log_error("r_swr_selftest: %d pixels covered zero or multiple times", bad_pixels);
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+
+    dc_log("r_swr_selftest: Passed");
+    return 0;
+}
+
+/**
+ * Times a random scene, serial and on the job system (Defaults to 20000 triangles at 1280x720)
+ */
+static int command_swr_bench(const int argc, const char** argv)
+{
+    int num_triangles = argc > 1 ? SDL_max(atoi(argv[1]), 1) : 20000;
+    int width = argc > 2 ? SDL_max(atoi(argv[2]), 1) : 1280;
+    int height = argc > 3 ? SDL_max(atoi(argv[3]), 1) : 720;
+    const int iterations = 10;
+
+    std::vector<Uint8> texels;
+    swr_texture_t texture;
+    build_test_texture(texels, texture);
+
+    swr_context_t ctx;
+    ctx.resize(width, height);
+
+    Uint64 ticks[2] = {};
+    for (int parallel = 0; parallel < 2; parallel++)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int it = 0; it < iterations; it++)
+        {
+            test_seed = 9876;
+            ctx.clear(0xFF000000);
+            draw_test_scene(ctx, &texture, num_triangles);
+            ctx.flush(parallel);
+        }
+        ticks[parallel] = SDL_GetPerformanceCounter() - start;
+    }
+
+    double to_ms = 1000.0 / double(SDL_GetPerformanceFrequency()) / iterations;
+    dc_log("r_swr_bench: %d triangles at %dx%d", num_triangles, width, height);
+    dc_log("r_swr_bench: Serial: %.2f ms, %d threads: %.2f ms", ticks[0] * to_ms, jobs::get_thread_count(), ticks[1] * to_ms);
+
+    return 0;
+}
+
+void render::swr_init()
+{
+    dev_console::add_command("r_swr_selftest", command_swr_selftest);
+    dev_console::add_command("r_swr_bench", command_swr_bench);
+}
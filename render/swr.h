@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_SWR_H
+#define MPH_TETRA_RENDER_SWR_H
+
+#include <SDL_bits.h>
+#include <stddef.h>
+#include <vector>
+
+struct ImDrawData;
+
+/**
+ * Tile based software rasterizer
+ *
+ * Fallback for machines without a usable GPU (CI, servers) where llvmpipe is slow and its output changes between Mesa
+ * releases. Triangles are set up with 28.4 fixed point edge functions and binned into SWR_TILE_SIZE tiles, then tiles
+ * are rasterized in parallel on the job system with 4 pixel wide integer edge tests (SSE2 when available).
+ *
+ * Every pixel belongs to exactly one tile and each tile walks its bin in submission order, so the output is identical
+ * for any number of threads. Attribute math is plain float without contraction (See CMakeLists.txt).
+ */
+#define SWR_TILE_SIZE 64
+
+struct swr_vertex_t
+{
+    /** Window coordinates in pixels, origin at the top left corner */
+    float x, y;
+    /** Depth [0, 1] */
+    float z;
+    /** Clip space w, for perspective correct interpolation (Must be positive, 1 for 2D) */
+    float w;
+    float u, v;
+    /** RGBA8, red in the lowest byte (Same as IM_COL32) */
+    Uint32 color;
+};
+
+enum swr_wrap_t
+{
+    SWR_WRAP_CLAMP,
+    SWR_WRAP_REPEAT,
+    /** Repeat with every other copy flipped (NDS flip bits) */
+    SWR_WRAP_MIRROR,
+};
+
+struct swr_texture_t
+{
+    int width;
+    int height;
+    /** RGBA8, 4 bytes per texel in RGBA order */
+    const Uint8* texels;
+    swr_wrap_t wrap_s;
+    swr_wrap_t wrap_t;
+};
+
+/**
+ * Fixed function state for a draw, everything the NDS geometry engine can toggle per polygon
+ */
+struct swr_state_t
+{
+    /** Nearest sampled and modulated with the vertex colour, NULL for vertex colour only */
+    const swr_texture_t* texture = NULL;
+
+    /** Scissor rectangle in pixels, min inclusive and max exclusive (Clamped to the framebuffer) */
+    int clip_min_x = 0;
+    int clip_min_y = 0;
+    int clip_max_x = 0x7FFFFFFF;
+    int clip_max_y = 0x7FFFFFFF;
+
+    /** Src alpha, 1 - src alpha */
+    bool blend = false;
+
+    /** Less than test against a float depth buffer */
+    bool depth_test = false;
+    bool depth_write = false;
+
+    /** Fragments are only kept when alpha > alpha_ref (NDS semantics) */
+    bool alpha_test = false;
+    Uint8 alpha_ref = 0;
+
+    /** Linear fog on depth, fog_color is RGBA8 like vertex colours and alpha is fogged too */
+    bool fog = false;
+    Uint32 fog_color = 0;
+    float fog_start = 0.0f;
+    float fog_end = 1.0f;
+};
+
+class swr_context_t
+{
+public:
+    /**
+     * Resizes the framebuffer, contents are undefined afterwards
+     */
+    void resize(int width, int height);
+
+    /**
+     * Rasterizes anything pending, then fills the colour and depth buffers
+     *
+     * @param color RGBA8, red in the lowest byte
+     * @param depth Depth value
+     */
+    void clear(Uint32 color, float depth = 1.0f);
+
+    /**
+     * Sets up and bins an indexed triangle list, nothing is rasterized until flush()
+     *
+     * Vertices and indices are consumed before returning, the texture in state must stay alive until flush()
+     *
+     * @param vertices Vertex array
+     * @param indices Index array, 3 per triangle
+     * @param count Number of indices
+     * @param state Fixed function state
+     */
+    void draw(const swr_vertex_t* vertices, const Uint16* indices, size_t count, const swr_state_t& state);
+    void draw(const swr_vertex_t* vertices, const Uint32* indices, size_t count, const swr_state_t& state);
+
+    /**
+     * Rasterizes every triangle drawn since the last flush
+     *
+     * @param parallel Spread tiles over the job system, the result is the same either way
+     */
+    void flush(bool parallel = true);
+
+    /**
+     * RGBA8 pixels, top row first
+     */
+    inline const Uint8* get_pixels() const { return _color.data(); }
+    inline const float* get_depth() const { return _depth.data(); }
+    inline int get_width() const { return _width; }
+    inline int get_height() const { return _height; }
+
+    /** Triangles binned since the last flush */
+    inline size_t get_pending_triangles() const { return _triangles.size(); }
+
+private:
+    /**
+     * Edge functions are E = step_x * px + step_y * py + origin at pixel (px, py), inside is E >= 0 and the top-left
+     * rule is folded into origin. Attributes are planes relative to vertex 0: base + ddx * dx + ddy * dy.
+     */
+    struct triangle_t
+    {
+        int state;
+        int min_x, min_y, max_x, max_y;
+        Sint32 step_x[3];
+        Sint32 step_y[3];
+        Sint64 origin[3];
+        float x0, y0;
+        float base[8];
+        float ddx[8];
+        float ddy[8];
+    };
+
+    template <typename T> void draw_indexed(const swr_vertex_t* vertices, const T* indices, size_t count, const swr_state_t& state);
+    void setup(const swr_vertex_t& v0, const swr_vertex_t& v1, const swr_vertex_t& v2);
+    void raster_tile(int tile);
+    void raster_triangle(const triangle_t& tri, int x0, int y0, int x1, int y1);
+
+    int _width = 0;
+    int _height = 0;
+    int _tiles_x = 0;
+    int _tiles_y = 0;
+    std::vector<Uint8> _color;
+    std::vector<float> _depth;
+
+    std::vector<swr_state_t> _states;
+    std::vector<triangle_t> _triangles;
+    std::vector<std::vector<Uint32>> _bins;
+};
+
+namespace render
+{
+/**
+ * Registers the software rasterizer commands
+ */
+void swr_init();
+
+/**
+ * Value of the r_software_rasterizer convar
+ */
+bool swr_is_enabled();
+
+/**
+ * Rasterizes ImGui draw data in software and blits the result to the default framebuffer
+ *
+ * Only the font atlas is available as a texture, commands using other textures are skipped
+ *
+ * @param draw_data Result of ImGui::GetDrawData()
+ * @param clear_color RGBA8 clear colour, red in the lowest byte
+ */
+void swr_render_imgui(ImDrawData* draw_data, Uint32 clear_color);
+
+/**
+ * Releases the GL objects used to present, must be called before the GL context is destroyed
+ */
+void swr_shutdown();
+}
+
+#endif
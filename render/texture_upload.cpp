@@ -0,0 +1,567 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "texture_upload.h"
+
+#include "stream_buffer.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/jobs.h"
+#include "util/profiler.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <memory>
+
+/* Staging space per frame in flight, levels bigger than this are uploaded in bands of rows over several frames */
+#define TEXTURE_UPLOAD_FRAME_SIZE (4 << 20)
+
+static convar_int_t r_texture_upload_budget_us("r_texture_upload_budget_us", 2000, 100, 100000,
+    "Time per frame spent copying and submitting queued texture data (At least one band of rows is always uploaded)");
+
+static profiler_zone_t zone_update("render::texture_upload_update");
+static profiler_zone_t zone_mips("render::texture_generate_mips");
+
+/* ================================ Mip generation ================================ */
+
+static void box_downsample(const Uint8* src, int sw, int sh, Uint8* dst, int dw, int dh)
+{
+    for (int y = 0; y < dh; y++)
+    {
+        int y0 = SDL_min(y * 2, sh - 1), y1 = SDL_min(y * 2 + 1, sh - 1);
+        for (int x = 0; x < dw; x++)
+        {
+            int x0 = SDL_min(x * 2, sw - 1), x1 = SDL_min(x * 2 + 1, sw - 1);
+            const Uint8* p[4] = { src + (y0 * sw + x0) * 4, src + (y0 * sw + x1) * 4, src + (y1 * sw + x0) * 4, src + (y1 * sw + x1) * 4 };
+
+            /* Alpha weighted so fully transparent texels don't bleed their (Usually black) color into the edges */
+            Uint32 alpha = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+            Uint8* out = dst + (y * dw + x) * 4;
+            for (int c = 0; c < 3; c++)
+            {
+                if (alpha)
+                    out[c] = (p[0][c] * p[0][3] + p[1][c] * p[1][3] + p[2][c] * p[2][3] + p[3][c] * p[3][3] + alpha / 2) / alpha;
+                else
+                    out[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4;
+            }
+            out[3] = (alpha + 2) / 4;
+        }
+    }
+}
+
+/* Kaiser windowed sinc for 2:1 reduction, 6 taps centered between source texels 2x and 2x + 1 */
+#define KAISER_TAPS 6
+#define KAISER_ALPHA 4.0
+#define KAISER_WIDTH 1.5
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void kaiser_weights(float weights[KAISER_TAPS])
+{
+    double total = 0.0;
+    double w[KAISER_TAPS];
+    for (int i = 0; i < KAISER_TAPS; i++)
+    {
+        /* Distance from the destination texel center, in destination texels */
+        double u = (i - KAISER_TAPS / 2 + 0.5) * 0.5;
+        double sinc = u == 0.0 ? 1.0 : sin(M_PI * u) / (M_PI * u);
+        double r = u / KAISER_WIDTH;
+        double window = fabs(r) < 1.0 ? bessel_i0(KAISER_ALPHA * sqrt(1.0 - r * r)) / bessel_i0(KAISER_ALPHA) : 0.0;
+        w[i] = sinc * window;
+        total += w[i];
+    }
+
+    for (int i = 0; i < KAISER_TAPS; i++)
+        weights[i] = float(w[i] / total);
+}
+
+/**
+ * Separable filter in premultiplied float, an axis of size 1 is passed through
+ */
+static void kaiser_downsample(const Uint8* src, int sw, int sh, Uint8* dst, int dw, int dh)
+{
+    /* Built once by whichever job gets here first, function local statics are initialized thread safely */
+    struct weight_table_t
+    {
+        float w[KAISER_TAPS];
+    };
+    static const weight_table_t table = []() {
+        weight_table_t t;
+        kaiser_weights(t.w);
+        return t;
+    }();
+    const float* weights = table.w;
+
+    std::vector<float> premul(size_t(sw) * sh * 4);
+    for (size_t i = 0; i < size_t(sw) * sh; i++)
+    {
+        float a = src[i * 4 + 3] / 255.0f;
+        for (int c = 0; c < 3; c++)
+            premul[i * 4 + c] = src[i * 4 + c] / 255.0f * a;
+        premul[i * 4 + 3] = a;
+    }
+
+    /* Horizontal: sw x sh -> dw x sh */
+    std::vector<float> horizontal(size_t(dw) * sh * 4, 0.0f);
+    for (int y = 0; y < sh; y++)
+        for (int x = 0; x < dw; x++)
+        {
+            float* out = &horizontal[(size_t(y) * dw + x) * 4];
+            if (sw == 1)
+            {
+                memcpy(out, &premul[size_t(y) * sw * 4], sizeof(float) * 4);
+                continue;
+            }
+            for (int t = 0; t < KAISER_TAPS; t++)
+            {
+                int sx = SDL_clamp(x * 2 - KAISER_TAPS / 2 + 1 + t, 0, sw - 1);
+                const float* in = &premul[(size_t(y) * sw + sx) * 4];
+                for (int c = 0; c < 4; c++)
+                    out[c] += in[c] * weights[t];
+            }
+        }
+
+    /* Vertical: dw x sh -> dw x dh */
+    for (int y = 0; y < dh; y++)
+        for (int x = 0; x < dw; x++)
+        {
+            float sum[4] = { 0, 0, 0, 0 };
+            if (sh == 1)
+                memcpy(sum, &horizontal[size_t(x) * 4], sizeof(sum));
+            else
+                for (int t = 0; t < KAISER_TAPS; t++)
+                {
+                    int sy = SDL_clamp(y * 2 - KAISER_TAPS / 2 + 1 + t, 0, sh - 1);
+                    const float* in = &horizontal[(size_t(sy) * dw + x) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += in[c] * weights[t];
+                }
+
+            /* Negative lobes can push values out of range */
+            float a = SDL_clamp(sum[3], 0.0f, 1.0f);
+            Uint8* out = dst + (size_t(y) * dw + x) * 4;
+            for (int c = 0; c < 3; c++)
+                out[c] = a > 0.0f ? Uint8(SDL_clamp(sum[c] / a, 0.0f, 1.0f) * 255.0f + 0.5f) : 0;
+            out[3] = Uint8(a * 255.0f + 0.5f);
+        }
+}
+
+void render::texture_generate_mips(const Uint8* rgba, int width, int height, texture_mip_filter_t filter, std::vector<std::vector<Uint8>>& levels)
+{
+    PROFILER_SCOPE(zone_mips);
+
+    levels.clear();
+    if (filter == TEXTURE_MIP_NONE)
+        return;
+
+    const Uint8* src = rgba;
+    int w = width, h = height;
+    while (w > 1 || h > 1)
+    {
+        int dw = SDL_max(w >> 1, 1), dh = SDL_max(h >> 1, 1);
+        levels.emplace_back(size_t(dw) * dh * 4);
+
+        if (filter == TEXTURE_MIP_KAISER)
+            kaiser_downsample(src, w, h, levels.back().data(), dw, dh);
+        else
+            box_downsample(src, w, h, levels.back().data(), dw, dh);
+
+        src = levels.back().data();
+        w = dw, h = dh;
+    }
+}
+
+/* ================================ Queue ================================ */
+
+struct pending_level_t
+{
+    int width;
+    int height;
+    std::vector<Uint8> rgba;
+};
+
+struct pending_texture_t
+{
+    GLuint texture;
+    /** Guards against a cancelled texture's name being reused before its mip job finishes */
+    Uint32 serial;
+    int num_levels;
+    /** Level 0 is shared with the mip job */
+    std::shared_ptr<const std::vector<Uint8>> level0;
+    int width;
+    int height;
+    /** Levels 1 and smaller, empty until the mip job is done */
+    std::vector<std::vector<Uint8>> mips;
+    bool mips_ready;
+
+    /** Level being uploaded, counts down to 0 */
+    int level;
+    /** Rows of level already uploaded */
+    int rows_done;
+};
+
+struct mip_result_t
+{
+    GLuint texture;
+    Uint32 serial;
+    std::vector<std::vector<Uint8>> mips;
+};
+
+static SDL_mutex* results_lock = NULL;
+static std::vector<mip_result_t> results;
+
+static std::vector<std::unique_ptr<pending_texture_t>> queue;
+static Uint32 next_serial = 1;
+static stream_buffer_t staging(GL_PIXEL_UNPACK_BUFFER, TEXTURE_UPLOAD_FRAME_SIZE);
+
+static struct
+{
+    Uint64 textures;
+    Uint64 bytes;
+    Uint64 bands;
+    Uint64 frames_over_budget;
+} stats;
+
+static int count_levels(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = SDL_max(width >> 1, 1);
+        height = SDL_max(height >> 1, 1);
+        levels++;
+    }
+    return levels;
+}
+
+GLuint render::texture_upload(std::vector<Uint8>&& rgba, int width, int height, texture_mip_filter_t filter)
+{
+    SDL_assert(rgba.size() == size_t(width) * height * 4);
+
+    std::unique_ptr<pending_texture_t> pending(new pending_texture_t);
+    pending->serial = next_serial++;
+    pending->num_levels = filter == TEXTURE_MIP_NONE ? 1 : count_levels(width, height);
+    pending->level0 = std::make_shared<const std::vector<Uint8>>(std::move(rgba));
+    pending->width = width;
+    pending->height = height;
+    pending->mips_ready = filter == TEXTURE_MIP_NONE;
+    pending->level = pending->num_levels - 1;
+    pending->rows_done = 0;
+
+    /* Storage for every level now (No data is transferred), texture_upload_update() only ever calls glTexSubImage2D() */
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glGenTextures(1, &pending->texture);
+    glBindTexture(GL_TEXTURE_2D, pending->texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    for (int i = 0; i < pending->num_levels; i++)
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, SDL_max(width >> i, 1), SDL_max(height >> i, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pending->num_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, pending->num_levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pending->num_levels - 1);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+
+    if (!pending->mips_ready)
+    {
+        GLuint texture = pending->texture;
+        Uint32 serial = pending->serial;
+        std::shared_ptr<const std::vector<Uint8>> level0 = pending->level0;
+        jobs::submit([=]() {
+            mip_result_t result;
+            result.texture = texture;
+            result.serial = serial;
+            render::texture_generate_mips(level0->data(), width, height, filter, result.mips);
+
+            SDL_LockMutex(results_lock);
+            results.push_back(std::move(result));
+            SDL_UnlockMutex(results_lock);
+        });
+    }
+
+    GLuint texture = pending->texture;
+    queue.push_back(std::move(pending));
+    return texture;
+}
+
+bool render::texture_upload_pending(GLuint texture)
+{
+    for (const std::unique_ptr<pending_texture_t>& p : queue)
+        if (p->texture == texture)
+            return true;
+    return false;
+}
+
+void render::texture_upload_cancel(GLuint texture)
+{
+    for (size_t i = 0; i < queue.size(); i++)
+        if (queue[i]->texture == texture)
+        {
+            queue.erase(queue.begin() + i);
+            return;
+        }
+}
+
+/**
+ * Uploads the next band of rows of a texture
+ *
+ * @returns false if the staging buffer is out of space for this frame
+ */
+static bool upload_band(pending_texture_t& p)
+{
+    int w = SDL_max(p.width >> p.level, 1);
+    int h = SDL_max(p.height >> p.level, 1);
+    const Uint8* pixels = p.level ? p.mips[p.level - 1].data() : p.level0->data();
+
+    size_t row_bytes = size_t(w) * 4;
+    size_t space = staging.get_frame_size() - SDL_min(staging.get_frame_used() + 4, staging.get_frame_size());
+    int rows = int(SDL_min(size_t(h - p.rows_done), space / row_bytes));
+    if (rows <= 0)
+        return false;
+
+    size_t offset;
+    void* dst = staging.map(row_bytes * rows, 4, offset);
+    if (!dst)
+        return false;
+    memcpy(dst, pixels + row_bytes * p.rows_done, row_bytes * rows);
+    staging.unmap();
+
+    glBindTexture(GL_TEXTURE_2D, p.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, p.level, 0, p.rows_done, w, rows, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+    stats.bytes += row_bytes * rows;
+    stats.bands++;
+
+    p.rows_done += rows;
+    if (p.rows_done == h)
+    {
+        /* Sample from the finest finished level until the rest arrive */
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, p.level);
+        p.level--;
+        p.rows_done = 0;
+    }
+
+    return true;
+}
+
+void render::texture_upload_update()
+{
+    PROFILER_SCOPE(zone_update);
+
+    std::vector<mip_result_t> done;
+    SDL_LockMutex(results_lock);
+    done.swap(results);
+    SDL_UnlockMutex(results_lock);
+
+    for (mip_result_t& result : done)
+        for (std::unique_ptr<pending_texture_t>& p : queue)
+            if (p->texture == result.texture && p->serial == result.serial)
+            {
+                p->mips.swap(result.mips);
+                p->mips_ready = true;
+            }
+
+    if (queue.empty())
+        return;
+
+    GLint last_texture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 budget = Uint64(r_texture_upload_budget_us.get()) * SDL_GetPerformanceFrequency() / 1000000;
+    bool out_of_time = false;
+    bool uploaded = false;
+    for (size_t i = 0; i < queue.size() && !out_of_time;)
+    {
+        pending_texture_t& p = *queue[i];
+        if (!p.mips_ready)
+        {
+            i++;
+            continue;
+        }
+
+        while (p.level >= 0)
+        {
+            if (!upload_band(p))
+            {
+                out_of_time = true;
+                break;
+            }
+            uploaded = true;
+
+            if (SDL_GetPerformanceCounter() - start > budget)
+            {
+                out_of_time = true;
+                break;
+            }
+        }
+
+        if (p.level < 0)
+        {
+            stats.textures++;
+            queue.erase(queue.begin() + i);
+        }
+        else
+            i++;
+    }
+
+    if (out_of_time)
+        stats.frames_over_budget++;
+
+    /* A bound unpack buffer would turn client pointers in later glTex(Sub)Image2D() calls (ImGui) into offsets */
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+
+    if (uploaded)
+        staging.end_frame();
+}
+
+static int command_texture_upload_stats()
+{
+    size_t queued_bytes = 0;
+    for (const std::unique_ptr<pending_texture_t>& p : queue)
+        queued_bytes += p->level0->size() * (p->num_levels > 1 ? 4 : 3) / 3;
+
+    dc_log("Queued: %zu textures (~%zu KiB with mips)", queue.size(), queued_bytes >> 10);
+    dc_log("Uploaded: %llu textures, %llu KiB in %llu bands", (unsigned long long)stats.textures, (unsigned long long)(stats.bytes >> 10),
+        (unsigned long long)stats.bands);
+    dc_log("Frames that hit the budget or staging limit: %llu", (unsigned long long)stats.frames_over_budget);
+    return 0;
+}
+
+/**
+ * Checks one filter: level sizes, a constant image staying constant, a 2x2 checker averaging to grey, and transparent
+ * texels not bleeding into opaque ones
+ */
+static int mip_selftest(texture_mip_filter_t filter, const char* name)
+{
+    int failures = 0;
+    std::vector<std::vector<Uint8>> levels;
+
+    const int width = 37, height = 20;
+    const Uint8 color[4] = { 0x40, 0x80, 0xC0, 0xFF };
+    std::vector<Uint8> constant(size_t(width) * height * 4);
+    for (size_t i = 0; i < constant.size(); i++)
+        constant[i] = color[i % 4];
+
+    render::texture_generate_mips(constant.data(), width, height, filter, levels);
+    if (levels.size() != 5)
+    {
+        dc_log_error("r_texture_mip_selftest: %s: %zu levels for %dx%d, expected 5", name, levels.size(), width, height);
+        failures++;
+    }
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        int lw = SDL_max(width >> (l + 1), 1), lh = SDL_max(height >> (l + 1), 1);
+        if (levels[l].size() != size_t(lw) * lh * 4)
+        {
+            dc_log_error("r_texture_mip_selftest: %s: Level %zu is %zu bytes, expected %dx%d", name, l + 1, levels[l].size(), lw, lh);
+            failures++;
+            continue;
+        }
+        for (size_t i = 0; i < levels[l].size(); i++)
+        {
+            if (levels[l][i] == color[i % 4])
+                continue;
+            dc_log_error("r_texture_mip_selftest: %s: Constant image changed on level %zu (%d != %d)", name, l + 1, levels[l][i], color[i % 4]);
+            failures++;
+            break;
+        }
+    }
+
+    /* Exact average is 127.5 */
+    const Uint8 checker[16] = { 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 255 };
+    render::texture_generate_mips(checker, 2, 2, filter, levels);
+    if (levels.size() != 1 || levels[0][3] != 255)
+    {
+        dc_log_error("r_texture_mip_selftest: %s: 2x2 checker did not reduce to one opaque texel", name);
+        failures++;
+    }
+    else
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (levels[0][c] == 127 || levels[0][c] == 128)
+                continue;
+            dc_log_error("r_texture_mip_selftest: %s: 2x2 checker averaged to %d, expected 127 or 128", name, levels[0][c]);
+            failures++;
+            break;
+        }
+    }
+
+    /* Left column transparent black, right column opaque red */
+    const Uint8 edge[16] = { 0, 0, 0, 0, 255, 0, 0, 255, 0, 0, 0, 0, 255, 0, 0, 255 };
+    render::texture_generate_mips(edge, 2, 2, filter, levels);
+    if (levels.size() != 1 || levels[0][0] != 255 || levels[0][1] || levels[0][2] || (levels[0][3] != 127 && levels[0][3] != 128))
+    {
+        dc_log_error("r_texture_mip_selftest: %s: Transparent texels bled into the color", name);
+        failures++;
+    }
+
+    return failures;
+}
+
+static int command_texture_mip_selftest()
+{
+    int failures = mip_selftest(TEXTURE_MIP_BOX, "Box") + mip_selftest(TEXTURE_MIP_KAISER, "Kaiser");
+
+    std::vector<std::vector<Uint8>> levels;
+    const Uint8 texel[4] = { 1, 2, 3, 4 };
+    render::texture_generate_mips(texel, 1, 1, TEXTURE_MIP_KAISER, levels);
+    if (!levels.empty())
+    {
+        dc_log_error("r_texture_mip_selftest: A 1x1 image produced mip levels");
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+
+    dc_log("r_texture_mip_selftest: Passed");
+    return 0;
+}
+
+void render::texture_upload_init()
+{
+    results_lock = SDL_CreateMutex();
+    dev_console::add_command("r_texture_upload_stats", command_texture_upload_stats);
+    dev_console::add_command("r_texture_mip_selftest", command_texture_mip_selftest);
+}
+
+void render::texture_upload_shutdown()
+{
+    queue.clear();
+    staging.destroy();
+
+    SDL_LockMutex(results_lock);
+    results.clear();
+    SDL_UnlockMutex(results_lock);
+}
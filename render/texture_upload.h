@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_TEXTURE_UPLOAD_H
+#define MPH_TETRA_RENDER_TEXTURE_UPLOAD_H
+
+#include "gl.h"
+
+#include <SDL_bits.h>
+#include <vector>
+
+enum texture_mip_filter_t
+{
+    /** Only level 0 */
+    TEXTURE_MIP_NONE,
+    /** 2x2 average */
+    TEXTURE_MIP_BOX,
+    /** Kaiser windowed sinc, sharper than box without much ringing */
+    TEXTURE_MIP_KAISER,
+};
+
+/**
+ * Streaming texture uploads
+ *
+ * texture_upload() allocates the texture storage right away and queues the pixels. Mip levels are generated by low
+ * priority jobs. texture_upload_update() then copies ready levels into a pixel unpack stream buffer and issues
+ * glTexSubImage2D() from it, until the r_texture_upload_budget_us time budget for the frame is used up. Big levels are
+ * split into bands of rows, so a single texture never costs more than one frame's budget.
+ *
+ * Levels are uploaded smallest first and GL_TEXTURE_BASE_LEVEL follows the finest finished level. A texture can be
+ * drawn as soon as it is queued: it starts blurry and sharpens as levels arrive.
+ *
+ * Everything here is main thread only (The thread with the GL context).
+ */
+namespace render
+{
+/**
+ * Creates a texture and queues its contents
+ *
+ * @param rgba width * height RGBA8 pixels, moved from
+ * @param filter Mip generation filter, TEXTURE_MIP_NONE for a single level texture
+ *
+ * @returns Texture name, owned by the caller (Call texture_upload_cancel() before deleting it while it is pending)
+ */
+GLuint texture_upload(std::vector<Uint8>&& rgba, int width, int height, texture_mip_filter_t filter);
+
+/**
+ * @returns true if the texture still has levels waiting to be generated or uploaded
+ */
+bool texture_upload_pending(GLuint texture);
+
+/**
+ * Drops any queued levels of a texture
+ */
+void texture_upload_cancel(GLuint texture);
+
+/**
+ * Uploads queued levels within the frame budget, call once per frame
+ */
+void texture_upload_update();
+
+/**
+ * Generates the mip chain of an RGBA8 image on the calling thread
+ *
+ * @param levels Receives levels 1 and smaller (Level 0 is not copied), each level is max(1, size >> level) on each axis
+ */
+void texture_generate_mips(const Uint8* rgba, int width, int height, texture_mip_filter_t filter, std::vector<std::vector<Uint8>>& levels);
+
+/**
+ * Registers the texture upload commands
+ */
+void texture_upload_init();
+
+/**
+ * Drops all queued uploads and releases the GL objects, must be called before the GL context is destroyed
+ */
+void texture_upload_shutdown();
+}
+
+#endif
@@ -0,0 +1,381 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "vertex_format.h"
+
+#include "shader.h"
+
+#include "gui/console.h"
+
+#include <SDL.h>
+#include <math.h>
+#include <vector>
+
+static inline Sint32 quantize(float x, float lo, float hi) { return Sint32(lrintf(SDL_clamp(x, lo, hi))); }
+
+gx_quantization_t gx_compute_quantization(const gx_mesh_vertex_t* vertices, size_t count)
+{
+    gx_quantization_t q;
+
+    float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+    float pos_max = 0.0f, uv_max = 0.0f;
+    bool pos_on_grid = true, uv_on_grid = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        const gx_mesh_vertex_t& v = vertices[i];
+        for (int j = 0; j < 3; j++)
+        {
+            lo[j] = i ? SDL_min(lo[j], v.pos[j]) : v.pos[j];
+            hi[j] = i ? SDL_max(hi[j], v.pos[j]) : v.pos[j];
+            pos_max = SDL_max(pos_max, fabsf(v.pos[j]));
+            pos_on_grid = pos_on_grid && v.pos[j] * 4096.0f == floorf(v.pos[j] * 4096.0f);
+        }
+        for (int j = 0; j < 2; j++)
+        {
+            uv_max = SDL_max(uv_max, fabsf(v.uv[j]));
+            uv_on_grid = uv_on_grid && v.uv[j] * 16.0f == floorf(v.uv[j] * 16.0f);
+        }
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+        float half_extent = (hi[j] - lo[j]) * 0.5f;
+        q.pos_offset[j] = lo[j] + half_extent;
+        q.pos_scale[j] = half_extent > 0.0f ? half_extent / 32767.0f : 1.0f;
+
+        /* Untransformed NDS vertices are 4.12 fixed point and can be stored exactly */
+        if (pos_on_grid && pos_max * 4096.0f <= 32767.0f)
+        {
+            q.pos_offset[j] = 0.0f;
+            q.pos_scale[j] = 1.0f / 4096.0f;
+        }
+    }
+
+    float uv_scale = 1.0f / 16.0f;
+    if (!uv_on_grid || uv_max * 16.0f > 32767.0f)
+        uv_scale = uv_max > 0.0f ? uv_max / 32767.0f : 1.0f;
+    q.uv_scale[0] = q.uv_scale[1] = uv_scale;
+
+    return q;
+}
+
+void gx_pack_vertices(const gx_mesh_vertex_t* in, size_t count, const gx_quantization_t& q, gx_packed_vertex_t* out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const gx_mesh_vertex_t& v = in[i];
+        gx_packed_vertex_t& p = out[i];
+
+        for (int j = 0; j < 3; j++)
+            p.pos[j] = quantize((v.pos[j] - q.pos_offset[j]) / q.pos_scale[j], -32767.0f, 32767.0f);
+        p.pos[3] = 0;
+
+        Uint32 normal = 0;
+        for (int j = 0; j < 3; j++)
+            normal |= (Uint32(quantize(v.normal[j] * 512.0f, -512.0f, 511.0f)) & 0x3FF) << (j * 10);
+        p.normal = Sint32(normal);
+
+        for (int j = 0; j < 4; j++)
+            p.color[j] = quantize(v.color[j] * 255.0f, 0.0f, 255.0f);
+
+        for (int j = 0; j < 2; j++)
+            p.uv[j] = quantize(v.uv[j] / q.uv_scale[j], -32767.0f, 32767.0f);
+    }
+}
+
+void gx_unpack_vertex(const gx_packed_vertex_t& in, const gx_quantization_t& q, gx_mesh_vertex_t& out)
+{
+    for (int j = 0; j < 3; j++)
+        out.pos[j] = q.pos_offset[j] + float(in.pos[j]) * q.pos_scale[j];
+
+    /* Sign extends each 10-bit field, same as the shifts in GX_PACKED_VERTEX_GLSL */
+    for (int j = 0; j < 3; j++)
+        out.normal[j] = float(Sint32(Uint32(in.normal) << (22 - j * 10)) >> 22) / 512.0f;
+
+    for (int j = 0; j < 4; j++)
+        out.color[j] = in.color[j] / 255.0f;
+
+    for (int j = 0; j < 2; j++)
+        out.uv[j] = float(in.uv[j]) * q.uv_scale[j];
+}
+
+void render::gx_packed_vertex_attribs(GLuint first_location, size_t offset)
+{
+    const GLsizei stride = sizeof(gx_packed_vertex_t);
+
+    for (GLuint i = 0; i < 4; i++)
+        glEnableVertexAttribArray(first_location + i);
+
+    glVertexAttribPointer(first_location + 0, 4, GL_SHORT, GL_FALSE, stride, (void*)(offset + offsetof(gx_packed_vertex_t, pos)));
+    glVertexAttribIPointer(first_location + 1, 1, GL_INT, stride, (void*)(offset + offsetof(gx_packed_vertex_t, normal)));
+    glVertexAttribPointer(first_location + 2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(offset + offsetof(gx_packed_vertex_t, color)));
+    glVertexAttribPointer(first_location + 3, 2, GL_SHORT, GL_FALSE, stride, (void*)(offset + offsetof(gx_packed_vertex_t, uv)));
+}
+
+void render::gx_packed_vertex_uniforms(GLuint program, const gx_quantization_t& q)
+{
+    glUniform3f(glGetUniformLocation(program, "u_pos_offset"), q.pos_offset[0], q.pos_offset[1], q.pos_offset[2]);
+    glUniform3f(glGetUniformLocation(program, "u_pos_scale"), q.pos_scale[0], q.pos_scale[1], q.pos_scale[2]);
+    glUniform2f(glGetUniformLocation(program, "u_uv_scale"), q.uv_scale[0], q.uv_scale[1]);
+}
+
+/* ================================ Self test ================================ */
+
+static Uint32 test_seed;
+static int test_rand_int(int lo, int hi)
+{
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return lo + int((test_seed >> 8) % Uint32(hi - lo + 1));
+}
+
+/**
+ * Mesh with NDS precision data: 4.12 positions, 1.9 normals, BGR555 colors, and 12.4 texcoords
+ */
+static void build_test_mesh(std::vector<gx_mesh_vertex_t>& mesh, size_t count)
+{
+    mesh.resize(count);
+    for (gx_mesh_vertex_t& v : mesh)
+    {
+        for (int j = 0; j < 3; j++)
+            v.pos[j] = test_rand_int(-32767, 32767) / 4096.0f;
+        for (int j = 0; j < 3; j++)
+            v.normal[j] = test_rand_int(-512, 511) / 512.0f;
+
+        Uint8 color[4];
+        gx_color_from_bgr555(test_rand_int(0, 0x7FFF), color);
+        for (int j = 0; j < 4; j++)
+            v.color[j] = color[j] / 255.0f;
+
+        for (int j = 0; j < 2; j++)
+            v.uv[j] = test_rand_int(-32767, 32767) / 16.0f;
+    }
+}
+
+/**
+ * Packs and unpacks a mesh
+ *
+ * @param exact_pos Whether positions must round trip exactly, otherwise they may be off by half a step
+ *
+ * @returns Number of failures
+ */
+static int test_round_trip(const std::vector<gx_mesh_vertex_t>& mesh, bool exact_pos, const char* name)
+{
+    gx_quantization_t q = gx_compute_quantization(mesh.data(), mesh.size());
+    std::vector<gx_packed_vertex_t> packed(mesh.size());
+    gx_pack_vertices(mesh.data(), mesh.size(), q, packed.data());
+
+    float max_pos_error = 0.0f;
+    int mismatches = 0;
+    for (size_t i = 0; i < mesh.size(); i++)
+    {
+        gx_mesh_vertex_t v;
+        gx_unpack_vertex(packed[i], q, v);
+
+        for (int j = 0; j < 3; j++)
+            max_pos_error = SDL_max(max_pos_error, fabsf(v.pos[j] - mesh[i].pos[j]) / q.pos_scale[j]);
+
+        /* Everything but the position is on a grid the packed format represents exactly */
+        for (int j = 0; j < 3; j++)
+            mismatches += v.normal[j] != mesh[i].normal[j];
+        for (int j = 0; j < 4; j++)
+            mismatches += v.color[j] != mesh[i].color[j];
+        for (int j = 0; j < 2; j++)
+            mismatches += v.uv[j] != mesh[i].uv[j];
+    }
+
+    /* Rounding is at most half a step, the rest is float error in the offset/scale math */
+    if (max_pos_error > (exact_pos ? 0.0f : 0.501f) || mismatches)
+    {
+        dc_log_error("r_vertex_format_selftest: %s: Max position error %.4f steps, %d exact attribute mismatches", name, max_pos_error, mismatches);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decodes a packed mesh with GX_PACKED_VERTEX_GLSL and compares against gx_unpack_vertex() and the float mesh
+ *
+ * Every vertex is drawn as a point into its own texel of a float render target, once per attribute
+ *
+ * @returns Number of failures
+ */
+static int test_gpu_decode(const std::vector<gx_mesh_vertex_t>& mesh, const char* name)
+{
+    const char* vertex_src = GX_PACKED_VERTEX_GLSL "uniform int u_select;\n"
+                                                   "uniform int u_width;\n"
+                                                   "flat out vec4 v_value;\n"
+                                                   "void main()\n"
+                                                   "{\n"
+                                                   "    if (u_select == 0)\n"
+                                                   "        v_value = vec4(gx_decode_pos(), 0.0);\n"
+                                                   "    else if (u_select == 1)\n"
+                                                   "        v_value = vec4(gx_decode_normal(), 0.0);\n"
+                                                   "    else if (u_select == 2)\n"
+                                                   "        v_value = gx_decode_color();\n"
+                                                   "    else\n"
+                                                   "        v_value = vec4(gx_decode_uv(), 0.0, 0.0);\n"
+                                                   "    vec2 texel = vec2(gl_VertexID % u_width, gl_VertexID / u_width) + 0.5;\n"
+                                                   "    gl_Position = vec4(texel / float(u_width) * 2.0 - 1.0, 0.0, 1.0);\n"
+                                                   "}\n";
+    const char* fragment_src = "flat in vec4 v_value;\n"
+                               "out vec4 out_color;\n"
+                               "void main() { out_color = v_value; }\n";
+
+    shader_t shader("vertex_format_selftest", vertex_src, fragment_src, GX_PACKED_VERTEX_ATTRIBUTES);
+    if (!shader.build())
+    {
+        dc_log_error("r_vertex_format_selftest: %s: Shader failed to build", name);
+        return 1;
+    }
+
+    int width = 1;
+    while (size_t(width) * size_t(width) < mesh.size())
+        width *= 2;
+
+    gx_quantization_t q = gx_compute_quantization(mesh.data(), mesh.size());
+    std::vector<gx_packed_vertex_t> packed(mesh.size());
+    gx_pack_vertices(mesh.data(), mesh.size(), q, packed.data());
+
+    GLint last_fbo, last_viewport[4], last_program, last_vao, last_array_buffer, last_texture;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_fbo);
+    glGetIntegerv(GL_VIEWPORT, last_viewport);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    GLboolean last_blend = glIsEnabled(GL_BLEND);
+    GLboolean last_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+    GLuint target, fbo, vao, vbo;
+    glGenTextures(1, &target);
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, width, 0, GL_RGBA, GL_FLOAT, NULL);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(gx_packed_vertex_t), packed.data(), GL_STATIC_DRAW);
+    render::gx_packed_vertex_attribs(0);
+    glViewport(0, 0, width, width);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+
+    shader.use();
+    render::gx_packed_vertex_uniforms(shader.get_program(), q);
+    glUniform1i(shader.get_uniform("u_width"), width);
+
+    /* Components of each attribute in gx_mesh_vertex_t, in u_select order */
+    const size_t offsets[] = {
+        offsetof(gx_mesh_vertex_t, pos),
+        offsetof(gx_mesh_vertex_t, normal),
+        offsetof(gx_mesh_vertex_t, color),
+        offsetof(gx_mesh_vertex_t, uv),
+    };
+    const int components[] = { 3, 3, 4, 2 };
+    const char* attribute_names[] = { "position", "normal", "color", "uv" };
+
+    int failures = 0;
+    std::vector<float> gpu(size_t(width) * width * 4);
+    for (int a = 0; a < 4; a++)
+    {
+        glClear(GL_COLOR_BUFFER_BIT);
+        glUniform1i(shader.get_uniform("u_select"), a);
+        glDrawArrays(GL_POINTS, 0, GLsizei(mesh.size()));
+        glReadPixels(0, 0, width, width, GL_RGBA, GL_FLOAT, gpu.data());
+
+        /* The CPU decode is the reference, the float mesh is only off by the quantization step */
+        float max_cpu_error = 0.0f, max_float_error = 0.0f;
+        for (size_t i = 0; i < mesh.size(); i++)
+        {
+            gx_mesh_vertex_t cpu;
+            gx_unpack_vertex(packed[i], q, cpu);
+            const float* c = (const float*)((const Uint8*)&cpu + offsets[a]);
+            const float* f = (const float*)((const Uint8*)&mesh[i] + offsets[a]);
+            for (int j = 0; j < components[a]; j++)
+            {
+                float step = a == 0 ? q.pos_scale[j] : 1.0f;
+                max_cpu_error = SDL_max(max_cpu_error, fabsf(gpu[i * 4 + j] - c[j]) / SDL_max(1.0f, fabsf(c[j])));
+                max_float_error = SDL_max(max_float_error, fabsf(gpu[i * 4 + j] - f[j]) / step);
+            }
+        }
+
+        /* Positions can be half a step off the float mesh when they are not on the 4.12 grid, everything else is exact */
+        if (max_cpu_error > 1e-5f || max_float_error > (a == 0 ? 0.501f : 1e-5f))
+        {
+            dc_log_error("r_vertex_format_selftest: %s: GPU %s off by %g from the CPU decode, %g from the float mesh", name, attribute_names[a], max_cpu_error,
+                max_float_error);
+            failures++;
+        }
+    }
+
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &target);
+    shader.destroy();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, last_fbo);
+    glViewport(last_viewport[0], last_viewport[1], last_viewport[2], last_viewport[3]);
+    glUseProgram(last_program);
+    glBindVertexArray(last_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+    if (last_blend)
+        glEnable(GL_BLEND);
+    if (last_scissor_test)
+        glEnable(GL_SCISSOR_TEST);
+
+    return failures;
+}
+
+static int command_vertex_format_selftest()
+{
+    test_seed = 12345;
+    int failures = 0;
+
+    std::vector<gx_mesh_vertex_t> mesh;
+    build_test_mesh(mesh, 4096);
+    failures += test_round_trip(mesh, true, "4.12 positions");
+    failures += test_gpu_decode(mesh, "4.12 positions");
+
+    /* Transformed positions are off the 4.12 grid and take the bounding box path */
+    for (gx_mesh_vertex_t& v : mesh)
+        for (int j = 0; j < 3; j++)
+            v.pos[j] = v.pos[j] * 3.7f + 100.0f;
+    failures += test_round_trip(mesh, false, "Scaled positions");
+    failures += test_gpu_decode(mesh, "Scaled positions");
+
+    if (failures)
+        return 1;
+
+    size_t float_size = mesh.size() * sizeof(gx_mesh_vertex_t);
+    size_t packed_size = mesh.size() * sizeof(gx_packed_vertex_t);
+    dc_log("r_vertex_format_selftest: Passed on the CPU and GPU (%zu -> %zu bytes, %.1fx smaller)", float_size, packed_size,
+        double(float_size) / double(packed_size));
+    return 0;
+}
+
+void render::vertex_format_init() { dev_console::add_command("r_vertex_format_selftest", command_vertex_format_selftest); }
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_RENDER_VERTEX_FORMAT_H
+#define MPH_TETRA_RENDER_VERTEX_FORMAT_H
+
+#include "gl.h"
+
+#include <SDL_bits.h>
+#include <stddef.h>
+
+/**
+ * Vertex as produced by mesh conversion, before quantization (48 bytes)
+ */
+struct gx_mesh_vertex_t
+{
+    float pos[3];
+    float normal[3];
+    float color[4];
+    float uv[2];
+};
+
+/**
+ * Quantized vertex for static meshes (20 bytes)
+ *
+ * NDS geometry is already low precision (4.12 positions, 1.9 normals, BGR555 colors, 12.4 texcoords), so this keeps
+ * all of it while taking well under half the memory of gx_mesh_vertex_t:
+ * - pos: Signed 16-bit, decoded as offset + pos * scale with a per mesh offset and scale (w is padding)
+ * - normal: 10:10:10:2 packed signed 1.9 fixed point (x in the low bits, the 2 high bits are unused)
+ * - color: 8-bit UNORM RGBA
+ * - uv: Signed 16-bit, decoded as uv * uv_scale (1/16 when the source is 12.4 fixed point)
+ *
+ * GL 3.2 has no GL_INT_2_10_10_10_REV, so the normal is an integer attribute unpacked by GX_PACKED_VERTEX_GLSL.
+ */
+struct gx_packed_vertex_t
+{
+    Sint16 pos[4];
+    Sint32 normal;
+    Uint8 color[4];
+    Sint16 uv[2];
+};
+static_assert(sizeof(gx_packed_vertex_t) == 20, "gx_packed_vertex_t size incorrect");
+
+/**
+ * Per mesh decode parameters for gx_packed_vertex_t
+ */
+struct gx_quantization_t
+{
+    float pos_offset[3];
+    float pos_scale[3];
+    float uv_scale[2];
+};
+
+/**
+ * Attribute names of gx_packed_vertex_t, in the order of the attribute locations set up by gx_packed_vertex_attribs()
+ */
+#define GX_PACKED_VERTEX_ATTRIBUTES { "a_pos", "a_normal", "a_color", "a_uv" }
+
+/**
+ * Vertex shader declarations and decode functions for gx_packed_vertex_t, paste after the #version line
+ */
+#define GX_PACKED_VERTEX_GLSL                                                                                        \
+    "in vec4 a_pos;\n"                                                                                               \
+    "in int a_normal;\n"                                                                                             \
+    "in vec4 a_color;\n"                                                                                             \
+    "in vec2 a_uv;\n"                                                                                                \
+    "uniform vec3 u_pos_offset;\n"                                                                                   \
+    "uniform vec3 u_pos_scale;\n"                                                                                    \
+    "uniform vec2 u_uv_scale;\n"                                                                                     \
+    "vec3 gx_decode_pos() { return u_pos_offset + a_pos.xyz * u_pos_scale; }\n"                                      \
+    "vec3 gx_decode_normal() { return vec3(ivec3(a_normal << 22, a_normal << 12, a_normal << 2) >> 22) / 512.0; }\n" \
+    "vec4 gx_decode_color() { return a_color; }\n"                                                                   \
+    "vec2 gx_decode_uv() { return a_uv * u_uv_scale; }\n"
+
+/**
+ * Expands an NDS BGR555 color (Bit 15 ignored) to 8 bits per channel RGBA with full alpha
+ */
+inline void gx_color_from_bgr555(Uint16 bgr555, Uint8 out[4])
+{
+    Uint8 r = bgr555 & 0x1F, g = (bgr555 >> 5) & 0x1F, b = (bgr555 >> 10) & 0x1F;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 3) | (g >> 2);
+    out[2] = (b << 3) | (b >> 2);
+    out[3] = 0xFF;
+}
+
+/**
+ * Picks the decode parameters for a mesh
+ *
+ * Positions use 1/4096 when every coordinate is on the 4.12 grid and fits, otherwise the bounding box center and half
+ * extent. Texcoords use 1/16 when every texcoord is on the 12.4 grid and
+ * fits, otherwise the largest magnitude maps to 32767.
+ */
+gx_quantization_t gx_compute_quantization(const gx_mesh_vertex_t* vertices, size_t count);
+
+/**
+ * Quantizes vertices with rounding to nearest (Normals and colors are clamped)
+ */
+void gx_pack_vertices(const gx_mesh_vertex_t* in, size_t count, const gx_quantization_t& quantization, gx_packed_vertex_t* out);
+
+/**
+ * CPU version of the GX_PACKED_VERTEX_GLSL decode functions
+ */
+void gx_unpack_vertex(const gx_packed_vertex_t& in, const gx_quantization_t& quantization, gx_mesh_vertex_t& out);
+
+namespace render
+{
+/**
+ * Sets up and enables the attribute pointers for gx_packed_vertex_t in the bound VAO, from the bound GL_ARRAY_BUFFER
+ *
+ * @param first_location Location of a_pos, the others follow in GX_PACKED_VERTEX_ATTRIBUTES order
+ * @param offset Byte offset of the first vertex in the buffer
+ */
+void gx_packed_vertex_attribs(GLuint first_location, size_t offset = 0);
+
+/**
+ * Uploads the decode parameters of a mesh to the u_pos_offset, u_pos_scale, and u_uv_scale uniforms of the bound program
+ */
+void gx_packed_vertex_uniforms(GLuint program, const gx_quantization_t& quantization);
+
+/**
+ * Registers the r_vertex_format_selftest console command
+ */
+void vertex_format_init();
+};
+
+#endif
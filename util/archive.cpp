@@ -25,7 +25,9 @@
  * However the implementation of archive_extract_entries() is original
  */
 #include "archive.h"
+#include "binary_layout.h"
 #include "misc.h"
+#include "profiler.h"
 
 #include "gui/console.h"
 
@@ -53,20 +55,10 @@ struct header_archive_t
     Uint32 archive_size;
 
     Uint32 reserved[4];
-
-    /**
-     * Returns an endian corrected version of this struct
-     */
-    header_archive_t endian_correct()
-    {
-        header_archive_t t;
-        memcpy(&t, this, sizeof(header_archive_t));
-        ASSERT_SwapBE32(t.file_count);
-        ASSERT_SwapBE32(t.archive_size);
-        return t;
-    }
 };
 static_assert(sizeof(header_archive_t) == 32, "header_archive_t size incorrect!");
+typedef util::binary_layout_t<header_archive_t, BINARY_FIELD_BE(header_archive_t, file_count), BINARY_FIELD_BE(header_archive_t, archive_size)>
+    header_archive_layout_t;
 
 /* This structure was derived from MphRead:/src/Utility/Archive.cs */
 struct archive_file_entry_t
@@ -91,21 +83,11 @@ struct archive_file_entry_t
     Uint32 size_target;
 
     Uint32 reserved[5];
-
-    /**
-     * Returns an endian corrected version of this struct
-     */
-    archive_file_entry_t endian_correct()
-    {
-        archive_file_entry_t t;
-        memcpy(&t, this, sizeof(archive_file_entry_t));
-        ASSERT_SwapBE32(t.offset);
-        ASSERT_SwapBE32(t.size_padded);
-        ASSERT_SwapBE32(t.size_target);
-        return t;
-    }
 };
 static_assert(sizeof(archive_file_entry_t) == 64, "archive_file_entry_t size incorrect");
+typedef util::binary_layout_t<archive_file_entry_t, BINARY_FIELD_BE(archive_file_entry_t, offset), BINARY_FIELD_BE(archive_file_entry_t, size_padded),
+    BINARY_FIELD_BE(archive_file_entry_t, size_target)>
+    archive_file_entry_layout_t;
 
 #if 0
 #define bail_assert(cond) \
@@ -124,12 +106,15 @@ static_assert(sizeof(archive_file_entry_t) == 64, "archive_file_entry_t size inc
     } while (0)
 #endif
 
+static profiler_zone_t zone_extract("util::archive_extract_entries");
+
 /* TODO: Is there a difference  */
 bool util::archive_extract_entries(const std::vector<Uint8>& in, std::vector<util::archive_entry_t>& out)
 {
-    bail_assert(in.size() >= sizeof(header_archive_t));
+    PROFILER_SCOPE(zone_extract);
 
-    header_archive_t header = ((header_archive_t*)in.data())->endian_correct();
+    header_archive_t header;
+    bail_assert(header_archive_layout_t::read(in.data(), in.size(), 0, header));
 
     bail_assert(strncmp(header.magic, MAGIC, sizeof(header.magic)) == 0);
 
@@ -140,10 +125,11 @@ bool util::archive_extract_entries(const std::vector<Uint8>& in, std::vector<uti
     out.clear();
     out.reserve(header.file_count);
 
-    archive_file_entry_t* file_entries = ((archive_file_entry_t*)(in.data() + sizeof(header_archive_t)));
+    util::binary_table_t<archive_file_entry_layout_t> file_entries(in.data(), in.size(), sizeof(header_archive_t), header.file_count);
     for (Uint32 i = 0; i < header.file_count; i++)
     {
-        archive_file_entry_t current = file_entries[i].endian_correct();
+        archive_file_entry_t current;
+        bail_assert(file_entries.get(i, current));
         bail_assert(current.offset <= in.size());
         bail_assert(current.offset + current.size_target <= in.size());
         util::archive_entry_t entry;
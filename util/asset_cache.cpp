@@ -0,0 +1,377 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "asset_cache.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/jobs.h"
+#include "util/physfs/io_trace.h"
+#include "util/physfs/physfs.h"
+
+#include <SDL.h>
+#include <list>
+#include <unordered_map>
+
+static convar_int_t asset_cache_budget_mb("asset_cache_budget_mb", 256, 16, 4096, "Memory the asset cache (And everything preloading into it) may use, in MiB");
+
+struct entry_t
+{
+    std::string path;
+    asset_cache::data_t data;
+    /** Inserted by a preload and not load()ed since */
+    bool speculative;
+    /** Insertion order */
+    Uint64 seq;
+};
+
+/* cache_lock guards everything below it */
+static SDL_mutex* cache_lock = NULL;
+/** Most recently used at the front */
+static std::list<entry_t> lru;
+static std::unordered_map<std::string, std::list<entry_t>::iterator> lookup;
+static size_t used_bytes = 0;
+static Uint64 next_seq = 1;
+static std::vector<std::weak_ptr<asset_cache::preload_t>> preloads;
+
+static struct
+{
+    SDL_atomic_t hits;
+    SDL_atomic_t preload_hits;
+    SDL_atomic_t misses;
+    SDL_atomic_t evictions;
+} stats;
+
+size_t asset_cache::get_budget_bytes() { return size_t(asset_cache_budget_mb.get()) * 1024 * 1024; }
+
+/**
+ * Evicts until size more bytes fit in the budget, cache_lock must be held
+ *
+ * @param size Bytes to make room for
+ * @param speculative_before If non-zero only speculative entries inserted before this are evicted (For preloads)
+ *
+ * @returns True if there is room for size bytes
+ */
+static bool make_room(size_t size, Uint64 speculative_before)
+{
+    const size_t budget = asset_cache::get_budget_bytes();
+    if (size > budget)
+        return false;
+
+    std::list<entry_t>::iterator it = lru.end();
+    while (used_bytes + size > budget && it != lru.begin())
+    {
+        --it;
+        if (speculative_before && !(it->speculative && it->seq < speculative_before))
+            continue;
+
+        used_bytes -= it->data->size();
+        lookup.erase(it->path);
+        it = lru.erase(it);
+        SDL_AtomicIncRef(&stats.evictions);
+    }
+
+    return used_bytes + size <= budget;
+}
+
+/**
+ * Inserts a file, or returns the copy that beat it there, cache_lock must be held
+ *
+ * @returns The cached data, or data itself if there was no room for it
+ */
+static asset_cache::data_t insert(const char* path, const asset_cache::data_t& data, bool speculative, Uint64 speculative_before)
+{
+    std::unordered_map<std::string, std::list<entry_t>::iterator>::iterator it = lookup.find(path);
+    if (it != lookup.end())
+        return it->second->data;
+
+    if (!make_room(data->size(), speculative_before))
+        return data;
+
+    entry_t entry;
+    entry.path = path;
+    entry.data = data;
+    entry.speculative = speculative;
+    entry.seq = next_seq++;
+    lru.push_front(entry);
+    lookup[entry.path] = lru.begin();
+    used_bytes += data->size();
+
+    return data;
+}
+
+/**
+ * Reads a whole file in one go
+ *
+ * @returns Contents of the file, or NULL if it could not be read
+ */
+static asset_cache::data_t read_file(PHYSFS_File* fd)
+{
+    PHYSFS_sint64 length = PHYSFS_fileLength(fd);
+    if (length < 0)
+        return NULL;
+
+    std::shared_ptr<std::vector<Uint8>> data = std::make_shared<std::vector<Uint8>>(size_t(length));
+    if (PHYSFS_readBytes(fd, data->data(), PHYSFS_uint64(length)) != length)
+        return NULL;
+
+    return data;
+}
+
+asset_cache::data_t asset_cache::find(const char* path)
+{
+    data_t retval;
+
+    SDL_LockMutex(cache_lock);
+    std::unordered_map<std::string, std::list<entry_t>::iterator>::iterator it = lookup.find(path);
+    if (it != lookup.end())
+    {
+        lru.splice(lru.begin(), lru, it->second);
+        SDL_AtomicIncRef(it->second->speculative ? &stats.preload_hits : &stats.hits);
+        it->second->speculative = false;
+        retval = it->second->data;
+    }
+    SDL_UnlockMutex(cache_lock);
+
+    return retval;
+}
+
+bool asset_cache::contains(const char* path)
+{
+    SDL_LockMutex(cache_lock);
+    bool retval = lookup.count(path) != 0;
+    SDL_UnlockMutex(cache_lock);
+    return retval;
+}
+
+asset_cache::data_t asset_cache::load(const char* path)
+{
+    data_t data = find(path);
+    if (data)
+        return data;
+
+    SDL_AtomicIncRef(&stats.misses);
+
+    PHYSFS_File* fd = PHYSFS_openRead(path);
+    if (!fd)
+        return NULL;
+    data = read_file(fd);
+    PHYSFS_close(fd);
+
+    if (!data)
+        return NULL;
+
+    SDL_LockMutex(cache_lock);
+    data = insert(path, data, false, 0);
+    SDL_UnlockMutex(cache_lock);
+
+    return data;
+}
+
+void asset_cache::preload_t::run()
+{
+    for (size_t i = 0; i < paths.size() && !is_cancelled(); i++)
+    {
+        const char* path = paths[i].c_str();
+
+        if (contains(path))
+            continue;
+
+        PHYSFS_File* fd = PHYSFS_openRead(path);
+        if (!fd)
+            continue;
+
+        /* Check for room before reading, so a preload that does not fit does not read anything */
+        PHYSFS_sint64 length = PHYSFS_fileLength(fd);
+        SDL_LockMutex(cache_lock);
+        bool fits = length >= 0 && make_room(size_t(length), start_seq);
+        SDL_UnlockMutex(cache_lock);
+
+        if (!fits)
+        {
+            PHYSFS_close(fd);
+            SDL_AtomicSet(&budget_hit, 1);
+            break;
+        }
+
+        data_t data = read_file(fd);
+        PHYSFS_close(fd);
+        if (!data)
+            continue;
+
+        /* Loads and other preloads may have taken the room while this was reading, that counts as hitting the budget too */
+        SDL_LockMutex(cache_lock);
+        insert(path, data, true, start_seq);
+        bool stored = lookup.count(path) != 0;
+        SDL_UnlockMutex(cache_lock);
+
+        if (!stored)
+        {
+            SDL_AtomicSet(&budget_hit, 1);
+            break;
+        }
+        SDL_AtomicIncRef(&files_loaded);
+    }
+
+    SDL_AtomicSet(&done, 1);
+}
+
+std::shared_ptr<asset_cache::preload_t> asset_cache::preload(const std::vector<std::string>& paths)
+{
+    std::shared_ptr<preload_t> p(new preload_t);
+    p->paths = paths;
+
+    SDL_LockMutex(cache_lock);
+    p->start_seq = next_seq;
+    for (size_t i = 0; i < preloads.size();)
+    {
+        if (preloads[i].expired())
+        {
+            preloads[i] = preloads.back();
+            preloads.pop_back();
+        }
+        else
+            i++;
+    }
+    preloads.push_back(p);
+    SDL_UnlockMutex(cache_lock);
+
+    jobs::submit([p]() { p->run(); }, jobs::PRIORITY_LOW);
+
+    return p;
+}
+
+std::shared_ptr<asset_cache::preload_t> asset_cache::preload_scene(const char* scene)
+{
+    std::vector<MPH_TETRA_PHYSFS_PreloadEntry> entries;
+    if (!MPH_TETRA_PHYSFS_loadPreloadManifest(scene, entries))
+        return NULL;
+
+    std::vector<std::string> paths;
+    paths.reserve(entries.size());
+    for (const MPH_TETRA_PHYSFS_PreloadEntry& entry : entries)
+        paths.push_back(entry.path);
+
+    return preload(paths);
+}
+
+size_t asset_cache::get_used_bytes()
+{
+    SDL_LockMutex(cache_lock);
+    size_t retval = used_bytes;
+    SDL_UnlockMutex(cache_lock);
+    return retval;
+}
+
+void asset_cache::clear()
+{
+    SDL_LockMutex(cache_lock);
+    lru.clear();
+    lookup.clear();
+    used_bytes = 0;
+    SDL_UnlockMutex(cache_lock);
+}
+
+/* ================================ Commands ================================ */
+
+static int command_preload(const int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        dc_log("Usage: %s <scene>", argv[0]);
+        dc_log("Reads every file in the preload manifest of scene (See io_trace_begin) into the asset cache in the background");
+        return 1;
+    }
+
+    std::shared_ptr<asset_cache::preload_t> p = asset_cache::preload_scene(argv[1]);
+    if (!p)
+    {
+        dc_log_error("%s: No manifest for \"%s\"", argv[0], argv[1]);
+        return 1;
+    }
+
+    dc_log("Preloading %d files for \"%s\"", p->get_file_count(), argv[1]);
+    return 0;
+}
+
+static int command_asset_cache_stats()
+{
+    size_t count = 0;
+    size_t speculative = 0;
+    size_t speculative_bytes = 0;
+    std::vector<std::shared_ptr<asset_cache::preload_t>> running;
+
+    SDL_LockMutex(cache_lock);
+    for (const entry_t& entry : lru)
+    {
+        count++;
+        if (entry.speculative)
+        {
+            speculative++;
+            speculative_bytes += entry.data->size();
+        }
+    }
+    for (const std::weak_ptr<asset_cache::preload_t>& weak : preloads)
+    {
+        std::shared_ptr<asset_cache::preload_t> p = weak.lock();
+        if (p && !p->is_done())
+            running.push_back(p);
+    }
+    size_t used = used_bytes;
+    SDL_UnlockMutex(cache_lock);
+
+    dc_log("%zu files, %.2f/%.2f MiB (%zu files, %.2f MiB preloaded and unused)", count, used / (1024.0 * 1024.0),
+        asset_cache::get_budget_bytes() / (1024.0 * 1024.0), speculative, speculative_bytes / (1024.0 * 1024.0));
+    dc_log("Hits: %d, preload hits: %d, misses: %d, evictions: %d", SDL_AtomicGet(&stats.hits), SDL_AtomicGet(&stats.preload_hits),
+        SDL_AtomicGet(&stats.misses), SDL_AtomicGet(&stats.evictions));
+    for (const std::shared_ptr<asset_cache::preload_t>& p : running)
+        dc_log("Preload: %d/%d files%s", p->get_files_loaded(), p->get_file_count(), p->is_cancelled() ? " (Cancelled)" : "");
+
+    return 0;
+}
+
+static int command_asset_cache_clear()
+{
+    asset_cache::clear();
+    return 0;
+}
+
+void asset_cache::init()
+{
+    cache_lock = SDL_CreateMutex();
+    dev_console::add_command("preload", command_preload);
+    dev_console::add_command("asset_cache_stats", command_asset_cache_stats);
+    dev_console::add_command("asset_cache_clear", command_asset_cache_clear);
+}
+
+void asset_cache::shutdown()
+{
+    SDL_LockMutex(cache_lock);
+    for (const std::weak_ptr<preload_t>& weak : preloads)
+    {
+        std::shared_ptr<preload_t> p = weak.lock();
+        if (p)
+            p->cancel();
+    }
+    preloads.clear();
+    SDL_UnlockMutex(cache_lock);
+}
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_ASSET_CACHE_H
+#define MPH_TETRA_UTIL_ASSET_CACHE_H
+
+#include <SDL_atomic.h>
+#include <SDL_bits.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * In-memory cache of whole files from the PhysFS tree
+ *
+ * Files are kept in least recently used order and the total size is held under the asset_cache_budget_mb convar.
+ * load() is the blocking path the game uses, preload() warms the cache from low priority jobs ahead of time.
+ *
+ * Preloaded files are speculative until something load()s them. To keep a preload from pushing out data that is
+ * actually in use, a preload may only evict speculative files that were inserted before it started, and it stops
+ * (See preload_t::hit_budget()) once that is not enough to make room.
+ */
+namespace asset_cache
+{
+typedef std::shared_ptr<const std::vector<Uint8>> data_t;
+
+/**
+ * A running (or finished) preload, see preload()
+ */
+class preload_t
+{
+public:
+    /**
+     * Stops the preload after the file currently being read, files that were already read stay in the cache
+     */
+    void cancel() { SDL_AtomicSet(&cancelled, 1); }
+
+    bool is_cancelled() { return SDL_AtomicGet(&cancelled); }
+
+    bool is_done() { return SDL_AtomicGet(&done); }
+
+    /**
+     * @returns True if the preload stopped because the cache had no room left for it
+     */
+    bool hit_budget() { return SDL_AtomicGet(&budget_hit); }
+
+    /**
+     * @returns Number of files read, files that were already in the cache are skipped and not counted
+     */
+    int get_files_loaded() { return SDL_AtomicGet(&files_loaded); }
+
+    /**
+     * @returns Number of files in the preload
+     */
+    int get_file_count() { return int(paths.size()); }
+
+private:
+    friend std::shared_ptr<preload_t> preload(const std::vector<std::string>& paths);
+
+    /**
+     * Body of the preload job
+     */
+    void run();
+
+    std::vector<std::string> paths;
+    /** Entries inserted at or after this are not evicted to make room for this preload */
+    Uint64 start_seq = 0;
+    SDL_atomic_t cancelled = {};
+    SDL_atomic_t done = {};
+    SDL_atomic_t budget_hit = {};
+    SDL_atomic_t files_loaded = {};
+};
+
+/**
+ * Registers the console commands
+ */
+void init();
+
+/**
+ * Cancels every running preload, call before jobs::shutdown()
+ */
+void shutdown();
+
+/**
+ * Returns a file if it is cached, never does any I/O
+ *
+ * @param path PhysFS path of the file
+ *
+ * @returns Contents of the file, or NULL if it is not in the cache
+ */
+data_t find(const char* path);
+
+/**
+ * @returns True if a file is cached, unlike find() this does not count as a use
+ */
+bool contains(const char* path);
+
+/**
+ * Returns a file, reading and caching it on a miss
+ *
+ * Files larger than the budget are returned without being cached
+ *
+ * @param path PhysFS path of the file
+ *
+ * @returns Contents of the file, or NULL if it could not be read
+ */
+data_t load(const char* path);
+
+/**
+ * Starts reading files into the cache from a low priority job, in the given order
+ *
+ * Files are read whole, one after the other, so a list sorted by ROM offset (See MPH_TETRA_PHYSFS_loadPreloadManifest())
+ * turns into a single forward pass over each ROM
+ *
+ * @param paths PhysFS paths of the files
+ *
+ * @returns Handle to follow or cancel the preload with
+ */
+std::shared_ptr<preload_t> preload(const std::vector<std::string>& paths);
+
+/**
+ * Starts a preload of every file in the manifest of a scene (See MPH_TETRA_PHYSFS_traceBegin())
+ *
+ * @returns Handle to follow or cancel the preload with, or NULL if the scene has no manifest
+ */
+std::shared_ptr<preload_t> preload_scene(const char* scene);
+
+/**
+ * @returns Bytes held by the cache
+ */
+size_t get_used_bytes();
+
+/**
+ * @returns Size the cache is held under (asset_cache_budget_mb)
+ */
+size_t get_budget_bytes();
+
+/**
+ * Drops every cached file, callers holding a data_t keep their copy alive
+ */
+void clear();
+}
+
+#endif
@@ -0,0 +1,275 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_BINARY_LAYOUT_H
+#define MPH_TETRA_UTIL_BINARY_LAYOUT_H
+
+#include <SDL_bits.h>
+#include <SDL_endian.h>
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Compile time descriptions of on-disk structures
+ *
+ * A layout lists the multi-byte fields of a POD struct along with their on-disk byte order. Everything else (Byte
+ * fields, character arrays, reserved space) is copied as is. From that the layout provides:
+ * - correct(): In place byte order correction of one struct (Replaces the hand written endian_correct() functions)
+ * - correct_array(): The same for an array, a no-op when every field is already in host order and a plain word swap
+ *   loop (Which the compiler vectorizes) when the struct is entirely made of swapped 32-bit fields
+ * - read(): Bounds checked load of one struct from a byte buffer at any alignment
+ *
+ * Example:
+ *     struct foo_t { Uint32 a; Uint16 b; char name[2]; };
+ *     typedef util::binary_layout_t<foo_t, BINARY_FIELD_LE(foo_t, a), BINARY_FIELD_LE(foo_t, b)> foo_layout_t;
+ *
+ * On little endian hosts correct() of a little endian struct compiles to nothing, so loading a table is a memcpy.
+ */
+
+/**
+ * Describes a little endian member of S
+ */
+#define BINARY_FIELD_LE(S, member) util::binary_field_t<offsetof(S, member), sizeof(((S*)0)->member), util::BINARY_ENDIAN_LITTLE>
+
+/**
+ * Describes a big endian member of S
+ */
+#define BINARY_FIELD_BE(S, member) util::binary_field_t<offsetof(S, member), sizeof(((S*)0)->member), util::BINARY_ENDIAN_BIG>
+
+namespace util
+{
+enum binary_endian_t
+{
+    BINARY_ENDIAN_LITTLE,
+    BINARY_ENDIAN_BIG,
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    BINARY_ENDIAN_HOST = BINARY_ENDIAN_LITTLE,
+#else
+    BINARY_ENDIAN_HOST = BINARY_ENDIAN_BIG,
+#endif
+};
+
+template <size_t Offset, size_t Size, binary_endian_t Endian> struct binary_field_t
+{
+    static_assert(Size == 1 || Size == 2 || Size == 4 || Size == 8, "Only scalar fields can be byte swapped");
+
+    static const size_t offset = Offset;
+    static const size_t size = Size;
+    static const bool needs_swap = Size > 1 && Endian != BINARY_ENDIAN_HOST;
+
+    static inline void correct(Uint8* base)
+    {
+        if (!needs_swap)
+            return;
+
+        /* memcpy keeps this valid for packed and unaligned fields, it still compiles to a load/bswap/store */
+        if (Size == 2)
+        {
+            Uint16 x;
+            memcpy(&x, base + Offset, sizeof(x));
+            x = SDL_Swap16(x);
+            memcpy(base + Offset, &x, sizeof(x));
+        }
+        else if (Size == 4)
+        {
+            Uint32 x;
+            memcpy(&x, base + Offset, sizeof(x));
+            x = SDL_Swap32(x);
+            memcpy(base + Offset, &x, sizeof(x));
+        }
+        else if (Size == 8)
+        {
+            Uint64 x;
+            memcpy(&x, base + Offset, sizeof(x));
+            x = SDL_Swap64(x);
+            memcpy(base + Offset, &x, sizeof(x));
+        }
+    }
+};
+
+template <typename... Fields> struct binary_fields_t;
+
+template <> struct binary_fields_t<>
+{
+    static const bool needs_swap = false;
+    static const bool all_swapped_words = true;
+    static const size_t total_size = 0;
+    static const size_t end = 0;
+
+    static inline void correct(Uint8*) { }
+};
+
+template <typename Field, typename... Rest> struct binary_fields_t<Field, Rest...>
+{
+    typedef binary_fields_t<Rest...> rest_t;
+
+    static const bool needs_swap = Field::needs_swap || rest_t::needs_swap;
+    /** Every field is a 32-bit word that needs swapping */
+    static const bool all_swapped_words = Field::size == 4 && Field::needs_swap && rest_t::all_swapped_words;
+    static const size_t total_size = Field::size + rest_t::total_size;
+    static const size_t end = Field::offset + Field::size > rest_t::end ? Field::offset + Field::size : rest_t::end;
+
+    static inline void correct(Uint8* base)
+    {
+        Field::correct(base);
+        rest_t::correct(base);
+    }
+};
+
+/**
+ * Byte order description of struct S, see the comment at the top of this file
+ *
+ * Fields must not overlap (Only one member of a union may be listed)
+ */
+template <typename S, typename... Fields> struct binary_layout_t
+{
+    typedef S struct_t;
+    typedef binary_fields_t<Fields...> fields_t;
+
+    static_assert(fields_t::end <= sizeof(S), "Field outside of struct");
+    static_assert(fields_t::total_size <= sizeof(S), "Overlapping fields");
+
+    /** True when the on-disk representation is the in-memory one */
+    static const bool is_native = !fields_t::needs_swap;
+
+    /** True when S is nothing but 32-bit words in the opposite byte order, so an array of S is an array of words */
+    static const bool is_swapped_words = fields_t::all_swapped_words && fields_t::total_size == sizeof(S) && sizeof(S) % 4 == 0;
+
+    /**
+     * Converts s between on-disk and host byte order (The conversion is its own inverse)
+     */
+    static inline void correct(S& s) { fields_t::correct((Uint8*)&s); }
+
+    /**
+     * Converts count structs between on-disk and host byte order
+     */
+    static inline void correct_array(S* s, size_t count)
+    {
+        if (is_native)
+            return;
+
+        if (is_swapped_words)
+        {
+            Uint8* p = (Uint8*)s;
+            for (size_t i = 0; i < count * (sizeof(S) / 4); i++)
+            {
+                Uint32 x;
+                memcpy(&x, p + i * 4, sizeof(x));
+                x = SDL_Swap32(x);
+                memcpy(p + i * 4, &x, sizeof(x));
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            correct(s[i]);
+    }
+
+    /**
+     * Loads and corrects a struct from a buffer of any alignment
+     *
+     * @param data Start of the buffer
+     * @param len Size of the buffer
+     * @param offset Offset of the struct in the buffer
+     *
+     * @returns false if the struct does not fit in the buffer (out is left untouched)
+     */
+    static inline bool read(const void* data, size_t len, size_t offset, S& out)
+    {
+        if (offset > len || len - offset < sizeof(S))
+            return false;
+
+        memcpy(&out, (const Uint8*)data + offset, sizeof(S));
+        correct(out);
+        return true;
+    }
+};
+
+/**
+ * Bounds checked view of a table of structs in a byte buffer, the buffer must outlive the view
+ */
+template <typename Layout> class binary_table_t
+{
+public:
+    typedef typename Layout::struct_t struct_t;
+
+    binary_table_t()
+        : data(NULL)
+        , count(0)
+    {
+    }
+
+    /**
+     * @param data Start of the buffer
+     * @param len Size of the buffer
+     * @param offset Offset of the first entry in the buffer
+     * @param count Number of entries, entries past the end of the buffer are dropped
+     */
+    binary_table_t(const void* _data, size_t len, size_t offset, size_t _count = SIZE_MAX)
+        : data(NULL)
+        , count(0)
+    {
+        if (!_data || offset > len)
+            return;
+
+        data = (const Uint8*)_data + offset;
+        count = SDL_min(_count, (len - offset) / sizeof(struct_t));
+    }
+
+    size_t size() const { return count; }
+
+    /**
+     * @returns false if i is out of range (out is left untouched)
+     */
+    bool get(size_t i, struct_t& out) const
+    {
+        if (i >= count)
+            return false;
+
+        memcpy(&out, data + i * sizeof(struct_t), sizeof(struct_t));
+        Layout::correct(out);
+        return true;
+    }
+
+    /**
+     * Copies and corrects entries [first, first + num) into out
+     *
+     * @returns false if the range is out of bounds
+     */
+    bool get_range(size_t first, size_t num, struct_t* out) const
+    {
+        if (first > count || count - first < num)
+            return false;
+
+        memcpy(out, data + first * sizeof(struct_t), num * sizeof(struct_t));
+        Layout::correct_array(out, num);
+        return true;
+    }
+
+private:
+    const Uint8* data;
+    size_t count;
+};
+}
+
+#endif
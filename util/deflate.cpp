@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "deflate.h"
+
+#include "hash.h"
+
+#include <string.h>
+
+#define WINDOW_SIZE 32768
+#define HASH_BITS 15
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+/* How many previous occurrences of a hash are checked for a match */
+#define MAX_CHAIN 32
+
+static const Uint16 length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const Uint8 length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const Uint16 dist_base[30]
+    = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const Uint8 dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct bit_output_t
+{
+    std::vector<Uint8>& out;
+    Uint64 buffer = 0;
+    int count = 0;
+
+    bit_output_t(std::vector<Uint8>& _out)
+        : out(_out)
+    {
+    }
+
+    /**
+     * Writes bits LSB first
+     */
+    inline void put(Uint32 bits, int n)
+    {
+        buffer |= Uint64(bits) << count;
+        count += n;
+        while (count >= 8)
+        {
+            out.push_back(buffer & 0xFF);
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+
+    /**
+     * Writes a Huffman code, codes are stored MSB first in the stream
+     */
+    inline void put_code(Uint32 code, int n)
+    {
+        Uint32 reversed = 0;
+        for (int i = 0; i < n; i++)
+            reversed |= ((code >> i) & 1) << (n - 1 - i);
+        put(reversed, n);
+    }
+
+    inline void flush()
+    {
+        if (count > 0)
+            out.push_back(buffer & 0xFF);
+        buffer = 0;
+        count = 0;
+    }
+};
+
+static inline void put_literal(bit_output_t& bits, int symbol)
+{
+    if (symbol < 144)
+        bits.put_code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bits.put_code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bits.put_code(symbol - 256, 7);
+    else
+        bits.put_code(0xC0 + symbol - 280, 8);
+}
+
+static inline void put_match(bit_output_t& bits, int length, int dist)
+{
+    int code = 28;
+    while (length_base[code] > length)
+        code--;
+    put_literal(bits, 257 + code);
+    bits.put(length - length_base[code], length_extra[code]);
+
+    code = 29;
+    while (dist_base[code] > dist)
+        code--;
+    bits.put_code(code, 5);
+    bits.put(dist - dist_base[code], dist_extra[code]);
+}
+
+static inline Uint32 hash3(const Uint8* p) { return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS); }
+
+void util::zlib_compress(const Uint8* in, size_t len, std::vector<Uint8>& out)
+{
+    /* CMF: deflate with a 32K window, FLG: fastest compression level, no dictionary, check bits */
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    bit_output_t bits(out);
+
+    /* Single final block with the fixed Huffman tables */
+    bits.put(1, 1);
+    bits.put(1, 2);
+
+    std::vector<Sint32> head(1 << HASH_BITS, -1);
+    std::vector<Sint32> prev(WINDOW_SIZE, -1);
+
+    auto insert = [&](size_t pos) {
+        Uint32 h = hash3(in + pos);
+        prev[pos & (WINDOW_SIZE - 1)] = head[h];
+        head[h] = pos;
+    };
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        int best_len = 0;
+        int best_dist = 0;
+
+        if (pos + MIN_MATCH <= len)
+        {
+            size_t max_len = len - pos < MAX_MATCH ? len - pos : MAX_MATCH;
+            Sint32 candidate = head[hash3(in + pos)];
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && pos - candidate <= WINDOW_SIZE; chain++)
+            {
+                const Uint8* a = in + candidate;
+                const Uint8* b = in + pos;
+                if (a[best_len] == b[best_len])
+                {
+                    size_t l = 0;
+                    while (l < max_len && a[l] == b[l])
+                        l++;
+                    if ((int)l > best_len)
+                    {
+                        best_len = l;
+                        best_dist = pos - candidate;
+                        if (l == max_len)
+                            break;
+                    }
+                }
+                Sint32 next = prev[candidate & (WINDOW_SIZE - 1)];
+                /* The slot may have been reused by a newer position, chains must go strictly backwards */
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        if (best_len >= MIN_MATCH)
+        {
+            put_match(bits, best_len, best_dist);
+            for (int i = 0; i < best_len; i++, pos++)
+                if (pos + MIN_MATCH <= len)
+                    insert(pos);
+        }
+        else
+        {
+            put_literal(bits, in[pos]);
+            if (pos + MIN_MATCH <= len)
+                insert(pos);
+            pos++;
+        }
+    }
+
+    put_literal(bits, 256);
+    bits.flush();
+
+    Uint32 adler = util::adler32(in, len);
+    out.push_back(adler >> 24);
+    out.push_back(adler >> 16);
+    out.push_back(adler >> 8);
+    out.push_back(adler);
+}
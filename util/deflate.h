@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_DEFLATE_H
+#define MPH_TETRA_UTIL_DEFLATE_H
+#include <SDL_bits.h>
+#include <stddef.h>
+#include <vector>
+
+namespace util
+{
+/**
+ * Compresses data into a zlib stream (RFC 1950/1951)
+ *
+ * This is a small single pass compressor (Hash chain LZ77 + the fixed Huffman tables), it trades ratio for simplicity
+ * and is meant for things like screenshots and caches, not for shipping data
+ *
+ * @param in Data to compress
+ * @param len Length of data
+ * @param out Compressed stream is appended to this
+ */
+void zlib_compress(const Uint8* in, size_t len, std::vector<Uint8>& out);
+}
+#endif
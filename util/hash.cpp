@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "hash.h"
+
+#define FNV1A64_PRIME 0x100000001b3ull
+
+Uint64 util::fnv1a64(const void* data, size_t len, Uint64 hash)
+{
+    const Uint8* bytes = (const Uint8*)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A64_PRIME;
+    }
+    return hash;
+}
+
+Uint64 util::fnv1a64_str(const char* str, Uint64 hash)
+{
+    if (!str)
+        return hash;
+    for (; *str; str++)
+    {
+        hash ^= (Uint8)*str;
+        hash *= FNV1A64_PRIME;
+    }
+    return hash;
+}
+
+Uint32 util::crc32(const void* data, size_t len, Uint32 crc)
+{
+    struct table_t
+    {
+        Uint32 values[256];
+        table_t()
+        {
+            for (Uint32 i = 0; i < 256; i++)
+            {
+                Uint32 c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                values[i] = c;
+            }
+        }
+    };
+    static const table_t table;
+
+    const Uint8* bytes = (const Uint8*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table.values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+Uint32 util::adler32(const void* data, size_t len, Uint32 adler)
+{
+    const Uint8* bytes = (const Uint8*)data;
+    Uint32 a = adler & 0xFFFF;
+    Uint32 b = adler >> 16;
+
+    /* 5552 is the largest block that can't overflow 32 bits before the modulo */
+    while (len)
+    {
+        size_t block = len < 5552 ? len : 5552;
+        len -= block;
+        for (size_t i = 0; i < block; i++)
+        {
+            a += bytes[i];
+            b += a;
+        }
+        bytes += block;
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_HASH_H
+#define MPH_TETRA_UTIL_HASH_H
+#include <SDL_bits.h>
+#include <stddef.h>
+
+#define FNV1A64_OFFSET_BASIS 0xcbf29ce484222325ull
+
+namespace util
+{
+/**
+ * 64-bit FNV-1a, used for cache keys and content hashes (Not cryptographically secure)
+ *
+ * @param data Bytes to hash
+ * @param len Number of bytes
+ * @param hash Previous hash to continue from
+ */
+Uint64 fnv1a64(const void* data, size_t len, Uint64 hash = FNV1A64_OFFSET_BASIS);
+
+/**
+ * Hashes a NUL terminated string (Excluding the terminator), NULL is treated as an empty string
+ */
+Uint64 fnv1a64_str(const char* str, Uint64 hash = FNV1A64_OFFSET_BASIS);
+
+/**
+ * CRC-32 (ISO-HDLC / zlib / PNG variant)
+ *
+ * @param crc Previous CRC to continue from, 0 to start
+ */
+Uint32 crc32(const void* data, size_t len, Uint32 crc = 0);
+
+/**
+ * Adler-32 as used by zlib streams
+ *
+ * @param adler Previous checksum to continue from, 1 to start
+ */
+Uint32 adler32(const void* data, size_t len, Uint32 adler = 1);
+}
+#endif
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "jobs.h"
+
+#include "convar.h"
+#include "profiler.h"
+
+#include "gui/console.h"
+
+#include <SDL_atomic.h>
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+static convar_int_t jobs_threads("jobs_threads", 0, 0, JOBS_MAX_THREADS - 1, "Number of worker threads (0 = Number of CPUs - 1), applied on startup");
+
+static profiler_zone_t zone_parallel_for("jobs::parallel_for");
+
+static SDL_mutex* queue_lock = NULL;
+static SDL_cond* queue_cond = NULL;
+static std::deque<std::function<void()>> queues[2];
+static bool quit = false;
+
+static std::vector<SDL_Thread*> workers;
+
+/* Signalled whenever a parallel_for() finishes its last chunk */
+static SDL_mutex* done_lock = NULL;
+static SDL_cond* done_cond = NULL;
+
+static thread_local int thread_index = 0;
+
+static int worker_main(void* data)
+{
+    thread_index = (int)(intptr_t)data;
+
+    SDL_LockMutex(queue_lock);
+    while (1)
+    {
+        while (!quit && queues[jobs::PRIORITY_HIGH].empty() && queues[jobs::PRIORITY_LOW].empty())
+            SDL_CondWait(queue_cond, queue_lock);
+
+        if (quit)
+            break;
+
+        std::deque<std::function<void()>>& queue = queues[jobs::PRIORITY_HIGH].empty() ? queues[jobs::PRIORITY_LOW] : queues[jobs::PRIORITY_HIGH];
+        std::function<void()> job = std::move(queue.front());
+        queue.pop_front();
+
+        SDL_UnlockMutex(queue_lock);
+        job();
+        SDL_LockMutex(queue_lock);
+    }
+    SDL_UnlockMutex(queue_lock);
+
+    return 0;
+}
+
+void jobs::init()
+{
+    if (!queue_lock)
+    {
+        queue_lock = SDL_CreateMutex();
+        queue_cond = SDL_CreateCond();
+        done_lock = SDL_CreateMutex();
+        done_cond = SDL_CreateCond();
+    }
+
+    int num_workers = jobs_threads.get();
+    if (num_workers == 0)
+        num_workers = SDL_GetCPUCount() - 1;
+    if (num_workers > JOBS_MAX_THREADS - 1)
+        num_workers = JOBS_MAX_THREADS - 1;
+
+    quit = false;
+    for (int i = 0; i < num_workers; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "jobs_worker_%d", i + 1);
+        SDL_Thread* thread = SDL_CreateThread(worker_main, name, (void*)(intptr_t)(i + 1));
+        if (!thread)
+        {
+            dc_log_error("Unable to create worker thread: %s", SDL_GetError());
+            break;
+        }
+        workers.push_back(thread);
+    }
+
+    dc_log("Job system started with %zu worker threads", workers.size());
+}
+
+void jobs::shutdown()
+{
+    if (!queue_lock)
+        return;
+
+    SDL_LockMutex(queue_lock);
+    quit = true;
+    queues[PRIORITY_HIGH].clear();
+    queues[PRIORITY_LOW].clear();
+    SDL_CondBroadcast(queue_cond);
+    SDL_UnlockMutex(queue_lock);
+
+    for (size_t i = 0; i < workers.size(); i++)
+        SDL_WaitThread(workers[i], NULL);
+    workers.clear();
+}
+
+int jobs::get_thread_count() { return workers.size() + 1; }
+
+int jobs::get_thread_index() { return thread_index; }
+
+void jobs::submit(std::function<void()> func, priority_t priority)
+{
+    if (workers.empty())
+    {
+        func();
+        return;
+    }
+
+    SDL_LockMutex(queue_lock);
+    queues[priority].push_back(std::move(func));
+    SDL_CondSignal(queue_cond);
+    SDL_UnlockMutex(queue_lock);
+}
+
+struct parallel_for_t
+{
+    const std::function<void(int, int)>* func;
+    int count;
+    int grain;
+    int num_chunks;
+    SDL_atomic_t next_chunk;
+    SDL_atomic_t chunks_done;
+};
+
+/**
+ * Claims and runs chunks until none are left
+ *
+ * `ctx->func` belongs to the caller of parallel_for() and is only valid while chunks remain, helpers that show up late
+ * never touch it
+ */
+static void run_chunks(parallel_for_t* ctx)
+{
+    int chunk;
+    while ((chunk = SDL_AtomicAdd(&ctx->next_chunk, 1)) < ctx->num_chunks)
+    {
+        int begin = chunk * ctx->grain;
+        int end = SDL_min(begin + ctx->grain, ctx->count);
+        (*ctx->func)(begin, end);
+
+        if (SDL_AtomicAdd(&ctx->chunks_done, 1) + 1 == ctx->num_chunks)
+        {
+            SDL_LockMutex(done_lock);
+            SDL_CondBroadcast(done_cond);
+            SDL_UnlockMutex(done_lock);
+        }
+    }
+}
+
+void jobs::parallel_for(int count, int grain, const std::function<void(int begin, int end)>& func)
+{
+    if (count <= 0)
+        return;
+
+    PROFILER_SCOPE(zone_parallel_for);
+
+    if (grain < 1)
+        grain = 1;
+    int num_chunks = (count + grain - 1) / grain;
+
+    if (num_chunks == 1 || workers.empty())
+    {
+        for (int begin = 0; begin < count; begin += grain)
+            func(begin, SDL_min(begin + grain, count));
+        return;
+    }
+
+    /* Shared ownership because helper jobs may still be queued after all chunks are done */
+    std::shared_ptr<parallel_for_t> ctx = std::make_shared<parallel_for_t>();
+    ctx->func = &func;
+    ctx->count = count;
+    ctx->grain = grain;
+    ctx->num_chunks = num_chunks;
+    SDL_AtomicSet(&ctx->next_chunk, 0);
+    SDL_AtomicSet(&ctx->chunks_done, 0);
+
+    int num_helpers = SDL_min(num_chunks - 1, (int)workers.size());
+    SDL_LockMutex(queue_lock);
+    for (int i = 0; i < num_helpers; i++)
+        queues[PRIORITY_HIGH].push_back([ctx]() { run_chunks(ctx.get()); });
+    SDL_CondBroadcast(queue_cond);
+    SDL_UnlockMutex(queue_lock);
+
+    run_chunks(ctx.get());
+
+    SDL_LockMutex(done_lock);
+    while (SDL_AtomicGet(&ctx->chunks_done) < num_chunks)
+        SDL_CondWait(done_cond, done_lock);
+    SDL_UnlockMutex(done_lock);
+}
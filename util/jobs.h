@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_JOBS_H
+#define MPH_TETRA_UTIL_JOBS_H
+
+#include <SDL_bits.h>
+#include <functional>
+
+/**
+ * Upper limit of get_thread_count()
+ */
+#define JOBS_MAX_THREADS 64
+
+/**
+ * Small worker thread pool
+ *
+ * The calling thread always takes part in parallel_for(), so nested calls from inside a job can not deadlock and
+ * everything still works (serially) when there are no workers.
+ */
+namespace jobs
+{
+enum priority_t
+{
+    /**
+     * Work the current frame is waiting on (parallel_for() helpers)
+     */
+    PRIORITY_HIGH,
+    /**
+     * Background work (Streaming, prefetching, cache generation), only picked up when no high priority work is queued
+     */
+    PRIORITY_LOW,
+};
+
+/**
+ * Starts the worker threads, the count comes from the jobs_threads convar
+ */
+void init();
+
+/**
+ * Stops and joins the worker threads, queued jobs that have not started yet are dropped
+ */
+void shutdown();
+
+/**
+ * Number of threads that can run jobs (workers + the main thread)
+ */
+int get_thread_count();
+
+/**
+ * Index of the calling thread in [0, get_thread_count()), the main thread (and any non-worker thread) is 0
+ *
+ * Meant for indexing per-thread scratch buffers
+ */
+int get_thread_index();
+
+/**
+ * Calls func(begin, end) for consecutive chunks of [0, count), blocks until every chunk has been processed
+ *
+ * @param count Number of items
+ * @param grain Maximum number of items per chunk
+ * @param func Chunk function, must be safe to call concurrently from multiple threads
+ */
+void parallel_for(int count, int grain, const std::function<void(int begin, int end)>& func);
+
+/**
+ * Queues a job, returns immediately
+ *
+ * If there are no worker threads the job is run before returning
+ */
+void submit(std::function<void()> func, priority_t priority = PRIORITY_LOW);
+};
+
+#endif
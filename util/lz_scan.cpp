@@ -0,0 +1,413 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "lz_scan.h"
+
+#include "jobs.h"
+#include "lzss.h"
+#include "profiler.h"
+
+#include "gui/console.h"
+#include "util/physfs/physfs.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <stdlib.h>
+
+/* Offsets per job */
+#define LZ_SCAN_REGION_SIZE (64 << 10)
+/* Headers claiming more than this are not considered plausible */
+#define LZ_SCAN_MAX_SIZE (16 << 20)
+#define LZ_SCAN_HEADER_SIZE 4
+
+static profiler_zone_t zone_scan("util::scan_lz_streams");
+
+/**
+ * Same token format and acceptance rules as decompress_lz10() in lzss.cpp without producing output: a back-reference
+ * may not reach before the start of the output, and a copy may not overshoot the size
+ *
+ * @returns Bytes consumed including the header, or 0 if the stream is invalid
+ */
+static size_t validate_lz10(const Uint8* in, size_t len, Uint32 size)
+{
+    size_t iter = LZ_SCAN_HEADER_SIZE;
+    Uint32 out = 0;
+
+    while (out < size)
+    {
+        if (iter >= len)
+            return 0;
+        Uint8 flags = in[iter++];
+
+        for (int i = 7; i >= 0 && out < size; i--)
+        {
+            if (!((flags >> i) & 1))
+            {
+                if (iter >= len)
+                    return 0;
+                iter++;
+                out++;
+                continue;
+            }
+
+            if (iter + 2 > len)
+                return 0;
+            Uint32 count = (in[iter] >> 4) + 3;
+            Uint32 disp = (((in[iter] & 0xF) << 8) | in[iter + 1]) + 1;
+            iter += 2;
+
+            if (disp > out || count > size - out)
+                return 0;
+            out += count;
+        }
+    }
+
+    return iter;
+}
+
+/**
+ * Same token format and acceptance rules as decompress_lz11() in lzss.cpp
+ *
+ * @returns Bytes consumed including the header, or 0 if the stream is invalid
+ */
+static size_t validate_lz11(const Uint8* in, size_t len, Uint32 size)
+{
+    size_t iter = LZ_SCAN_HEADER_SIZE;
+    Uint32 out = 0;
+
+    while (out < size)
+    {
+        if (iter >= len)
+            return 0;
+        Uint8 flags = in[iter++];
+
+        for (int i = 7; i >= 0 && out < size; i--)
+        {
+            if (!((flags >> i) & 1))
+            {
+                if (iter >= len)
+                    return 0;
+                iter++;
+                out++;
+                continue;
+            }
+
+            if (iter >= len)
+                return 0;
+            Uint32 indicator = in[iter] >> 4;
+            Uint32 count;
+            size_t token_len;
+
+            if (indicator == 0)
+            {
+                if (iter + 3 > len)
+                    return 0;
+                count = (((in[iter] & 0xF) << 4) | (in[iter + 1] >> 4)) + 0x11;
+                token_len = 3;
+            }
+            else if (indicator == 1)
+            {
+                if (iter + 4 > len)
+                    return 0;
+                count = (((in[iter] & 0xF) << 12) | (in[iter + 1] << 4) | (in[iter + 2] >> 4)) + 0x111;
+                token_len = 4;
+            }
+            else
+            {
+                if (iter + 2 > len)
+                    return 0;
+                count = indicator + 1;
+                token_len = 2;
+            }
+
+            Uint32 disp = (((in[iter + token_len - 2] & 0xF) << 8) | in[iter + token_len - 1]) + 1;
+            iter += token_len;
+
+            if (disp > out || count > size - out)
+                return 0;
+            out += count;
+        }
+    }
+
+    return iter;
+}
+
+static void scan_region(const Uint8* data, size_t len, size_t begin, size_t end, Uint32 min_size, std::vector<util::lz_stream_t>& out)
+{
+    for (size_t offset = begin; offset < end && offset + LZ_SCAN_HEADER_SIZE <= len; offset++)
+    {
+        Uint8 method = data[offset];
+        if (method != 0x10 && method != 0x11)
+            continue;
+
+        Uint32 size = data[offset + 1] | (data[offset + 2] << 8) | (data[offset + 3] << 16);
+        if (size < min_size || size > LZ_SCAN_MAX_SIZE)
+            continue;
+
+        /* Even the best case of each format can't reach the size from what is left */
+        size_t remaining = len - offset - LZ_SCAN_HEADER_SIZE;
+        if (method == 0x10 && (Uint64)remaining * 18 * 8 / 17 < size)
+            continue;
+
+        size_t consumed = method == 0x10 ? validate_lz10(data + offset, len - offset, size) : validate_lz11(data + offset, len - offset, size);
+        if (!consumed)
+            continue;
+
+        util::lz_stream_t stream = { Uint32(offset), method, Uint32(consumed), size };
+        out.push_back(stream);
+    }
+}
+
+void util::scan_lz_streams(const Uint8* data, size_t len, std::vector<lz_stream_t>& streams, Uint32 min_size)
+{
+    PROFILER_SCOPE(zone_scan);
+
+    streams.clear();
+
+    int num_regions = (len + LZ_SCAN_REGION_SIZE - 1) / LZ_SCAN_REGION_SIZE;
+    std::vector<std::vector<lz_stream_t>> found(num_regions);
+
+    /* Regions only bound where streams may start, validation reads past the end of the region */
+    jobs::parallel_for(num_regions, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            scan_region(data, len, size_t(i) * LZ_SCAN_REGION_SIZE, size_t(i + 1) * LZ_SCAN_REGION_SIZE, min_size, found[i]);
+    });
+
+    std::vector<lz_stream_t> candidates;
+    for (int i = 0; i < num_regions; i++)
+        candidates.insert(candidates.end(), found[i].begin(), found[i].end());
+
+    /* Once the output is past the 4 KB window any bytes decode without error, so a header that happens to survive its first
+     * few KB (Usually one read out of phase inside a real stream) runs on over everything after it. Keeping the most
+     * non-overlapping streams (Earliest end first) makes the real streams it covers win over it. */
+    std::sort(candidates.begin(), candidates.end(), [](const lz_stream_t& a, const lz_stream_t& b) {
+        return Uint64(a.offset) + a.compressed_size < Uint64(b.offset) + b.compressed_size;
+    });
+
+    Uint64 covered_end = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (candidates[i].offset < covered_end)
+            continue;
+        streams.push_back(candidates[i]);
+        covered_end = Uint64(candidates[i].offset) + candidates[i].compressed_size;
+    }
+
+    /* That also picks short headers nested inside a real stream over the real one, so longer candidates (Longest first)
+     * replace the streams they fully contain. A run on starts inside the stream it was misread from and is never allowed
+     * to cut into a kept stream. */
+    std::stable_sort(candidates.begin(), candidates.end(), [](const lz_stream_t& a, const lz_stream_t& b) { return a.compressed_size > b.compressed_size; });
+
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        Uint64 begin = candidates[i].offset;
+        Uint64 end = begin + candidates[i].compressed_size;
+
+        /* Kept streams overlapping the candidate are [first, last) */
+        std::vector<lz_stream_t>::iterator first = std::lower_bound(streams.begin(), streams.end(), begin,
+            [](const lz_stream_t& a, Uint64 pos) { return Uint64(a.offset) + a.compressed_size <= pos; });
+        std::vector<lz_stream_t>::iterator last = first;
+        while (last != streams.end() && last->offset < end)
+            last++;
+
+        if (first == last || first->offset < begin || Uint64(last[-1].offset) + last[-1].compressed_size > end)
+            continue;
+        if (last - first == 1 && first->offset == begin && first->compressed_size == candidates[i].compressed_size)
+            continue;
+
+        *first = candidates[i];
+        streams.erase(first + 1, last);
+    }
+}
+
+static Uint32 test_seed = 1;
+static Uint32 test_rand()
+{
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return test_seed >> 8;
+}
+
+/**
+ * Appends one flag byte and its 8 tokens to an LZ10 stream, and what they decompress to to plain
+ *
+ * @param literals If set the tokens are these 8 literals, otherwise literals and back-references are random
+ */
+static void test_lz10_group(std::vector<Uint8>& stream, std::vector<Uint8>& plain, const Uint8* literals)
+{
+    size_t flags = stream.size();
+    stream.push_back(0);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        if (literals || plain.size() < 3 || test_rand() & 1)
+        {
+            Uint8 c = literals ? literals[7 - i] : Uint8(test_rand());
+            stream.push_back(c);
+            plain.push_back(c);
+            continue;
+        }
+
+        Uint32 count = (test_rand() & 0xF) + 3;
+        Uint32 disp = test_rand() % SDL_min(plain.size(), size_t(4096)) + 1;
+        stream[flags] |= 1 << i;
+        stream.push_back(((count - 3) << 4) | ((disp - 1) >> 8));
+        stream.push_back((disp - 1) & 0xFF);
+        for (Uint32 j = 0; j < count; j++)
+        {
+            Uint8 c = plain[plain.size() - disp];
+            plain.push_back(c);
+        }
+    }
+}
+
+/**
+ * Embeds a real LZ10 stream in random data, with a shorter valid header nested in its literals, and checks that the
+ * scan finds the real stream and not the nested one
+ */
+static int command_lz_scan_selftest()
+{
+    test_seed = 1234;
+
+    std::vector<Uint8> stream = { 0x10, 0, 0, 0 };
+    std::vector<Uint8> plain;
+    for (int i = 0; i < 48; i++)
+        test_lz10_group(stream, plain, NULL);
+
+    /* A literal only LZ10 stream of 64 bytes is its header followed by 8 flag bytes of 0 and 8 literals each, that is
+     * the same layout as literal only groups of the outer stream when the header fills the end of a group */
+    Uint8 literals[8];
+    for (int i = 0; i < 4; i++)
+        literals[i] = test_rand();
+    literals[4] = 0x10;
+    literals[5] = 64;
+    literals[6] = 0;
+    literals[7] = 0;
+    test_lz10_group(stream, plain, literals);
+    size_t nested_offset = stream.size() - 4;
+    for (int g = 0; g < 8; g++)
+    {
+        for (int i = 0; i < 8; i++)
+            literals[i] = test_rand();
+        test_lz10_group(stream, plain, literals);
+    }
+
+    for (int i = 0; i < 48; i++)
+        test_lz10_group(stream, plain, NULL);
+
+    stream[1] = plain.size() & 0xFF;
+    stream[2] = (plain.size() >> 8) & 0xFF;
+    stream[3] = (plain.size() >> 16) & 0xFF;
+
+    std::vector<Uint8> data(3001);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = test_rand();
+    size_t offset = data.size();
+    data.insert(data.end(), stream.begin(), stream.end());
+    for (int i = 0; i < 2003; i++)
+        data.push_back(test_rand());
+
+    int failures = 0;
+    std::vector<util::lz_stream_t> streams;
+
+    util::scan_lz_streams(data.data() + offset + nested_offset, 4 + 8 * 9, streams);
+    if (streams.size() != 1 || streams[0].offset != 0)
+    {
+        dc_log_error("lz_scan_selftest: The nested stream does not validate on its own");
+        failures++;
+    }
+
+    util::scan_lz_streams(data.data(), data.size(), streams);
+    bool found = false;
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        if (streams[i].offset != offset)
+            continue;
+        found = streams[i].method == 0x10 && streams[i].compressed_size == stream.size() && streams[i].decompressed_size == plain.size();
+        std::vector<Uint8> in(data.begin() + offset, data.begin() + offset + streams[i].compressed_size), out;
+        found = found && util::decompress_lz(in, out) && out == plain;
+    }
+    if (!found)
+    {
+        dc_log_error("lz_scan_selftest: The embedded stream at 0x%zX was not found", offset);
+        for (size_t i = 0; i < streams.size(); i++)
+            dc_log_error("lz_scan_selftest: Found 0x%08X %u -> %u bytes", streams[i].offset, streams[i].compressed_size, streams[i].decompressed_size);
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+
+    dc_log("lz_scan_selftest: Passed");
+    return 0;
+}
+
+static int command_lz_scan(const int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        dc_log("Usage: %s <physfs path> [min_size]", argv[0]);
+        return 1;
+    }
+
+    Uint32 min_size = argc > 2 ? strtoul(argv[2], NULL, 0) : 64;
+
+    PHYSFS_File* fd = PHYSFS_openRead(argv[1]);
+    if (!fd)
+    {
+        dc_log_error("Unable to open %s: %s", argv[1], PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    }
+
+    std::vector<Uint8> data;
+    PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+    bool success = len >= 0 && len <= SDL_MAX_SINT32;
+    if (success)
+    {
+        data.resize(len);
+        success = PHYSFS_readBytes(fd, data.data(), len) == len;
+    }
+    PHYSFS_close(fd);
+
+    if (!success)
+    {
+        dc_log_error("Unable to read %s", argv[1]);
+        return 1;
+    }
+
+    std::vector<util::lz_stream_t> streams;
+    Uint64 start = SDL_GetPerformanceCounter();
+    util::scan_lz_streams(data.data(), data.size(), streams, min_size);
+    Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+    for (size_t i = 0; i < streams.size(); i++)
+        dc_log("0x%08X %s %u -> %u bytes", streams[i].offset, streams[i].method == 0x10 ? "LZ10" : "LZ11", streams[i].compressed_size, streams[i].decompressed_size);
+
+    dc_log("Found %zu streams in %zu bytes in %.1f ms", streams.size(), data.size(), elapsed * 1000.0 / SDL_GetPerformanceFrequency());
+
+    return 0;
+}
+
+void util::lz_scan_init()
+{
+    dev_console::add_command("lz_scan", command_lz_scan);
+    dev_console::add_command("lz_scan_selftest", command_lz_scan_selftest);
+}
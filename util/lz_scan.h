@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_LZ_SCAN_H
+#define MPH_TETRA_UTIL_LZ_SCAN_H
+#include <SDL_bits.h>
+#include <stddef.h>
+#include <vector>
+
+namespace util
+{
+struct lz_stream_t
+{
+    Uint32 offset;
+    /**
+     * 0x10 (LZ10) or 0x11 (LZ11)
+     */
+    Uint8 method;
+    /**
+     * Bytes from offset up to and including the last token, the header included
+     */
+    Uint32 compressed_size;
+    Uint32 decompressed_size;
+};
+
+/**
+ * Finds LZ10/LZ11 streams at arbitrary offsets in a binary
+ *
+ * Every offset holding a 0x10/0x11 magic is checked by walking the token stream without producing output, only the
+ * output position is tracked so back references can be checked against it. A candidate is valid if it reaches exactly its
+ * header's size without running off the end of the data. Overlapping candidates are resolved by keeping as many
+ * non-overlapping streams as possible, then letting longer candidates replace the kept streams nested inside them.
+ *
+ * The data is split into regions that are scanned on the job threads.
+ *
+ * Streams are accepted by util::decompress_lz() when passed the bytes [offset, offset + compressed_size)
+ *
+ * @param data Data to scan
+ * @param len Length of data
+ * @param streams Found streams in offset order, WARNING: this is cleared at the beginning of the function
+ * @param min_size Smallest decompressed size to consider, small sizes match noise very easily
+ */
+void scan_lz_streams(const Uint8* data, size_t len, std::vector<lz_stream_t>& streams, Uint32 min_size = 64);
+
+/**
+ * Registers the lz_scan and lz_scan_selftest commands
+ */
+void lz_scan_init();
+}
+#endif
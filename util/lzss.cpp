@@ -26,6 +26,8 @@
  */
 
 #include "lzss.h"
+#include "binary_layout.h"
+#include "profiler.h"
 
 #include <SDL_bits.h>
 #include <SDL_endian.h>
@@ -33,24 +35,39 @@
 
 /**
  * Leaving this on until I am confident I didn't break anything - Ian (2024-11-06)
+ *
+ * Off now that rom_diff decompresses from job threads, the console is main thread only
  */
-#if 1
+#if 0
 #include "gui/console.h"
 #define TRACE(fmt, ...) dc_log_trace(fmt, ##__VA_ARGS__)
 #else
-#define TRACE(fmt, ...) (0)
+#include <stdio.h>
+/* Still type checks the arguments (And keeps them "used") */
+#define TRACE(fmt, ...)                      \
+    do                                       \
+    {                                        \
+        if (0)                               \
+            printf(fmt "\n", ##__VA_ARGS__); \
+    } while (0)
 #endif
 
+static profiler_zone_t zone_lz10("util::decompress_lz (LZ10)");
+static profiler_zone_t zone_lz11("util::decompress_lz (LZ11)");
+static profiler_zone_t zone_lz_overlay("util::decompress_lz (Overlay)");
+
 #define next(it) (_in[iter++])
 #define bail_if_next_next_is_unsafe() \
     do                                \
     {                                 \
-        if (iter > _in.size())        \
+        if (iter >= _in.size())       \
             goto end;                 \
     } while (0)
 
 static bool decompress_lz10(const std::vector<Uint8>& _in, Uint32 offset, Uint32 decompressed_size, std::vector<Uint8>& _out, bool is_overlay)
 {
+    PROFILER_SCOPE(zone_lz10);
+
     _out.clear();
     _out.reserve(decompressed_size);
 
@@ -80,7 +97,12 @@ static bool decompress_lz10(const std::vector<Uint8>& _in, Uint32 offset, Uint32
                 Uint32 disp = (sh & 0xfff) + disp_extra;
 
                 for (Uint32 i = 0; i < count; i++)
-                    _out.push_back(_out[_out.size() - disp]);
+                {
+                    size_t pos = _out.size() - disp;
+                    if (pos > _out.size())
+                        goto end;
+                    _out.push_back(_out[pos]);
+                }
             }
             if (decompressed_size <= _out.size())
                 goto end;
@@ -98,6 +120,8 @@ static bool decompress_lz11(const std::vector<Uint8>& _in, Uint32 offset, Uint32
     if (is_overlay)
         return false;
 
+    PROFILER_SCOPE(zone_lz11);
+
     _out.clear();
     _out.reserve(decompressed_size);
 
@@ -106,11 +130,13 @@ static bool decompress_lz11(const std::vector<Uint8>& _in, Uint32 offset, Uint32
     while (_out.size() < decompressed_size)
     {
         bail_if_next_next_is_unsafe();
-        Uint8 b = next(it);
+        /* Separate from b, lzss3.py unpacks the flags before b gets reused for the tokens */
+        Uint8 flags = next(it);
+        Uint8 b;
 
         for (int i = 7; i >= 0; i--)
         {
-            bool flag = (b >> i) & 1;
+            bool flag = (flags >> i) & 1;
             if (!flag)
             {
                 bail_if_next_next_is_unsafe();
@@ -172,7 +198,7 @@ end:
     if (_out.size() != decompressed_size)
         return false;
 
-    return false;
+    return true;
 }
 
 static bool decompress_lz_normal(const std::vector<Uint8>& _in, std::vector<Uint8>& _out)
@@ -197,19 +223,18 @@ static bool decompress_lz_normal(const std::vector<Uint8>& _in, std::vector<Uint
         break;
     }
 
-    int decompressed_size = 0;
+    Uint32 decompressed_size = 0;
     {
-        char header[4];
-        memcpy(header, _in.data() + 1, 3);
-        header[3] = 0;
+        Uint32 header = 0;
+        memcpy(&header, _in.data() + 1, 3);
 
-        decompressed_size = SDL_SwapLE16(*(Uint32*)header);
+        decompressed_size = SDL_SwapLE32(header);
     }
 
     {
         size_t in_size = _in.size();
         float increase = ((float)decompressed_size * 100.0) / ((float)in_size);
-        TRACE("Size: %zu->%d bytes (%.2f%%)", _in.size(), decompressed_size, increase);
+        TRACE("Size: %zu->%u bytes (%.2f%%)", _in.size(), decompressed_size, increase);
     }
 
     return algorithm(_in, 4, decompressed_size, _out, 0);
@@ -219,21 +244,18 @@ struct overlay_compression_header_t
 {
     Uint32 end_delta;
     Uint32 start_delta;
-
-    overlay_compression_header_t endian_correct()
-    {
-        overlay_compression_header_t temp;
-        temp.end_delta = SDL_SwapLE32(end_delta);
-        temp.start_delta = SDL_SwapLE32(start_delta);
-        return temp;
-    }
 };
+typedef util::binary_layout_t<overlay_compression_header_t, BINARY_FIELD_LE(overlay_compression_header_t, end_delta),
+    BINARY_FIELD_LE(overlay_compression_header_t, start_delta)>
+    overlay_compression_header_layout_t;
 
 /**
  * It is very possible that this function is too paranoid in its checks - Ian (2024-11-06)
  */
 static bool decompress_lz_overlay(const std::vector<Uint8>& _in, std::vector<Uint8>& _out)
 {
+    PROFILER_SCOPE(zone_lz_overlay);
+
     _out.clear();
 
     if (_in.size() > UINT32_MAX)
@@ -247,7 +269,9 @@ static bool decompress_lz_overlay(const std::vector<Uint8>& _in, std::vector<Uin
     // # the compression header is at the end of the file
     pos -= 8;
 
-    overlay_compression_header_t header = ((overlay_compression_header_t*)(&_in.data()[pos]))->endian_correct();
+    overlay_compression_header_t header;
+    if (!overlay_compression_header_layout_t::read(_in.data(), _in.size(), pos, header))
+        return false;
 
     // # decompression goes backwards.
     // # end < here < start
@@ -268,6 +292,11 @@ static bool decompress_lz_overlay(const std::vector<Uint8>& _in, std::vector<Uin
         return false;
     pos = filelen - header.end_delta;
 
+    /* A token is at most 2 bytes plus a flag bit for 18 bytes out, anything claiming more is not an overlay footer (And
+     * would otherwise reserve up to 4 GiB) */
+    if (Uint64(decompressed_size) > Uint64(header.end_delta) * 9 || decompressed_size < header.end_delta)
+        return false;
+
     std::vector<Uint8> flipped_data;
 
     if (header.end_delta < padding)
@@ -25,22 +25,6 @@
 
 #include "gui/imgui.h"
 
-#include <SDL_endian.h>
-
-#define __ASSERT_Swap(func, type, x)                                     \
-    do                                                                   \
-    {                                                                    \
-        static_assert(sizeof(x) == sizeof(type), "Field size mismatch"); \
-        x = func(x);                                                     \
-    } while (0)
-
-#define ASSERT_SwapLE16(x) __ASSERT_Swap(SDL_SwapLE16, Uint16, x)
-#define ASSERT_SwapLE32(x) __ASSERT_Swap(SDL_SwapLE32, Uint32, x)
-#define ASSERT_SwapLE64(x) __ASSERT_Swap(SDL_SwapLE64, Uint64, x)
-#define ASSERT_SwapBE16(x) __ASSERT_Swap(SDL_SwapBE16, Uint16, x)
-#define ASSERT_SwapBE32(x) __ASSERT_Swap(SDL_SwapBE32, Uint32, x)
-#define ASSERT_SwapBE64(x) __ASSERT_Swap(SDL_SwapBE64, Uint64, x)
-
 namespace util
 {
 /**
@@ -21,6 +21,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 #include "nds.h"
+#include "binary_layout.h"
 #include "misc.h"
 #include <stdio.h>
 
@@ -53,57 +54,31 @@ static const rom_data roms_release[] = {
  */
 static const rom_data roms_first_hunt[] = { { "AMFE", 0 }, { "AMFP", 0 } };
 
+typedef util::binary_layout_t<nds_cartridge_header_t,
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm9_rom_offset), BINARY_FIELD_LE(nds_cartridge_header_t, arm9_address_entry),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm9_address_ram), BINARY_FIELD_LE(nds_cartridge_header_t, arm9_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm7_rom_offset), BINARY_FIELD_LE(nds_cartridge_header_t, arm7_address_entry),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm7_address_ram), BINARY_FIELD_LE(nds_cartridge_header_t, arm7_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, file_name_table_offset), BINARY_FIELD_LE(nds_cartridge_header_t, file_name_table_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, file_allocation_table_offset), BINARY_FIELD_LE(nds_cartridge_header_t, file_allocation_table_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm9_overlay_offset), BINARY_FIELD_LE(nds_cartridge_header_t, arm9_overlay_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm7_overlay_offset), BINARY_FIELD_LE(nds_cartridge_header_t, arm7_overlay_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, port_40001A4_setting_normal), BINARY_FIELD_LE(nds_cartridge_header_t, port_40001A4_setting_key1),
+    BINARY_FIELD_LE(nds_cartridge_header_t, icon_title_offset), BINARY_FIELD_LE(nds_cartridge_header_t, secure_area_crc16),
+    BINARY_FIELD_LE(nds_cartridge_header_t, secure_area_delay), BINARY_FIELD_LE(nds_cartridge_header_t, arm9_auto_load_list_hook_address_ram),
+    BINARY_FIELD_LE(nds_cartridge_header_t, arm7_auto_load_list_hook_address_ram), BINARY_FIELD_LE(nds_cartridge_header_t, secure_area_disable),
+    BINARY_FIELD_LE(nds_cartridge_header_t, rom_size_total_used), BINARY_FIELD_LE(nds_cartridge_header_t, rom_size_header),
+    BINARY_FIELD_LE(nds_cartridge_header_t, unknown), BINARY_FIELD_LE(nds_cartridge_header_t, nand_end_of_rom_area),
+    BINARY_FIELD_LE(nds_cartridge_header_t, nand_start_of_rw_area), BINARY_FIELD_LE(nds_cartridge_header_t, header_crc16),
+    BINARY_FIELD_LE(nds_cartridge_header_t, debug_rom_offset), BINARY_FIELD_LE(nds_cartridge_header_t, debug_size),
+    BINARY_FIELD_LE(nds_cartridge_header_t, debug_ram_address)>
+    nds_cartridge_header_layout_t;
+static_assert(sizeof(nds_cartridge_header_t) == NDS_CARTRIDGE_HEADER_SIZE, "nds_cartridge_header_t size incorrect");
+
 nds_cartridge_header_t::nds_cartridge_header_t(char raw_data[NDS_CARTRIDGE_HEADER_SIZE])
 {
     memcpy(this, raw_data, NDS_CARTRIDGE_HEADER_SIZE);
-
-    ASSERT_SwapLE32(arm9_rom_offset);
-    ASSERT_SwapLE32(arm9_address_entry);
-    ASSERT_SwapLE32(arm9_address_ram);
-    ASSERT_SwapLE32(arm9_size);
-
-    ASSERT_SwapLE32(arm7_rom_offset);
-    ASSERT_SwapLE32(arm7_address_entry);
-    ASSERT_SwapLE32(arm7_address_ram);
-    ASSERT_SwapLE32(arm7_size);
-
-    ASSERT_SwapLE32(file_name_table_offset);
-    ASSERT_SwapLE32(file_name_table_size);
-    ASSERT_SwapLE32(file_allocation_table_offset);
-    ASSERT_SwapLE32(file_allocation_table_size);
-
-    ASSERT_SwapLE32(arm9_overlay_offset);
-    ASSERT_SwapLE32(arm9_overlay_size);
-
-    ASSERT_SwapLE32(arm7_overlay_offset);
-    ASSERT_SwapLE32(arm7_overlay_size);
-
-    ASSERT_SwapLE32(port_40001A4_setting_normal);
-    ASSERT_SwapLE32(port_40001A4_setting_key1);
-
-    ASSERT_SwapLE32(icon_title_offset);
-
-    ASSERT_SwapLE16(secure_area_crc16);
-    ASSERT_SwapLE16(secure_area_delay);
-
-    ASSERT_SwapLE32(arm9_auto_load_list_hook_address_ram);
-    ASSERT_SwapLE32(arm7_auto_load_list_hook_address_ram);
-
-    ASSERT_SwapLE64(secure_area_disable);
-
-    ASSERT_SwapLE32(rom_size_total_used);
-    ASSERT_SwapLE32(rom_size_header);
-
-    ASSERT_SwapLE32(unknown);
-
-    ASSERT_SwapLE16(nand_end_of_rom_area);
-    ASSERT_SwapLE16(nand_start_of_rw_area);
-
-    ASSERT_SwapLE16(header_crc16);
-
-    ASSERT_SwapLE32(debug_rom_offset);
-    ASSERT_SwapLE32(debug_size);
-    ASSERT_SwapLE32(debug_ram_address);
+    nds_cartridge_header_layout_t::correct(*this);
 }
 
 std::string nds_cartridge_header_t::get_friendly_game_name()
@@ -50,9 +50,16 @@
  * found here: https://problemkaputt.de/gbatek.htm
  */
 
+#include "io_trace.h"
+
+#include "util/binary_layout.h"
 #include "util/misc.h"
 #include "util/nds.h"
 
+#include <ctype.h>
+#include <string>
+#include <unordered_map>
+
 /* vector **must** be included before physfs_internal.h otherwise things break */
 #include <vector>
 
@@ -63,18 +70,9 @@ struct fat_entry_t
 {
     Uint32 start;
     Uint32 end;
-
-    /**
-     * Returns an endian corrected version of the struct
-     */
-    fat_entry_t endian_correct()
-    {
-        fat_entry_t temp;
-        temp.start = PHYSFS_swapULE32(start);
-        temp.end = PHYSFS_swapULE32(end);
-        return temp;
-    }
 };
+typedef util::binary_layout_t<fat_entry_t, BINARY_FIELD_LE(fat_entry_t, start), BINARY_FIELD_LE(fat_entry_t, end)> fat_entry_layout_t;
+typedef util::binary_table_t<fat_entry_layout_t> fat_table_t;
 
 struct fnt_entry_main_t
 {
@@ -101,19 +99,11 @@ struct fnt_entry_main_t
          */
         Uint16 parent_id;
     };
-
-    /**
-     * Returns an endian corrected version of the struct
-     */
-    fnt_entry_main_t endian_correct()
-    {
-        fnt_entry_main_t temp;
-        temp.sub_entry_offset = PHYSFS_swapULE32(sub_entry_offset);
-        temp.first_fat_entry_id = PHYSFS_swapULE16(first_fat_entry_id);
-        temp.parent_id = PHYSFS_swapULE16(parent_id);
-        return temp;
-    }
 };
+typedef util::binary_layout_t<fnt_entry_main_t, BINARY_FIELD_LE(fnt_entry_main_t, sub_entry_offset), BINARY_FIELD_LE(fnt_entry_main_t, first_fat_entry_id),
+    BINARY_FIELD_LE(fnt_entry_main_t, parent_id)>
+    fnt_entry_main_layout_t;
+typedef util::binary_table_t<fnt_entry_main_layout_t> fnt_main_table_t;
 
 /**
  * This doesn't map well to a struct because name is variable length and...
@@ -152,29 +142,20 @@ struct overlay_table_entry_t
     Uint32 static_initializer_address_end;
     Uint32 fat_file_id;
     Uint32 reserved;
-
-    /**
-     * Returns an endian corrected version of the struct
-     */
-    overlay_table_entry_t endian_correct()
-    {
-        overlay_table_entry_t temp;
-        temp.overlay_id = PHYSFS_swapULE32(overlay_id);
-        temp.ram_address = PHYSFS_swapULE32(ram_address);
-        temp.ram_size = PHYSFS_swapULE32(ram_size);
-        temp.bss_size = PHYSFS_swapULE32(bss_size);
-        temp.static_initializer_address_start = PHYSFS_swapULE32(static_initializer_address_start);
-        temp.static_initializer_address_end = PHYSFS_swapULE32(static_initializer_address_end);
-        temp.fat_file_id = PHYSFS_swapULE32(fat_file_id);
-        temp.reserved = PHYSFS_swapULE32(reserved);
-        return temp;
-    }
 };
+typedef util::binary_layout_t<overlay_table_entry_t, BINARY_FIELD_LE(overlay_table_entry_t, overlay_id), BINARY_FIELD_LE(overlay_table_entry_t, ram_address),
+    BINARY_FIELD_LE(overlay_table_entry_t, ram_size), BINARY_FIELD_LE(overlay_table_entry_t, bss_size),
+    BINARY_FIELD_LE(overlay_table_entry_t, static_initializer_address_start), BINARY_FIELD_LE(overlay_table_entry_t, static_initializer_address_end),
+    BINARY_FIELD_LE(overlay_table_entry_t, fat_file_id), BINARY_FIELD_LE(overlay_table_entry_t, reserved)>
+    overlay_table_entry_layout_t;
+static_assert(sizeof(overlay_table_entry_t) == 32, "overlay_table_entry_t size incorrect");
 
 /**
  * Parse a NitroROM file name table entry
  *
- * @param current Pointer to pointer of current fnt entry, functions sets it to NULL if there are no more entries
+ * @param current Offset of the current fnt entry in fnt, advanced past the entry on success
+ * @param fnt Start of the file name table
+ * @param fnt_size Size of the file name table
  * @param is_dir Set to true if the entry defines a sub directory
  * @param name A null terminated string of no greater than 128 bytes including terminator will be written to this field
  * @param name_len Length of data written to name
@@ -182,47 +163,93 @@ struct overlay_table_entry_t
  *
  * @returns true on successful parse, and false if there are no more entries or on error
  */
-static bool fnt_entry_subtable_parse(fnt_entry_sub_t** current, bool& is_dir, char* name, int& name_len, int& sub_dir_id)
+static bool fnt_entry_subtable_parse(size_t& current, const Uint8* fnt, size_t fnt_size, bool& is_dir, char* name, int& name_len, int& sub_dir_id)
 {
-    if (!current || !(*current))
+    if (current >= fnt_size)
         return false;
-    fnt_entry_sub_t* temp = *current;
+    const fnt_entry_sub_t* temp = (const fnt_entry_sub_t*)(fnt + current);
 
     name_len = temp->type & fnt_entry_sub_t::LEN_MASK;
 
     if ((name_len & fnt_entry_sub_t::LEN_MASK) == 0)
-    {
-        *current = NULL;
         return false;
-    }
 
     is_dir = temp->type & fnt_entry_sub_t::IS_DIR_MASK;
+
+    size_t entry_len = 1 + name_len + is_dir * sizeof(Uint16);
+    if (fnt_size - current < entry_len)
+        return false;
+
     memcpy(name, temp->name, name_len);
     name[name_len] = '\0';
 
     if (is_dir)
-        sub_dir_id = PHYSFS_swapULE16((*(Uint16*)(temp + name_len + 1))) - 0xF000;
+        sub_dir_id = (fnt[current + 1 + name_len] | (fnt[current + 2 + name_len] << 8)) - 0xF000;
     else
         sub_dir_id = 0;
 
-    temp = temp + name_len + 1 + is_dir * sizeof(Uint16);
-    *current = temp;
+    current += entry_len;
     return true;
 }
 
+/**
+ * Opaque handed to PhysFS, the unpacked archive plus what the I/O tracer needs to know about it
+ */
+struct nds_archive_t
+{
+    void* unpk;
+    /** Name PhysFS knows the archive by */
+    std::string name;
+    /**
+     * Position and size of every file, keyed by lowercase path (The unpacked archive is case insensitive)
+     *
+     * UNPKentry has the same information, but its layout is private to physfs_archiver_unpacked.c
+     */
+    std::unordered_map<std::string, std::pair<PHYSFS_uint64, PHYSFS_uint64>> extents;
+};
+
+static std::string NDS_extent_key(const char* name)
+{
+    std::string key(name);
+    for (char& c : key)
+        c = tolower((unsigned char)c);
+    return key;
+}
+
+/**
+ * UNPK_addEntry() that also records the extent of files
+ *
+ * @returns whatever UNPK_addEntry would return
+ */
+static void* NDS_add_entry(nds_archive_t* arc, char* name, const int isdir, const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+{
+    void* entry = UNPK_addEntry(arc->unpk, name, isdir, -1, -1, pos, len);
+    if (entry && !isdir)
+        arc->extents[NDS_extent_key(name)] = std::make_pair(pos, len);
+    return entry;
+}
+
 /**
  * Parse and when necessary recurse through a NitroROM and add files
  *
+ * @param dir_id Index of the fnt_entry_main_t to parse
+ * @param visited One flag per directory the root entry says there are, a directory may only be parsed once
+ *
  * @returns non-zero on success, zero on error
  */
-static int recurse_dir_table(
-    PHYSFS_Io* io, void* arc, const char* parent, fnt_entry_main_t* _current_entry, char* start_of_fnt, fat_entry_t* start_of_fat, int max_fat_entries)
+static int recurse_dir_table(PHYSFS_Io* io, nds_archive_t* arc, const char* parent, int dir_id, const Uint8* fnt, size_t fnt_size, const fat_table_t& fat,
+    std::vector<bool>& visited)
 {
-    BAIL_IF_ERRPASS(max_fat_entries < 1, 0);
+    BAIL_IF_ERRPASS(fat.size() < 1, 0);
+
+    /* A sub_dir_id pointing back up the tree would otherwise recurse until the stack runs out */
+    BAIL_IF(dir_id < 0 || size_t(dir_id) >= visited.size() || visited[dir_id], PHYSFS_ERR_CORRUPT, 0);
+    visited[dir_id] = true;
 
-    fnt_entry_main_t current_entry = _current_entry->endian_correct();
+    fnt_entry_main_t current_entry;
+    BAIL_IF(!fnt_main_table_t(fnt, fnt_size, 0).get(dir_id, current_entry), PHYSFS_ERR_CORRUPT, 0);
 
-    fnt_entry_sub_t* next = (fnt_entry_sub_t*)start_of_fnt + current_entry.sub_entry_offset;
+    size_t next = current_entry.sub_entry_offset;
 
     size_t parent_len = strlen(parent);
     std::vector<char> name_buf;
@@ -237,20 +264,18 @@ static int recurse_dir_table(
     bool is_dir;
     int name_len;
     int sub_dir_id;
-    while (fnt_entry_subtable_parse(&next, is_dir, &name[parent_len], name_len, sub_dir_id))
+    while (fnt_entry_subtable_parse(next, fnt, fnt_size, is_dir, &name[parent_len], name_len, sub_dir_id))
     {
         if (is_dir)
         {
-            BAIL_IF_ERRPASS(!UNPK_addEntry(arc, name, 1, -1, -1, 0, 0), 0);
-            fnt_entry_main_t* next_dir_table = &((fnt_entry_main_t*)start_of_fnt)[sub_dir_id];
-            BAIL_IF_ERRPASS(!recurse_dir_table(io, arc, name, next_dir_table, start_of_fnt, start_of_fat, max_fat_entries), 0);
+            BAIL_IF_ERRPASS(!NDS_add_entry(arc, name, 1, 0, 0), 0);
+            BAIL_IF_ERRPASS(!recurse_dir_table(io, arc, name, sub_dir_id, fnt, fnt_size, fat, visited), 0);
         }
         else
         {
-            BAIL_IF_ERRPASS(max_fat_entries <= file_id, 0);
-            fat_entry_t fat_entry = start_of_fat[file_id];
-            fat_entry.endian_correct();
-            BAIL_IF_ERRPASS(!UNPK_addEntry(arc, name, 0, -1, -1, fat_entry.start, fat_entry.end - fat_entry.start), 0);
+            fat_entry_t fat_entry;
+            BAIL_IF(!fat.get(file_id, fat_entry), PHYSFS_ERR_CORRUPT, 0);
+            BAIL_IF_ERRPASS(!NDS_add_entry(arc, name, 0, fat_entry.start, fat_entry.end - fat_entry.start), 0);
             file_id++;
         }
     }
@@ -276,16 +301,16 @@ int read_to_buffer(PHYSFS_Io* io, std::vector<char>& buf, Uint32 offset, Uint32
 /**
  * Manually add an entry
  *
- * Wrapper around UNPK_addEntry() to allow for name to be const
+ * Wrapper around NDS_add_entry() to allow for name to be const
  *
  * @returns whatever UNPK_addEntry would return
  */
-static void* NDS_add_entry_manual(void* opaque, const char* name, const int isdir, const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+static void* NDS_add_entry_manual(nds_archive_t* arc, const char* name, const int isdir, const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
 {
     std::vector<char> buf;
     buf.resize(strlen(name) + 1);
     strncpy(buf.data(), name, buf.size());
-    return UNPK_addEntry(opaque, buf.data(), isdir, -1, -1, pos, len);
+    return NDS_add_entry(arc, buf.data(), isdir, pos, len);
 }
 
 #define ADD_FILE(name, offset, size) BAIL_IF_ERRPASS(!NDS_add_entry_manual(arc, name, 0, offset, size), 0)
@@ -296,7 +321,7 @@ static void* NDS_add_entry_manual(void* opaque, const char* name, const int isdi
  * OVT Table: "bin/%prefix%_ovt.bin"
  * Overlays: "bin/%prefix%_overlays/overlay_%overlay_id%"
  */
-static int NDS_load_overlay_table(PHYSFS_Io* io, void* arc, Uint32 offset, Uint32 size, const char* prefix, fat_entry_t* start_of_fat, Uint32 max_fat_entries)
+static int NDS_load_overlay_table(PHYSFS_Io* io, nds_archive_t* arc, Uint32 offset, Uint32 size, const char* prefix, const fat_table_t& fat)
 {
     if (offset && size)
     {
@@ -305,21 +330,21 @@ static int NDS_load_overlay_table(PHYSFS_Io* io, void* arc, Uint32 offset, Uint3
         std::string ovt_entry_pre = ovt_prefix + "_overlays/overlay_";
 
         ADD_FILE(ovt_name_file.c_str(), offset, size);
-        if (size % 32 == 0)
+        if (size % sizeof(overlay_table_entry_t) == 0)
         {
             std::vector<char> overlay_data;
             BAIL_IF_ERRPASS(!read_to_buffer(io, overlay_data, offset, size), 0);
 
-            int num_overlays = size / 32;
+            /* Corrected in one pass, free on little endian hosts */
+            std::vector<overlay_table_entry_t> overlays(size / sizeof(overlay_table_entry_t));
+            util::binary_table_t<overlay_table_entry_layout_t> ovt(overlay_data.data(), size, 0);
+            BAIL_IF(!ovt.get_range(0, overlays.size(), overlays.data()), PHYSFS_ERR_CORRUPT, 0);
 
-            overlay_table_entry_t* cur = (overlay_table_entry_t*)overlay_data.data();
-            for (int i = 0; i < num_overlays; i++)
+            for (const overlay_table_entry_t& ovte : overlays)
             {
-                overlay_table_entry_t ovte = cur->endian_correct();
-                BAIL_IF_ERRPASS(max_fat_entries <= ovte.fat_file_id, 0);
-                fat_entry_t fat_entry = start_of_fat[ovte.fat_file_id].endian_correct();
+                fat_entry_t fat_entry;
+                BAIL_IF(!fat.get(ovte.fat_file_id, fat_entry), PHYSFS_ERR_CORRUPT, 0);
                 ADD_FILE((ovt_entry_pre + std::to_string(ovte.overlay_id)).c_str(), fat_entry.start, fat_entry.end - fat_entry.start);
-                cur = &cur[1];
             }
         }
     }
@@ -327,7 +352,7 @@ static int NDS_load_overlay_table(PHYSFS_Io* io, void* arc, Uint32 offset, Uint3
     return 1;
 }
 
-static int NDS_load_entries(PHYSFS_Io* io, const nds_cartridge_header_t header, void* arc)
+static int NDS_load_entries(PHYSFS_Io* io, const nds_cartridge_header_t header, nds_archive_t* arc)
 {
     std::vector<char> fat_buffer;
     std::vector<char> fnt_buffer;
@@ -335,10 +360,7 @@ static int NDS_load_entries(PHYSFS_Io* io, const nds_cartridge_header_t header,
     BAIL_IF_ERRPASS(!read_to_buffer(io, fat_buffer, header.file_allocation_table_offset, header.file_allocation_table_size), 0);
     BAIL_IF_ERRPASS(!read_to_buffer(io, fnt_buffer, header.file_name_table_offset, header.file_name_table_size), 0);
 
-    fat_entry_t* start_of_fat = (fat_entry_t*)fat_buffer.data();
-    fnt_entry_main_t* root_fnt_entry = (fnt_entry_main_t*)fnt_buffer.data();
-
-    int max_fat_entries = header.file_allocation_table_size / sizeof(fat_entry_t);
+    fat_table_t fat(fat_buffer.data(), header.file_allocation_table_size, 0);
 
     ADD_FILE("header", 0, header.rom_size_header);
 
@@ -348,13 +370,17 @@ static int NDS_load_entries(PHYSFS_Io* io, const nds_cartridge_header_t header,
     ADD_FILE("bin/fat.bin", header.file_allocation_table_offset, header.file_allocation_table_size);
     ADD_FILE("bin/fnt.bin", header.file_name_table_offset, header.file_name_table_size);
 
-    BAIL_IF_ERRPASS(!NDS_load_overlay_table(io, arc, header.arm7_overlay_offset, header.arm7_overlay_size, "arm7", start_of_fat, max_fat_entries), 0);
-    BAIL_IF_ERRPASS(!NDS_load_overlay_table(io, arc, header.arm9_overlay_offset, header.arm9_overlay_size, "arm9", start_of_fat, max_fat_entries), 0);
+    BAIL_IF_ERRPASS(!NDS_load_overlay_table(io, arc, header.arm7_overlay_offset, header.arm7_overlay_size, "arm7", fat), 0);
+    BAIL_IF_ERRPASS(!NDS_load_overlay_table(io, arc, header.arm9_overlay_offset, header.arm9_overlay_size, "arm9", fat), 0);
 
     if (header.icon_title_offset)
         ADD_FILE("bin/banner.bin", header.icon_title_offset, 0x840);
 
-    BAIL_IF_ERRPASS(!recurse_dir_table(io, arc, "nitrofs", root_fnt_entry, (char*)root_fnt_entry, start_of_fat, max_fat_entries), 0);
+    const Uint8* fnt = (const Uint8*)fnt_buffer.data();
+    fnt_entry_main_t root_entry;
+    BAIL_IF(!fnt_main_table_t(fnt, header.file_name_table_size, 0).get(0, root_entry), PHYSFS_ERR_CORRUPT, 0);
+    std::vector<bool> visited(root_entry.number_of_dirs);
+    BAIL_IF_ERRPASS(!recurse_dir_table(io, arc, "nitrofs", 0, fnt, header.file_name_table_size, fat, visited), 0);
 
     return 1;
 }
@@ -387,13 +413,58 @@ static void* NDS_open_archive(PHYSFS_Io* io, const char* name, int forWriting, i
     unpkarc = UNPK_openArchive(io, 0, 1);
     BAIL_IF_ERRPASS(!unpkarc, NULL);
 
-    if (!NDS_load_entries(io, header, unpkarc))
+    nds_archive_t* arc = new nds_archive_t;
+    arc->unpk = unpkarc;
+    arc->name = name;
+
+    if (!NDS_load_entries(io, header, arc))
     {
         UNPK_abandonArchive(unpkarc);
+        delete arc;
         return NULL;
     }
 
-    return unpkarc;
+    return arc;
+}
+
+static PHYSFS_EnumerateCallbackResult NDS_enumerate(void* opaque, const char* dirname, PHYSFS_EnumerateCallback cb, const char* origdir, void* callbackdata)
+{
+    return UNPK_enumerate(((nds_archive_t*)opaque)->unpk, dirname, cb, origdir, callbackdata);
+}
+
+/**
+ * UNPK_openRead(), wrapped by the I/O tracer while a trace is running
+ */
+static PHYSFS_Io* NDS_open_read(void* opaque, const char* name)
+{
+    nds_archive_t* arc = (nds_archive_t*)opaque;
+    PHYSFS_Io* io = UNPK_openRead(arc->unpk, name);
+
+    if (!io || !MPH_TETRA_PHYSFS_isTracing())
+        return io;
+
+    std::unordered_map<std::string, std::pair<PHYSFS_uint64, PHYSFS_uint64>>::const_iterator it = arc->extents.find(NDS_extent_key(name));
+    if (it == arc->extents.end())
+        return io;
+
+    return MPH_TETRA_PHYSFS_traceIo(io, arc->name.c_str(), name, it->second.first, it->second.second);
+}
+
+static PHYSFS_Io* NDS_open_write(void* opaque, const char* name) { return UNPK_openWrite(((nds_archive_t*)opaque)->unpk, name); }
+
+static PHYSFS_Io* NDS_open_append(void* opaque, const char* name) { return UNPK_openAppend(((nds_archive_t*)opaque)->unpk, name); }
+
+static int NDS_remove(void* opaque, const char* name) { return UNPK_remove(((nds_archive_t*)opaque)->unpk, name); }
+
+static int NDS_mkdir(void* opaque, const char* name) { return UNPK_mkdir(((nds_archive_t*)opaque)->unpk, name); }
+
+static int NDS_stat(void* opaque, const char* name, PHYSFS_Stat* st) { return UNPK_stat(((nds_archive_t*)opaque)->unpk, name, st); }
+
+static void NDS_close_archive(void* opaque)
+{
+    nds_archive_t* arc = (nds_archive_t*)opaque;
+    UNPK_closeArchive(arc->unpk);
+    delete arc;
 }
 
 PHYSFS_Archiver MPH_TETRA_PHYSFS_Archiver_NDS = {
@@ -406,12 +477,12 @@ PHYSFS_Archiver MPH_TETRA_PHYSFS_Archiver_NDS = {
         0,
     },
     .openArchive = NDS_open_archive,
-    .enumerate = UNPK_enumerate,
-    .openRead = UNPK_openRead,
-    .openWrite = UNPK_openWrite,
-    .openAppend = UNPK_openAppend,
-    .remove = UNPK_remove,
-    .mkdir = UNPK_mkdir,
-    .stat = UNPK_stat,
-    .closeArchive = UNPK_closeArchive
+    .enumerate = NDS_enumerate,
+    .openRead = NDS_open_read,
+    .openWrite = NDS_open_write,
+    .openAppend = NDS_open_append,
+    .remove = NDS_remove,
+    .mkdir = NDS_mkdir,
+    .stat = NDS_stat,
+    .closeArchive = NDS_close_archive
 };
@@ -0,0 +1,405 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "io_trace.h"
+
+#include "gui/console.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <ctype.h>
+#include <set>
+
+#define __PHYSICSFS_INTERNAL__
+#include "physfs_internal.h"
+
+#define TRACE_MANIFEST_DIR "/cache/preload"
+
+/**
+ * A file read during the trace
+ */
+struct access_t
+{
+    std::string archive;
+    std::string path;
+    PHYSFS_uint64 rom_offset;
+    PHYSFS_uint64 size;
+    Uint32 first_read_ms;
+};
+
+/* trace_lock guards everything below it */
+static SDL_mutex* trace_lock = NULL;
+static std::string trace_scene;
+static Uint64 trace_start;
+static std::vector<access_t> trace_accesses;
+/** Keyed by "<archive>\n<path>" */
+static std::set<std::string> trace_lookup;
+
+/**
+ * Bumped when a trace starts or ends, Io's made for another generation do not record anything
+ *
+ * Odd while a trace is running
+ */
+static SDL_atomic_t trace_generation;
+
+struct trace_io_t
+{
+    PHYSFS_Io* io;
+    int generation;
+    std::string archive;
+    std::string path;
+    PHYSFS_uint64 rom_offset;
+    PHYSFS_uint64 size;
+};
+
+static std::string get_manifest_path(const char* scene)
+{
+    std::string path = TRACE_MANIFEST_DIR "/";
+    for (const char* it = scene; *it; it++)
+        path += (isalnum((unsigned char)*it) || *it == '_' || *it == '.' || *it == '-') ? *it : '_';
+    return path + ".txt";
+}
+
+/**
+ * Adds a file to the trace on its first read (If the trace the file was opened under is still running)
+ */
+static void record_read(const trace_io_t* info)
+{
+    SDL_LockMutex(trace_lock);
+    if (SDL_AtomicGet(&trace_generation) == info->generation)
+    {
+        std::string key = info->archive + '\n' + info->path;
+        if (trace_lookup.insert(key).second)
+        {
+            access_t access;
+            access.archive = info->archive;
+            access.path = info->path;
+            access.rom_offset = info->rom_offset;
+            access.size = info->size;
+            access.first_read_ms = Uint32((SDL_GetPerformanceCounter() - trace_start) * 1000 / SDL_GetPerformanceFrequency());
+            trace_accesses.push_back(access);
+        }
+    }
+    SDL_UnlockMutex(trace_lock);
+}
+
+/* ================================ Io ================================ */
+
+static PHYSFS_sint64 trace_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len);
+static PHYSFS_sint64 trace_io_write(PHYSFS_Io* io, const void* buf, PHYSFS_uint64 len);
+static int trace_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset);
+static PHYSFS_sint64 trace_io_tell(PHYSFS_Io* io);
+static PHYSFS_sint64 trace_io_length(PHYSFS_Io* io);
+static PHYSFS_Io* trace_io_duplicate(PHYSFS_Io* io);
+static int trace_io_flush(PHYSFS_Io* io);
+static void trace_io_destroy(PHYSFS_Io* io);
+
+static const PHYSFS_Io trace_io_interface = {
+    .version = 0,
+    .opaque = NULL,
+    .read = trace_io_read,
+    .write = trace_io_write,
+    .seek = trace_io_seek,
+    .tell = trace_io_tell,
+    .length = trace_io_length,
+    .duplicate = trace_io_duplicate,
+    .flush = trace_io_flush,
+    .destroy = trace_io_destroy,
+};
+
+static PHYSFS_Io* trace_io_create(PHYSFS_Io* inner, const trace_io_t& proto)
+{
+    PHYSFS_Io* io = (PHYSFS_Io*)allocator.Malloc(sizeof(PHYSFS_Io));
+    BAIL_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    trace_io_t* info = new trace_io_t(proto);
+    info->io = inner;
+
+    memcpy(io, &trace_io_interface, sizeof(PHYSFS_Io));
+    io->opaque = info;
+    return io;
+}
+
+static PHYSFS_sint64 trace_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    PHYSFS_sint64 retval = info->io->read(info->io, buf, len);
+    if (retval > 0 && SDL_AtomicGet(&trace_generation) == info->generation)
+        record_read(info);
+    return retval;
+}
+
+static PHYSFS_sint64 trace_io_write(PHYSFS_Io* io, const void* buf, PHYSFS_uint64 len)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    return info->io->write(info->io, buf, len);
+}
+
+static int trace_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    return info->io->seek(info->io, offset);
+}
+
+static PHYSFS_sint64 trace_io_tell(PHYSFS_Io* io)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    return info->io->tell(info->io);
+}
+
+static PHYSFS_sint64 trace_io_length(PHYSFS_Io* io)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    return info->io->length(info->io);
+}
+
+static PHYSFS_Io* trace_io_duplicate(PHYSFS_Io* io)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    PHYSFS_Io* inner = info->io->duplicate(info->io);
+    BAIL_IF_ERRPASS(!inner, NULL);
+
+    PHYSFS_Io* retval = trace_io_create(inner, *info);
+    if (!retval)
+        inner->destroy(inner);
+    return retval;
+}
+
+static int trace_io_flush(PHYSFS_Io* io)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    return info->io->flush(info->io);
+}
+
+static void trace_io_destroy(PHYSFS_Io* io)
+{
+    trace_io_t* info = (trace_io_t*)io->opaque;
+    info->io->destroy(info->io);
+    delete info;
+    allocator.Free(io);
+}
+
+/* ================================ Traces ================================ */
+
+void MPH_TETRA_PHYSFS_traceBegin(const char* scene)
+{
+    SDL_LockMutex(trace_lock);
+    trace_scene = scene;
+    trace_start = SDL_GetPerformanceCounter();
+    trace_accesses.clear();
+    trace_lookup.clear();
+    /* Always lands on an odd generation */
+    SDL_AtomicAdd(&trace_generation, (SDL_AtomicGet(&trace_generation) & 1) ? 2 : 1);
+    SDL_UnlockMutex(trace_lock);
+}
+
+int MPH_TETRA_PHYSFS_isTracing() { return SDL_AtomicGet(&trace_generation) & 1; }
+
+PHYSFS_Io* MPH_TETRA_PHYSFS_traceIo(PHYSFS_Io* io, const char* archive, const char* path, PHYSFS_uint64 rom_offset, PHYSFS_uint64 size)
+{
+    trace_io_t proto;
+    proto.io = NULL;
+    proto.generation = SDL_AtomicGet(&trace_generation);
+    proto.archive = archive;
+    proto.path = path;
+    proto.rom_offset = rom_offset;
+    proto.size = size;
+
+    if (!(proto.generation & 1))
+        return io;
+
+    PHYSFS_Io* retval = trace_io_create(io, proto);
+    return retval ? retval : io;
+}
+
+int MPH_TETRA_PHYSFS_traceEnd()
+{
+    std::string scene;
+    std::vector<access_t> accesses;
+
+    SDL_LockMutex(trace_lock);
+    bool was_tracing = MPH_TETRA_PHYSFS_isTracing();
+    if (was_tracing)
+    {
+        SDL_AtomicAdd(&trace_generation, 1);
+        scene.swap(trace_scene);
+        accesses.swap(trace_accesses);
+        trace_lookup.clear();
+    }
+    SDL_UnlockMutex(trace_lock);
+
+    if (!was_tracing)
+        return -1;
+
+    /* Grouping by archive keeps each ROM a single front to back pass */
+    std::sort(accesses.begin(), accesses.end(), [](const access_t& a, const access_t& b) {
+        if (a.archive != b.archive)
+            return a.archive < b.archive;
+        return a.rom_offset < b.rom_offset;
+    });
+
+    std::string manifest;
+    int count = 0;
+    PHYSFS_uint64 total_size = 0;
+    for (const access_t& access : accesses)
+    {
+        /* Archive was unmounted while tracing */
+        const char* mount_point = PHYSFS_getMountPoint(access.archive.c_str());
+        if (!mount_point)
+            continue;
+
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%llu %llu %u ", (unsigned long long)access.rom_offset, (unsigned long long)access.size, access.first_read_ms);
+        manifest += buf;
+        /* PhysFS hands back "a/b/" for a mount at "/a/b" */
+        if (mount_point[0] != '/')
+            manifest += '/';
+        manifest += mount_point;
+        manifest += access.path;
+        manifest += '\n';
+        count++;
+        total_size += access.size;
+    }
+
+    std::string path = get_manifest_path(scene.c_str());
+    if (!PHYSFS_mkdir(TRACE_MANIFEST_DIR))
+        return -1;
+
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+        return -1;
+
+    char header[128];
+    snprintf(header, sizeof(header), "# %d files, %llu bytes\n", count, (unsigned long long)total_size);
+    bool success = PHYSFS_writeBytes(fd, header, strlen(header)) == PHYSFS_sint64(strlen(header))
+        && PHYSFS_writeBytes(fd, manifest.data(), manifest.size()) == PHYSFS_sint64(manifest.size());
+    PHYSFS_close(fd);
+
+    if (!success)
+    {
+        PHYSFS_delete(path.c_str());
+        return -1;
+    }
+
+    return count;
+}
+
+int MPH_TETRA_PHYSFS_loadPreloadManifest(const char* scene, std::vector<MPH_TETRA_PHYSFS_PreloadEntry>& entries)
+{
+    entries.clear();
+
+    PHYSFS_File* fd = PHYSFS_openRead(get_manifest_path(scene).c_str());
+    if (!fd)
+        return 0;
+
+    std::string data;
+    PHYSFS_sint64 length = PHYSFS_fileLength(fd);
+    if (length > 0)
+    {
+        data.resize(size_t(length));
+        if (PHYSFS_readBytes(fd, &data[0], PHYSFS_uint64(length)) != length)
+            data.clear();
+    }
+    PHYSFS_close(fd);
+
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos)
+            end = data.size();
+        std::string line = data.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        unsigned long long rom_offset, size;
+        unsigned int first_read_ms;
+        int path_start = 0;
+        if (sscanf(line.c_str(), "%llu %llu %u %n", &rom_offset, &size, &first_read_ms, &path_start) != 3 || !path_start || line[path_start] != '/')
+            continue;
+
+        MPH_TETRA_PHYSFS_PreloadEntry entry;
+        entry.path = line.substr(size_t(path_start));
+        entry.rom_offset = rom_offset;
+        entry.size = size;
+        entry.first_read_ms = first_read_ms;
+        entries.push_back(entry);
+    }
+
+    return 1;
+}
+
+/* ================================ Commands ================================ */
+
+static std::string get_trace_scene()
+{
+    SDL_LockMutex(trace_lock);
+    std::string scene = trace_scene;
+    SDL_UnlockMutex(trace_lock);
+    return scene;
+}
+
+static int command_io_trace_begin(const int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        dc_log("Usage: %s <scene>", argv[0]);
+        dc_log("Records which files of mounted ROMs are read until io_trace_end, then saves them as the preload manifest of scene");
+        return 1;
+    }
+
+    if (MPH_TETRA_PHYSFS_isTracing())
+        dc_log_warn("Dropping the trace of \"%s\"", get_trace_scene().c_str());
+
+    MPH_TETRA_PHYSFS_traceBegin(argv[1]);
+    dc_log("Tracing \"%s\"", argv[1]);
+    return 0;
+}
+
+static int command_io_trace_end(const int, const char** argv)
+{
+    if (!MPH_TETRA_PHYSFS_isTracing())
+    {
+        dc_log_error("%s: No trace is running", argv[0]);
+        return 1;
+    }
+
+    std::string path = get_manifest_path(get_trace_scene().c_str());
+    int count = MPH_TETRA_PHYSFS_traceEnd();
+    if (count < 0)
+    {
+        dc_log_error("%s: Unable to write %s", argv[0], path.c_str());
+        return 1;
+    }
+
+    dc_log("Wrote %d files to %s", count, path.c_str());
+    return 0;
+}
+
+void MPH_TETRA_PHYSFS_registerTraceCommands()
+{
+    trace_lock = SDL_CreateMutex();
+    dev_console::add_command("io_trace_begin", command_io_trace_begin);
+    dev_console::add_command("io_trace_end", command_io_trace_end);
+}
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_PHYSFS_IO_TRACE_H
+#define MPH_TETRA_UTIL_PHYSFS_IO_TRACE_H
+
+#include "physfs.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Per-scene file access tracing and preload manifests
+ *
+ * While a trace is running, MPH_TETRA_PHYSFS_Archiver_NDS wraps every PHYSFS_Io it opens and records which files get
+ * read, how much of them, and when. Ending the trace writes a manifest to /cache/preload/<scene>.txt in the write
+ * directory with every file that was read, sorted by archive and then by ROM offset. Preloading a scene from that list
+ * (See asset_cache::preload_scene()) walks each ROM front to back instead of hopping around in the order the game
+ * happened to ask for files.
+ *
+ * Manifests are plain text, one "<rom offset> <size> <first read ms> <path>" line per file, so they can be edited by hand.
+ */
+
+/**
+ * A file in a preload manifest
+ */
+struct MPH_TETRA_PHYSFS_PreloadEntry
+{
+    /** PhysFS path, including the mount point of the archive */
+    std::string path;
+    PHYSFS_uint64 rom_offset;
+    PHYSFS_uint64 size;
+    /** Milliseconds between the start of the trace and the first read of the file */
+    PHYSFS_uint32 first_read_ms;
+};
+
+/**
+ * Starts recording file accesses for scene, any trace already running is dropped
+ *
+ * @param scene Name of the scene, characters other than [A-Za-z0-9_.-] are replaced in the manifest name
+ */
+void MPH_TETRA_PHYSFS_traceBegin(const char* scene);
+
+/**
+ * Stops the running trace and writes its manifest
+ *
+ * @returns Number of files in the manifest, or -1 if no trace was running or the manifest could not be written
+ */
+int MPH_TETRA_PHYSFS_traceEnd();
+
+/**
+ * @returns Non-zero while a trace is running
+ */
+int MPH_TETRA_PHYSFS_isTracing();
+
+/**
+ * Wraps io so reads are recorded in the running trace, for archivers to call from openRead
+ *
+ * The wrapper takes ownership of io and stops recording once the trace it was made for ends
+ *
+ * @param io Io of the file
+ * @param archive Name of the archive as passed to openArchive (Used to find the mount point when the trace ends)
+ * @param path Path of the file inside the archive
+ * @param rom_offset Offset of the file in the archive
+ * @param size Size of the file
+ *
+ * @returns The wrapped Io, or io itself if it could not be wrapped
+ */
+PHYSFS_Io* MPH_TETRA_PHYSFS_traceIo(PHYSFS_Io* io, const char* archive, const char* path, PHYSFS_uint64 rom_offset, PHYSFS_uint64 size);
+
+/**
+ * Reads the manifest of a scene
+ *
+ * @param scene Name of the scene, same as the one given to MPH_TETRA_PHYSFS_traceBegin()
+ * @param entries Filled with the files in the manifest, in manifest order
+ *
+ * @returns Non-zero on success, zero if there is no manifest for the scene
+ */
+int MPH_TETRA_PHYSFS_loadPreloadManifest(const char* scene, std::vector<MPH_TETRA_PHYSFS_PreloadEntry>& entries);
+
+/**
+ * Registers the io_trace_begin and io_trace_end commands
+ */
+void MPH_TETRA_PHYSFS_registerTraceCommands();
+
+#endif
@@ -0,0 +1,721 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "nested_mount.h"
+
+#include "gui/console.h"
+#include "util/convar.h"
+#include "util/hash.h"
+
+#include <SDL.h>
+#include <memory>
+#include <string>
+
+/* vector **must** be included before physfs_internal.h otherwise things break */
+#include <vector>
+
+#define __PHYSICSFS_INTERNAL__
+#include "physfs_internal.h"
+
+/* Same inflater the zip archiver uses, some of the helpers in it are unused here */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "physfs-74c3054/src/physfs_miniz.h"
+#pragma GCC diagnostic pop
+
+#define NESTED_INDEX_DIR "/cache/inflate_index"
+#define NESTED_INDEX_MAGIC 0x58444E49
+#define NESTED_INDEX_VERSION 1
+
+#define NESTED_INPUT_BUFFER_SIZE (16 * 1024)
+#define NESTED_DICT_MASK (TINFL_LZ_DICT_SIZE - 1)
+
+#define ZIP_SIG_LOCAL_HEADER 0x04034b50
+#define ZIP_SIG_CENTRAL_DIR 0x02014b50
+#define ZIP_SIG_EOCD 0x06054b50
+#define ZIP_SIG_ZIP64_EOCD 0x06064b50
+#define ZIP_SIG_ZIP64_LOCATOR 0x07064b50
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATE 8
+
+static convar_int_t physfs_nested_checkpoint_kb("physfs_nested_checkpoint_kb", 1024, 64, 16384,
+    "KiB of uncompressed data between inflate checkpoints for nested mounts (Smaller seeks faster, but the index grows by ~43 KiB per checkpoint)");
+
+/**
+ * Everything needed to resume inflating at out_pos
+ *
+ * The window is kept as a ring indexed by output position (out_pos & NESTED_DICT_MASK), which is the layout tinfl
+ * expects for a wrapping output buffer, so the last 32 KiB of output can also be served straight from it.
+ */
+struct checkpoint_t
+{
+    /** Compressed bytes consumed, bits still in the bit buffer are part of decomp */
+    PHYSFS_uint64 in_pos;
+    PHYSFS_uint64 out_pos;
+    tinfl_decompressor decomp;
+    Uint8 dict[TINFL_LZ_DICT_SIZE];
+};
+
+/**
+ * A file in the zip, shared between all duplicates of a member Io
+ */
+struct member_t
+{
+    std::string name;
+    Uint32 crc;
+    bool deflated;
+    /** Offset of the file data in the zip */
+    PHYSFS_uint64 data_offset;
+    PHYSFS_uint64 compressed_size;
+    PHYSFS_uint64 size;
+
+    /** Sorted by out_pos, the first one is the start of the stream */
+    std::vector<checkpoint_t> checkpoints;
+};
+
+struct decoder_t
+{
+    checkpoint_t state;
+    Uint8 input[NESTED_INPUT_BUFFER_SIZE];
+    size_t input_ofs;
+    size_t input_avail;
+};
+
+struct member_io_t
+{
+    std::shared_ptr<const member_t> member;
+    /** The zip, each duplicate has its own */
+    PHYSFS_Io* zip;
+    PHYSFS_uint64 pos;
+    /** Created on first read of a deflated member */
+    decoder_t* decoder;
+};
+
+static inline Uint16 read_le16(const Uint8* p) { return Uint16(p[0] | (p[1] << 8)); }
+static inline Uint32 read_le32(const Uint8* p) { return Uint32(p[0]) | (Uint32(p[1]) << 8) | (Uint32(p[2]) << 16) | (Uint32(p[3]) << 24); }
+static inline PHYSFS_uint64 read_le64(const Uint8* p) { return PHYSFS_uint64(read_le32(p)) | (PHYSFS_uint64(read_le32(p + 4)) << 32); }
+
+/* ================================ Inflater ================================ */
+
+static void decoder_restore(decoder_t& d, const checkpoint_t& checkpoint)
+{
+    d.state = checkpoint;
+    d.input_ofs = 0;
+    d.input_avail = 0;
+}
+
+/**
+ * Runs the inflater once, output lands in d.state.dict at the old out_pos and does not wrap
+ *
+ * @returns Number of bytes produced, or -1 on error
+ */
+static PHYSFS_sint64 decoder_step(const member_t& m, PHYSFS_Io* zip, decoder_t& d)
+{
+    if (!d.input_avail)
+    {
+        PHYSFS_uint64 want = SDL_min(PHYSFS_uint64(sizeof(d.input)), m.compressed_size - d.state.in_pos);
+        if (want)
+        {
+            BAIL_IF_ERRPASS(!zip->seek(zip, m.data_offset + d.state.in_pos), -1);
+            BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, d.input, size_t(want)), -1);
+        }
+        d.input_ofs = 0;
+        d.input_avail = size_t(want);
+    }
+
+    size_t in_size = d.input_avail;
+    size_t dict_ofs = size_t(d.state.out_pos & NESTED_DICT_MASK);
+    size_t out_size = TINFL_LZ_DICT_SIZE - dict_ofs;
+    mz_uint32 flags = d.state.in_pos + in_size < m.compressed_size ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+
+    tinfl_status status
+        = tinfl_decompress(&d.state.decomp, d.input + d.input_ofs, &in_size, d.state.dict, d.state.dict + dict_ofs, &out_size, flags);
+
+    d.input_ofs += in_size;
+    d.input_avail -= in_size;
+    d.state.in_pos += in_size;
+    d.state.out_pos += out_size;
+
+    BAIL_IF(status < TINFL_STATUS_DONE, PHYSFS_ERR_CORRUPT, -1);
+    BAIL_IF(d.state.out_pos > m.size, PHYSFS_ERR_CORRUPT, -1);
+    /* Also stops a truncated stream from spinning forever */
+    BAIL_IF(!in_size && !out_size, PHYSFS_ERR_CORRUPT, -1);
+
+    return PHYSFS_sint64(out_size);
+}
+
+/* ================================ Index ================================ */
+
+static std::string get_index_path(const member_t& m, PHYSFS_uint64 spacing)
+{
+    Uint64 key = util::fnv1a64_str(m.name.c_str());
+    key = util::fnv1a64(&m.crc, sizeof(m.crc), key);
+    key = util::fnv1a64(&m.compressed_size, sizeof(m.compressed_size), key);
+    key = util::fnv1a64(&m.size, sizeof(m.size), key);
+    key = util::fnv1a64(&spacing, sizeof(spacing), key);
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), NESTED_INDEX_DIR "/%016llx.bin", (unsigned long long)key);
+    return buf;
+}
+
+/**
+ * Checkpoints are raw inflater state, so the layout of tinfl_decompressor is part of the format (checkpoint_size)
+ */
+struct index_file_header_t
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 checkpoint_size;
+    Uint32 count;
+    Uint64 hash;
+};
+
+static bool load_index(const std::string& path, member_t& m)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path.c_str());
+    if (!fd)
+        return false;
+
+    index_file_header_t header;
+    bool success = PHYSFS_readBytes(fd, &header, sizeof(header)) == sizeof(header) && header.magic == NESTED_INDEX_MAGIC
+        && header.version == NESTED_INDEX_VERSION && header.checkpoint_size == sizeof(checkpoint_t) && header.count > 0
+        && header.count <= m.size / TINFL_LZ_DICT_SIZE + 1;
+
+    if (success)
+    {
+        m.checkpoints.resize(header.count);
+        PHYSFS_sint64 bytes = PHYSFS_sint64(m.checkpoints.size() * sizeof(checkpoint_t));
+        success = PHYSFS_readBytes(fd, m.checkpoints.data(), bytes) == bytes && util::fnv1a64(m.checkpoints.data(), size_t(bytes)) == header.hash;
+    }
+    PHYSFS_close(fd);
+
+    for (size_t i = 0; success && i < m.checkpoints.size(); i++)
+    {
+        const checkpoint_t& c = m.checkpoints[i];
+        success = c.in_pos <= m.compressed_size && c.out_pos <= m.size && (i == 0 || c.out_pos > m.checkpoints[i - 1].out_pos);
+    }
+
+    if (!success)
+        m.checkpoints.clear();
+    return success;
+}
+
+static void store_index(const std::string& path, const member_t& m)
+{
+    if (!PHYSFS_mkdir(NESTED_INDEX_DIR))
+    {
+        dc_log_warn("Unable to create " NESTED_INDEX_DIR ": %s", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    PHYSFS_File* fd = PHYSFS_openWrite(path.c_str());
+    if (!fd)
+    {
+        dc_log_warn("Unable to open %s for writing: %s", path.c_str(), PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return;
+    }
+
+    size_t bytes = m.checkpoints.size() * sizeof(checkpoint_t);
+    index_file_header_t header = {
+        NESTED_INDEX_MAGIC,
+        NESTED_INDEX_VERSION,
+        Uint32(sizeof(checkpoint_t)),
+        Uint32(m.checkpoints.size()),
+        util::fnv1a64(m.checkpoints.data(), bytes),
+    };
+    bool success = PHYSFS_writeBytes(fd, &header, sizeof(header)) == sizeof(header)
+        && PHYSFS_writeBytes(fd, m.checkpoints.data(), bytes) == PHYSFS_sint64(bytes);
+    PHYSFS_close(fd);
+
+    if (!success)
+        PHYSFS_delete(path.c_str());
+}
+
+/**
+ * Inflates the whole member once, snapshotting the inflater every spacing bytes and checking the CRC
+ */
+static bool build_index(member_t& m, PHYSFS_Io* zip, PHYSFS_uint64 spacing)
+{
+    std::unique_ptr<decoder_t> d(new decoder_t);
+    tinfl_init(&d->state.decomp);
+    d->state.in_pos = 0;
+    d->state.out_pos = 0;
+    d->input_ofs = 0;
+    d->input_avail = 0;
+
+    m.checkpoints.clear();
+    m.checkpoints.push_back(d->state);
+
+    Uint32 crc = 0;
+    PHYSFS_uint64 next_checkpoint = spacing;
+    while (d->state.out_pos < m.size)
+    {
+        PHYSFS_sint64 produced = decoder_step(m, zip, *d);
+        if (produced < 0)
+        {
+            m.checkpoints.clear();
+            return false;
+        }
+
+        crc = util::crc32(d->state.dict + ((d->state.out_pos - produced) & NESTED_DICT_MASK), size_t(produced), crc);
+
+        if (d->state.out_pos >= next_checkpoint && d->state.out_pos < m.size)
+        {
+            m.checkpoints.push_back(d->state);
+            next_checkpoint = d->state.out_pos + spacing;
+        }
+    }
+
+    if (crc != m.crc)
+    {
+        m.checkpoints.clear();
+        BAIL(PHYSFS_ERR_CORRUPT, false);
+    }
+
+    return true;
+}
+
+/* ================================ Io ================================ */
+
+static PHYSFS_sint64 member_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len);
+static PHYSFS_sint64 member_io_write(PHYSFS_Io* io, const void* buf, PHYSFS_uint64 len);
+static int member_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset);
+static PHYSFS_sint64 member_io_tell(PHYSFS_Io* io);
+static PHYSFS_sint64 member_io_length(PHYSFS_Io* io);
+static PHYSFS_Io* member_io_duplicate(PHYSFS_Io* io);
+static int member_io_flush(PHYSFS_Io* io);
+static void member_io_destroy(PHYSFS_Io* io);
+
+static const PHYSFS_Io member_io_interface = {
+    .version = 0,
+    .opaque = NULL,
+    .read = member_io_read,
+    .write = member_io_write,
+    .seek = member_io_seek,
+    .tell = member_io_tell,
+    .length = member_io_length,
+    .duplicate = member_io_duplicate,
+    .flush = member_io_flush,
+    .destroy = member_io_destroy,
+};
+
+static PHYSFS_Io* member_io_create(PHYSFS_Io* zip, const std::shared_ptr<const member_t>& member)
+{
+    PHYSFS_Io* io = (PHYSFS_Io*)allocator.Malloc(sizeof(PHYSFS_Io));
+    BAIL_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    member_io_t* info = new member_io_t;
+    info->member = member;
+    info->zip = zip;
+    info->pos = 0;
+    info->decoder = NULL;
+
+    memcpy(io, &member_io_interface, sizeof(PHYSFS_Io));
+    io->opaque = info;
+    return io;
+}
+
+/**
+ * Serves a read from the window or inflates forward to it, resuming from the closest checkpoint when the target is
+ * behind the window or when a checkpoint is closer than the current inflater position
+ */
+static PHYSFS_sint64 member_io_read_deflated(member_io_t* info, Uint8* out, PHYSFS_uint64 len)
+{
+    const member_t& m = *info->member;
+
+    if (!info->decoder)
+    {
+        info->decoder = new decoder_t;
+        decoder_restore(*info->decoder, m.checkpoints[0]);
+    }
+    decoder_t& d = *info->decoder;
+
+    PHYSFS_uint64 done = 0;
+    while (done < len)
+    {
+        PHYSFS_uint64 pos = info->pos;
+        if (pos < d.state.out_pos && d.state.out_pos - pos <= TINFL_LZ_DICT_SIZE)
+        {
+            size_t dict_ofs = size_t(pos & NESTED_DICT_MASK);
+            PHYSFS_uint64 avail = SDL_min(d.state.out_pos - pos, PHYSFS_uint64(TINFL_LZ_DICT_SIZE - dict_ofs));
+            size_t count = size_t(SDL_min(avail, len - done));
+            memcpy(out + done, d.state.dict + dict_ofs, count);
+            done += count;
+            info->pos += count;
+            continue;
+        }
+
+        /* Last checkpoint at or before pos */
+        size_t lo = 0, hi = m.checkpoints.size();
+        while (hi - lo > 1)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (m.checkpoints[mid].out_pos <= pos)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        const checkpoint_t& checkpoint = m.checkpoints[lo];
+        if (pos < d.state.out_pos || checkpoint.out_pos > d.state.out_pos)
+            decoder_restore(d, checkpoint);
+
+        if (decoder_step(m, info->zip, d) < 0)
+        {
+            /* The inflater state is unknown after an error */
+            decoder_restore(d, m.checkpoints[0]);
+            return done ? PHYSFS_sint64(done) : -1;
+        }
+    }
+
+    return PHYSFS_sint64(done);
+}
+
+static PHYSFS_sint64 member_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len)
+{
+    member_io_t* info = (member_io_t*)io->opaque;
+    const member_t& m = *info->member;
+
+    len = SDL_min(len, m.size - info->pos);
+    if (!len)
+        return 0;
+
+    if (m.deflated)
+        return member_io_read_deflated(info, (Uint8*)buf, len);
+
+    BAIL_IF_ERRPASS(!info->zip->seek(info->zip, m.data_offset + info->pos), -1);
+    PHYSFS_sint64 count = info->zip->read(info->zip, buf, len);
+    if (count > 0)
+        info->pos += count;
+    return count;
+}
+
+static PHYSFS_sint64 member_io_write(PHYSFS_Io*, const void*, PHYSFS_uint64) { BAIL(PHYSFS_ERR_READ_ONLY, -1); }
+
+static int member_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset)
+{
+    member_io_t* info = (member_io_t*)io->opaque;
+    BAIL_IF(offset > info->member->size, PHYSFS_ERR_PAST_EOF, 0);
+    info->pos = offset;
+    return 1;
+}
+
+static PHYSFS_sint64 member_io_tell(PHYSFS_Io* io) { return PHYSFS_sint64(((member_io_t*)io->opaque)->pos); }
+
+static PHYSFS_sint64 member_io_length(PHYSFS_Io* io) { return PHYSFS_sint64(((member_io_t*)io->opaque)->member->size); }
+
+static PHYSFS_Io* member_io_duplicate(PHYSFS_Io* io)
+{
+    member_io_t* info = (member_io_t*)io->opaque;
+    PHYSFS_Io* zip = info->zip->duplicate(info->zip);
+    BAIL_IF_ERRPASS(!zip, NULL);
+
+    PHYSFS_Io* retval = member_io_create(zip, info->member);
+    if (!retval)
+        zip->destroy(zip);
+    return retval;
+}
+
+static int member_io_flush(PHYSFS_Io*) { return 1; }
+
+static void member_io_destroy(PHYSFS_Io* io)
+{
+    member_io_t* info = (member_io_t*)io->opaque;
+    info->zip->destroy(info->zip);
+    delete info->decoder;
+    delete info;
+    allocator.Free(io);
+}
+
+/**
+ * Io over a file in the PhysFS search path, so zips inside mounted directories (or other archives) work too
+ */
+struct file_io_t
+{
+    std::string path;
+    PHYSFS_File* fd;
+};
+
+static PHYSFS_sint64 file_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len);
+static int file_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset);
+static PHYSFS_sint64 file_io_tell(PHYSFS_Io* io);
+static PHYSFS_sint64 file_io_length(PHYSFS_Io* io);
+static PHYSFS_Io* file_io_duplicate(PHYSFS_Io* io);
+static void file_io_destroy(PHYSFS_Io* io);
+
+static const PHYSFS_Io file_io_interface = {
+    .version = 0,
+    .opaque = NULL,
+    .read = file_io_read,
+    .write = member_io_write,
+    .seek = file_io_seek,
+    .tell = file_io_tell,
+    .length = file_io_length,
+    .duplicate = file_io_duplicate,
+    .flush = member_io_flush,
+    .destroy = file_io_destroy,
+};
+
+static PHYSFS_Io* file_io_create(const char* path)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path);
+    BAIL_IF_ERRPASS(!fd, NULL);
+
+    PHYSFS_Io* io = (PHYSFS_Io*)allocator.Malloc(sizeof(PHYSFS_Io));
+    if (!io)
+    {
+        PHYSFS_close(fd);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    }
+
+    file_io_t* info = new file_io_t;
+    info->path = path;
+    info->fd = fd;
+
+    memcpy(io, &file_io_interface, sizeof(PHYSFS_Io));
+    io->opaque = info;
+    return io;
+}
+
+static PHYSFS_sint64 file_io_read(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len) { return PHYSFS_readBytes(((file_io_t*)io->opaque)->fd, buf, len); }
+
+static int file_io_seek(PHYSFS_Io* io, PHYSFS_uint64 offset) { return PHYSFS_seek(((file_io_t*)io->opaque)->fd, offset); }
+
+static PHYSFS_sint64 file_io_tell(PHYSFS_Io* io) { return PHYSFS_tell(((file_io_t*)io->opaque)->fd); }
+
+static PHYSFS_sint64 file_io_length(PHYSFS_Io* io) { return PHYSFS_fileLength(((file_io_t*)io->opaque)->fd); }
+
+static PHYSFS_Io* file_io_duplicate(PHYSFS_Io* io) { return file_io_create(((file_io_t*)io->opaque)->path.c_str()); }
+
+static void file_io_destroy(PHYSFS_Io* io)
+{
+    file_io_t* info = (file_io_t*)io->opaque;
+    PHYSFS_close(info->fd);
+    delete info;
+    allocator.Free(io);
+}
+
+/* ================================ Zip directory ================================ */
+
+static bool ends_with_nds(const std::string& name) { return name.length() >= 4 && !SDL_strcasecmp(name.c_str() + name.length() - 4, ".nds"); }
+
+/**
+ * Finds the central directory, handling zip64
+ */
+static bool zip_find_central_dir(PHYSFS_Io* zip, PHYSFS_uint64& offset, PHYSFS_uint64& size)
+{
+    PHYSFS_sint64 length = zip->length(zip);
+    BAIL_IF_ERRPASS(length < 0, false);
+    BAIL_IF(length < 22, PHYSFS_ERR_UNSUPPORTED, false);
+
+    /* End of central directory record (22 bytes) followed by a comment of up to 65535 bytes */
+    PHYSFS_uint64 tail_size = SDL_min(PHYSFS_uint64(length), PHYSFS_uint64(22 + 65535));
+    PHYSFS_uint64 tail_start = PHYSFS_uint64(length) - tail_size;
+    std::vector<Uint8> tail(tail_size);
+    BAIL_IF_ERRPASS(!zip->seek(zip, tail_start), false);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, tail.data(), tail.size()), false);
+
+    PHYSFS_sint64 eocd = -1;
+    for (PHYSFS_sint64 i = PHYSFS_sint64(tail_size) - 22; i >= 0 && eocd < 0; i--)
+        if (read_le32(&tail[i]) == ZIP_SIG_EOCD)
+            eocd = i;
+    BAIL_IF(eocd < 0, PHYSFS_ERR_UNSUPPORTED, false);
+
+    size = read_le32(&tail[eocd + 12]);
+    offset = read_le32(&tail[eocd + 16]);
+    if (size != 0xFFFFFFFF && offset != 0xFFFFFFFF)
+        return true;
+
+    /* Zip64 locator sits right before the regular record */
+    Uint8 locator[20];
+    PHYSFS_uint64 eocd_pos = tail_start + PHYSFS_uint64(eocd);
+    BAIL_IF(eocd_pos < sizeof(locator), PHYSFS_ERR_CORRUPT, false);
+    BAIL_IF_ERRPASS(!zip->seek(zip, eocd_pos - sizeof(locator)), false);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, locator, sizeof(locator)), false);
+    BAIL_IF(read_le32(locator) != ZIP_SIG_ZIP64_LOCATOR, PHYSFS_ERR_CORRUPT, false);
+
+    Uint8 eocd64[56];
+    BAIL_IF_ERRPASS(!zip->seek(zip, read_le64(locator + 8)), false);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, eocd64, sizeof(eocd64)), false);
+    BAIL_IF(read_le32(eocd64) != ZIP_SIG_ZIP64_EOCD, PHYSFS_ERR_CORRUPT, false);
+
+    size = read_le64(eocd64 + 40);
+    offset = read_le64(eocd64 + 48);
+    return true;
+}
+
+/**
+ * Looks up a member in the central directory and resolves where its data starts
+ *
+ * @param name Member path, NULL or empty for the first .nds file
+ */
+static bool zip_find_member(PHYSFS_Io* zip, const char* name, member_t& m)
+{
+    PHYSFS_uint64 cd_offset, cd_size;
+    BAIL_IF_ERRPASS(!zip_find_central_dir(zip, cd_offset, cd_size), false);
+    BAIL_IF(cd_size > 256 * 1024 * 1024, PHYSFS_ERR_CORRUPT, false);
+
+    std::vector<Uint8> cd(size_t(cd_size) + 1);
+    BAIL_IF_ERRPASS(!zip->seek(zip, cd_offset), false);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, cd.data(), size_t(cd_size)), false);
+
+    bool pick_first_nds = !name || !name[0];
+    size_t pos = 0;
+    while (pos + 46 <= cd_size && read_le32(&cd[pos]) == ZIP_SIG_CENTRAL_DIR)
+    {
+        const Uint8* e = &cd[pos];
+        Uint16 flags = read_le16(e + 8);
+        Uint16 method = read_le16(e + 10);
+        Uint32 crc = read_le32(e + 16);
+        PHYSFS_uint64 compressed_size = read_le32(e + 20);
+        PHYSFS_uint64 size = read_le32(e + 24);
+        Uint16 name_len = read_le16(e + 28);
+        Uint16 extra_len = read_le16(e + 30);
+        Uint16 comment_len = read_le16(e + 32);
+        PHYSFS_uint64 local_offset = read_le32(e + 42);
+        BAIL_IF(pos + 46 + name_len + extra_len + comment_len > cd_size, PHYSFS_ERR_CORRUPT, false);
+
+        std::string entry_name((const char*)e + 46, name_len);
+        pos += 46 + name_len + extra_len + comment_len;
+
+        if (pick_first_nds ? !ends_with_nds(entry_name) : entry_name != name)
+            continue;
+
+        /* Zip64 extended information, fields are only present when the regular one is saturated */
+        const Uint8* extra = e + 46 + name_len;
+        for (size_t i = 0; i + 4 <= extra_len;)
+        {
+            Uint16 id = read_le16(extra + i);
+            Uint16 len = read_le16(extra + i + 2);
+            if (i + 4 + len > extra_len)
+                break;
+            if (id == 0x0001)
+            {
+                const Uint8* field = extra + i + 4;
+                const Uint8* field_end = field + len;
+                if (size == 0xFFFFFFFF && field + 8 <= field_end)
+                    size = read_le64(field), field += 8;
+                if (compressed_size == 0xFFFFFFFF && field + 8 <= field_end)
+                    compressed_size = read_le64(field), field += 8;
+                if (local_offset == 0xFFFFFFFF && field + 8 <= field_end)
+                    local_offset = read_le64(field), field += 8;
+            }
+            i += 4 + len;
+        }
+
+        BAIL_IF(flags & 1, PHYSFS_ERR_UNSUPPORTED, false);
+        BAIL_IF(method != ZIP_METHOD_STORED && method != ZIP_METHOD_DEFLATE, PHYSFS_ERR_UNSUPPORTED, false);
+
+        /* The local header can carry a different extra field than the central directory */
+        Uint8 local[30];
+        BAIL_IF_ERRPASS(!zip->seek(zip, local_offset), false);
+        BAIL_IF_ERRPASS(!__PHYSFS_readAll(zip, local, sizeof(local)), false);
+        BAIL_IF(read_le32(local) != ZIP_SIG_LOCAL_HEADER, PHYSFS_ERR_CORRUPT, false);
+
+        m.name = entry_name;
+        m.crc = crc;
+        m.deflated = method == ZIP_METHOD_DEFLATE;
+        m.data_offset = local_offset + sizeof(local) + read_le16(local + 26) + read_le16(local + 28);
+        m.compressed_size = compressed_size;
+        m.size = size;
+        BAIL_IF(!m.deflated && m.compressed_size != m.size, PHYSFS_ERR_CORRUPT, false);
+        return true;
+    }
+
+    BAIL(PHYSFS_ERR_NOT_FOUND, false);
+}
+
+/* ================================ Mounting ================================ */
+
+int MPH_TETRA_PHYSFS_mountNested(const char* zip_path, const char* member, const char* mount_point, int append_to_path)
+{
+    BAIL_IF(!zip_path, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    PHYSFS_Io* zip = PHYSFS_exists(zip_path) ? file_io_create(zip_path) : __PHYSFS_createNativeIo(zip_path, 'r');
+    BAIL_IF_ERRPASS(!zip, 0);
+
+    std::shared_ptr<member_t> m(new member_t);
+    if (!zip_find_member(zip, member, *m))
+    {
+        zip->destroy(zip);
+        return 0;
+    }
+
+    if (m->deflated)
+    {
+        PHYSFS_uint64 spacing = PHYSFS_uint64(physfs_nested_checkpoint_kb.get()) * 1024;
+        std::string index_path = get_index_path(*m, spacing);
+        if (!load_index(index_path, *m))
+        {
+            Uint64 start = SDL_GetTicks64();
+            if (!build_index(*m, zip, spacing))
+            {
+                PHYSFS_ErrorCode error = PHYSFS_getLastErrorCode();
+                zip->destroy(zip);
+                BAIL(error, 0);
+            }
+            dc_log("Indexed %s:%s, %zu checkpoints in %llu ms", zip_path, m->name.c_str(), m->checkpoints.size(),
+                (unsigned long long)(SDL_GetTicks64() - start));
+            store_index(index_path, *m);
+        }
+    }
+
+    PHYSFS_Io* io = member_io_create(zip, m);
+    if (!io)
+    {
+        zip->destroy(zip);
+        return 0;
+    }
+
+    /* Also the name to pass to PHYSFS_unmount() */
+    std::string name = std::string(zip_path) + "/" + m->name;
+    if (!PHYSFS_mountIo(io, name.c_str(), mount_point, append_to_path))
+    {
+        io->destroy(io);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int command_mount_nested(const int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        dc_log("Usage: %s <zip> <mount point> [member]", argv[0]);
+        dc_log("The zip is looked up in the PhysFS search path, then on disk. Without a member the first .nds file is used");
+        return 1;
+    }
+
+    if (!MPH_TETRA_PHYSFS_mountNested(argv[1], argc > 3 ? argv[3] : NULL, argv[2], 1))
+    {
+        dc_log_error("Unable to mount %s at %s: %s", argv[1], argv[2], PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    }
+
+    dc_log("Mounted %s at %s", argv[1], argv[2]);
+    return 0;
+}
+
+void MPH_TETRA_PHYSFS_registerNestedCommands() { dev_console::add_command("mount_nested", command_mount_nested); }
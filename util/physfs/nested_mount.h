@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_PHYSFS_NESTED_MOUNT_H
+#define MPH_TETRA_UTIL_PHYSFS_NESTED_MOUNT_H
+
+#include "physfs.h"
+
+/**
+ * Mounting of archives that are stored inside a zip (Zipped ROMs) without extracting them
+ *
+ * The member is exposed as a seekable PHYSFS_Io and handed to PHYSFS_mountIo(), so any archiver (Including
+ * MPH_TETRA_PHYSFS_Archiver_NDS) can open it. Stored members are read straight from the zip. Deflated members get a
+ * checkpoint index on first open: a full inflater snapshot (State + 32 KiB window) every physfs_nested_checkpoint_kb
+ * of output. A seek resumes from the nearest checkpoint instead of inflating from the start. Indices are saved to
+ * /cache/inflate_index/ in the write directory so later mounts skip the indexing pass.
+ *
+ * Every duplicate of the PHYSFS_Io has its own inflater and zip handle, the index is shared and read-only.
+ */
+
+/**
+ * Mounts an archive stored in a zip
+ *
+ * @param zip_path Path of the zip, looked up in the PhysFS search path first, then on disk
+ * @param member Path of the archive inside the zip, NULL or empty picks the first .nds file
+ * @param mount_point Where to mount the inner archive
+ * @param append_to_path Same as PHYSFS_mount()
+ *
+ * The mount is named "<zip_path>/<member>", which is what PHYSFS_unmount() expects
+ *
+ * @returns non-zero on success, zero on failure (Details in PHYSFS_getLastErrorCode())
+ */
+int MPH_TETRA_PHYSFS_mountNested(const char* zip_path, const char* member, const char* mount_point, int append_to_path);
+
+/**
+ * Registers the mount_nested command
+ */
+void MPH_TETRA_PHYSFS_registerNestedCommands();
+
+#endif
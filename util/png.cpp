@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "png.h"
+
+#include "deflate.h"
+#include "hash.h"
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_be32(std::vector<Uint8>& out, Uint32 x)
+{
+    out.push_back(x >> 24);
+    out.push_back(x >> 16);
+    out.push_back(x >> 8);
+    out.push_back(x);
+}
+
+static void put_chunk(std::vector<Uint8>& out, const char type[4], const Uint8* data, size_t len)
+{
+    put_be32(out, len);
+    size_t crc_start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + len);
+    put_be32(out, util::crc32(&out[crc_start], len + 4));
+}
+
+void util::encode_png(const Uint8* pixels, int width, int height, int channels, int stride, std::vector<Uint8>& out)
+{
+    SDL_assert(channels == 3 || channels == 4);
+
+    const Uint8 signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.insert(out.end(), signature, signature + sizeof(signature));
+
+    std::vector<Uint8> ihdr;
+    put_be32(ihdr, width);
+    put_be32(ihdr, height);
+    ihdr.push_back(8);
+    ihdr.push_back(channels == 4 ? 6 : 2);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    put_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    /* Each row gets whichever of None/Sub/Up has the smallest sum of absolute values (The usual libpng heuristic) */
+    size_t row_bytes = size_t(width) * channels;
+    std::vector<Uint8> filtered((row_bytes + 1) * height);
+    std::vector<Uint8> candidates[3];
+    for (int i = 0; i < 3; i++)
+        candidates[i].resize(row_bytes);
+
+    for (int y = 0; y < height; y++)
+    {
+        const Uint8* row = pixels + (ptrdiff_t)y * stride;
+        const Uint8* prev = y ? row - stride : NULL;
+
+        Uint32 scores[3] = { 0, 0, 0 };
+        for (size_t x = 0; x < row_bytes; x++)
+        {
+            Uint8 left = x >= (size_t)channels ? row[x - channels] : 0;
+            Uint8 up = prev ? prev[x] : 0;
+            candidates[0][x] = row[x];
+            candidates[1][x] = row[x] - left;
+            candidates[2][x] = row[x] - up;
+            for (int i = 0; i < 3; i++)
+                scores[i] += abs((Sint8)candidates[i][x]);
+        }
+
+        int best = 0;
+        for (int i = 1; i < 3; i++)
+            if (scores[i] < scores[best])
+                best = i;
+
+        Uint8* dst = &filtered[y * (row_bytes + 1)];
+        dst[0] = best;
+        memcpy(dst + 1, candidates[best].data(), row_bytes);
+    }
+
+    std::vector<Uint8> idat;
+    util::zlib_compress(filtered.data(), filtered.size(), idat);
+    put_chunk(out, "IDAT", idat.data(), idat.size());
+
+    put_chunk(out, "IEND", NULL, 0);
+}
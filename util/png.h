@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_PNG_H
+#define MPH_TETRA_UTIL_PNG_H
+#include <SDL_bits.h>
+#include <vector>
+
+namespace util
+{
+/**
+ * Encodes 8-bit RGBA or RGB pixels as a PNG
+ *
+ * @param pixels First row of the image
+ * @param width Width in pixels
+ * @param height Height in pixels
+ * @param channels 3 (RGB) or 4 (RGBA)
+ * @param stride Bytes from one row to the next, negative strides flip the image (For bottom up GL readbacks)
+ * @param out Encoded file is appended to this
+ */
+void encode_png(const Uint8* pixels, int width, int height, int channels, int stride, std::vector<Uint8>& out);
+}
+#endif
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "profiler.h"
+#include "convar.h"
+
+#include <SDL_mutex.h>
+#include <SDL_stdinc.h>
+#include <SDL_timer.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static convar_int_t dev_profiler_hw_counters(
+    "dev_profiler_hw_counters", 0, 0, 1, "Collect hardware performance counters for profiler zones (Linux only)", CONVAR_FLAG_INT_IS_BOOL);
+
+/**
+ * This is a workaround for undefined behavior (Static initialization order)
+ */
+static SDL_mutex* get_mutex()
+{
+    static SDL_mutex* mutex = SDL_CreateMutex();
+    return mutex;
+}
+
+static char unavailable_reason[128] = "";
+
+static void set_unavailable_reason(const char* reason)
+{
+    SDL_LockMutex(get_mutex());
+    if (!unavailable_reason[0])
+        SDL_strlcpy(unavailable_reason, reason, sizeof(unavailable_reason));
+    SDL_UnlockMutex(get_mutex());
+}
+
+#ifdef __linux__
+#define NUM_COUNTERS 4
+
+static const Uint64 counter_configs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+/**
+ * perf_event_open(2) counters are per thread (pid = 0, cpu = -1), so each thread gets its own group
+ */
+struct thread_counters_t
+{
+    /**
+     * [0: Not yet opened, 1: Opened, -1: Unavailable]
+     */
+    int state = 0;
+    int fds[NUM_COUNTERS] = { -1, -1, -1, -1 };
+
+    bool open()
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = counter_configs[i];
+            /* User space only so that this works with the default perf_event_paranoid value of 2 */
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], PERF_FLAG_FD_CLOEXEC);
+            if (fds[i] < 0)
+            {
+                char buf[sizeof(unavailable_reason)];
+                snprintf(buf, sizeof(buf), "perf_event_open() failed for counter %d: %s", i, strerror(errno));
+                set_unavailable_reason(buf);
+                close_all();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close_all()
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            if (fds[i] >= 0)
+                close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+
+    ~thread_counters_t() { close_all(); }
+};
+
+static thread_local thread_counters_t thread_counters;
+
+bool profiler::read_counters(perf_counters_t& out)
+{
+    out.valid = false;
+
+    if (thread_counters.state == 0)
+        thread_counters.state = thread_counters.open() ? 1 : -1;
+
+    if (thread_counters.state != 1)
+        return false;
+
+    /* PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, values[nr] */
+    Uint64 buf[3 + NUM_COUNTERS];
+    if (read(thread_counters.fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != NUM_COUNTERS)
+        return false;
+
+    Uint64 enabled = buf[1];
+    Uint64 running = buf[2];
+    if (running == 0)
+        return false;
+
+    /* Scale if the kernel had to multiplex the group */
+    for (int i = 0; i < NUM_COUNTERS; i++)
+        if (running < enabled)
+            buf[3 + i] = (Uint64)((double)buf[3 + i] * (double)enabled / (double)running);
+
+    out.cycles = buf[3];
+    out.instructions = buf[4];
+    out.llc_misses = buf[5];
+    out.branch_misses = buf[6];
+    out.valid = true;
+
+    return true;
+}
+#undef NUM_COUNTERS
+#else
+bool profiler::read_counters(perf_counters_t& out)
+{
+    set_unavailable_reason("Hardware counters are only supported on Linux");
+    out.valid = false;
+    return false;
+}
+#endif
+
+bool profiler::counters_enabled() { return dev_profiler_hw_counters.get(); }
+
+const char* profiler::counters_unavailable_reason()
+{
+    SDL_LockMutex(get_mutex());
+    const char* reason = unavailable_reason[0] ? unavailable_reason : NULL;
+    SDL_UnlockMutex(get_mutex());
+    return reason;
+}
+
+std::vector<profiler_zone_t*>* profiler_zone_t::get_zone_list()
+{
+    static std::vector<profiler_zone_t*> _vector;
+    return &_vector;
+}
+
+profiler_zone_t::profiler_zone_t(const char* name)
+{
+    _name = name;
+    reset();
+    get_zone_list()->push_back(this);
+}
+
+profiler_zone_t::stats_t profiler_zone_t::get_stats()
+{
+    stats_t stats;
+    stats.calls = _calls.load(std::memory_order_relaxed);
+    stats.ticks = _ticks.load(std::memory_order_relaxed);
+    stats.counted_calls = _counted_calls.load(std::memory_order_relaxed);
+    stats.cycles = _cycles.load(std::memory_order_relaxed);
+    stats.instructions = _instructions.load(std::memory_order_relaxed);
+    stats.llc_misses = _llc_misses.load(std::memory_order_relaxed);
+    stats.branch_misses = _branch_misses.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void profiler_zone_t::add_sample(Uint64 ticks, const perf_counters_t& start, const perf_counters_t& end)
+{
+    _calls.fetch_add(1, std::memory_order_relaxed);
+    _ticks.fetch_add(ticks, std::memory_order_relaxed);
+    if (start.valid && end.valid)
+    {
+        _counted_calls.fetch_add(1, std::memory_order_relaxed);
+        _cycles.fetch_add(end.cycles - start.cycles, std::memory_order_relaxed);
+        _instructions.fetch_add(end.instructions - start.instructions, std::memory_order_relaxed);
+        _llc_misses.fetch_add(end.llc_misses - start.llc_misses, std::memory_order_relaxed);
+        _branch_misses.fetch_add(end.branch_misses - start.branch_misses, std::memory_order_relaxed);
+    }
+}
+
+void profiler_zone_t::reset()
+{
+    _calls.store(0, std::memory_order_relaxed);
+    _ticks.store(0, std::memory_order_relaxed);
+    _counted_calls.store(0, std::memory_order_relaxed);
+    _cycles.store(0, std::memory_order_relaxed);
+    _instructions.store(0, std::memory_order_relaxed);
+    _llc_misses.store(0, std::memory_order_relaxed);
+    _branch_misses.store(0, std::memory_order_relaxed);
+}
+
+profiler_scope_t::profiler_scope_t(profiler_zone_t& zone)
+    : _zone(zone)
+{
+    _counters_start.valid = false;
+    if (profiler::counters_enabled())
+        profiler::read_counters(_counters_start);
+    _ticks_start = SDL_GetPerformanceCounter();
+}
+
+profiler_scope_t::~profiler_scope_t()
+{
+    Uint64 ticks = SDL_GetPerformanceCounter() - _ticks_start;
+    perf_counters_t counters_end;
+    counters_end.valid = false;
+    if (_counters_start.valid)
+        profiler::read_counters(counters_end);
+    _zone.add_sample(ticks, _counters_start, counters_end);
+}
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_PROFILER_H
+#define MPH_TETRA_UTIL_PROFILER_H
+
+#include <SDL_bits.h>
+#include <atomic>
+
+#include <vector>
+
+/**
+ * Snapshot of the hardware performance counters for the calling thread
+ *
+ * Values are only meaningful when valid == true
+ */
+struct perf_counters_t
+{
+    Uint64 cycles;
+    Uint64 instructions;
+    /**
+     * Last level cache misses (PERF_COUNT_HW_CACHE_MISSES)
+     */
+    Uint64 llc_misses;
+    Uint64 branch_misses;
+    bool valid;
+};
+
+/**
+ * Named profiler zone
+ *
+ * Zones are meant to be declared as static variables (like convars) and be wrapped around hot code with PROFILER_SCOPE()
+ *
+ * NOTE: Once a zone has been created it must not be destroyed before program exit
+ */
+class profiler_zone_t
+{
+public:
+    struct stats_t
+    {
+        Uint64 calls;
+        /**
+         * Total wall time in SDL_GetPerformanceCounter() ticks
+         */
+        Uint64 ticks;
+
+        /**
+         * Number of calls that had valid hardware counter readings, the counter fields are totals of those calls only
+         */
+        Uint64 counted_calls;
+        Uint64 cycles;
+        Uint64 instructions;
+        Uint64 llc_misses;
+        Uint64 branch_misses;
+    };
+
+    profiler_zone_t(const char* name);
+
+    inline const char* get_name() { return _name; }
+
+    /**
+     * Returns a copy of the accumulated stats, safe to call from any thread
+     *
+     * Fields are read one at a time, so a sample added concurrently may show up in some fields but not others
+     */
+    stats_t get_stats();
+
+    /**
+     * Adds a sample to the zone, safe to call from any thread and lock free
+     *
+     * @param ticks Elapsed SDL_GetPerformanceCounter() ticks
+     * @param start Counters at the start of the zone
+     * @param end Counters at the end of the zone
+     */
+    void add_sample(Uint64 ticks, const perf_counters_t& start, const perf_counters_t& end);
+
+    void reset();
+
+    static std::vector<profiler_zone_t*>* get_zone_list();
+
+private:
+    const char* _name;
+
+    /* Mirrors stats_t, relaxed atomic adds keep scope exits from serializing on a lock */
+    std::atomic<Uint64> _calls;
+    std::atomic<Uint64> _ticks;
+    std::atomic<Uint64> _counted_calls;
+    std::atomic<Uint64> _cycles;
+    std::atomic<Uint64> _instructions;
+    std::atomic<Uint64> _llc_misses;
+    std::atomic<Uint64> _branch_misses;
+};
+
+/**
+ * Records wall time (and hardware counters when enabled and available) from construction to destruction into a zone
+ */
+class profiler_scope_t
+{
+public:
+    profiler_scope_t(profiler_zone_t& zone);
+    ~profiler_scope_t();
+
+private:
+    profiler_zone_t& _zone;
+    perf_counters_t _counters_start;
+    Uint64 _ticks_start;
+};
+
+#define PROFILER_CONCAT2_(a, b) a##b
+#define PROFILER_CONCAT_(a, b) PROFILER_CONCAT2_(a, b)
+#define PROFILER_SCOPE(zone) profiler_scope_t PROFILER_CONCAT_(profiler_scope_, __LINE__)(zone)
+
+namespace profiler
+{
+/**
+ * Reads the hardware counters of the calling thread
+ *
+ * Counters are opened lazily per thread with perf_event_open(2) on Linux, on other platforms
+ * or when the counters can't be opened (perf_event_paranoid, VMs without a PMU, ...) out.valid is set to false
+ *
+ * @returns out.valid
+ */
+bool read_counters(perf_counters_t& out);
+
+/**
+ * Returns true if hardware counter collection is enabled (dev_profiler_hw_counters)
+ */
+bool counters_enabled();
+
+/**
+ * Returns a human readable reason for why the counters are unavailable, or NULL if they were opened successfully (or not tried yet)
+ */
+const char* counters_unavailable_reason();
+};
+
+#endif
@@ -0,0 +1,529 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "rom_diff.h"
+
+#include "hash.h"
+#include "jobs.h"
+#include "lzss.h"
+#include "profiler.h"
+
+#include "gui/console.h"
+#include "util/physfs/physfs.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <string.h>
+#include <unordered_map>
+
+/* Block size for matching, changes smaller than this between two matches are still found because matches extend byte by
+ * byte in both directions */
+#define ROM_DIFF_BLOCK_SIZE 32
+/* Candidates checked per rolling hash lookup, runs of identical blocks (Padding) would be quadratic otherwise */
+#define ROM_DIFF_MAX_CHAIN 16
+#define ROM_DIFF_HASH_BASE 0x01000193u
+
+#define ROM_DIFF_READ_CHUNK (256 << 10)
+
+/* Ranges listed per file by the console command */
+#define ROM_DIFF_PRINT_RANGES 8
+
+static profiler_zone_t zone_diff_trees("rom_diff::diff_trees");
+static profiler_zone_t zone_diff_bytes("rom_diff::diff_bytes");
+
+/* ================================ Block matching ================================ */
+
+struct match_t
+{
+    size_t new_start;
+    size_t old_start;
+    size_t len;
+};
+
+static inline Uint32 block_hash(const Uint8* data)
+{
+    Uint32 h = 0;
+    for (int i = 0; i < ROM_DIFF_BLOCK_SIZE; i++)
+        h = h * ROM_DIFF_HASH_BASE + data[i];
+    return h;
+}
+
+/**
+ * Finds regions of new that also appear in old
+ *
+ * Every block aligned to ROM_DIFF_BLOCK_SIZE in old is indexed by a rolling hash, then a window slides over new one byte
+ * at a time. Before looking at the index the window is checked against the offset the last match had, which is where
+ * the next match almost always is when data was only patched in place.
+ */
+static void find_matches(const Uint8* old_data, size_t old_len, const Uint8* new_data, size_t new_len, std::vector<match_t>& matches)
+{
+    if (old_len < ROM_DIFF_BLOCK_SIZE || new_len < ROM_DIFF_BLOCK_SIZE)
+        return;
+
+    size_t num_blocks = old_len / ROM_DIFF_BLOCK_SIZE;
+    int bits = 1;
+    while ((size_t(1) << bits) < num_blocks * 2)
+        bits++;
+
+    std::vector<int> heads(size_t(1) << bits, -1);
+    std::vector<int> chain(num_blocks);
+    std::vector<Uint32> hashes(num_blocks);
+    for (size_t i = 0; i < num_blocks; i++)
+    {
+        hashes[i] = block_hash(old_data + i * ROM_DIFF_BLOCK_SIZE);
+        size_t bucket = (hashes[i] * 0x9E3779B1u) >> (32 - bits);
+        chain[i] = heads[bucket];
+        heads[bucket] = i;
+    }
+
+    Uint32 base_pow = 1;
+    for (int i = 0; i < ROM_DIFF_BLOCK_SIZE - 1; i++)
+        base_pow *= ROM_DIFF_HASH_BASE;
+
+    size_t p = 0;
+    size_t unmatched_start = 0;
+    bool have_delta = false;
+    ptrdiff_t last_delta = 0;
+    Uint32 h = block_hash(new_data);
+
+    while (p + ROM_DIFF_BLOCK_SIZE <= new_len)
+    {
+        ptrdiff_t found = -1;
+
+        if (have_delta)
+        {
+            ptrdiff_t expected = (ptrdiff_t)p + last_delta;
+            if (expected >= 0 && size_t(expected) + ROM_DIFF_BLOCK_SIZE <= old_len && !memcmp(old_data + expected, new_data + p, ROM_DIFF_BLOCK_SIZE))
+                found = expected;
+        }
+
+        if (found < 0)
+        {
+            int candidate = heads[(h * 0x9E3779B1u) >> (32 - bits)];
+            for (int n = 0; candidate >= 0 && n < ROM_DIFF_MAX_CHAIN; candidate = chain[candidate], n++)
+            {
+                size_t offset = size_t(candidate) * ROM_DIFF_BLOCK_SIZE;
+                if (hashes[candidate] == h && !memcmp(old_data + offset, new_data + p, ROM_DIFF_BLOCK_SIZE))
+                {
+                    found = offset;
+                    break;
+                }
+            }
+        }
+
+        if (found < 0)
+        {
+            if (p + ROM_DIFF_BLOCK_SIZE < new_len)
+                h = (h - new_data[p] * base_pow) * ROM_DIFF_HASH_BASE + new_data[p + ROM_DIFF_BLOCK_SIZE];
+            p++;
+            continue;
+        }
+
+        match_t match = { p, size_t(found), ROM_DIFF_BLOCK_SIZE };
+        while (match.new_start > unmatched_start && match.old_start > 0 && new_data[match.new_start - 1] == old_data[match.old_start - 1])
+        {
+            match.new_start--;
+            match.old_start--;
+            match.len++;
+        }
+        while (match.new_start + match.len < new_len && match.old_start + match.len < old_len
+            && new_data[match.new_start + match.len] == old_data[match.old_start + match.len])
+            match.len++;
+
+        matches.push_back(match);
+        have_delta = true;
+        last_delta = (ptrdiff_t)match.old_start - (ptrdiff_t)match.new_start;
+
+        p = match.new_start + match.len;
+        unmatched_start = p;
+        if (p + ROM_DIFF_BLOCK_SIZE <= new_len)
+            h = block_hash(new_data + p);
+    }
+}
+
+void rom_diff::diff_bytes(const Uint8* old_data, size_t old_len, const Uint8* new_data, size_t new_len, file_t& file)
+{
+    PROFILER_SCOPE(zone_diff_bytes);
+
+    file.old_size = old_len;
+    file.new_size = new_len;
+    file.ranges.clear();
+
+    /* Most changes are patches somewhere in the middle, so the common ends are cheap to take care of up front */
+    size_t prefix = 0;
+    while (prefix < old_len && prefix < new_len && old_data[prefix] == new_data[prefix])
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < old_len - prefix && suffix < new_len - prefix && old_data[old_len - 1 - suffix] == new_data[new_len - 1 - suffix])
+        suffix++;
+
+    std::vector<match_t> matches;
+    find_matches(old_data + prefix, old_len - prefix - suffix, new_data + prefix, new_len - prefix - suffix, matches);
+
+    /* Ranges of new between matches */
+    size_t new_mid_len = new_len - prefix - suffix;
+    size_t pos = 0;
+    file.new_changed = 0;
+    for (size_t i = 0; i <= matches.size(); i++)
+    {
+        size_t end = i < matches.size() ? matches[i].new_start : new_mid_len;
+        if (end > pos)
+        {
+            range_t range = { Uint32(prefix + pos), Uint32(prefix + end) };
+            file.ranges.push_back(range);
+            file.new_changed += end - pos;
+        }
+        if (i < matches.size())
+            pos = matches[i].new_start + matches[i].len;
+    }
+
+    /* Parts of old no match came from, matches can overlap in old so merge them first */
+    std::vector<range_t> used(matches.size());
+    for (size_t i = 0; i < matches.size(); i++)
+        used[i] = { Uint32(matches[i].old_start), Uint32(matches[i].old_start + matches[i].len) };
+    std::sort(used.begin(), used.end(), [](const range_t& a, const range_t& b) { return a.start < b.start; });
+
+    size_t old_mid_len = old_len - prefix - suffix;
+    size_t covered = 0;
+    size_t covered_end = 0;
+    for (size_t i = 0; i < used.size(); i++)
+    {
+        size_t start = SDL_max(size_t(used[i].start), covered_end);
+        if (used[i].end > start)
+        {
+            covered += used[i].end - start;
+            covered_end = used[i].end;
+        }
+    }
+    file.old_changed = old_mid_len - covered;
+}
+
+/* ================================ Trees ================================ */
+
+static void list_files(const std::string& root, const std::string& relative, std::vector<std::string>& out)
+{
+    std::string dir = root + relative;
+    char** names = PHYSFS_enumerateFiles(dir.c_str());
+    for (int i = 0; names && names[i]; i++)
+    {
+        std::string path = relative + "/" + names[i];
+
+        PHYSFS_Stat stat;
+        if (!PHYSFS_stat((root + path).c_str(), &stat))
+            continue;
+
+        if (stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+            list_files(root, path, out);
+        else if (stat.filetype == PHYSFS_FILETYPE_REGULAR)
+            out.push_back(path);
+    }
+    PHYSFS_freeList(names);
+}
+
+static bool read_file(const std::string& path, std::vector<Uint8>& data)
+{
+    data.clear();
+
+    PHYSFS_File* fd = PHYSFS_openRead(path.c_str());
+    if (!fd)
+        return false;
+
+    PHYSFS_sint64 len = PHYSFS_fileLength(fd);
+    bool success = len >= 0 && len <= SDL_MAX_SINT32;
+    if (success)
+    {
+        data.resize(len);
+        success = PHYSFS_readBytes(fd, data.data(), len) == len;
+    }
+    PHYSFS_close(fd);
+    return success;
+}
+
+/**
+ * Streams the file through the hash so the whole ROM never has to be in memory at once
+ */
+static bool hash_file(const std::string& path, Uint64& hash, Uint32& size)
+{
+    PHYSFS_File* fd = PHYSFS_openRead(path.c_str());
+    if (!fd)
+        return false;
+
+    std::vector<Uint8> chunk(ROM_DIFF_READ_CHUNK);
+    hash = FNV1A64_OFFSET_BASIS;
+    size = 0;
+
+    PHYSFS_sint64 len;
+    while ((len = PHYSFS_readBytes(fd, chunk.data(), chunk.size())) > 0)
+    {
+        hash = util::fnv1a64(chunk.data(), len, hash);
+        size += len;
+    }
+    PHYSFS_close(fd);
+
+    return len == 0;
+}
+
+/**
+ * NitroFS files are LZ10/LZ11 with a magic byte, overlays use the backwards overlay format instead
+ */
+static bool try_decompress(const std::string& path, const std::vector<Uint8>& in, std::vector<Uint8>& out)
+{
+    bool is_overlay = path.find("_overlays/") != std::string::npos;
+    if (!is_overlay && (in.empty() || (in[0] != 0x10 && in[0] != 0x11)))
+        return false;
+    return util::decompress_lz(in, out, is_overlay);
+}
+
+bool rom_diff::diff_trees(const char* old_root, const char* new_root, std::vector<file_t>& files)
+{
+    PROFILER_SCOPE(zone_diff_trees);
+
+    files.clear();
+
+    PHYSFS_Stat stat;
+    if (!PHYSFS_stat(old_root, &stat) || stat.filetype != PHYSFS_FILETYPE_DIRECTORY)
+        return false;
+    if (!PHYSFS_stat(new_root, &stat) || stat.filetype != PHYSFS_FILETYPE_DIRECTORY)
+        return false;
+
+    std::vector<std::string> old_paths;
+    std::vector<std::string> new_paths;
+    list_files(old_root, "", old_paths);
+    list_files(new_root, "", new_paths);
+
+    /* One entry per distinct path, old and new sides are hashed in the same pass */
+    std::unordered_map<std::string, size_t> by_path;
+    for (size_t i = 0; i < old_paths.size(); i++)
+    {
+        file_t file = {};
+        file.path = old_paths[i];
+        file.old_path = old_paths[i];
+        file.status = STATUS_REMOVED;
+        by_path[file.path] = files.size();
+        files.push_back(file);
+    }
+    for (size_t i = 0; i < new_paths.size(); i++)
+    {
+        auto it = by_path.find(new_paths[i]);
+        if (it != by_path.end())
+        {
+            files[it->second].status = STATUS_CHANGED;
+            continue;
+        }
+
+        file_t file = {};
+        file.path = new_paths[i];
+        file.status = STATUS_ADDED;
+        files.push_back(file);
+    }
+
+    std::string old_prefix = old_root;
+    std::string new_prefix = new_root;
+
+    jobs::parallel_for(files.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            file_t& file = files[i];
+            if (file.status != STATUS_ADDED)
+                hash_file(old_prefix + file.old_path, file.old_hash, file.old_size);
+            if (file.status != STATUS_REMOVED)
+                hash_file(new_prefix + file.path, file.new_hash, file.new_size);
+            if (file.status == STATUS_CHANGED && file.old_hash == file.new_hash && file.old_size == file.new_size)
+                file.status = STATUS_SAME;
+        }
+    });
+
+    /* Renames, the first removed file with the same contents claims each added file */
+    std::unordered_multimap<Uint64, size_t> removed_by_hash;
+    for (size_t i = 0; i < files.size(); i++)
+        if (files[i].status == STATUS_REMOVED)
+            removed_by_hash.insert(std::make_pair(files[i].old_hash, i));
+
+    std::vector<bool> erase(files.size(), false);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (files[i].status != STATUS_ADDED)
+            continue;
+
+        auto range = removed_by_hash.equal_range(files[i].new_hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const file_t& removed = files[it->second];
+            if (erase[it->second] || removed.old_size != files[i].new_size)
+                continue;
+
+            files[i].status = STATUS_MOVED;
+            files[i].old_path = removed.old_path;
+            files[i].old_hash = removed.old_hash;
+            files[i].old_size = removed.old_size;
+            erase[it->second] = true;
+            break;
+        }
+    }
+
+    std::vector<file_t> kept;
+    kept.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+        if (!erase[i])
+            kept.push_back(std::move(files[i]));
+    files.swap(kept);
+
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        file_t& file = files[i];
+        if (file.status == STATUS_CHANGED)
+            changed.push_back(i);
+        else if (file.status == STATUS_ADDED)
+            file.new_changed = file.new_size;
+        else if (file.status == STATUS_REMOVED)
+            file.old_changed = file.old_size;
+    }
+
+    /* Biggest first so a large arm9 binary doesn't end up alone at the end of the run */
+    std::sort(changed.begin(), changed.end(), [&](size_t a, size_t b) { return files[a].new_size > files[b].new_size; });
+
+    jobs::parallel_for(changed.size(), 1, [&](int begin, int end) {
+        std::vector<Uint8> old_data, new_data, old_unpacked, new_unpacked;
+        for (int i = begin; i < end; i++)
+        {
+            file_t& file = files[changed[i]];
+            if (!read_file(old_prefix + file.old_path, old_data) || !read_file(new_prefix + file.path, new_data))
+                old_data.clear(), new_data.clear();
+
+            file.decompressed = try_decompress(file.path, old_data, old_unpacked) && try_decompress(file.path, new_data, new_unpacked);
+            if (file.decompressed)
+                diff_bytes(old_unpacked.data(), old_unpacked.size(), new_unpacked.data(), new_unpacked.size(), file);
+            else
+                diff_bytes(old_data.data(), old_data.size(), new_data.data(), new_data.size(), file);
+        }
+    });
+
+    std::sort(files.begin(), files.end(), [](const file_t& a, const file_t& b) { return a.path < b.path; });
+
+    return true;
+}
+
+/* ================================ Command ================================ */
+
+/**
+ * Mounts argument if it is not already a PhysFS directory
+ *
+ * @returns PhysFS directory to diff, or an empty string on failure
+ */
+static std::string resolve_root(const char* arg, const char* mount_point, bool& mounted)
+{
+    mounted = false;
+
+    PHYSFS_Stat stat;
+    if (PHYSFS_stat(arg, &stat) && stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        return arg;
+
+    if (!PHYSFS_mount(arg, mount_point, 1))
+    {
+        dc_log_error("Unable to mount %s: %s", arg, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return "";
+    }
+
+    mounted = true;
+    return mount_point;
+}
+
+static int command_rom_diff(const int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        dc_log("Usage: %s <old> <new> [all]", argv[0]);
+        dc_log("Arguments are PhysFS directories (/nds/rom_release) or ROM paths on disk");
+        dc_log("Pass \"all\" to list every file instead of only the differences");
+        return 1;
+    }
+
+    bool mounted_old, mounted_new;
+    std::string old_root = resolve_root(argv[1], "/nds/rom_diff_old", mounted_old);
+    std::string new_root = resolve_root(argv[2], "/nds/rom_diff_new", mounted_new);
+
+    std::vector<rom_diff::file_t> files;
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool success = old_root.length() && new_root.length() && rom_diff::diff_trees(old_root.c_str(), new_root.c_str(), files);
+    Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+    if (mounted_old)
+        PHYSFS_unmount(argv[1]);
+    if (mounted_new)
+        PHYSFS_unmount(argv[2]);
+
+    if (!success)
+    {
+        dc_log_error("Unable to diff \"%s\" and \"%s\"", argv[1], argv[2]);
+        return 1;
+    }
+
+    bool list_all = argc > 3 && !strcmp(argv[3], "all");
+    int counts[rom_diff::STATUS_REMOVED + 1] = {};
+    Uint64 total_old = 0, total_changed = 0;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const rom_diff::file_t& file = files[i];
+        counts[file.status]++;
+        total_old += file.old_size;
+        total_changed += file.old_changed + file.new_changed;
+
+        switch (file.status)
+        {
+        case rom_diff::STATUS_SAME:
+            if (list_all)
+                dc_log("  %s", file.path.c_str());
+            break;
+        case rom_diff::STATUS_MOVED:
+            dc_log("R %s -> %s", file.old_path.c_str(), file.path.c_str());
+            break;
+        case rom_diff::STATUS_ADDED:
+            dc_log("A %s (%u bytes)", file.path.c_str(), file.new_size);
+            break;
+        case rom_diff::STATUS_REMOVED:
+            dc_log("D %s (%u bytes)", file.path.c_str(), file.old_size);
+            break;
+        case rom_diff::STATUS_CHANGED:
+        {
+            dc_log("M %s: %.2f%% changed, %u -> %u bytes%s, %zu ranges", file.path.c_str(), file.get_change_ratio() * 100.0f, file.old_size,
+                file.new_size, file.decompressed ? " (decompressed)" : "", file.ranges.size());
+
+            size_t num_print = SDL_min(file.ranges.size(), (size_t)ROM_DIFF_PRINT_RANGES);
+            for (size_t j = 0; j < num_print; j++)
+                dc_log("    [0x%06X, 0x%06X) %u bytes", file.ranges[j].start, file.ranges[j].end, file.ranges[j].end - file.ranges[j].start);
+            if (num_print < file.ranges.size())
+                dc_log("    ... %zu more", file.ranges.size() - num_print);
+            break;
+        }
+        }
+    }
+
+    dc_log("%zu files in %.1f ms: %d same, %d modified, %d renamed, %d added, %d deleted (%llu of %llu bytes differ)", files.size(),
+        elapsed * 1000.0 / SDL_GetPerformanceFrequency(), counts[rom_diff::STATUS_SAME], counts[rom_diff::STATUS_CHANGED], counts[rom_diff::STATUS_MOVED],
+        counts[rom_diff::STATUS_ADDED], counts[rom_diff::STATUS_REMOVED], (unsigned long long)total_changed, (unsigned long long)total_old);
+
+    return 0;
+}
+
+void rom_diff::init() { dev_console::add_command("rom_diff", command_rom_diff); }
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 Ian Hangartner <icrashstuff at outlook dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPH_TETRA_UTIL_ROM_DIFF_H
+#define MPH_TETRA_UTIL_ROM_DIFF_H
+
+#include <SDL_bits.h>
+#include <string>
+#include <vector>
+
+/**
+ * Compares two ROM file trees (Usually two mounted ROMs, e.g. rev 0 vs rev 1 or USA vs EUR)
+ *
+ * Files are paired by path, and identical files are skipped by content hash. Files that only appear in one tree are
+ * paired by content hash to catch renames. Changed pairs are LZ decompressed when both sides decompress, then diffed
+ * with rsync style rolling hash block matching. The hashing and diffing are spread over the job threads.
+ */
+namespace rom_diff
+{
+/**
+ * Byte range [start, end) in the new file
+ */
+struct range_t
+{
+    Uint32 start;
+    Uint32 end;
+};
+
+enum status_t
+{
+    STATUS_SAME,
+    STATUS_CHANGED,
+    /** Same contents at a different path */
+    STATUS_MOVED,
+    STATUS_ADDED,
+    STATUS_REMOVED,
+};
+
+struct file_t
+{
+    /**
+     * Path relative to the roots, for removed files this is the old path
+     */
+    std::string path;
+    /**
+     * Only differs from path for moved files
+     */
+    std::string old_path;
+    status_t status;
+
+    Uint64 old_hash;
+    Uint64 new_hash;
+
+    /**
+     * Both sides were LZ compressed and the sizes/ranges below are of the decompressed data
+     */
+    bool decompressed;
+    Uint32 old_size;
+    Uint32 new_size;
+
+    /**
+     * Bytes of the old file that don't appear in the new one
+     */
+    Uint32 old_changed;
+    /**
+     * Bytes of the new file that don't appear in the old one, this is the sum of the ranges
+     */
+    Uint32 new_changed;
+    std::vector<range_t> ranges;
+
+    /**
+     * @returns Fraction of bytes across both files that only exist on one side [0, 1]
+     */
+    inline float get_change_ratio() const
+    {
+        Uint64 total = (Uint64)old_size + new_size;
+        return total ? float(old_changed + new_changed) / total : 0.0f;
+    }
+};
+
+/**
+ * Diffs two buffers, filling in the size, changed and ranges fields of file
+ */
+void diff_bytes(const Uint8* old_data, size_t old_len, const Uint8* new_data, size_t new_len, file_t& file);
+
+/**
+ * Diffs every file below two PhysFS directories
+ *
+ * @param files Results sorted by path, identical files are included with STATUS_SAME
+ *
+ * @returns False if either root is not a directory
+ */
+bool diff_trees(const char* old_root, const char* new_root, std::vector<file_t>& files);
+
+/**
+ * Registers the rom_diff command
+ */
+void init();
+}
+
+#endif